@@ -0,0 +1,464 @@
+/**
+ * Benchmark del Sistema di Gestione Biblioteca
+ *
+ * Genera cataloghi sintetici di diverse dimensioni e misura i tempi delle
+ * operazioni principali di biblioteca.c: aggiunta (singola e in blocco),
+ * ricerca per ISBN, ricerca di sottostringhe per titolo e autore,
+ * ordinamento, salvataggio e caricamento.
+ *
+ * Autori e parole dei titoli vengono estratti con una distribuzione di Zipf,
+ * così che, come in un catalogo reale, pochi autori e poche parole siano
+ * molto frequenti e la maggior parte compaia raramente.
+ *
+ * Il risultato è in formato CSV su stdout (una riga per operazione e
+ * dimensione), adatto a essere confrontato tra versioni diverse del codice;
+ * i messaggi di avanzamento vanno su stderr.
+ *
+ * Concetti applicati:
+ * - Riutilizzo di un programma come libreria tramite #include e macro
+ * - Generatori di numeri pseudocasuali (xorshift) e distribuzione di Zipf
+ * - Misura dei tempi con un orologio monotono
+ */
+
+#define BIBLIOTECA_SENZA_MAIN
+#include "biblioteca.c"
+
+#include <math.h>
+
+#define MAX_DIMENSIONI 16
+#define DIMENSIONE_VOCABOLARIO 20000  // Parole distinte nei titoli
+#define MAX_RICERCHE_ISBN 1000000
+#define NUM_RICERCHE_TESTO 1000
+#define FILE_BENCHMARK "bench_biblioteca.dat"
+
+// Parametri del benchmark, impostabili da riga di comando
+typedef struct {
+    long dimensioni[MAX_DIMENSIONI];
+    int num_dimensioni;
+    double esponente_zipf;   // 0 = distribuzione uniforme
+    int num_autori;          // 0 = un autore ogni 20 libri
+    uint64_t seme;
+    int num_thread;          // Thread per l'ordinamento, 0 = tutti i processori
+    const char* file;
+} ParametriBenchmark;
+
+// Distribuzione di Zipf su n elementi: l'elemento k (da 0) ha probabilità
+// proporzionale a 1 / (k + 1)^s. L'estrazione è una ricerca binaria sulla
+// funzione di ripartizione.
+typedef struct {
+    double* ripartizione;
+    int n;
+} Zipf;
+
+// Catalogo sintetico da cui si attingono i libri
+typedef struct {
+    Libro* libri;
+    long num;
+    char (*parole)[16];
+    char (*autori)[MAX_AUTORE];
+    int num_autori;
+    Zipf zipf_parole;
+    Zipf zipf_autori;
+} CatalogoSintetico;
+
+// Funzioni per i numeri casuali
+static uint64_t casuale(uint64_t* stato);
+static double casuale_uniforme(uint64_t* stato);
+static int zipf_inizializza(Zipf* zipf, int n, double esponente);
+static int zipf_estrai(const Zipf* zipf, uint64_t* stato);
+static void zipf_libera(Zipf* zipf);
+
+// Funzioni per il catalogo sintetico
+static int genera_catalogo(CatalogoSintetico* catalogo, long num, const ParametriBenchmark* parametri);
+static void libera_catalogo(CatalogoSintetico* catalogo);
+
+// Funzioni di misura
+static double secondi();
+static void riporta(const char* operazione, long num_libri, long operazioni, double tempo);
+static int esegui_benchmark(long num, const ParametriBenchmark* parametri);
+
+// Generatore xorshift64*: veloce e riproducibile a parità di seme
+static uint64_t casuale(uint64_t* stato) {
+    uint64_t x = *stato;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *stato = x;
+    return x * 2685821657736338717ull;
+}
+
+// Numero casuale in [0, 1)
+static double casuale_uniforme(uint64_t* stato) {
+    return (double)(casuale(stato) >> 11) / 9007199254740992.0;
+}
+
+static int zipf_inizializza(Zipf* zipf, int n, double esponente) {
+    zipf->ripartizione = (double*)malloc(n * sizeof(double));
+    if (zipf->ripartizione == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per la distribuzione\n");
+        return 0;
+    }
+    zipf->n = n;
+
+    double somma = 0.0;
+    for (int k = 0; k < n; k++) {
+        somma += 1.0 / pow(k + 1, esponente);
+        zipf->ripartizione[k] = somma;
+    }
+    for (int k = 0; k < n; k++) {
+        zipf->ripartizione[k] /= somma;
+    }
+    return 1;
+}
+
+static int zipf_estrai(const Zipf* zipf, uint64_t* stato) {
+    double u = casuale_uniforme(stato);
+    int basso = 0, alto = zipf->n - 1;
+    while (basso < alto) {
+        int medio = basso + (alto - basso) / 2;
+        if (zipf->ripartizione[medio] < u) {
+            basso = medio + 1;
+        } else {
+            alto = medio;
+        }
+    }
+    return basso;
+}
+
+static void zipf_libera(Zipf* zipf) {
+    free(zipf->ripartizione);
+    zipf->ripartizione = NULL;
+}
+
+// Parola pronunciabile ottenuta alternando consonanti e vocali
+static void genera_parola(char* parola, size_t dimensione, uint64_t* stato) {
+    static const char consonanti[] = "bcdfglmnprstvz";
+    static const char vocali[] = "aeiou";
+    size_t lunghezza = 4 + casuale(stato) % 7;
+    if (lunghezza >= dimensione) {
+        lunghezza = dimensione - 1;
+    }
+    for (size_t i = 0; i < lunghezza; i++) {
+        parola[i] = i % 2 == 0 ? consonanti[casuale(stato) % (sizeof(consonanti) - 1)]
+                               : vocali[casuale(stato) % (sizeof(vocali) - 1)];
+    }
+    parola[0] = (char)(parola[0] - 'a' + 'A');
+    parola[lunghezza] = '\0';
+}
+
+static int genera_catalogo(CatalogoSintetico* catalogo, long num, const ParametriBenchmark* parametri) {
+    uint64_t stato = parametri->seme;
+    memset(catalogo, 0, sizeof(CatalogoSintetico));
+
+    catalogo->num_autori = parametri->num_autori > 0 ? parametri->num_autori : (int)(num / 20 + 1);
+    catalogo->libri = (Libro*)malloc(num * sizeof(Libro));
+    catalogo->parole = (char (*)[16])malloc(DIMENSIONE_VOCABOLARIO * sizeof(*catalogo->parole));
+    catalogo->autori = (char (*)[MAX_AUTORE])malloc(catalogo->num_autori * sizeof(*catalogo->autori));
+    if (catalogo->libri == NULL || catalogo->parole == NULL || catalogo->autori == NULL ||
+        !zipf_inizializza(&catalogo->zipf_parole, DIMENSIONE_VOCABOLARIO, parametri->esponente_zipf) ||
+        !zipf_inizializza(&catalogo->zipf_autori, catalogo->num_autori, parametri->esponente_zipf)) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il catalogo sintetico\n");
+        libera_catalogo(catalogo);
+        return 0;
+    }
+
+    for (int i = 0; i < DIMENSIONE_VOCABOLARIO; i++) {
+        genera_parola(catalogo->parole[i], sizeof(catalogo->parole[i]), &stato);
+    }
+    for (int i = 0; i < catalogo->num_autori; i++) {
+        char nome[16], cognome[16];
+        genera_parola(nome, sizeof(nome), &stato);
+        genera_parola(cognome, sizeof(cognome), &stato);
+        snprintf(catalogo->autori[i], MAX_AUTORE, "%s %s %d", nome, cognome, i);
+    }
+
+    for (long i = 0; i < num; i++) {
+        Libro* libro = &(catalogo->libri[i]);
+        memset(libro, 0, sizeof(Libro));
+
+        // Titolo di 2-6 parole
+        int num_parole = 2 + (int)(casuale(&stato) % 5);
+        size_t lunghezza = 0;
+        for (int p = 0; p < num_parole; p++) {
+            const char* parola = catalogo->parole[zipf_estrai(&catalogo->zipf_parole, &stato)];
+            int scritti = snprintf(libro->titolo + lunghezza, MAX_TITOLO - lunghezza,
+                                   p == 0 ? "%s" : " %s", parola);
+            if (scritti < 0 || lunghezza + (size_t)scritti >= MAX_TITOLO) {
+                break;
+            }
+            lunghezza += (size_t)scritti;
+        }
+
+        int autore = zipf_estrai(&catalogo->zipf_autori, &stato);
+        snprintf(libro->autore, MAX_AUTORE, "%s", catalogo->autori[autore]);
+
+        // ISBN distinti ma non consecutivi: il moltiplicatore è primo con
+        // 10^10, quindi i -> codice è una permutazione
+        uint64_t codice = ((uint64_t)i * 2654435761ull + 12345) % 10000000000ull;
+        snprintf(libro->isbn, MAX_ISBN, "978%010llu", (unsigned long long)codice);
+
+        libro->anno_pubblicazione = 1450 + (int)(casuale(&stato) % 575);
+        libro->disponibile = 1;
+    }
+    catalogo->num = num;
+    return 1;
+}
+
+static void libera_catalogo(CatalogoSintetico* catalogo) {
+    free(catalogo->libri);
+    free(catalogo->parole);
+    free(catalogo->autori);
+    zipf_libera(&catalogo->zipf_parole);
+    zipf_libera(&catalogo->zipf_autori);
+    memset(catalogo, 0, sizeof(CatalogoSintetico));
+}
+
+// Secondi da un istante fisso, con un orologio monotono
+static double secondi() {
+#ifdef _WIN32
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Riga CSV: operazione,num_libri,operazioni,secondi,ns_per_operazione,operazioni_al_secondo
+static void riporta(const char* operazione, long num_libri, long operazioni, double tempo) {
+    double ns = operazioni > 0 ? tempo * 1e9 / (double)operazioni : 0.0;
+    double al_secondo = tempo > 0 ? (double)operazioni / tempo : 0.0;
+    printf("%s,%ld,%ld,%.6f,%.1f,%.0f\n", operazione, num_libri, operazioni, tempo, ns, al_secondo);
+    fflush(stdout);
+}
+
+static int esegui_benchmark(long num, const ParametriBenchmark* parametri) {
+    CatalogoSintetico catalogo;
+    fprintf(stderr, "Generazione di un catalogo di %ld libri...\n", num);
+    if (!genera_catalogo(&catalogo, num, parametri)) {
+        return 0;
+    }
+
+    // Aggiunta un libro alla volta
+    Biblioteca* bib = inizializza_biblioteca();
+    if (bib == NULL) {
+        libera_catalogo(&catalogo);
+        return 0;
+    }
+    double inizio = secondi();
+    for (long i = 0; i < num; i++) {
+        const Libro* libro = &(catalogo.libri[i]);
+        aggiungi_libro(bib, libro->titolo, libro->autore, libro->isbn, libro->anno_pubblicazione);
+    }
+    riporta("aggiungi", num, num, secondi() - inizio);
+    libera_biblioteca(bib);
+
+    // Importazione in blocco (la biblioteca usata per il resto delle misure)
+    bib = inizializza_biblioteca();
+    if (bib == NULL) {
+        libera_catalogo(&catalogo);
+        return 0;
+    }
+    inizio = secondi();
+    int ok = importa_libri(bib, catalogo.libri, (int)num, NULL);
+    riporta("importa", num, num, secondi() - inizio);
+    if (!ok) {
+        libera_biblioteca(bib);
+        libera_catalogo(&catalogo);
+        return 0;
+    }
+
+    // Ricerca per ISBN: metà presenti, metà assenti
+    uint64_t stato = parametri->seme ^ 0x9e3779b97f4a7c15ull;
+    long ricerche = num < MAX_RICERCHE_ISBN ? num : MAX_RICERCHE_ISBN;
+    long trovati = 0;
+    inizio = secondi();
+    for (long i = 0; i < ricerche; i++) {
+        long j = (long)(casuale(&stato) % (uint64_t)num);
+        if (i % 2 == 0) {
+            trovati += cerca_libro_per_isbn(bib, catalogo.libri[j].isbn) != NULL;
+        } else {
+            char isbn[MAX_ISBN];
+            snprintf(isbn, sizeof(isbn), "979%010llu", (unsigned long long)j % 10000000000ull);
+            trovati += cerca_libro_per_isbn(bib, isbn) != NULL;
+        }
+    }
+    riporta("cerca_isbn", num, ricerche, secondi() - inizio);
+    if (trovati != (ricerche + 1) / 2) {
+        fprintf(stderr, "Attenzione: trovati %ld ISBN invece di %ld\n", trovati, (ricerche + 1) / 2);
+    }
+
+    // Ricerca di sottostringhe: parole e autori estratti con la stessa
+    // distribuzione del catalogo, quindi soprattutto quelli popolari. Le
+    // stesse query vengono eseguite prima con la cache disattivata, per
+    // misurare gli indici, poi con la cache attiva (righe *_cache), dove le
+    // query ripetute vengono trovate nella cache
+    long risultati_totali = 0;
+    uint64_t stato_ricerche = stato;
+    for (int con_cache = 0; con_cache <= 1; con_cache++) {
+        if (con_cache) {
+            configura_cache_ricerche(bib, CACHE_MAX_VOCI, CACHE_MAX_BYTE);
+        } else {
+            configura_cache_ricerche(bib, 0, 0);
+        }
+        stato = stato_ricerche;
+        
+        inizio = secondi();
+        for (int i = 0; i < NUM_RICERCHE_TESTO; i++) {
+            int num_trovati;
+            const char* parola = catalogo.parole[zipf_estrai(&catalogo.zipf_parole, &stato)];
+            free(cerca_libri_per_titolo(bib, parola, &num_trovati));
+            risultati_totali += num_trovati;
+        }
+        riporta(con_cache ? "cerca_titolo_cache" : "cerca_titolo", num, NUM_RICERCHE_TESTO,
+                secondi() - inizio);
+
+        inizio = secondi();
+        for (int i = 0; i < NUM_RICERCHE_TESTO; i++) {
+            int num_trovati;
+            const char* autore = catalogo.autori[zipf_estrai(&catalogo.zipf_autori, &stato)];
+            free(cerca_libri_per_autore(bib, autore, &num_trovati));
+            risultati_totali += num_trovati;
+        }
+        riporta(con_cache ? "cerca_autore_cache" : "cerca_autore", num, NUM_RICERCHE_TESTO,
+                secondi() - inizio);
+    }
+    fprintf(stderr, "Risultati delle ricerche di testo: %ld\n", risultati_totali);
+
+    // Costruzione degli indici ordinati (prima interrogazione dopo l'importazione)
+    static const char* nomi_indici[NUM_CHIAVI] = { "indice_titolo", "indice_autore", "indice_anno" };
+    for (int chiave = 0; chiave < NUM_CHIAVI; chiave++) {
+        int num_ordinati;
+        inizio = secondi();
+        vista_ordinata(bib, (ChiaveOrdinamento)chiave, &num_ordinati);
+        riporta(nomi_indici[chiave], num, num, secondi() - inizio);
+    }
+
+    // Ordinamento fisico dell'array (include la ricostruzione degli indici)
+    inizio = secondi();
+    ordina_fisicamente(bib, CHIAVE_TITOLO, parametri->num_thread);
+    riporta("ordina", num, num, secondi() - inizio);
+
+    // Salvataggio e caricamento
+    inizio = secondi();
+    ok = salva_biblioteca(bib, parametri->file);
+    riporta("salva", num, num, secondi() - inizio);
+    libera_biblioteca(bib);
+
+    if (ok) {
+        bib = inizializza_biblioteca();
+        if (bib != NULL) {
+            inizio = secondi();
+            ok = carica_biblioteca(bib, parametri->file);
+            riporta("carica", num, num, secondi() - inizio);
+            if (bib->num_libri != num) {
+                fprintf(stderr, "Attenzione: caricati %d libri invece di %ld\n", bib->num_libri, num);
+            }
+            libera_biblioteca(bib);
+        }
+        remove(parametri->file);
+    }
+
+    libera_catalogo(&catalogo);
+    return ok;
+}
+
+// Legge una dimensione, accettando i suffissi K e M (10K, 1M, 10M)
+static long leggi_dimensione(const char* testo) {
+    char* fine;
+    double valore = strtod(testo, &fine);
+    if (*fine == 'K' || *fine == 'k') {
+        valore *= 1e3;
+        fine++;
+    } else if (*fine == 'M' || *fine == 'm') {
+        valore *= 1e6;
+        fine++;
+    }
+    if (fine == testo || *fine != '\0' || valore < 1 || valore > INT32_MAX / 2) {
+        return -1;
+    }
+    return (long)valore;
+}
+
+static void stampa_uso(const char* programma) {
+    fprintf(stderr,
+            "Uso: %s [opzioni] [dimensioni...]\n"
+            "  dimensioni      numero di libri, anche con suffisso K o M (predefinite: 10K 1M 10M)\n"
+            "  --zipf S        esponente della distribuzione di Zipf (predefinito 1.0, 0 = uniforme)\n"
+            "  --autori N      numero di autori distinti (predefinito: uno ogni 20 libri)\n"
+            "  --seme N        seme del generatore casuale\n"
+            "  --thread N      thread per l'ordinamento (predefinito: tutti i processori)\n"
+            "  --file NOME     file temporaneo per salvataggio e caricamento\n",
+            programma);
+}
+
+int main(int argc, char* argv[]) {
+    ParametriBenchmark parametri;
+    memset(&parametri, 0, sizeof(parametri));
+    parametri.esponente_zipf = 1.0;
+    parametri.seme = 88172645463325252ull;
+    parametri.file = FILE_BENCHMARK;
+
+    for (int i = 1; i < argc; i++) {
+        int ha_valore = i + 1 < argc;
+        if (strcmp(argv[i], "--zipf") == 0 && ha_valore) {
+            parametri.esponente_zipf = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--autori") == 0 && ha_valore) {
+            parametri.num_autori = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seme") == 0 && ha_valore) {
+            parametri.seme = strtoull(argv[++i], NULL, 10) | 1;
+        } else if (strcmp(argv[i], "--thread") == 0 && ha_valore) {
+            parametri.num_thread = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--file") == 0 && ha_valore) {
+            parametri.file = argv[++i];
+        } else {
+            long dimensione = leggi_dimensione(argv[i]);
+            if (dimensione < 0 || parametri.num_dimensioni == MAX_DIMENSIONI) {
+                stampa_uso(argv[0]);
+                return EXIT_FAILURE;
+            }
+            parametri.dimensioni[parametri.num_dimensioni++] = dimensione;
+        }
+    }
+
+    if (parametri.num_dimensioni == 0) {
+        parametri.dimensioni[0] = 10000;
+        parametri.dimensioni[1] = 1000000;
+        parametri.dimensioni[2] = 10000000;
+        parametri.num_dimensioni = 3;
+    }
+
+    printf("operazione,num_libri,operazioni,secondi,ns_per_operazione,operazioni_al_secondo\n");
+    for (int i = 0; i < parametri.num_dimensioni; i++) {
+        if (!esegui_benchmark(parametri.dimensioni[i], &parametri)) {
+            fprintf(stderr, "Errore: benchmark con %ld libri non riuscito\n", parametri.dimensioni[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Compilazione ed esecuzione:
+ *
+ * Su sistemi Linux/Unix:
+ *   gcc -O2 -o bench_biblioteca bench_biblioteca.c -lpthread -lm
+ *   ./bench_biblioteca > risultati.csv
+ *   ./bench_biblioteca --zipf 1.2 10K 100K
+ *
+ * Su Windows con MinGW:
+ *   gcc -O2 -o bench_biblioteca bench_biblioteca.c -lpthread -lm
+ *   bench_biblioteca.exe > risultati.csv
+ *
+ * Note:
+ * - Il file include biblioteca.c definendo BIBLIOTECA_SENZA_MAIN, quindi
+ *   misura esattamente il codice del programma principale
+ * - Con 10M libri servono alcuni GB di memoria (circa 200 byte per libro per
+ *   l'array, più indici e catalogo sintetico)
+ * - A parità di seme il catalogo generato è sempre lo stesso, così i tempi
+ *   di due versioni del codice sono confrontabili
+ * - cerca_titolo e cerca_autore misurano le ricerche con la cache
+ *   disattivata; cerca_titolo_cache e cerca_autore_cache ripetono le stesse
+ *   query con la cache attiva
+ */
\ No newline at end of file
@@ -9,17 +9,68 @@
  * - Allocazione dinamica della memoria
  * - File I/O per persistenza dei dati
  * - Puntatori a funzione per ordinamento personalizzato
+ * - Tabella hash a indirizzamento aperto per la ricerca per ISBN
+ * - Indice invertito di trigrammi per la ricerca di sottostringhe
+ * - File binario versionato, con checksum, aperto tramite mmap
+ * - Journal delle operazioni (write-ahead log) con compattazione in background
+ * - Catalogo alternativo a colonne (structure of arrays) con autori internati
+ * - Indici secondari ordinati per titolo, autore e anno
+ * - Radix sort parallelo per ordinamenti in blocco
+ * - Letture concorrenti senza lock (seqlock e recupero della memoria per epoche)
+ * - Importazione in blocco da array o da file CSV/TSV
+ * - Storico dei prestiti compresso (differenze varint in blocchi append-only)
+ *   con statistiche su intervalli di tempo
+ * - Cache dei risultati delle ricerche (algoritmo dell'orologio, segmenti con
+ *   lock lettori/scrittori), invalidata da un contatore di generazione
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+
+#ifndef _WIN32
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
 
 #define MAX_TITOLO 100
 #define MAX_AUTORE 50
 #define MAX_ISBN 20
 #define FILENAME "biblioteca.dat"
+#define FILENAME_JOURNAL "biblioteca.log"
+#define CAPACITA_INDICE_INIZIALE 16  // Numero iniziale di slot (potenza di 2)
+#define LUNGHEZZA_TRIGRAMMA 3
+#define MIN_PENDENTI 1024  // Inserimenti accumulati prima di fondere un indice ordinato
+#define DIM_BUFFER_IMPORTAZIONE (1 << 20)  // Byte letti per volta dai file da importare
+#define LIBRI_PER_BLOCCO 4096              // Libri analizzati prima di inserirli in blocco
+#define DIM_DELTA_STORICO 40               // Byte di differenze per blocco dello storico dei prestiti
+#define CACHE_MAX_VOCI 256                 // Ricerche ricordate dalla cache dei risultati...
+#define CACHE_MAX_BYTE (4 << 20)           // ...e memoria che possono occupare
+#define CACHE_SEGMENTI 16                  // Segmenti della cache, ognuno con il proprio lock
+
+// Parametri dell'ordinamento parallelo
+#define MAX_THREAD_ORDINAMENTO 64
+#define SOGLIA_RADIX 64                    // Sotto questa dimensione si ordina per confronto
+#define SOGLIA_ORDINAMENTO_PARALLELO 65536 // Posizioni da fondere oltre cui usare il radix sort
+
+// Formato del file della biblioteca
+#define MAGIC_ARCHIVIO "BIBLIODB"
+#define VERSIONE_ARCHIVIO 1
+#define ALLINEAMENTO_SEZIONI 64
+
+// Parametri del journal
+#define JOURNAL_OPERAZIONI_PER_SYNC 64          // fsync al più ogni N operazioni...
+#define JOURNAL_ATTESA_MAX_SECONDI 1            // ...o quando la più vecchia attende da tanto
+#define JOURNAL_BUFFER_MAX (1 << 20)            // Byte massimi in attesa di scrittura
+#define JOURNAL_SOGLIA_COMPATTAZIONE (8 << 20)  // Dimensione oltre cui compattare
 
 // Struttura per rappresentare un libro
 typedef struct {
@@ -31,40 +82,454 @@ typedef struct {
     time_t data_prestito;  // Data dell'ultimo prestito
 } Libro;
 
+// Slot della tabella hash degli ISBN (indirizzamento aperto, scansione lineare)
+typedef struct {
+    uint32_t hash;  // Hash dell'ISBN, evita strcmp su slot che non corrispondono
+    int indice;     // Posizione del libro nell'array, -1 se lo slot è vuoto
+} SlotIsbn;
+
+// Lista dei libri che contengono un trigramma (posting list)
+typedef struct {
+    uint32_t trigramma;  // I 3 byte del trigramma, 0 se lo slot è vuoto
+    int* libri;          // Posizioni dei libri, in ordine crescente e senza duplicati
+    int num;
+    int capacita;
+} ListaTrigramma;
+
+// Indice invertito: tabella hash trigramma -> lista dei libri che lo contengono
+typedef struct {
+    ListaTrigramma* liste;
+    int num_liste;
+    int capacita;  // Numero di slot (potenza di 2)
+} IndiceTrigrammi;
+
+// Chiavi degli indici ordinati
+typedef enum {
+    CHIAVE_TITOLO,
+    CHIAVE_AUTORE,
+    CHIAVE_ANNO,
+    NUM_CHIAVI
+} ChiaveOrdinamento;
+
+#define NESSUNA_VISTA (-1)  // Elenco nell'ordine di inserimento
+
+// Indice secondario: posizioni dei libri ordinate per una chiave. I nuovi
+// libri vengono accumulati in 'pendenti' e fusi nella parte ordinata in
+// blocco, senza mai spostare i record.
+typedef struct {
+    int* ordinati;
+    int num_ordinati;
+    int capacita_ordinati;
+    int* pendenti;
+    int num_pendenti;
+    int capacita_pendenti;
+} IndiceOrdinato;
+
+// Elemento ordinato dal radix sort: prefisso della chiave e posizione del libro
+typedef struct {
+    uint64_t prefisso;
+    int32_t indice;
+} CoppiaOrdinamento;
+
+// Blocco dello storico dei prestiti di un libro. Il primo prestito è
+// memorizzato per intero, i successivi come differenza dal precedente
+// (varint zigzag). I blocchi di un libro formano una catena dal più
+// recente al più vecchio.
+typedef struct {
+    int64_t primo;             // Istante del primo prestito del blocco
+    int64_t ultimo;            // Istante dell'ultimo, base della prossima differenza
+    int64_t minimo;            // Intervallo coperto dai prestiti del blocco
+    int64_t massimo;
+    int64_t massimo_catena;    // Massimo di questo blocco e di tutti i precedenti
+    int32_t precedente;        // Blocco precedente dello stesso libro, -1 se nessuno
+    uint16_t num;              // Prestiti nel blocco
+    uint16_t usati;            // Byte di 'delta' occupati
+    uint8_t delta[DIM_DELTA_STORICO];
+} BloccoStorico;
+
+// Storico append-only dei prestiti: i blocchi di tutti i libri stanno in un
+// unico array e ogni libro conosce solo il proprio blocco più recente
+typedef struct {
+    BloccoStorico* blocchi;
+    int num_blocchi;
+    int capacita_blocchi;
+    int32_t* ultimo_blocco;    // Per posizione del libro, -1 se mai prestato
+    int capacita_libri;
+    int* attivi;               // Posizioni dei libri prestati almeno una volta
+    int num_attivi;
+    int capacita_attivi;
+    int64_t num_prestiti;
+} StoricoPrestiti;
+
+// Risultati delle interrogazioni sullo storico
+typedef struct {
+    int posizione;  // Posizione del libro
+    int prestiti;   // Prestiti nell'intervallo
+} ConteggioPrestiti;
+
+typedef struct {
+    int anno;            // Anno di pubblicazione
+    int libri;           // Libri pubblicati in quell'anno
+    int libri_prestati;  // Di questi, quanti prestati nell'intervallo
+    int prestiti;        // Prestiti nell'intervallo
+} UtilizzoAnno;
+
+// Voce della cache dei risultati delle ricerche per titolo e autore
+typedef struct {
+    char* query;               // NULL se la voce è libera
+    uint32_t hash;
+    ChiaveOrdinamento campo;   // CHIAVE_TITOLO o CHIAVE_AUTORE
+    unsigned generazione;      // Generazione del catalogo su cui è stata calcolata
+    int* risultati;
+    int num_risultati;
+    size_t byte;               // Memoria occupata da query e risultati
+    int catena;                // Voce successiva nel bucket (o tra le libere), -1 se ultima
+    int usata;                 // Consultata dall'ultimo passaggio della lancetta
+} VoceCache;
+
+// Segmento della cache: tabella hash a catene su un array di voci di
+// dimensione fissa. Quando è pieno esce una voce scelta con l'algoritmo
+// dell'orologio, un'approssimazione di LRU che non modifica strutture
+// condivise quando una voce viene ritrovata.
+typedef struct {
+    VoceCache* voci;
+    int max_voci;              // 0 = segmento non usato
+    size_t max_byte;
+    int* bucket;               // Prima voce di ogni bucket, -1 se vuoto
+    int num_bucket;            // Potenza di 2
+    int num_voci;
+    size_t byte_usati;
+    int lancetta;              // Prossima voce esaminata dall'orologio
+    int libere;                // Voci libere, collegate tramite 'catena'
+    uint64_t successi;         // Aggiornati con operazioni atomiche
+    uint64_t mancati;
+    pthread_rwlock_t lock;     // Usato solo in modalità concorrente
+} SegmentoCache;
+
+// Cache dei risultati: le query sono divise tra i segmenti in base all'hash
+typedef struct {
+    SegmentoCache segmenti[CACHE_SEGMENTI];
+    int num_segmenti;          // Segmenti usati (potenza di 2), 0 = cache disattivata
+} CacheRicerche;
+
+// Contatori della cache, vedi statistiche_cache_ricerche
+typedef struct {
+    uint64_t successi;
+    uint64_t mancati;
+    int voci;
+    size_t byte;
+} StatisticheCache;
+
+typedef struct Journal Journal;
+
 // Struttura per gestire la biblioteca
 typedef struct {
     Libro* libri;  // Array dinamico di libri
     int num_libri;  // Numero di libri attualmente presenti
     int capacita;   // Capacità totale dell'array
+    SlotIsbn* indice_isbn;  // Tabella hash ISBN -> posizione in libri
+    int capacita_indice;    // Numero di slot della tabella (potenza di 2)
+    IndiceTrigrammi indice_titoli;  // Trigrammi dei titoli
+    IndiceTrigrammi indice_autori;  // Trigrammi degli autori
+    IndiceOrdinato indici_ordinati[NUM_CHIAVI];
+    int vista;              // Chiave usata per elencare i libri, o NESSUNA_VISTA
+    uint64_t sequenza;      // Ultima operazione del journal inclusa nello stato
+    Journal* journal;       // Journal delle modifiche, NULL se non attivo
+    StoricoPrestiti storico;  // Prestiti registrati, per le statistiche
+    CacheRicerche cache;      // Risultati delle ultime ricerche per titolo e autore
+    unsigned generazione;     // Cambia a ogni modifica che può alterare quei risultati
+    
+    // Modalità concorrente (vedi abilita_concorrenza)
+    int concorrente;
+    pthread_mutex_t mutex_scrittura;  // Serializza le modifiche (ricorsivo)
+    atomic_uint versione;             // Seqlock: dispari mentre una modifica è in corso
+    int profondita_modifica;          // Modifiche annidate, la versione cambia solo all'esterno
+    atomic_uint epoca;                // Epoca corrente dei lettori
+    atomic_int lettori[2];            // Lettori attivi, per parità dell'epoca di ingresso
+    void** da_liberare;               // Blocchi sostituiti che un lettore può ancora usare
+    int num_da_liberare;
+    int capacita_da_liberare;
 } Biblioteca;
 
+// Accessi ai campi letti dai lettori concorrenti: chi modifica pubblica prima
+// il nuovo array e poi il contatore, chi legge carica prima il contatore e
+// poi l'array, così non vede mai un contatore più grande dell'array
+#define LEGGI(campo) __atomic_load_n(&(campo), __ATOMIC_ACQUIRE)
+#define PUBBLICA(campo, valore) __atomic_store_n(&(campo), (valore), __ATOMIC_RELEASE)
+
+// Tipi di operazione registrati nel journal
+enum {
+    OP_AGGIUNTA = 1,      // Payload: anno (int32), titolo, autore, ISBN
+    OP_PRESTITO = 2,      // Payload: data del prestito (int64), ISBN
+    OP_RESTITUZIONE = 3   // Payload: ISBN
+};
+
+// Intestazione di ogni record del journal, seguita da 'lunghezza' byte di payload.
+// crc è il CRC-32 dell'intestazione (con crc a zero) e del payload.
+typedef struct {
+    uint32_t lunghezza;
+    uint32_t crc;
+    uint64_t sequenza;
+    uint32_t tipo;
+    uint32_t riservato;
+} IntestazioneOperazione;
+
+// Journal append-only delle operazioni. Le operazioni vengono accumulate in
+// un buffer e rese durevoli a gruppi (un fsync per gruppo); un thread scrive
+// il gruppo in attesa anche quando non arrivano altre operazioni. All'avvio
+// quelle successive all'ultimo snapshot vengono riapplicate.
+struct Journal {
+    FILE* file;
+    char nome[FILENAME_MAX];
+    pthread_mutex_t mutex;     // Protegge buffer e file, usati anche dalla compattazione
+    char* buffer;              // Operazioni non ancora scritte su disco
+    size_t usati;
+    size_t capacita;
+    int in_attesa;             // Numero di operazioni nel buffer
+    time_t prima_attesa;       // Istante della prima operazione in attesa
+    uint64_t sequenza;         // Ultimo numero di sequenza assegnato
+    uint64_t dimensione;       // Byte già scritti nel file
+    
+    // Sincronizzazione periodica: rispetta JOURNAL_ATTESA_MAX_SECONDI anche
+    // se dopo l'ultima operazione non ne arrivano altre
+    pthread_t sincronizzatore;
+    pthread_cond_t attesa;     // Segnalata alla prima operazione in attesa e alla chiusura
+    int chiusura;
+    
+    // Stato della compattazione in background
+    pthread_t compattatore;
+    int compattazione_attiva;
+    atomic_int compattazione_terminata;
+    int esito_compattazione;
+    Biblioteca* copia;         // Copia dei record da salvare nello snapshot
+    uint64_t offset_snapshot;  // Fine, nel journal, delle operazioni incluse nella copia
+    char file_snapshot[FILENAME_MAX];
+};
+
+/*
+ * Formato del file (versione 1). Tutti i campi sono nell'ordine dei byte
+ * della macchina che ha scritto il file e ogni sezione è allineata a
+ * ALLINEAMENTO_SEZIONI byte:
+ *
+ *   [IntestazioneArchivio][RecordArchivio x num_libri][SlotIsbn x capacita_indice][stringhe]
+ *   [IntestazioneStorico][storico dei prestiti]   (facoltativa)
+ *
+ * Il blocco delle stringhe contiene, per ogni libro, titolo, autore e ISBN
+ * terminati da '\0'. checksum_dati è il CRC-32 di tutto ciò che segue
+ * l'intestazione fino alla fine delle stringhe; checksum_intestazione è il
+ * CRC-32 dell'intestazione con quel campo a zero. La sezione dello storico
+ * ha un proprio checksum; i file scritti prima della sua introduzione hanno
+ * off_storico (allora riservato) a zero e restano validi.
+ */
+typedef struct {
+    char magic[8];               // MAGIC_ARCHIVIO, senza terminatore
+    uint32_t versione;
+    uint32_t dim_intestazione;
+    uint64_t num_libri;
+    uint64_t capacita_indice;    // Numero di slot dell'indice ISBN
+    uint64_t off_record;         // Offset delle sezioni dall'inizio del file
+    uint64_t off_indice;
+    uint64_t off_stringhe;
+    uint64_t dim_stringhe;
+    uint64_t sequenza_journal;   // Ultima operazione del journal inclusa nel file
+    uint64_t off_storico;        // Sezione dello storico dei prestiti, 0 se assente
+    uint32_t checksum_dati;
+    uint32_t checksum_intestazione;
+} IntestazioneArchivio;
+
+// Intestazione della sezione dello storico, seguita da 'dimensione' byte:
+// per ogni libro prestato almeno una volta posizione, numero di prestiti e
+// istanti come differenze successive, tutti varint
+typedef struct {
+    uint64_t dimensione;
+    uint64_t num_libri;
+    uint64_t num_prestiti;
+    uint32_t checksum;           // CRC-32 dei dati della sezione
+    uint32_t riservato;
+} IntestazioneStorico;
+
+// Record a dimensione fissa di un libro nel file
+typedef struct {
+    int64_t data_prestito;
+    uint64_t off_stringhe;       // Offset di titolo, autore e ISBN nel blocco stringhe
+    int32_t anno_pubblicazione;
+    int32_t disponibile;
+} RecordArchivio;
+
+// Archivio aperto in sola lettura tramite mmap
+typedef struct {
+    void* mappa;
+    size_t dimensione;
+    const IntestazioneArchivio* intestazione;
+    const RecordArchivio* record;
+    const SlotIsbn* indice;
+    const char* stringhe;
+    const IntestazioneStorico* storico;  // NULL se il file non ha lo storico
+    int num_libri;
+} Archivio;
+
+// Arena di stringhe: un unico blocco che cresce, le stringhe sono riferite per offset
+typedef struct {
+    char* dati;
+    size_t usati;
+    size_t capacita;
+} ArenaStringhe;
+
+// Catalogo a colonne: ogni campo è un array separato, così filtri e
+// statistiche leggono solo i dati che servono invece di trascinare in
+// cache l'intero Libro (circa 200 byte) per ogni libro esaminato.
+// Titoli, autori e ISBN stanno nell'arena; ogni autore vi compare una
+// sola volta e i libri ne memorizzano solo l'identificativo.
+typedef struct {
+    int num_libri;
+    int capacita;
+    
+    // Colonne, indicizzate per posizione del libro
+    int32_t* anni;
+    uint64_t* disponibili;     // Un bit per libro, 1 = disponibile
+    int64_t* date_prestito;
+    uint64_t* chiavi_isbn;     // Hash a 64 bit dell'ISBN
+    uint64_t* off_isbn;        // Offset degli ISBN nell'arena
+    uint64_t* off_titoli;
+    uint32_t* id_autori;       // Identificativo dell'autore internato
+    
+    // Autori internati, indicizzati per identificativo
+    uint64_t* off_autori;
+    uint64_t* chiavi_autori;
+    int num_autori;
+    int capacita_autori;
+    
+    // Tabelle hash (posizione o identificativo, -1 = slot vuoto)
+    int32_t* tabella_isbn;
+    int capacita_tabella_isbn;
+    int32_t* tabella_autori;
+    int capacita_tabella_autori;
+    
+    ArenaStringhe arena;
+} BibliotecaColonnare;
+
 // Funzioni di inizializzazione e pulizia
 Biblioteca* inizializza_biblioteca();
 void libera_biblioteca(Biblioteca* bib);
 
+// Funzioni per l'accesso concorrente
+int abilita_concorrenza(Biblioteca* bib);
+int leggi_libro_per_isbn(Biblioteca* bib, const char* isbn, Libro* copia);
+
+// Funzioni per gli indici
+int ricostruisci_indice_isbn(Biblioteca* bib);
+int ricostruisci_indici_testo(Biblioteca* bib);
+int ricostruisci_indici_ordinati(Biblioteca* bib);
+int ricostruisci_indici(Biblioteca* bib);
+
 // Funzioni di gestione dei libri
 int aggiungi_libro(Biblioteca* bib, const char* titolo, const char* autore, 
                   const char* isbn, int anno);
 Libro* cerca_libro_per_isbn(Biblioteca* bib, const char* isbn);
-Libro* cerca_libri_per_autore(Biblioteca* bib, const char* autore, int* num_trovati);
-Libro* cerca_libri_per_titolo(Biblioteca* bib, const char* titolo, int* num_trovati);
+// Le ricerche per autore e titolo restituiscono le posizioni dei libri trovati
+// (array da liberare con free), non copie dei libri
+int* cerca_libri_per_autore(Biblioteca* bib, const char* autore, int* num_trovati);
+int* cerca_libri_per_titolo(Biblioteca* bib, const char* titolo, int* num_trovati);
+int* cerca_libri_per_anno(Biblioteca* bib, int anno_da, int anno_a, int* num_trovati);
+
+// Funzioni per la cache delle ricerche per titolo e autore
+int configura_cache_ricerche(Biblioteca* bib, int max_voci, size_t max_byte);
+void statistiche_cache_ricerche(Biblioteca* bib, StatisticheCache* statistiche);
+
+// Funzioni per l'importazione in blocco
+int importa_libri(Biblioteca* bib, const Libro* libri, int num, int* num_importati);
+int importa_libri_da_file(Biblioteca* bib, FILE* file, char separatore, int* num_importati);
 
 // Funzioni per prestito e restituzione
 int presta_libro(Biblioteca* bib, const char* isbn);
 int restituisci_libro(Biblioteca* bib, const char* isbn);
 
+// Funzioni per lo storico dei prestiti (intervalli di tempo inclusi)
+int conta_prestiti(Biblioteca* bib, const char* isbn, time_t da, time_t a);
+int libri_piu_prestati(Biblioteca* bib, time_t da, time_t a, int k, ConteggioPrestiti* risultati);
+UtilizzoAnno* utilizzo_per_anno(Biblioteca* bib, time_t da, time_t a, int* num_anni);
+
 // Funzioni per ordinamento
 void ordina_per_titolo(Biblioteca* bib);
 void ordina_per_autore(Biblioteca* bib);
 void ordina_per_anno(Biblioteca* bib);
+const int* vista_ordinata(Biblioteca* bib, ChiaveOrdinamento chiave, int* num);
+int ordina_posizioni_parallelo(Biblioteca* bib, ChiaveOrdinamento chiave,
+                               int* posizioni, int num, int num_thread);
+int ordina_fisicamente(Biblioteca* bib, ChiaveOrdinamento chiave, int num_thread);
+int numero_processori();
 
 // Funzioni per la persistenza dei dati
 int salva_biblioteca(const Biblioteca* bib, const char* filename);
 int carica_biblioteca(Biblioteca* bib, const char* filename);
 
+// Funzioni per il journal delle operazioni
+int riapplica_journal(Biblioteca* bib, const char* nome);
+int apri_journal(Biblioteca* bib, const char* nome);
+int journal_sincronizza(Journal* journal);
+int journal_da_compattare(Biblioteca* bib);
+int avvia_compattazione(Biblioteca* bib, const char* file_snapshot);
+int attendi_compattazione(Biblioteca* bib);
+void chiudi_journal(Biblioteca* bib);
+
+// Funzioni per l'accesso diretto al file mappato in memoria
+int apri_archivio(Archivio* arch, const char* filename);
+void chiudi_archivio(Archivio* arch);
+int verifica_archivio(const Archivio* arch);
+int archivio_leggi_libro(const Archivio* arch, int i, Libro* libro);
+int archivio_cerca_per_isbn(const Archivio* arch, const char* isbn);
+
+// Funzioni per il catalogo a colonne
+BibliotecaColonnare* crea_biblioteca_colonnare();
+BibliotecaColonnare* converti_in_colonnare(const Biblioteca* bib);
+void libera_biblioteca_colonnare(BibliotecaColonnare* col);
+int colonnare_riserva(BibliotecaColonnare* col, int capacita);
+int colonnare_aggiungi(BibliotecaColonnare* col, const char* titolo, const char* autore,
+                       const char* isbn, int anno);
+int colonnare_cerca_isbn(const BibliotecaColonnare* col, const char* isbn);
+const char* colonnare_titolo(const BibliotecaColonnare* col, int i);
+const char* colonnare_autore(const BibliotecaColonnare* col, int i);
+const char* colonnare_isbn(const BibliotecaColonnare* col, int i);
+int colonnare_disponibile(const BibliotecaColonnare* col, int i);
+int colonnare_presta(BibliotecaColonnare* col, const char* isbn, time_t data);
+int colonnare_restituisci(BibliotecaColonnare* col, const char* isbn);
+int colonnare_conta_disponibili(const BibliotecaColonnare* col);
+int* colonnare_filtra_per_anno(const BibliotecaColonnare* col, int anno_da, int anno_a, int* num_trovati);
+void colonnare_statistiche_anni(const BibliotecaColonnare* col, int* anno_min, int* anno_max,
+                                double* anno_medio);
+int colonnare_conta_per_autore(const BibliotecaColonnare* col, const char* autore);
+
 // Funzioni di utilità
 void stampa_libro(const Libro* libro);
-void stampa_biblioteca(const Biblioteca* bib);
+void stampa_biblioteca(Biblioteca* bib);
+
+// Funzioni interne
+static void scrittura_inizia(Biblioteca* bib);
+static void scrittura_termina(Biblioteca* bib);
+static void modifica_inizia(Biblioteca* bib);
+static void modifica_termina(Biblioteca* bib);
+static void esclusiva_inizia(Biblioteca* bib);
+static void esclusiva_termina(Biblioteca* bib);
+static unsigned lettura_inizia(Biblioteca* bib, unsigned* epoca);
+static int lettura_termina(Biblioteca* bib, unsigned epoca, unsigned versione);
+static void* rialloca_condiviso(Biblioteca* bib, void* vecchio, size_t usati, size_t dimensione);
+static void libera_condiviso(Biblioteca* bib, void* blocco);
+static int inserisci_libro(Biblioteca* bib, const char* titolo, const char* autore,
+                           const char* isbn, int anno);
+static int riordina_libri(Biblioteca* bib, ChiaveOrdinamento chiave, int num_thread);
+static void trigrammi_libera(IndiceTrigrammi* indice);
+static int indici_ordinati_aggiungi(Biblioteca* bib, int pos);
+static void indici_ordinati_libera(Biblioteca* bib);
+static int esegui_prestito(Biblioteca* bib, const char* isbn, time_t data);
+static int storico_registra(StoricoPrestiti* storico, int pos, int64_t istante);
+static void storico_libera(StoricoPrestiti* storico);
+static void catalogo_modificato(Biblioteca* bib);
+static void cache_libera(CacheRicerche* cache);
+static int journal_scrivi_buffer(Journal* journal);
+static int journal_registra_aggiunta(Journal* journal, const Libro* libro);
+static int journal_registra_prestito(Journal* journal, const Libro* libro);
+static int journal_registra_restituzione(Journal* journal, const Libro* libro);
+static uint32_t aggiorna_crc32(uint32_t crc, const void* dati, size_t lunghezza);
 
 // Implementazione delle funzioni
 
@@ -85,246 +550,3995 @@ Biblioteca* inizializza_biblioteca() {
         return NULL;
     }
     
-    return bib;
+    bib->indice_isbn = NULL;
+    bib->capacita_indice = 0;
+    bib->sequenza = 0;
+    bib->journal = NULL;
+    memset(&bib->indice_titoli, 0, sizeof(IndiceTrigrammi));
+    memset(&bib->indice_autori, 0, sizeof(IndiceTrigrammi));
+    memset(bib->indici_ordinati, 0, sizeof(bib->indici_ordinati));
+    memset(&bib->storico, 0, sizeof(StoricoPrestiti));
+    memset(&bib->cache, 0, sizeof(CacheRicerche));
+    bib->generazione = 0;
+    bib->vista = NESSUNA_VISTA;
+    bib->concorrente = 0;
+    bib->profondita_modifica = 0;
+    bib->da_liberare = NULL;
+    bib->num_da_liberare = 0;
+    bib->capacita_da_liberare = 0;
+    if (!configura_cache_ricerche(bib, CACHE_MAX_VOCI, CACHE_MAX_BYTE) ||
+        !ricostruisci_indici(bib)) {
+        libera_biblioteca(bib);
+        return NULL;
+    }
+    
+    return bib;
+}
+
+void libera_biblioteca(Biblioteca* bib) {
+    if (bib != NULL) {
+        chiudi_journal(bib);
+        if (bib->libri != NULL) {
+            free(bib->libri);
+        }
+        free(bib->indice_isbn);
+        trigrammi_libera(&bib->indice_titoli);
+        trigrammi_libera(&bib->indice_autori);
+        indici_ordinati_libera(bib);
+        storico_libera(&bib->storico);
+        cache_libera(&bib->cache);
+        for (int i = 0; i < bib->num_da_liberare; i++) {
+            free(bib->da_liberare[i]);
+        }
+        free(bib->da_liberare);
+        if (bib->concorrente) {
+            pthread_mutex_destroy(&bib->mutex_scrittura);
+            for (int i = 0; i < CACHE_SEGMENTI; i++) {
+                pthread_rwlock_destroy(&bib->cache.segmenti[i].lock);
+            }
+        }
+        free(bib);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Accesso concorrente
+// ---------------------------------------------------------------------------
+//
+// In modalità concorrente le ricerche non prendono lock. Le modifiche sono
+// serializzate da mutex_scrittura e, quando toccano strutture che i lettori
+// stanno scorrendo, incrementano 'versione' prima e dopo (seqlock): un lettore
+// che trova la versione cambiata ripete la ricerca. Gli array che crescono non
+// vengono riallocati sul posto ma copiati; il vecchio blocco resta valido
+// finché tutti i lettori entrati prima della sostituzione sono usciti
+// (recupero per epoche). Le operazioni che riorganizzano tutto (ricostruzione
+// degli indici, ordinamento fisico) attendono invece che i lettori escano.
+
+// Attiva la modalità concorrente; va chiamata prima di avviare i thread.
+// Caricamento e riapplicazione del journal vanno fatti prima dell'attivazione.
+int abilita_concorrenza(Biblioteca* bib) {
+    pthread_mutexattr_t attributi;
+    if (pthread_mutexattr_init(&attributi) != 0 ||
+        pthread_mutexattr_settype(&attributi, PTHREAD_MUTEX_RECURSIVE) != 0 ||
+        pthread_mutex_init(&bib->mutex_scrittura, &attributi) != 0) {
+        fprintf(stderr, "Errore: impossibile inizializzare il mutex della biblioteca\n");
+        return 0;
+    }
+    for (int i = 0; i < CACHE_SEGMENTI; i++) {
+        if (pthread_rwlock_init(&bib->cache.segmenti[i].lock, NULL) != 0) {
+            fprintf(stderr, "Errore: impossibile inizializzare i lock della cache\n");
+            while (--i >= 0) {
+                pthread_rwlock_destroy(&bib->cache.segmenti[i].lock);
+            }
+            pthread_mutex_destroy(&bib->mutex_scrittura);
+            return 0;
+        }
+    }
+    pthread_mutexattr_destroy(&attributi);
+    
+    atomic_init(&bib->versione, 0);
+    atomic_init(&bib->epoca, 0);
+    atomic_init(&bib->lettori[0], 0);
+    atomic_init(&bib->lettori[1], 0);
+    bib->concorrente = 1;
+    return 1;
+}
+
+static void scrittura_inizia(Biblioteca* bib) {
+    if (bib->concorrente) {
+        pthread_mutex_lock(&bib->mutex_scrittura);
+    }
+}
+
+// Attende che escano i lettori entrati prima di questo momento
+static void attendi_lettori(Biblioteca* bib) {
+    unsigned epoca = atomic_fetch_add(&bib->epoca, 1);
+    while (atomic_load(&bib->lettori[epoca & 1]) != 0) {
+        sched_yield();
+    }
+}
+
+static void libera_ritirati(Biblioteca* bib) {
+    if (bib->num_da_liberare == 0) {
+        return;
+    }
+    attendi_lettori(bib);
+    for (int i = 0; i < bib->num_da_liberare; i++) {
+        free(bib->da_liberare[i]);
+    }
+    bib->num_da_liberare = 0;
+}
+
+static void scrittura_termina(Biblioteca* bib) {
+    if (bib->concorrente) {
+        libera_ritirati(bib);
+        pthread_mutex_unlock(&bib->mutex_scrittura);
+    }
+}
+
+// Racchiudono una modifica visibile ai lettori: la versione è dispari
+// finché la modifica più esterna non termina
+static void modifica_inizia(Biblioteca* bib) {
+    if (bib->concorrente && bib->profondita_modifica++ == 0) {
+        atomic_fetch_add(&bib->versione, 1);
+    }
+}
+
+static void modifica_termina(Biblioteca* bib) {
+    if (bib->concorrente && --bib->profondita_modifica == 0) {
+        atomic_fetch_add(&bib->versione, 1);
+    }
+}
+
+// Modifica con i lettori esclusi: i nuovi lettori attendono la versione
+// pari, quelli già entrati vengono attesi
+static void esclusiva_inizia(Biblioteca* bib) {
+    scrittura_inizia(bib);
+    modifica_inizia(bib);
+    if (bib->concorrente) {
+        attendi_lettori(bib);
+    }
+}
+
+static void esclusiva_termina(Biblioteca* bib) {
+    modifica_termina(bib);
+    scrittura_termina(bib);
+}
+
+// Entra in una sezione di lettura e restituisce la versione osservata.
+// Il lettore si registra nell'epoca corrente e ricontrolla l'epoca, così
+// chi attende i lettori di quell'epoca non può non vederlo.
+static unsigned lettura_inizia(Biblioteca* bib, unsigned* epoca) {
+    if (!bib->concorrente) {
+        return 0;
+    }
+    for (;;) {
+        unsigned e = atomic_load(&bib->epoca);
+        atomic_fetch_add(&bib->lettori[e & 1], 1);
+        unsigned versione = atomic_load(&bib->versione);
+        if (atomic_load(&bib->epoca) == e && (versione & 1) == 0) {
+            *epoca = e;
+            return versione;
+        }
+        atomic_fetch_sub(&bib->lettori[e & 1], 1);
+        if (versione & 1) {
+            sched_yield();  // Modifica in corso
+        }
+    }
+}
+
+// Esce dalla sezione di lettura; restituisce 0 se nel frattempo c'è stata
+// una modifica e quanto letto va scartato
+static int lettura_termina(Biblioteca* bib, unsigned epoca, unsigned versione) {
+    if (!bib->concorrente) {
+        return 1;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    int valida = atomic_load(&bib->versione) == versione;
+    atomic_fetch_sub(&bib->lettori[epoca & 1], 1);
+    return valida;
+}
+
+// Libera un blocco che i lettori potrebbero ancora usare: in modalità
+// concorrente viene solo messo da parte e liberato alla fine della modifica
+static void libera_condiviso(Biblioteca* bib, void* blocco) {
+    if (!bib->concorrente || blocco == NULL) {
+        free(blocco);
+        return;
+    }
+    
+    if (bib->num_da_liberare >= bib->capacita_da_liberare) {
+        int nuova_capacita = bib->capacita_da_liberare ? bib->capacita_da_liberare * 2 : 16;
+        void** temp = (void**)realloc(bib->da_liberare, nuova_capacita * sizeof(void*));
+        if (temp == NULL) {
+            // Nessuno spazio per rimandare: si attendono subito i lettori
+            attendi_lettori(bib);
+            free(blocco);
+            return;
+        }
+        bib->da_liberare = temp;
+        bib->capacita_da_liberare = nuova_capacita;
+    }
+    bib->da_liberare[bib->num_da_liberare++] = blocco;
+}
+
+// Come realloc, ma in modalità concorrente il vecchio blocco (di cui sono
+// significativi i primi 'usati' byte) resta leggibile fino alla fine della modifica
+static void* rialloca_condiviso(Biblioteca* bib, void* vecchio, size_t usati, size_t dimensione) {
+    if (!bib->concorrente) {
+        return realloc(vecchio, dimensione);
+    }
+    
+    void* nuovo = malloc(dimensione);
+    if (nuovo == NULL) {
+        return NULL;
+    }
+    if (usati > 0) {
+        memcpy(nuovo, vecchio, usati);
+    }
+    libera_condiviso(bib, vecchio);
+    return nuovo;
+}
+
+// Cerca un libro per ISBN e ne copia il record; utilizzabile da più thread
+// insieme alle modifiche, a differenza di cerca_libro_per_isbn il cui
+// risultato può essere spostato da un'aggiunta
+int leggi_libro_per_isbn(Biblioteca* bib, const char* isbn, Libro* copia) {
+    int trovato;
+    unsigned epoca = 0, versione;
+    do {
+        versione = lettura_inizia(bib, &epoca);
+        const Libro* libro = cerca_libro_per_isbn(bib, isbn);
+        trovato = libro != NULL;
+        if (trovato) {
+            memcpy(copia, libro, sizeof(Libro));
+        }
+    } while (!lettura_termina(bib, epoca, versione));
+    return trovato;
+}
+
+// Hash FNV-1a a 32 bit della stringa ISBN
+static uint32_t hash_isbn(const char* isbn) {
+    uint32_t hash = 2166136261u;
+    while (*isbn != '\0') {
+        hash ^= (unsigned char)*isbn++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Inserisce la posizione di un libro nella tabella (deve esserci spazio libero)
+static void indice_isbn_inserisci(SlotIsbn* slot, int capacita, uint32_t hash, int indice) {
+    int maschera = capacita - 1;
+    int i = (int)(hash & (uint32_t)maschera);
+    
+    while (slot[i].indice != -1) {
+        i = (i + 1) & maschera;
+    }
+    
+    slot[i].hash = hash;
+    PUBBLICA(slot[i].indice, indice);
+}
+
+// Ridimensiona la tabella e reinserisce tutti i libri presenti
+static int indice_isbn_ridimensiona(Biblioteca* bib, int nuova_capacita) {
+    SlotIsbn* nuovi_slot = (SlotIsbn*)malloc(nuova_capacita * sizeof(SlotIsbn));
+    if (nuovi_slot == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per l'indice ISBN\n");
+        return 0;
+    }
+    
+    for (int i = 0; i < nuova_capacita; i++) {
+        nuovi_slot[i].indice = -1;
+    }
+    
+    for (int i = 0; i < bib->num_libri; i++) {
+        indice_isbn_inserisci(nuovi_slot, nuova_capacita, hash_isbn(bib->libri[i].isbn), i);
+    }
+    
+    SlotIsbn* vecchi_slot = bib->indice_isbn;
+    modifica_inizia(bib);
+    PUBBLICA(bib->indice_isbn, nuovi_slot);
+    PUBBLICA(bib->capacita_indice, nuova_capacita);
+    modifica_termina(bib);
+    libera_condiviso(bib, vecchi_slot);
+    return 1;
+}
+
+// Ricostruisce l'indice da zero; va chiamata quando le posizioni dei libri
+// cambiano (ordinamento, caricamento da file). Il fattore di carico resta
+// sotto il 50% così che le sequenze di scansione rimangano corte.
+int ricostruisci_indice_isbn(Biblioteca* bib) {
+    int capacita = CAPACITA_INDICE_INIZIALE;
+    while (capacita < 2 * bib->num_libri) {
+        capacita *= 2;
+    }
+    esclusiva_inizia(bib);
+    int ok = indice_isbn_ridimensiona(bib, capacita);
+    esclusiva_termina(bib);
+    return ok;
+}
+
+// Impacchetta i primi 3 byte di una stringa; non è mai 0 perché i byte
+// di una stringa C prima del terminatore sono tutti diversi da zero
+static uint32_t trigramma(const char* s) {
+    return ((uint32_t)(unsigned char)s[0] << 16) |
+           ((uint32_t)(unsigned char)s[1] << 8) |
+           (uint32_t)(unsigned char)s[2];
+}
+
+static int trigrammi_slot(uint32_t trigramma, int capacita) {
+    uint32_t hash = trigramma * 2654435761u;  // Hash moltiplicativo di Knuth
+    return (int)((hash ^ (hash >> 16)) & (uint32_t)(capacita - 1));
+}
+
+static void trigrammi_libera(IndiceTrigrammi* indice) {
+    for (int i = 0; i < indice->capacita; i++) {
+        free(indice->liste[i].libri);
+    }
+    free(indice->liste);
+    memset(indice, 0, sizeof(IndiceTrigrammi));
+}
+
+// Restituisce la lista del trigramma, oppure NULL se nessun libro lo contiene
+static ListaTrigramma* trigrammi_trova(const IndiceTrigrammi* indice, uint32_t t) {
+    int capacita = LEGGI(indice->capacita);
+    ListaTrigramma* liste = LEGGI(indice->liste);
+    if (capacita == 0) {
+        return NULL;
+    }
+    
+    int maschera = capacita - 1;
+    uint32_t presente;
+    for (int i = trigrammi_slot(t, capacita); (presente = LEGGI(liste[i].trigramma)) != 0;
+         i = (i + 1) & maschera) {
+        if (presente == t) {
+            return &(liste[i]);
+        }
+    }
+    return NULL;
+}
+
+static int trigrammi_ridimensiona(Biblioteca* bib, IndiceTrigrammi* indice, int nuova_capacita) {
+    ListaTrigramma* nuove = (ListaTrigramma*)calloc(nuova_capacita, sizeof(ListaTrigramma));
+    if (nuove == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per l'indice dei trigrammi\n");
+        return 0;
+    }
+    
+    // Le liste vengono spostate, non copiate
+    for (int i = 0; i < indice->capacita; i++) {
+        if (indice->liste[i].trigramma != 0) {
+            int j = trigrammi_slot(indice->liste[i].trigramma, nuova_capacita);
+            while (nuove[j].trigramma != 0) {
+                j = (j + 1) & (nuova_capacita - 1);
+            }
+            nuove[j] = indice->liste[i];
+        }
+    }
+    
+    ListaTrigramma* vecchie = indice->liste;
+    modifica_inizia(bib);
+    PUBBLICA(indice->liste, nuove);
+    PUBBLICA(indice->capacita, nuova_capacita);
+    modifica_termina(bib);
+    libera_condiviso(bib, vecchie);
+    return 1;
+}
+
+static ListaTrigramma* trigrammi_trova_o_crea(Biblioteca* bib, IndiceTrigrammi* indice, uint32_t t) {
+    ListaTrigramma* lista = trigrammi_trova(indice, t);
+    if (lista != NULL) {
+        return lista;
+    }
+    
+    if (2 * (indice->num_liste + 1) > indice->capacita) {
+        int nuova_capacita = indice->capacita ? indice->capacita * 2 : CAPACITA_INDICE_INIZIALE;
+        if (!trigrammi_ridimensiona(bib, indice, nuova_capacita)) {
+            return NULL;
+        }
+    }
+    
+    int i = trigrammi_slot(t, indice->capacita);
+    while (indice->liste[i].trigramma != 0) {
+        i = (i + 1) & (indice->capacita - 1);
+    }
+    PUBBLICA(indice->liste[i].trigramma, t);
+    indice->num_liste++;
+    return &(indice->liste[i]);
+}
+
+// Registra tutti i trigrammi di un testo per il libro in posizione pos.
+// I libri vengono aggiunti in ordine di posizione, quindi un trigramma ripetuto
+// nello stesso testo si riconosce confrontando con l'ultimo elemento della lista.
+static int trigrammi_aggiungi_testo(Biblioteca* bib, IndiceTrigrammi* indice, const char* testo, int pos) {
+    size_t lunghezza = strlen(testo);
+    
+    for (size_t k = 0; k + LUNGHEZZA_TRIGRAMMA <= lunghezza; k++) {
+        ListaTrigramma* lista = trigrammi_trova_o_crea(bib, indice, trigramma(testo + k));
+        if (lista == NULL) {
+            return 0;
+        }
+        if (lista->num > 0 && lista->libri[lista->num - 1] == pos) {
+            continue;
+        }
+        if (lista->num >= lista->capacita) {
+            int nuova_capacita = lista->capacita ? lista->capacita * 2 : 4;
+            int* temp = (int*)rialloca_condiviso(bib, lista->libri, lista->num * sizeof(int),
+                                                 nuova_capacita * sizeof(int));
+            if (temp == NULL) {
+                fprintf(stderr, "Errore: impossibile espandere l'indice dei trigrammi\n");
+                return 0;
+            }
+            PUBBLICA(lista->libri, temp);
+            lista->capacita = nuova_capacita;
+        }
+        lista->libri[lista->num] = pos;
+        PUBBLICA(lista->num, lista->num + 1);
+    }
+    return 1;
+}
+
+int ricostruisci_indici_testo(Biblioteca* bib) {
+    esclusiva_inizia(bib);
+    trigrammi_libera(&bib->indice_titoli);
+    trigrammi_libera(&bib->indice_autori);
+    
+    int ok = 1;
+    for (int i = 0; ok && i < bib->num_libri; i++) {
+        ok = trigrammi_aggiungi_testo(bib, &bib->indice_titoli, bib->libri[i].titolo, i) &&
+             trigrammi_aggiungi_testo(bib, &bib->indice_autori, bib->libri[i].autore, i);
+    }
+    esclusiva_termina(bib);
+    return ok;
+}
+
+// Ricostruisce tutti gli indici; da chiamare quando le posizioni dei libri cambiano
+int ricostruisci_indici(Biblioteca* bib) {
+    esclusiva_inizia(bib);
+    int ok = ricostruisci_indice_isbn(bib) && ricostruisci_indici_testo(bib) &&
+             ricostruisci_indici_ordinati(bib);
+    catalogo_modificato(bib);
+    esclusiva_termina(bib);
+    return ok;
+}
+
+int aggiungi_libro(Biblioteca* bib, const char* titolo, const char* autore, 
+                  const char* isbn, int anno) {
+    scrittura_inizia(bib);
+    int ok = inserisci_libro(bib, titolo, autore, isbn, anno);
+    scrittura_termina(bib);
+    return ok;
+}
+
+static int inserisci_libro(Biblioteca* bib, const char* titolo, const char* autore,
+                           const char* isbn, int anno) {
+    // Verifica se il libro esiste già
+    if (cerca_libro_per_isbn(bib, isbn) != NULL) {
+        fprintf(stderr, "Errore: libro con ISBN %s già presente\n", isbn);
+        return 0;
+    }
+    
+    // Mantieni il fattore di carico dell'indice sotto il 50%
+    if (2 * (bib->num_libri + 1) > bib->capacita_indice) {
+        if (!indice_isbn_ridimensiona(bib, bib->capacita_indice * 2)) {
+            return 0;
+        }
+    }
+    
+    // Verifica se è necessario espandere l'array
+    if (bib->num_libri >= bib->capacita) {
+        // Raddoppia la capacità; i lettori concorrenti possono continuare
+        // a usare il vecchio array finché non escono
+        Libro* temp = (Libro*)rialloca_condiviso(bib, bib->libri, bib->num_libri * sizeof(Libro),
+                                                 2 * bib->capacita * sizeof(Libro));
+        
+        if (temp == NULL) {
+            fprintf(stderr, "Errore: impossibile espandere la memoria per i libri\n");
+            return 0;
+        }
+        
+        PUBBLICA(bib->libri, temp);
+        bib->capacita *= 2;
+    }
+    
+    // Aggiungi il nuovo libro
+    Libro* nuovo_libro = &(bib->libri[bib->num_libri]);
+    strncpy(nuovo_libro->titolo, titolo, MAX_TITOLO - 1);
+    nuovo_libro->titolo[MAX_TITOLO - 1] = '\0';  // Assicura terminazione
+    
+    strncpy(nuovo_libro->autore, autore, MAX_AUTORE - 1);
+    nuovo_libro->autore[MAX_AUTORE - 1] = '\0';
+    
+    strncpy(nuovo_libro->isbn, isbn, MAX_ISBN - 1);
+    nuovo_libro->isbn[MAX_ISBN - 1] = '\0';
+    
+    nuovo_libro->anno_pubblicazione = anno;
+    nuovo_libro->disponibile = 1;  // Inizialmente disponibile
+    nuovo_libro->data_prestito = 0;
+    
+    // Registra il libro negli indici usando i valori effettivamente memorizzati
+    indice_isbn_inserisci(bib->indice_isbn, bib->capacita_indice,
+                          hash_isbn(nuovo_libro->isbn), bib->num_libri);
+    if (!trigrammi_aggiungi_testo(bib, &bib->indice_titoli, nuovo_libro->titolo, bib->num_libri) ||
+        !trigrammi_aggiungi_testo(bib, &bib->indice_autori, nuovo_libro->autore, bib->num_libri) ||
+        !indici_ordinati_aggiungi(bib, bib->num_libri)) {
+        // Senza memoria per l'indice il libro non sarebbe trovabile: annulla
+        // l'aggiunta ricostruendo gli indici senza le voci parziali
+        ricostruisci_indici(bib);
+        return 0;
+    }
+    
+    PUBBLICA(bib->num_libri, bib->num_libri + 1);
+    catalogo_modificato(bib);
+    
+    // Il libro resta nel catalogo: il prossimo salvataggio lo rende durevole
+    if (bib->journal != NULL && !journal_registra_aggiunta(bib->journal, nuovo_libro)) {
+        fprintf(stderr, "Errore: aggiunta del libro con ISBN %s non registrata nel journal\n",
+                nuovo_libro->isbn);
+        return 0;
+    }
+    return 1;
+}
+
+Libro* cerca_libro_per_isbn(Biblioteca* bib, const char* isbn) {
+    uint32_t hash = hash_isbn(isbn);
+    int maschera = LEGGI(bib->capacita_indice) - 1;
+    const SlotIsbn* slot = LEGGI(bib->indice_isbn);
+    int i = (int)(hash & (uint32_t)maschera);
+    int indice;
+    
+    // Scansione lineare fino al primo slot vuoto
+    while ((indice = LEGGI(slot[i].indice)) != -1) {
+        if (slot[i].hash == hash) {
+            Libro* libro = &(LEGGI(bib->libri)[indice]);
+            if (strcmp(libro->isbn, isbn) == 0) {
+                return libro;
+            }
+        }
+        i = (i + 1) & maschera;
+    }
+    return NULL;
+}
+
+static int confronta_lunghezza_liste(const void* a, const void* b) {
+    return ((const ListaTrigramma*)a)->num - ((const ListaTrigramma*)b)->num;
+}
+
+// Interseca in place due liste ordinate, cercando gli elementi di 'risultato'
+// in 'lista' con ricerca binaria (la lista più corta guida l'intersezione)
+static int interseca(int* risultato, int num, const ListaTrigramma* lista) {
+    int trovati = 0;
+    int inizio = 0;
+    
+    for (int i = 0; i < num && inizio < lista->num; i++) {
+        int basso = inizio, alto = lista->num;
+        while (basso < alto) {
+            int medio = basso + (alto - basso) / 2;
+            if (lista->libri[medio] < risultato[i]) {
+                basso = medio + 1;
+            } else {
+                alto = medio;
+            }
+        }
+        if (basso < lista->num && lista->libri[basso] == risultato[i]) {
+            risultato[trovati++] = risultato[i];
+        }
+        inizio = basso;
+    }
+    return trovati;
+}
+
+// Ricerca di sottostringa su un campo di Libro usando l'indice dei trigrammi.
+// Le liste dei trigrammi della query vengono intersecate a partire dalla più
+// corta; i candidati rimasti sono poi verificati con strstr, perché la presenza
+// di tutti i trigrammi non garantisce che siano contigui. Delle liste si usa
+// una copia (array e lunghezza), che un'aggiunta concorrente non altera.
+static int* cerca_sottostringa(Biblioteca* bib, const IndiceTrigrammi* indice,
+                               size_t offset_campo, const char* query, int* num_trovati) {
+    size_t lunghezza = strlen(query);
+    int* candidati = NULL;
+    int num_candidati = 0;
+    
+    *num_trovati = 0;
+    
+    if (lunghezza < LUNGHEZZA_TRIGRAMMA) {
+        // Query troppo corta per l'indice: tutti i libri sono candidati
+        num_candidati = LEGGI(bib->num_libri);
+        if (num_candidati == 0) {
+            return NULL;
+        }
+        candidati = (int*)malloc(num_candidati * sizeof(int));
+        if (candidati == NULL) {
+            fprintf(stderr, "Errore: impossibile allocare memoria per i risultati\n");
+            return NULL;
+        }
+        for (int i = 0; i < num_candidati; i++) {
+            candidati[i] = i;
+        }
+    } else {
+        size_t num_trigrammi = lunghezza - LUNGHEZZA_TRIGRAMMA + 1;
+        ListaTrigramma* liste = (ListaTrigramma*)malloc(num_trigrammi * sizeof(ListaTrigramma));
+        if (liste == NULL) {
+            fprintf(stderr, "Errore: impossibile allocare memoria per la ricerca\n");
+            return NULL;
+        }
+        
+        for (size_t k = 0; k < num_trigrammi; k++) {
+            const ListaTrigramma* lista = trigrammi_trova(indice, trigramma(query + k));
+            if (lista == NULL) {
+                // Un trigramma che non compare in nessun libro: nessun risultato
+                free(liste);
+                return NULL;
+            }
+            liste[k].trigramma = lista->trigramma;
+            liste[k].num = LEGGI(lista->num);
+            liste[k].libri = LEGGI(lista->libri);
+        }
+        
+        qsort(liste, num_trigrammi, sizeof(ListaTrigramma), confronta_lunghezza_liste);
+        
+        num_candidati = liste[0].num;
+        candidati = (int*)malloc((num_candidati > 0 ? num_candidati : 1) * sizeof(int));
+        if (candidati == NULL) {
+            fprintf(stderr, "Errore: impossibile allocare memoria per i risultati\n");
+            free(liste);
+            return NULL;
+        }
+        memcpy(candidati, liste[0].libri, num_candidati * sizeof(int));
+        
+        for (size_t k = 1; k < num_trigrammi && num_candidati > 0; k++) {
+            if (liste[k].libri != liste[k - 1].libri) {  // Trigrammi ripetuti nella query
+                num_candidati = interseca(candidati, num_candidati, &liste[k]);
+            }
+        }
+        free(liste);
+    }
+    
+    // Verifica dei candidati
+    const Libro* libri = LEGGI(bib->libri);
+    for (int i = 0; i < num_candidati; i++) {
+        const char* campo = (const char*)&(libri[candidati[i]]) + offset_campo;
+        if (strstr(campo, query) != NULL) {
+            candidati[(*num_trovati)++] = candidati[i];
+        }
+    }
+    
+    if (*num_trovati == 0) {
+        free(candidati);
+        return NULL;
+    }
+    return candidati;
+}
+
+// Esegue la ricerca in una sezione di lettura, ripetendola se una modifica
+// concorrente l'ha attraversata
+static int* cerca_sottostringa_in_lettura(Biblioteca* bib, const IndiceTrigrammi* indice,
+                                          size_t offset_campo, const char* query, int* num_trovati) {
+    int* risultati;
+    unsigned epoca = 0, versione;
+    for (;;) {
+        versione = lettura_inizia(bib, &epoca);
+        risultati = cerca_sottostringa(bib, indice, offset_campo, query, num_trovati);
+        if (lettura_termina(bib, epoca, versione)) {
+            return risultati;
+        }
+        free(risultati);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Cache dei risultati delle ricerche
+// ---------------------------------------------------------------------------
+//
+// Le ricerche per titolo e autore ricordano i risultati delle ultime query,
+// con chiave (campo, query). Ogni voce conserva la generazione del catalogo
+// su cui è stata calcolata: le modifiche che possono cambiare i risultati
+// (aggiunte, importazioni, ricostruzione degli indici, quindi anche
+// caricamento e ordinamento fisico) incrementano la generazione e le voci
+// superate non vengono più restituite e lasciano il posto al nuovo risultato.
+//
+// Le query sono divise in CACHE_SEGMENTI segmenti in base all'hash, ognuno
+// con i propri limiti di voci e memoria. In modalità concorrente ogni
+// segmento ha un lock lettori/scrittori: una voce ritrovata viene copiata
+// con il lock in lettura, quindi ricerche contemporanee non si attendono a
+// vicenda, e segna solo il proprio bit 'usata'. Inserimenti ed eliminazioni
+// prendono il lock in scrittura solo se è libero: se un altro thread sta
+// usando il segmento il risultato non viene memorizzato, invece di far
+// attendere la ricerca. Quando un segmento è pieno, per numero di voci o
+// per memoria, la lancetta dell'orologio percorre le voci azzerando i bit
+// 'usata' ed elimina la prima voce che non è stata consultata dall'ultimo
+// passaggio. Con la cache disattivata le ricerche non toccano alcun lock.
+
+// Segnala una modifica del catalogo; va chiamata a modifica completata, così
+// una ricerca che ha letto la generazione precedente non può aver visto il
+// catalogo nuovo e un risultato vecchio non viene mai preso per valido
+static void catalogo_modificato(Biblioteca* bib) {
+    PUBBLICA(bib->generazione, bib->generazione + 1);
+}
+
+static void segmento_blocca_lettura(Biblioteca* bib, SegmentoCache* segmento) {
+    if (bib->concorrente) {
+        pthread_rwlock_rdlock(&segmento->lock);
+    }
+}
+
+static void segmento_blocca_scrittura(Biblioteca* bib, SegmentoCache* segmento) {
+    if (bib->concorrente) {
+        pthread_rwlock_wrlock(&segmento->lock);
+    }
+}
+
+// Prende il lock in scrittura solo se nessun altro thread usa il segmento
+static int segmento_prova_scrittura(Biblioteca* bib, SegmentoCache* segmento) {
+    return !bib->concorrente || pthread_rwlock_trywrlock(&segmento->lock) == 0;
+}
+
+static void segmento_sblocca(Biblioteca* bib, SegmentoCache* segmento) {
+    if (bib->concorrente) {
+        pthread_rwlock_unlock(&segmento->lock);
+    }
+}
+
+static uint32_t hash_query(ChiaveOrdinamento campo, const char* query) {
+    return hash_isbn(query) ^ ((uint32_t)campo * 0x9E3779B9u);
+}
+
+// Segmento che contiene la query, NULL se la cache è disattivata
+static SegmentoCache* cache_segmento(CacheRicerche* cache, uint32_t hash) {
+    int num_segmenti = __atomic_load_n(&cache->num_segmenti, __ATOMIC_ACQUIRE);
+    if (num_segmenti == 0) {
+        return NULL;
+    }
+    return &cache->segmenti[hash & (uint32_t)(num_segmenti - 1)];
+}
+
+// Restituisce la voce con la chiave indicata, -1 se non presente
+static int cache_trova(const SegmentoCache* segmento, ChiaveOrdinamento campo,
+                       const char* query, uint32_t hash) {
+    int i = segmento->bucket[hash & (uint32_t)(segmento->num_bucket - 1)];
+    while (i != -1) {
+        const VoceCache* voce = &segmento->voci[i];
+        if (voce->hash == hash && voce->campo == campo && strcmp(voce->query, query) == 0) {
+            return i;
+        }
+        i = voce->catena;
+    }
+    return -1;
+}
+
+// Elimina la voce i e la rimette tra quelle libere
+static void cache_rimuovi(SegmentoCache* segmento, int i) {
+    VoceCache* voce = &segmento->voci[i];
+    int* collegamento = &segmento->bucket[voce->hash & (uint32_t)(segmento->num_bucket - 1)];
+    while (*collegamento != i) {
+        collegamento = &segmento->voci[*collegamento].catena;
+    }
+    *collegamento = voce->catena;
+    
+    segmento->num_voci--;
+    segmento->byte_usati -= voce->byte;
+    free(voce->query);
+    free(voce->risultati);
+    voce->query = NULL;
+    voce->risultati = NULL;
+    voce->catena = segmento->libere;
+    segmento->libere = i;
+}
+
+// Elimina una voce con l'algoritmo dell'orologio: la lancetta salta le voci
+// consultate dall'ultimo passaggio, azzerandone il bit, e si ferma sulla
+// prima che non lo è stata. Al più due giri; il segmento non è vuoto.
+static void cache_elimina_una(SegmentoCache* segmento) {
+    while (1) {
+        int i = segmento->lancetta;
+        VoceCache* voce = &segmento->voci[i];
+        segmento->lancetta = (i + 1) % segmento->max_voci;
+        if (voce->query == NULL) {
+            continue;
+        }
+        if (__atomic_load_n(&voce->usata, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&voce->usata, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+        cache_rimuovi(segmento, i);
+        return;
+    }
+}
+
+static void segmento_libera(SegmentoCache* segmento) {
+    for (int i = 0; i < segmento->max_voci; i++) {
+        free(segmento->voci[i].query);
+        free(segmento->voci[i].risultati);
+    }
+    free(segmento->voci);
+    free(segmento->bucket);
+    segmento->voci = NULL;
+    segmento->bucket = NULL;
+    segmento->max_voci = 0;
+    segmento->num_voci = 0;
+    segmento->byte_usati = 0;
+}
+
+static void cache_libera(CacheRicerche* cache) {
+    for (int i = 0; i < CACHE_SEGMENTI; i++) {
+        segmento_libera(&cache->segmenti[i]);
+    }
+    cache->num_segmenti = 0;
+}
+
+// Imposta i limiti della cache (numero di voci e byte occupati da query e
+// risultati) svuotandola; con max_voci a 0 la cache è disattivata. I limiti
+// sono divisi in parti uguali tra i segmenti, al più uno per voce.
+// I contatori di successi e mancati non vengono azzerati.
+int configura_cache_ricerche(Biblioteca* bib, int max_voci, size_t max_byte) {
+    CacheRicerche* cache = &bib->cache;
+    int num_segmenti = 0;
+    if (max_voci > 0) {
+        num_segmenti = 1;
+        while (2 * num_segmenti <= CACHE_SEGMENTI && 2 * num_segmenti <= max_voci) {
+            num_segmenti *= 2;
+        }
+    }
+    int voci_segmento = num_segmenti > 0 ? max_voci / num_segmenti : 0;
+    int num_bucket = 1;
+    while (num_bucket < 2 * voci_segmento) {
+        num_bucket *= 2;
+    }
+    
+    // Tutta la memoria viene allocata prima di toccare la cache attuale
+    VoceCache* voci[CACHE_SEGMENTI] = {NULL};
+    int* bucket[CACHE_SEGMENTI] = {NULL};
+    for (int s = 0; s < num_segmenti; s++) {
+        voci[s] = (VoceCache*)calloc(voci_segmento, sizeof(VoceCache));
+        bucket[s] = (int*)malloc(num_bucket * sizeof(int));
+        if (voci[s] == NULL || bucket[s] == NULL) {
+            fprintf(stderr, "Errore: impossibile allocare memoria per la cache delle ricerche\n");
+            for (int t = 0; t <= s; t++) {
+                free(voci[t]);
+                free(bucket[t]);
+            }
+            return 0;
+        }
+        for (int i = 0; i < num_bucket; i++) {
+            bucket[s][i] = -1;
+        }
+        for (int i = 0; i < voci_segmento; i++) {
+            voci[s][i].catena = i + 1 < voci_segmento ? i + 1 : -1;
+        }
+    }
+    
+    // Le ricerche in corso possono trovare segmenti già sostituiti: ognuno è
+    // coerente sotto il proprio lock, al più la query non viene trovata
+    __atomic_store_n(&cache->num_segmenti, 0, __ATOMIC_RELEASE);
+    for (int s = 0; s < CACHE_SEGMENTI; s++) {
+        SegmentoCache* segmento = &cache->segmenti[s];
+        segmento_blocca_scrittura(bib, segmento);
+        segmento_libera(segmento);
+        if (s < num_segmenti) {
+            segmento->voci = voci[s];
+            segmento->bucket = bucket[s];
+            segmento->num_bucket = num_bucket;
+            segmento->max_voci = voci_segmento;
+            segmento->max_byte = max_byte / (size_t)num_segmenti;
+            segmento->lancetta = 0;
+            segmento->libere = 0;
+        }
+        segmento_sblocca(bib, segmento);
+    }
+    __atomic_store_n(&cache->num_segmenti, num_segmenti, __ATOMIC_RELEASE);
+    return 1;
+}
+
+void statistiche_cache_ricerche(Biblioteca* bib, StatisticheCache* statistiche) {
+    memset(statistiche, 0, sizeof(*statistiche));
+    for (int s = 0; s < CACHE_SEGMENTI; s++) {
+        SegmentoCache* segmento = &bib->cache.segmenti[s];
+        statistiche->successi += __atomic_load_n(&segmento->successi, __ATOMIC_RELAXED);
+        statistiche->mancati += __atomic_load_n(&segmento->mancati, __ATOMIC_RELAXED);
+        segmento_blocca_lettura(bib, segmento);
+        statistiche->voci += segmento->num_voci;
+        statistiche->byte += segmento->byte_usati;
+        segmento_sblocca(bib, segmento);
+    }
+}
+
+// Cerca la query nella cache. Se c'è un risultato valido ne restituisce una
+// copia (il chiamante la libera come quella di una ricerca) e restituisce 1.
+// Il segmento resta bloccato solo in lettura: la voce ritrovata segna il
+// proprio bit 'usata' ma non cambia posizione. Una voce superata resta al
+// suo posto finché il nuovo risultato non la sostituisce.
+static int cache_cerca(Biblioteca* bib, ChiaveOrdinamento campo, const char* query,
+                       int** risultati, int* num_trovati) {
+    uint32_t hash = hash_query(campo, query);
+    SegmentoCache* segmento = cache_segmento(&bib->cache, hash);
+    if (segmento == NULL) {
+        return 0;
+    }
+    int trovato = 0;
+    
+    segmento_blocca_lettura(bib, segmento);
+    int i = segmento->max_voci > 0 ? cache_trova(segmento, campo, query, hash) : -1;
+    if (i != -1 && segmento->voci[i].generazione == LEGGI(bib->generazione)) {
+        VoceCache* voce = &segmento->voci[i];
+        *num_trovati = voce->num_risultati;
+        *risultati = NULL;
+        if (voce->num_risultati > 0) {
+            *risultati = (int*)malloc(voce->num_risultati * sizeof(int));
+            if (*risultati != NULL) {
+                memcpy(*risultati, voce->risultati, voce->num_risultati * sizeof(int));
+            }
+        }
+        trovato = voce->num_risultati == 0 || *risultati != NULL;
+        if (trovato && !__atomic_load_n(&voce->usata, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&voce->usata, 1, __ATOMIC_RELAXED);
+        }
+    }
+    segmento_sblocca(bib, segmento);
+    
+    __atomic_fetch_add(trovato ? &segmento->successi : &segmento->mancati, 1, __ATOMIC_RELAXED);
+    return trovato;
+}
+
+// Memorizza il risultato di una ricerca calcolato sulla generazione indicata.
+// Un errore di memoria non è un errore della ricerca, e nemmeno un segmento
+// occupato da un altro thread: in entrambi i casi la voce viene saltata.
+static void cache_inserisci(Biblioteca* bib, ChiaveOrdinamento campo, const char* query,
+                            const int* risultati, int num, unsigned generazione) {
+    size_t lunghezza = strlen(query) + 1;
+    size_t byte = lunghezza + (size_t)num * sizeof(int);
+    uint32_t hash = hash_query(campo, query);
+    SegmentoCache* segmento = cache_segmento(&bib->cache, hash);
+    
+    if (segmento == NULL || !segmento_prova_scrittura(bib, segmento)) {
+        return;
+    }
+    if (segmento->max_voci == 0 || byte > segmento->max_byte ||
+        generazione != LEGGI(bib->generazione)) {
+        segmento_sblocca(bib, segmento);
+        return;
+    }
+    
+    // La query può essere già presente: inserita da un altro thread nel
+    // frattempo, oppure calcolata su una generazione precedente
+    int i = cache_trova(segmento, campo, query, hash);
+    if (i != -1) {
+        cache_rimuovi(segmento, i);
+    }
+    while (segmento->num_voci == segmento->max_voci ||
+           (segmento->num_voci > 0 && segmento->byte_usati + byte > segmento->max_byte)) {
+        cache_elimina_una(segmento);
+    }
+    
+    i = segmento->libere;
+    VoceCache* voce = &segmento->voci[i];
+    voce->query = (char*)malloc(lunghezza);
+    voce->risultati = num > 0 ? (int*)malloc(num * sizeof(int)) : NULL;
+    if (voce->query == NULL || (num > 0 && voce->risultati == NULL)) {
+        free(voce->query);
+        free(voce->risultati);
+        voce->query = NULL;
+        voce->risultati = NULL;
+        segmento_sblocca(bib, segmento);
+        return;
+    }
+    segmento->libere = voce->catena;
+    
+    memcpy(voce->query, query, lunghezza);
+    if (num > 0) {
+        memcpy(voce->risultati, risultati, num * sizeof(int));
+    }
+    voce->hash = hash;
+    voce->campo = campo;
+    voce->generazione = generazione;
+    voce->num_risultati = num;
+    voce->byte = byte;
+    voce->usata = 1;  // Una voce nuova sopravvive almeno a un passaggio della lancetta
+    
+    int* testa = &segmento->bucket[hash & (uint32_t)(segmento->num_bucket - 1)];
+    voce->catena = *testa;
+    *testa = i;
+    segmento->num_voci++;
+    segmento->byte_usati += byte;
+    segmento_sblocca(bib, segmento);
+}
+
+// Ricerca per titolo o autore passando per la cache. La generazione va letta
+// prima della ricerca: se il catalogo cambia nel frattempo il risultato viene
+// scartato invece di essere memorizzato come attuale.
+static int* cerca_con_cache(Biblioteca* bib, ChiaveOrdinamento campo, const char* query,
+                            int* num_trovati) {
+    int* risultati;
+    if (cache_cerca(bib, campo, query, &risultati, num_trovati)) {
+        return risultati;
+    }
+    
+    unsigned generazione = LEGGI(bib->generazione);
+    if (campo == CHIAVE_TITOLO) {
+        risultati = cerca_sottostringa_in_lettura(bib, &bib->indice_titoli, offsetof(Libro, titolo),
+                                                  query, num_trovati);
+    } else {
+        risultati = cerca_sottostringa_in_lettura(bib, &bib->indice_autori, offsetof(Libro, autore),
+                                                  query, num_trovati);
+    }
+    // Un risultato vuoto non si distingue da un errore di memoria: non si memorizza
+    if (risultati != NULL) {
+        cache_inserisci(bib, campo, query, risultati, *num_trovati, generazione);
+    }
+    return risultati;
+}
+
+int* cerca_libri_per_autore(Biblioteca* bib, const char* autore, int* num_trovati) {
+    return cerca_con_cache(bib, CHIAVE_AUTORE, autore, num_trovati);
+}
+
+int* cerca_libri_per_titolo(Biblioteca* bib, const char* titolo, int* num_trovati) {
+    return cerca_con_cache(bib, CHIAVE_TITOLO, titolo, num_trovati);
+}
+
+int presta_libro(Biblioteca* bib, const char* isbn) {
+    scrittura_inizia(bib);
+    int ok = esegui_prestito(bib, isbn, time(NULL));
+    
+    if (ok && bib->journal != NULL &&
+        !journal_registra_prestito(bib->journal, cerca_libro_per_isbn(bib, isbn))) {
+        fprintf(stderr, "Errore: prestito del libro con ISBN %s non registrato nel journal\n", isbn);
+        ok = 0;
+    }
+    scrittura_termina(bib);
+    return ok;
+}
+
+// Presta un libro registrando la data indicata (usata anche dalla riapplicazione del journal)
+static int esegui_prestito(Biblioteca* bib, const char* isbn, time_t data) {
+    Libro* libro = cerca_libro_per_isbn(bib, isbn);
+    
+    if (libro == NULL) {
+        fprintf(stderr, "Errore: libro con ISBN %s non trovato\n", isbn);
+        return 0;
+    }
+    
+    // Il passaggio disponibile -> in prestito è atomico, e la modifica fa
+    // ripetere le letture concorrenti che stanno copiando il record
+    int atteso = 1;
+    modifica_inizia(bib);
+    int ok = __atomic_compare_exchange_n(&libro->disponibile, &atteso, 0, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    if (ok) {
+        __atomic_store_n(&libro->data_prestito, data, __ATOMIC_RELEASE);
+    }
+    modifica_termina(bib);
+    
+    if (!ok) {
+        fprintf(stderr, "Errore: libro con ISBN %s già in prestito\n", isbn);
+        return 0;
+    }
+    
+    // Un errore di memoria nello storico non annulla il prestito
+    storico_registra(&bib->storico, (int)(libro - bib->libri), (int64_t)data);
+    return 1;
+}
+
+int restituisci_libro(Biblioteca* bib, const char* isbn) {
+    scrittura_inizia(bib);
+    Libro* libro = cerca_libro_per_isbn(bib, isbn);
+    
+    if (libro == NULL) {
+        scrittura_termina(bib);
+        fprintf(stderr, "Errore: libro con ISBN %s non trovato\n", isbn);
+        return 0;
+    }
+    
+    int atteso = 0;
+    modifica_inizia(bib);
+    int ok = __atomic_compare_exchange_n(&libro->disponibile, &atteso, 1, 0,
+                                         __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    modifica_termina(bib);
+    
+    if (!ok) {
+        scrittura_termina(bib);
+        fprintf(stderr, "Errore: libro con ISBN %s non risulta in prestito\n", isbn);
+        return 0;
+    }
+    
+    if (bib->journal != NULL && !journal_registra_restituzione(bib->journal, libro)) {
+        fprintf(stderr, "Errore: restituzione del libro con ISBN %s non registrata nel journal\n", isbn);
+        scrittura_termina(bib);
+        return 0;
+    }
+    scrittura_termina(bib);
+    return 1;
+}
+
+// Funzioni di confronto per qsort
+int confronta_titoli(const void* a, const void* b) {
+    return strcmp(((Libro*)a)->titolo, ((Libro*)b)->titolo);
+}
+
+int confronta_autori(const void* a, const void* b) {
+    return strcmp(((Libro*)a)->autore, ((Libro*)b)->autore);
+}
+
+int confronta_anni(const void* a, const void* b) {
+    return ((Libro*)a)->anno_pubblicazione - ((Libro*)b)->anno_pubblicazione;
+}
+
+// Confronta due libri (per posizione) secondo una chiave; a parità di chiave
+// vale l'ordine di inserimento, così ogni indice ha un ordine univoco
+static int confronta_per_chiave(const Biblioteca* bib, ChiaveOrdinamento chiave, int a, int b) {
+    const Libro* libri = LEGGI(bib->libri);
+    const Libro* la = &(libri[a]);
+    const Libro* lb = &(libri[b]);
+    int risultato;
+    
+    switch (chiave) {
+        case CHIAVE_TITOLO:
+            risultato = strcmp(la->titolo, lb->titolo);
+            break;
+        case CHIAVE_AUTORE:
+            risultato = strcmp(la->autore, lb->autore);
+            break;
+        default:
+            risultato = (la->anno_pubblicazione > lb->anno_pubblicazione) -
+                        (la->anno_pubblicazione < lb->anno_pubblicazione);
+            break;
+    }
+    return risultato != 0 ? risultato : (a > b) - (a < b);
+}
+
+// Merge sort delle posizioni (qsort non permette di passare la chiave al comparatore)
+static void ordina_posizioni(const Biblioteca* bib, ChiaveOrdinamento chiave,
+                             int* posizioni, int* appoggio, int num) {
+    if (num < 2) {
+        return;
+    }
+    
+    int meta = num / 2;
+    ordina_posizioni(bib, chiave, posizioni, appoggio, meta);
+    ordina_posizioni(bib, chiave, posizioni + meta, appoggio, num - meta);
+    
+    int i = 0, j = meta, k = 0;
+    while (i < meta && j < num) {
+        if (confronta_per_chiave(bib, chiave, posizioni[i], posizioni[j]) <= 0) {
+            appoggio[k++] = posizioni[i++];
+        } else {
+            appoggio[k++] = posizioni[j++];
+        }
+    }
+    while (i < meta) appoggio[k++] = posizioni[i++];
+    while (j < num) appoggio[k++] = posizioni[j++];
+    memcpy(posizioni, appoggio, num * sizeof(int));
+}
+
+static int indice_ordinato_riserva(Biblioteca* bib, int** array, int* capacita,
+                                   int usati, int necessaria) {
+    if (necessaria <= *capacita) {
+        return 1;
+    }
+    int nuova_capacita = *capacita ? *capacita : 16;
+    while (nuova_capacita < necessaria) {
+        nuova_capacita *= 2;
+    }
+    int* temp = (int*)rialloca_condiviso(bib, *array, usati * sizeof(int), nuova_capacita * sizeof(int));
+    if (temp == NULL) {
+        fprintf(stderr, "Errore: impossibile espandere l'indice ordinato\n");
+        return 0;
+    }
+    PUBBLICA(*array, temp);
+    *capacita = nuova_capacita;
+    return 1;
+}
+
+// Ordina le posizioni in attesa e le fonde con la parte già ordinata: O(N + P log P)
+static int indice_ordinato_fondi(Biblioteca* bib, ChiaveOrdinamento chiave) {
+    IndiceOrdinato* indice = &(bib->indici_ordinati[chiave]);
+    if (indice->num_pendenti == 0) {
+        return 1;
+    }
+    
+    int totale = indice->num_ordinati + indice->num_pendenti;
+    int* fusi = (int*)malloc(totale * sizeof(int));
+    if (fusi == NULL) {
+        fprintf(stderr, "Errore: impossibile aggiornare l'indice ordinato\n");
+        return 0;
+    }
+    
+    // I lettori concorrenti possono scorrere le posizioni in attesa mentre
+    // vengono ordinate: in quel caso si ordina una copia
+    int* pendenti = indice->pendenti;
+    if (bib->concorrente) {
+        pendenti = (int*)malloc(indice->num_pendenti * sizeof(int));
+        if (pendenti == NULL) {
+            fprintf(stderr, "Errore: impossibile aggiornare l'indice ordinato\n");
+            free(fusi);
+            return 0;
+        }
+        memcpy(pendenti, indice->pendenti, indice->num_pendenti * sizeof(int));
+    }
+    
+    // Molte posizioni da ordinare (per esempio dopo un caricamento): radix
+    // sort parallelo; altrimenti merge sort, il cui buffer di appoggio riusa
+    // la coda di 'fusi'
+    if (indice->num_pendenti < SOGLIA_ORDINAMENTO_PARALLELO ||
+        !ordina_posizioni_parallelo(bib, chiave, pendenti, indice->num_pendenti, 0)) {
+        ordina_posizioni(bib, chiave, pendenti, fusi + indice->num_ordinati, indice->num_pendenti);
+    }
+    
+    int i = 0, j = 0, k = 0;
+    while (i < indice->num_ordinati && j < indice->num_pendenti) {
+        if (confronta_per_chiave(bib, chiave, indice->ordinati[i], pendenti[j]) <= 0) {
+            fusi[k++] = indice->ordinati[i++];
+        } else {
+            fusi[k++] = pendenti[j++];
+        }
+    }
+    while (i < indice->num_ordinati) fusi[k++] = indice->ordinati[i++];
+    while (j < indice->num_pendenti) fusi[k++] = pendenti[j++];
+    
+    if (pendenti != indice->pendenti) {
+        free(pendenti);
+    }
+    
+    int* vecchi = indice->ordinati;
+    modifica_inizia(bib);
+    PUBBLICA(indice->ordinati, fusi);
+    PUBBLICA(indice->num_ordinati, totale);
+    indice->capacita_ordinati = totale;
+    PUBBLICA(indice->num_pendenti, 0);
+    modifica_termina(bib);
+    libera_condiviso(bib, vecchi);
+    return 1;
+}
+
+// Registra un nuovo libro negli indici ordinati. L'inserimento è O(1):
+// la posizione finisce tra quelle in attesa, che vengono fuse alla prima
+// interrogazione o quando diventano troppe rispetto alla parte ordinata.
+static int indici_ordinati_aggiungi(Biblioteca* bib, int pos) {
+    for (int chiave = 0; chiave < NUM_CHIAVI; chiave++) {
+        IndiceOrdinato* indice = &(bib->indici_ordinati[chiave]);
+        if (!indice_ordinato_riserva(bib, &indice->pendenti, &indice->capacita_pendenti,
+                                     indice->num_pendenti, indice->num_pendenti + 1)) {
+            return 0;
+        }
+        indice->pendenti[indice->num_pendenti] = pos;
+        PUBBLICA(indice->num_pendenti, indice->num_pendenti + 1);
+        
+        if (indice->num_pendenti > MIN_PENDENTI + indice->num_ordinati / 8 &&
+            !indice_ordinato_fondi(bib, (ChiaveOrdinamento)chiave)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void indici_ordinati_libera(Biblioteca* bib) {
+    for (int chiave = 0; chiave < NUM_CHIAVI; chiave++) {
+        free(bib->indici_ordinati[chiave].ordinati);
+        free(bib->indici_ordinati[chiave].pendenti);
+        memset(&(bib->indici_ordinati[chiave]), 0, sizeof(IndiceOrdinato));
+    }
+}
+
+// Dopo un caricamento tutte le posizioni sono "in attesa": l'ordinamento
+// vero e proprio avviene solo quando un indice viene usato
+int ricostruisci_indici_ordinati(Biblioteca* bib) {
+    esclusiva_inizia(bib);
+    indici_ordinati_libera(bib);
+    int ok = 1;
+    for (int chiave = 0; ok && chiave < NUM_CHIAVI; chiave++) {
+        IndiceOrdinato* indice = &(bib->indici_ordinati[chiave]);
+        ok = indice_ordinato_riserva(bib, &indice->pendenti, &indice->capacita_pendenti,
+                                     0, bib->num_libri);
+        for (int i = 0; ok && i < bib->num_libri; i++) {
+            indice->pendenti[i] = i;
+        }
+        indice->num_pendenti = ok ? bib->num_libri : 0;
+    }
+    esclusiva_termina(bib);
+    return ok;
+}
+
+// Restituisce le posizioni dei libri ordinate per la chiave indicata.
+// L'array appartiene alla biblioteca ed è valido fino alla prossima modifica,
+// quindi in modalità concorrente va usato solo da chi fa le modifiche.
+const int* vista_ordinata(Biblioteca* bib, ChiaveOrdinamento chiave, int* num) {
+    scrittura_inizia(bib);
+    int ok = indice_ordinato_fondi(bib, chiave);
+    scrittura_termina(bib);
+    if (!ok) {
+        *num = 0;
+        return NULL;
+    }
+    *num = bib->indici_ordinati[chiave].num_ordinati;
+    return bib->indici_ordinati[chiave].ordinati;
+}
+
+// Trova in un array di posizioni ordinato per anno il primo libro con
+// anno >= anno_da e il primo con anno > anno_a
+static void limiti_anni(const Libro* libri, const int* ordinati, int num,
+                        int anno_da, int anno_a, int limiti[2]) {
+    int soglie[2] = { anno_da, anno_a };
+    for (int k = 0; k < 2; k++) {
+        int basso = 0, alto = num;
+        while (basso < alto) {
+            int medio = basso + (alto - basso) / 2;
+            int anno = libri[ordinati[medio]].anno_pubblicazione;
+            if (k == 0 ? anno < soglie[k] : anno <= soglie[k]) {
+                basso = medio + 1;
+            } else {
+                alto = medio;
+            }
+        }
+        limiti[k] = basso;
+    }
+}
+
+// Ricerca per anno dei lettori concorrenti: fondere l'indice sarebbe una
+// modifica, quindi si cerca nella parte ordinata, si aggiungono le posizioni
+// in attesa che rientrano nell'intervallo e si fondono solo quelle
+static int* cerca_anni_in_lettura(Biblioteca* bib, int anno_da, int anno_a, int* num_trovati) {
+    const IndiceOrdinato* indice = &(bib->indici_ordinati[CHIAVE_ANNO]);
+    int num_ordinati = LEGGI(indice->num_ordinati);
+    const int* ordinati = LEGGI(indice->ordinati);
+    int num_pendenti = LEGGI(indice->num_pendenti);
+    const int* pendenti = LEGGI(indice->pendenti);
+    const Libro* libri = LEGGI(bib->libri);
+    
+    int limiti[2];
+    limiti_anni(libri, ordinati, num_ordinati, anno_da, anno_a, limiti);
+    int num_intervallo = limiti[1] - limiti[0];
+    
+    *num_trovati = 0;
+    int* risultati = (int*)malloc((2 * (size_t)(num_intervallo + num_pendenti) + 1) * sizeof(int));
+    if (risultati == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per i risultati\n");
+        return NULL;
+    }
+    
+    if (num_intervallo > 0) {
+        memcpy(risultati, ordinati + limiti[0], num_intervallo * sizeof(int));
+    }
+    int num_extra = 0;
+    int* extra = risultati + num_intervallo;
+    for (int i = 0; i < num_pendenti; i++) {
+        int anno = libri[pendenti[i]].anno_pubblicazione;
+        if (anno >= anno_da && anno <= anno_a) {
+            extra[num_extra++] = pendenti[i];
+        }
+    }
+    
+    // Ordina le posizioni in attesa e fondi le due parti, usando come
+    // appoggio la seconda metà del buffer
+    int totale = num_intervallo + num_extra;
+    if (num_extra > 0) {
+        int* appoggio = risultati + totale;
+        ordina_posizioni(bib, CHIAVE_ANNO, extra, appoggio, num_extra);
+        int i = 0, j = 0, k = 0;
+        while (i < num_intervallo && j < num_extra) {
+            if (confronta_per_chiave(bib, CHIAVE_ANNO, risultati[i], extra[j]) <= 0) {
+                appoggio[k++] = risultati[i++];
+            } else {
+                appoggio[k++] = extra[j++];
+            }
+        }
+        while (i < num_intervallo) appoggio[k++] = risultati[i++];
+        while (j < num_extra) appoggio[k++] = extra[j++];
+        memcpy(risultati, appoggio, totale * sizeof(int));
+    }
+    
+    if (totale == 0) {
+        free(risultati);
+        return NULL;
+    }
+    *num_trovati = totale;
+    return risultati;
+}
+
+// Libri pubblicati tra anno_da e anno_a (inclusi), in ordine di anno:
+// due ricerche binarie sull'indice per anno e la copia dell'intervallo
+int* cerca_libri_per_anno(Biblioteca* bib, int anno_da, int anno_a, int* num_trovati) {
+    *num_trovati = 0;
+    if (anno_da > anno_a) {
+        return NULL;
+    }
+    
+    if (bib->concorrente) {
+        int* risultati;
+        unsigned epoca = 0, versione;
+        for (;;) {
+            versione = lettura_inizia(bib, &epoca);
+            risultati = cerca_anni_in_lettura(bib, anno_da, anno_a, num_trovati);
+            if (lettura_termina(bib, epoca, versione)) {
+                return risultati;
+            }
+            free(risultati);
+        }
+    }
+    
+    int num;
+    const int* ordinati = vista_ordinata(bib, CHIAVE_ANNO, &num);
+    if (ordinati == NULL) {
+        return NULL;
+    }
+    
+    int limiti[2];
+    limiti_anni(bib->libri, ordinati, num, anno_da, anno_a, limiti);
+    
+    *num_trovati = limiti[1] - limiti[0];
+    if (*num_trovati == 0) {
+        return NULL;
+    }
+    
+    int* risultati = (int*)malloc(*num_trovati * sizeof(int));
+    if (risultati == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per i risultati\n");
+        *num_trovati = 0;
+        return NULL;
+    }
+    memcpy(risultati, ordinati + limiti[0], *num_trovati * sizeof(int));
+    return risultati;
+}
+
+// L'ordinamento non sposta più i libri: sceglie l'indice usato per elencarli
+void ordina_per_titolo(Biblioteca* bib) {
+    bib->vista = CHIAVE_TITOLO;
+}
+
+void ordina_per_autore(Biblioteca* bib) {
+    bib->vista = CHIAVE_AUTORE;
+}
+
+void ordina_per_anno(Biblioteca* bib) {
+    bib->vista = CHIAVE_ANNO;
+}
+
+// ---------------------------------------------------------------------------
+// Importazione in blocco
+// ---------------------------------------------------------------------------
+//
+// L'importazione riserva una sola volta lo spazio per array e indice ISBN e
+// controlla i duplicati con la tabella hash nello stesso passaggio in cui
+// inserisce; trigrammi e indici ordinati vengono costruiti solo alla fine,
+// per tutti i libri importati insieme.
+
+// Riserva spazio per altri 'num' libri nell'array e nell'indice ISBN
+static int riserva_libri(Biblioteca* bib, int num) {
+    int necessari = bib->num_libri + num;
+    
+    if (necessari > bib->capacita) {
+        int nuova_capacita = bib->capacita * 2 > necessari ? bib->capacita * 2 : necessari;
+        Libro* temp = (Libro*)rialloca_condiviso(bib, bib->libri, bib->num_libri * sizeof(Libro),
+                                                 nuova_capacita * sizeof(Libro));
+        if (temp == NULL) {
+            fprintf(stderr, "Errore: impossibile espandere la memoria per i libri\n");
+            return 0;
+        }
+        PUBBLICA(bib->libri, temp);
+        bib->capacita = nuova_capacita;
+    }
+    
+    int capacita_indice = bib->capacita_indice;
+    while (2 * necessari > capacita_indice) {
+        capacita_indice *= 2;
+    }
+    return capacita_indice == bib->capacita_indice ||
+           indice_isbn_ridimensiona(bib, capacita_indice);
+}
+
+// Copia un blocco di libri in coda all'array e li registra nell'indice ISBN.
+// La ricerca del duplicato e l'inserimento usano la stessa scansione: il
+// primo slot vuoto incontrato è quello in cui va il nuovo libro.
+static int importa_blocco(Biblioteca* bib, const Libro* libri, int num, int* num_duplicati) {
+    if (!riserva_libri(bib, num)) {
+        return 0;
+    }
+    
+    int maschera = bib->capacita_indice - 1;
+    for (int k = 0; k < num; k++) {
+        Libro* nuovo_libro = &(bib->libri[bib->num_libri]);
+        memcpy(nuovo_libro, &libri[k], sizeof(Libro));
+        nuovo_libro->titolo[MAX_TITOLO - 1] = '\0';
+        nuovo_libro->autore[MAX_AUTORE - 1] = '\0';
+        nuovo_libro->isbn[MAX_ISBN - 1] = '\0';
+        nuovo_libro->disponibile = 1;
+        nuovo_libro->data_prestito = 0;
+        
+        uint32_t hash = hash_isbn(nuovo_libro->isbn);
+        int i = (int)(hash & (uint32_t)maschera);
+        int duplicato = 0;
+        while (bib->indice_isbn[i].indice != -1) {
+            SlotIsbn* slot = &(bib->indice_isbn[i]);
+            if (slot->hash == hash && strcmp(bib->libri[slot->indice].isbn, nuovo_libro->isbn) == 0) {
+                duplicato = 1;
+                break;
+            }
+            i = (i + 1) & maschera;
+        }
+        if (duplicato) {
+            (*num_duplicati)++;
+            continue;
+        }
+        
+        bib->indice_isbn[i].hash = hash;
+        PUBBLICA(bib->indice_isbn[i].indice, bib->num_libri);
+        PUBBLICA(bib->num_libri, bib->num_libri + 1);
+        
+        // I libri già copiati restano; l'importazione si ferma al primo errore
+        if (bib->journal != NULL && !journal_registra_aggiunta(bib->journal, nuovo_libro)) {
+            fprintf(stderr, "Errore: aggiunta del libro con ISBN %s non registrata nel journal\n",
+                    nuovo_libro->isbn);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Registra nei trigrammi e negli indici ordinati i libri dalla posizione
+// 'da' in poi. Le posizioni finiscono tutte tra quelle in attesa: l'indice
+// verrà ordinato in blocco (radix sort) alla prima interrogazione.
+static int indicizza_importati(Biblioteca* bib, int da) {
+    for (int i = da; i < bib->num_libri; i++) {
+        if (!trigrammi_aggiungi_testo(bib, &bib->indice_titoli, bib->libri[i].titolo, i) ||
+            !trigrammi_aggiungi_testo(bib, &bib->indice_autori, bib->libri[i].autore, i)) {
+            return 0;
+        }
+    }
+    
+    int num = bib->num_libri - da;
+    for (int chiave = 0; chiave < NUM_CHIAVI; chiave++) {
+        IndiceOrdinato* indice = &(bib->indici_ordinati[chiave]);
+        if (!indice_ordinato_riserva(bib, &indice->pendenti, &indice->capacita_pendenti,
+                                     indice->num_pendenti, indice->num_pendenti + num)) {
+            return 0;
+        }
+        for (int i = 0; i < num; i++) {
+            indice->pendenti[indice->num_pendenti + i] = da + i;
+        }
+        PUBBLICA(indice->num_pendenti, indice->num_pendenti + num);
+    }
+    return 1;
+}
+
+// Completa un'importazione: indicizza i nuovi libri oppure, se manca la
+// memoria, riporta gli indici in uno stato coerente
+static int termina_importazione(Biblioteca* bib, int da, int ok) {
+    if (ok) {
+        ok = indicizza_importati(bib, da);
+    }
+    if (!ok) {
+        // I libri già copiati restano (sono anche nel journal): gli indici
+        // vengono ricostruiti da zero per includerli tutti
+        ricostruisci_indici(bib);
+    }
+    catalogo_modificato(bib);
+    return ok;
+}
+
+// Importa un array di libri. Gli ISBN già presenti (nella biblioteca o prima
+// nello stesso array) vengono ignorati; i libri importati risultano disponibili.
+int importa_libri(Biblioteca* bib, const Libro* libri, int num, int* num_importati) {
+    scrittura_inizia(bib);
+    int da = bib->num_libri;
+    int num_duplicati = 0;
+    int ok = termina_importazione(bib, da, importa_blocco(bib, libri, num, &num_duplicati));
+    
+    if (num_duplicati > 0) {
+        fprintf(stderr, "Attenzione: %d libri con ISBN duplicato ignorati\n", num_duplicati);
+    }
+    if (num_importati != NULL) {
+        *num_importati = bib->num_libri - da;
+    }
+    scrittura_termina(bib);
+    return ok;
+}
+
+// Divide una riga in campi separati da 'separatore', riscrivendoli sul posto.
+// Un campo tra virgolette può contenere il separatore e due virgolette
+// consecutive valgono come una. Restituisce il numero di campi trovati.
+static int dividi_campi(char* riga, char separatore, char** campi, int max_campi) {
+    int num = 0;
+    char* lettura = riga;
+    
+    while (num < max_campi) {
+        char* scrittura = lettura;
+        campi[num++] = scrittura;
+        
+        if (*lettura == '"') {
+            lettura++;
+            while (*lettura != '\0') {
+                if (*lettura == '"' && lettura[1] == '"') {
+                    *scrittura++ = '"';
+                    lettura += 2;
+                } else if (*lettura == '"') {
+                    lettura++;
+                    break;
+                } else {
+                    *scrittura++ = *lettura++;
+                }
+            }
+        }
+        while (*lettura != '\0' && *lettura != separatore) {
+            *scrittura++ = *lettura++;
+        }
+        
+        int fine = *lettura == '\0';
+        *scrittura = '\0';
+        if (fine) {
+            break;
+        }
+        lettura++;
+    }
+    return num;
+}
+
+// Converte una riga "titolo;autore;isbn;anno" in un Libro
+static int analizza_riga(char* riga, char separatore, Libro* libro) {
+    char* campi[4];
+    if (dividi_campi(riga, separatore, campi, 4) != 4) {
+        return 0;
+    }
+    
+    char* fine;
+    long anno = strtol(campi[3], &fine, 10);
+    if (fine == campi[3] || *campi[2] == '\0') {
+        return 0;
+    }
+    
+    memset(libro, 0, sizeof(Libro));
+    strncpy(libro->titolo, campi[0], MAX_TITOLO - 1);
+    strncpy(libro->autore, campi[1], MAX_AUTORE - 1);
+    strncpy(libro->isbn, campi[2], MAX_ISBN - 1);
+    libro->anno_pubblicazione = (int)anno;
+    return 1;
+}
+
+// Importa libri da un file di testo con una riga per libro e i campi titolo,
+// autore, ISBN e anno separati da 'separatore' (',' per CSV, '\t' per TSV).
+// Il file viene letto a blocchi grandi e le righe analizzate direttamente
+// nel buffer; le righe non valide (compresa un'eventuale intestazione)
+// vengono saltate.
+int importa_libri_da_file(Biblioteca* bib, FILE* file, char separatore, int* num_importati) {
+    char* buffer = (char*)malloc(DIM_BUFFER_IMPORTAZIONE + 1);
+    Libro* blocco = (Libro*)malloc(LIBRI_PER_BLOCCO * sizeof(Libro));
+    if (buffer == NULL || blocco == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per l'importazione\n");
+        free(buffer);
+        free(blocco);
+        return 0;
+    }
+    
+    scrittura_inizia(bib);
+    int da = bib->num_libri;
+    int num_blocco = 0;
+    int num_duplicati = 0;
+    long num_riga = 0;
+    long righe_scartate = 0;
+    size_t usati = 0;
+    int ok = 1;
+    int fine_file = 0;
+    
+    while (ok && !fine_file) {
+        size_t letti = fread(buffer + usati, 1, DIM_BUFFER_IMPORTAZIONE - usati, file);
+        usati += letti;
+        if (letti == 0) {
+            fine_file = 1;
+            if (ferror(file)) {
+                fprintf(stderr, "Errore: lettura del file da importare non riuscita\n");
+                ok = 0;
+                break;
+            }
+            if (usati == 0) {
+                break;
+            }
+            buffer[usati++] = '\n';  // Ultima riga senza terminatore
+        }
+        
+        char* inizio = buffer;
+        char* limite = buffer + usati;
+        char* a_capo;
+        while (ok && (a_capo = (char*)memchr(inizio, '\n', (size_t)(limite - inizio))) != NULL) {
+            *a_capo = '\0';
+            if (a_capo > inizio && a_capo[-1] == '\r') {
+                a_capo[-1] = '\0';
+            }
+            num_riga++;
+            
+            if (*inizio != '\0') {
+                if (analizza_riga(inizio, separatore, &blocco[num_blocco])) {
+                    if (++num_blocco == LIBRI_PER_BLOCCO) {
+                        ok = importa_blocco(bib, blocco, num_blocco, &num_duplicati);
+                        num_blocco = 0;
+                    }
+                } else if (num_riga > 1) {  // La prima riga può essere l'intestazione
+                    righe_scartate++;
+                }
+            }
+            inizio = a_capo + 1;
+        }
+        
+        // Sposta la riga incompleta all'inizio del buffer
+        usati = (size_t)(limite - inizio);
+        if (usati == DIM_BUFFER_IMPORTAZIONE) {
+            fprintf(stderr, "Errore: riga %ld troppo lunga nel file da importare\n", num_riga + 1);
+            ok = 0;
+        }
+        memmove(buffer, inizio, usati);
+    }
+    
+    if (ok && num_blocco > 0) {
+        ok = importa_blocco(bib, blocco, num_blocco, &num_duplicati);
+    }
+    ok = termina_importazione(bib, da, ok);
+    
+    if (num_duplicati > 0) {
+        fprintf(stderr, "Attenzione: %d libri con ISBN duplicato ignorati\n", num_duplicati);
+    }
+    if (righe_scartate > 0) {
+        fprintf(stderr, "Attenzione: %ld righe non valide ignorate\n", righe_scartate);
+    }
+    if (num_importati != NULL) {
+        *num_importati = bib->num_libri - da;
+    }
+    scrittura_termina(bib);
+    
+    free(buffer);
+    free(blocco);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Storico dei prestiti
+// ---------------------------------------------------------------------------
+//
+// Ogni prestito viene accodato allo storico del libro come differenza dal
+// precedente, in blocchi a dimensione fissa che non vengono più riscritti.
+// Ogni blocco conosce l'intervallo di tempo che copre e il massimo della
+// catena che lo precede, quindi le interrogazioni su una finestra temporale
+// visitano solo i libri prestati almeno una volta, si fermano al primo blocco
+// interamente precedente alla finestra e contano senza decodificarli i
+// blocchi che vi sono interamente contenuti. Lo storico è usato solo da chi
+// modifica: in modalità concorrente le interrogazioni prendono il lock di
+// scrittura.
+
+static uint64_t zigzag(int64_t valore) {
+    return ((uint64_t)valore << 1) ^ (uint64_t)(valore >> 63);
+}
+
+static int64_t da_zigzag(uint64_t valore) {
+    return (int64_t)(valore >> 1) ^ -(int64_t)(valore & 1);
+}
+
+// Scrive un intero 7 bit per byte; restituisce i byte usati (al più 10)
+static int scrivi_varint(uint8_t* dest, uint64_t valore) {
+    int n = 0;
+    while (valore >= 0x80) {
+        dest[n++] = (uint8_t)(valore | 0x80);
+        valore >>= 7;
+    }
+    dest[n++] = (uint8_t)valore;
+    return n;
+}
+
+// Legge un varint avanzando *p; restituisce 0 se i dati finiscono prima
+static int leggi_varint(const uint8_t** p, const uint8_t* fine, uint64_t* valore) {
+    uint64_t risultato = 0;
+    for (int spostamento = 0; *p < fine && spostamento < 64; spostamento += 7) {
+        uint8_t byte = *(*p)++;
+        risultato |= (uint64_t)(byte & 0x7F) << spostamento;
+        if ((byte & 0x80) == 0) {
+            *valore = risultato;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Differenza tra due istanti; l'aritmetica senza segno evita l'overflow
+// e si inverte esattamente in istante_successivo
+static int64_t differenza_istanti(int64_t dopo, int64_t prima) {
+    return (int64_t)((uint64_t)dopo - (uint64_t)prima);
+}
+
+static int64_t istante_successivo(int64_t istante, uint64_t codifica) {
+    return (int64_t)((uint64_t)istante + (uint64_t)da_zigzag(codifica));
+}
+
+static void storico_libera(StoricoPrestiti* storico) {
+    free(storico->blocchi);
+    free(storico->ultimo_blocco);
+    free(storico->attivi);
+    memset(storico, 0, sizeof(StoricoPrestiti));
+}
+
+// Garantisce lo spazio per un nuovo blocco del libro in posizione pos
+static int storico_riserva(StoricoPrestiti* storico, int pos) {
+    if (storico->num_blocchi == storico->capacita_blocchi) {
+        int nuova_capacita = storico->capacita_blocchi > 0 ? storico->capacita_blocchi * 2 : 64;
+        BloccoStorico* temp = (BloccoStorico*)realloc(storico->blocchi,
+                                                      nuova_capacita * sizeof(BloccoStorico));
+        if (temp == NULL) {
+            fprintf(stderr, "Errore: impossibile allocare memoria per lo storico dei prestiti\n");
+            return 0;
+        }
+        storico->blocchi = temp;
+        storico->capacita_blocchi = nuova_capacita;
+    }
+    
+    if (pos >= storico->capacita_libri) {
+        int nuova_capacita = storico->capacita_libri > 0 ? storico->capacita_libri : 64;
+        while (nuova_capacita <= pos) {
+            nuova_capacita *= 2;
+        }
+        int32_t* temp = (int32_t*)realloc(storico->ultimo_blocco, nuova_capacita * sizeof(int32_t));
+        if (temp == NULL) {
+            fprintf(stderr, "Errore: impossibile allocare memoria per lo storico dei prestiti\n");
+            return 0;
+        }
+        for (int i = storico->capacita_libri; i < nuova_capacita; i++) {
+            temp[i] = -1;
+        }
+        storico->ultimo_blocco = temp;
+        storico->capacita_libri = nuova_capacita;
+    }
+    
+    if (storico->ultimo_blocco[pos] == -1 && storico->num_attivi == storico->capacita_attivi) {
+        int nuova_capacita = storico->capacita_attivi > 0 ? storico->capacita_attivi * 2 : 64;
+        int* temp = (int*)realloc(storico->attivi, nuova_capacita * sizeof(int));
+        if (temp == NULL) {
+            fprintf(stderr, "Errore: impossibile allocare memoria per lo storico dei prestiti\n");
+            return 0;
+        }
+        storico->attivi = temp;
+        storico->capacita_attivi = nuova_capacita;
+    }
+    return 1;
+}
+
+// Registra un prestito del libro in posizione pos
+static int storico_registra(StoricoPrestiti* storico, int pos, int64_t istante) {
+    int32_t ultimo = pos < storico->capacita_libri ? storico->ultimo_blocco[pos] : -1;
+    
+    // Se la differenza sta nel blocco più recente del libro basta accodarla
+    if (ultimo != -1) {
+        BloccoStorico* blocco = &storico->blocchi[ultimo];
+        uint8_t codifica[10];
+        int n = scrivi_varint(codifica, zigzag(differenza_istanti(istante, blocco->ultimo)));
+        if (blocco->usati + n <= DIM_DELTA_STORICO && blocco->num < UINT16_MAX) {
+            memcpy(blocco->delta + blocco->usati, codifica, n);
+            blocco->usati += n;
+            blocco->num++;
+            blocco->ultimo = istante;
+            if (istante < blocco->minimo) {
+                blocco->minimo = istante;
+            }
+            if (istante > blocco->massimo) {
+                blocco->massimo = istante;
+            }
+            if (istante > blocco->massimo_catena) {
+                blocco->massimo_catena = istante;
+            }
+            storico->num_prestiti++;
+            return 1;
+        }
+    }
+    
+    // Altrimenti si apre un nuovo blocco in testa alla catena del libro
+    if (!storico_riserva(storico, pos)) {
+        return 0;
+    }
+    BloccoStorico* blocco = &storico->blocchi[storico->num_blocchi];
+    blocco->primo = istante;
+    blocco->ultimo = istante;
+    blocco->minimo = istante;
+    blocco->massimo = istante;
+    blocco->massimo_catena = istante;
+    if (ultimo != -1 && storico->blocchi[ultimo].massimo_catena > istante) {
+        blocco->massimo_catena = storico->blocchi[ultimo].massimo_catena;
+    }
+    blocco->precedente = ultimo;
+    blocco->num = 1;
+    blocco->usati = 0;
+    
+    if (ultimo == -1) {
+        storico->attivi[storico->num_attivi++] = pos;
+    }
+    storico->ultimo_blocco[pos] = storico->num_blocchi++;
+    storico->num_prestiti++;
+    return 1;
+}
+
+// Prestiti di un blocco compresi tra da e a (inclusi)
+static int blocco_conta(const BloccoStorico* blocco, int64_t da, int64_t a) {
+    if (blocco->massimo < da || blocco->minimo > a) {
+        return 0;
+    }
+    if (blocco->minimo >= da && blocco->massimo <= a) {
+        return blocco->num;
+    }
+    
+    // Il blocco è a cavallo di un estremo: si decodificano le differenze
+    int conteggio = 0;
+    int64_t istante = blocco->primo;
+    const uint8_t* p = blocco->delta;
+    const uint8_t* fine = blocco->delta + blocco->usati;
+    for (int i = 0; i < blocco->num; i++) {
+        uint64_t codifica;
+        if (i > 0) {
+            if (!leggi_varint(&p, fine, &codifica)) {
+                break;
+            }
+            istante = istante_successivo(istante, codifica);
+        }
+        if (istante >= da && istante <= a) {
+            conteggio++;
+        }
+    }
+    return conteggio;
+}
+
+// Prestiti del libro in posizione pos compresi tra da e a
+static int storico_conta(const StoricoPrestiti* storico, int pos, int64_t da, int64_t a) {
+    if (pos >= storico->capacita_libri) {
+        return 0;
+    }
+    int conteggio = 0;
+    int32_t b = storico->ultimo_blocco[pos];
+    while (b != -1 && storico->blocchi[b].massimo_catena >= da) {
+        conteggio += blocco_conta(&storico->blocchi[b], da, a);
+        b = storico->blocchi[b].precedente;
+    }
+    return conteggio;
+}
+
+// Aggiorna lo storico dopo un riordino fisico: il libro ora in posizione i
+// era in posizione posizioni[i]. I blocchi non si spostano, cambia solo
+// l'associazione tra posizioni e catene.
+static int storico_permuta(StoricoPrestiti* storico, const int* posizioni, int num) {
+    if (storico->num_attivi == 0) {
+        return 1;
+    }
+    int32_t* ultimo_blocco = (int32_t*)malloc(num * sizeof(int32_t));
+    if (ultimo_blocco == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per lo storico dei prestiti\n");
+        return 0;
+    }
+    
+    storico->num_attivi = 0;
+    for (int i = 0; i < num; i++) {
+        int vecchia = posizioni[i];
+        ultimo_blocco[i] = vecchia < storico->capacita_libri ? storico->ultimo_blocco[vecchia] : -1;
+        if (ultimo_blocco[i] != -1) {
+            storico->attivi[storico->num_attivi++] = i;
+        }
+    }
+    free(storico->ultimo_blocco);
+    storico->ultimo_blocco = ultimo_blocco;
+    storico->capacita_libri = num;
+    return 1;
+}
+
+// Copia lo storico (per lo snapshot della compattazione); dest deve essere vuoto
+static int storico_copia(StoricoPrestiti* dest, const StoricoPrestiti* origine) {
+    memset(dest, 0, sizeof(StoricoPrestiti));
+    if (origine->num_attivi == 0) {
+        return 1;
+    }
+    dest->blocchi = (BloccoStorico*)malloc(origine->num_blocchi * sizeof(BloccoStorico));
+    dest->ultimo_blocco = (int32_t*)malloc(origine->capacita_libri * sizeof(int32_t));
+    dest->attivi = (int*)malloc(origine->num_attivi * sizeof(int));
+    if (dest->blocchi == NULL || dest->ultimo_blocco == NULL || dest->attivi == NULL) {
+        storico_libera(dest);
+        return 0;
+    }
+    memcpy(dest->blocchi, origine->blocchi, origine->num_blocchi * sizeof(BloccoStorico));
+    memcpy(dest->ultimo_blocco, origine->ultimo_blocco, origine->capacita_libri * sizeof(int32_t));
+    memcpy(dest->attivi, origine->attivi, origine->num_attivi * sizeof(int));
+    dest->num_blocchi = dest->capacita_blocchi = origine->num_blocchi;
+    dest->capacita_libri = origine->capacita_libri;
+    dest->num_attivi = dest->capacita_attivi = origine->num_attivi;
+    dest->num_prestiti = origine->num_prestiti;
+    return 1;
+}
+
+// Serializza lo storico nel formato della sezione dell'archivio: per ogni
+// libro posizione, numero di prestiti e istanti come differenze (il primo
+// rispetto a zero). Le differenze interne ai blocchi sono già codificate e
+// vengono copiate così come sono.
+static uint8_t* storico_serializza(const StoricoPrestiti* storico, size_t* dimensione) {
+    size_t massimo = (size_t)storico->num_attivi * 20;
+    int lunghezza_massima = 0;
+    for (int b = 0; b < storico->num_blocchi; b++) {
+        massimo += 10 + storico->blocchi[b].usati;
+    }
+    
+    uint8_t* dati = (uint8_t*)malloc(massimo > 0 ? massimo : 1);
+    int32_t* catena = NULL;
+    if (dati == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per lo storico dei prestiti\n");
+        return NULL;
+    }
+    
+    size_t usati = 0;
+    for (int i = 0; i < storico->num_attivi; i++) {
+        int pos = storico->attivi[i];
+        
+        // La catena va dal blocco più recente al più vecchio: la si raccoglie
+        // per scriverla in ordine cronologico
+        int lunghezza = 0;
+        uint64_t num_prestiti = 0;
+        for (int32_t b = storico->ultimo_blocco[pos]; b != -1; b = storico->blocchi[b].precedente) {
+            if (lunghezza == lunghezza_massima) {
+                lunghezza_massima = lunghezza_massima > 0 ? lunghezza_massima * 2 : 16;
+                int32_t* temp = (int32_t*)realloc(catena, lunghezza_massima * sizeof(int32_t));
+                if (temp == NULL) {
+                    fprintf(stderr, "Errore: impossibile allocare memoria per lo storico dei prestiti\n");
+                    free(catena);
+                    free(dati);
+                    return NULL;
+                }
+                catena = temp;
+            }
+            catena[lunghezza++] = b;
+            num_prestiti += storico->blocchi[b].num;
+        }
+        
+        usati += scrivi_varint(dati + usati, (uint64_t)pos);
+        usati += scrivi_varint(dati + usati, num_prestiti);
+        int64_t precedente = 0;
+        for (int k = lunghezza - 1; k >= 0; k--) {
+            const BloccoStorico* blocco = &storico->blocchi[catena[k]];
+            usati += scrivi_varint(dati + usati, zigzag(differenza_istanti(blocco->primo, precedente)));
+            memcpy(dati + usati, blocco->delta, blocco->usati);
+            usati += blocco->usati;
+            precedente = blocco->ultimo;
+        }
+    }
+    
+    free(catena);
+    *dimensione = usati;
+    return dati;
+}
+
+// Ricostruisce lo storico dalla sezione dell'archivio; le posizioni devono
+// riferirsi a uno dei num_libri libri caricati
+static int storico_deserializza(StoricoPrestiti* storico, const uint8_t* dati, size_t dimensione,
+                                uint64_t num_sezione, int num_libri) {
+    const uint8_t* p = dati;
+    const uint8_t* fine = dati + dimensione;
+    
+    for (uint64_t i = 0; i < num_sezione; i++) {
+        uint64_t pos, num_prestiti;
+        if (!leggi_varint(&p, fine, &pos) || !leggi_varint(&p, fine, &num_prestiti) ||
+            pos >= (uint64_t)num_libri || num_prestiti == 0 ||
+            (pos < (uint64_t)storico->capacita_libri && storico->ultimo_blocco[pos] != -1)) {
+            return 0;
+        }
+        int64_t istante = 0;
+        for (uint64_t k = 0; k < num_prestiti; k++) {
+            uint64_t codifica;
+            if (!leggi_varint(&p, fine, &codifica)) {
+                return 0;
+            }
+            istante = istante_successivo(istante, codifica);
+            if (!storico_registra(storico, (int)pos, istante)) {
+                return 0;
+            }
+        }
+    }
+    return p == fine;
+}
+
+// Numero di prestiti del libro con l'ISBN indicato tra da e a (inclusi),
+// -1 se il libro non esiste
+int conta_prestiti(Biblioteca* bib, const char* isbn, time_t da, time_t a) {
+    scrittura_inizia(bib);
+    Libro* libro = cerca_libro_per_isbn(bib, isbn);
+    int conteggio = -1;
+    if (libro != NULL) {
+        conteggio = storico_conta(&bib->storico, (int)(libro - bib->libri), (int64_t)da, (int64_t)a);
+    }
+    scrittura_termina(bib);
+    return conteggio;
+}
+
+// Ordine dei risultati: più prestiti prima, a parità posizione minore prima
+static int conteggio_precede(const ConteggioPrestiti* a, const ConteggioPrestiti* b) {
+    return a->prestiti > b->prestiti || (a->prestiti == b->prestiti && a->posizione < b->posizione);
+}
+
+static int confronta_conteggi(const void* a, const void* b) {
+    const ConteggioPrestiti* x = (const ConteggioPrestiti*)a;
+    const ConteggioPrestiti* y = (const ConteggioPrestiti*)b;
+    return conteggio_precede(x, y) ? -1 : conteggio_precede(y, x) ? 1 : 0;
+}
+
+// Heap con in cima il peggiore dei risultati tenuti: fa scendere l'elemento i
+static void heap_conteggi_scendi(ConteggioPrestiti* heap, int num, int i) {
+    for (;;) {
+        int peggiore = i;
+        int figli[2] = { 2 * i + 1, 2 * i + 2 };
+        for (int f = 0; f < 2; f++) {
+            if (figli[f] < num && conteggio_precede(&heap[peggiore], &heap[figli[f]])) {
+                peggiore = figli[f];
+            }
+        }
+        if (peggiore == i) {
+            return;
+        }
+        ConteggioPrestiti temp = heap[i];
+        heap[i] = heap[peggiore];
+        heap[peggiore] = temp;
+        i = peggiore;
+    }
+}
+
+static void heap_conteggi_sali(ConteggioPrestiti* heap, int i) {
+    while (i > 0 && conteggio_precede(&heap[(i - 1) / 2], &heap[i])) {
+        ConteggioPrestiti temp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = temp;
+        i = (i - 1) / 2;
+    }
+}
+
+// I k libri più prestati tra da e a (inclusi), in ordine decrescente di
+// prestiti. risultati deve avere spazio per k elementi; restituisce il
+// numero di risultati, minore di k se i libri prestati sono meno di k.
+int libri_piu_prestati(Biblioteca* bib, time_t da, time_t a, int k, ConteggioPrestiti* risultati) {
+    if (k <= 0) {
+        return 0;
+    }
+    
+    scrittura_inizia(bib);
+    const StoricoPrestiti* storico = &bib->storico;
+    int num = 0;
+    for (int i = 0; i < storico->num_attivi; i++) {
+        ConteggioPrestiti conteggio;
+        conteggio.posizione = storico->attivi[i];
+        conteggio.prestiti = storico_conta(storico, conteggio.posizione, (int64_t)da, (int64_t)a);
+        if (conteggio.prestiti == 0) {
+            continue;
+        }
+        if (num < k) {
+            risultati[num] = conteggio;
+            heap_conteggi_sali(risultati, num++);
+        } else if (conteggio_precede(&conteggio, &risultati[0])) {
+            risultati[0] = conteggio;
+            heap_conteggi_scendi(risultati, num, 0);
+        }
+    }
+    scrittura_termina(bib);
+    
+    qsort(risultati, num, sizeof(ConteggioPrestiti), confronta_conteggi);
+    return num;
+}
+
+static int confronta_utilizzo(const void* a, const void* b) {
+    int x = ((const UtilizzoAnno*)a)->anno;
+    int y = ((const UtilizzoAnno*)b)->anno;
+    return (x > y) - (x < y);
+}
+
+// Utilizzo del catalogo per anno di pubblicazione tra da e a (inclusi): per
+// ogni anno con almeno un prestito, libri pubblicati, libri prestati e numero
+// di prestiti. Restituisce un array ordinato per anno (da liberare con free),
+// NULL se nel periodo non ci sono prestiti.
+UtilizzoAnno* utilizzo_per_anno(Biblioteca* bib, time_t da, time_t a, int* num_anni) {
+    *num_anni = 0;
+    scrittura_inizia(bib);
+    const StoricoPrestiti* storico = &bib->storico;
+    if (storico->num_attivi == 0) {
+        scrittura_termina(bib);
+        return NULL;
+    }
+    
+    UtilizzoAnno* utilizzo = (UtilizzoAnno*)malloc(storico->num_attivi * sizeof(UtilizzoAnno));
+    if (utilizzo == NULL) {
+        scrittura_termina(bib);
+        fprintf(stderr, "Errore: impossibile allocare memoria per le statistiche\n");
+        return NULL;
+    }
+    
+    // Un elemento per libro prestato, poi accorpati per anno
+    int num = 0;
+    for (int i = 0; i < storico->num_attivi; i++) {
+        int pos = storico->attivi[i];
+        int prestiti = storico_conta(storico, pos, (int64_t)da, (int64_t)a);
+        if (prestiti > 0) {
+            utilizzo[num].anno = bib->libri[pos].anno_pubblicazione;
+            utilizzo[num].libri = 0;
+            utilizzo[num].libri_prestati = 1;
+            utilizzo[num].prestiti = prestiti;
+            num++;
+        }
+    }
+    qsort(utilizzo, num, sizeof(UtilizzoAnno), confronta_utilizzo);
+    
+    int anni = 0;
+    for (int i = 0; i < num; i++) {
+        if (anni > 0 && utilizzo[anni - 1].anno == utilizzo[i].anno) {
+            utilizzo[anni - 1].libri_prestati++;
+            utilizzo[anni - 1].prestiti += utilizzo[i].prestiti;
+        } else {
+            utilizzo[anni++] = utilizzo[i];
+        }
+    }
+    
+    // I libri pubblicati in ogni anno si ricavano dall'indice per anno
+    // con due ricerche binarie, senza scorrere il catalogo
+    int num_ordinati;
+    const int* ordinati = vista_ordinata(bib, CHIAVE_ANNO, &num_ordinati);
+    for (int i = 0; ordinati != NULL && i < anni; i++) {
+        int limiti[2];
+        limiti_anni(bib->libri, ordinati, num_ordinati, utilizzo[i].anno, utilizzo[i].anno, limiti);
+        utilizzo[i].libri = limiti[1] - limiti[0];
+    }
+    scrittura_termina(bib);
+    
+    if (anni == 0 || ordinati == NULL) {
+        free(utilizzo);
+        return NULL;
+    }
+    *num_anni = anni;
+    return utilizzo;
+}
+
+// ---------------------------------------------------------------------------
+// Ordinamento parallelo: radix sort su coppie (prefisso della chiave, posizione)
+// ---------------------------------------------------------------------------
+
+int numero_processori() {
+#ifdef _SC_NPROCESSORS_ONLN
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+#else
+    return 1;
+#endif
+}
+
+// Prefisso ordinabile della chiave a partire dal carattere 'profondita': per
+// le stringhe 8 byte in ordine big-endian (confrontare i prefissi come interi
+// equivale a strcmp su quegli 8 caratteri), per l'anno il valore con il bit
+// di segno invertito
+static uint64_t prefisso_chiave(const Libro* libro, ChiaveOrdinamento chiave, size_t profondita) {
+    if (chiave == CHIAVE_ANNO) {
+        return (uint32_t)libro->anno_pubblicazione ^ 0x80000000u;
+    }
+    
+    const char* s = (chiave == CHIAVE_TITOLO ? libro->titolo : libro->autore) + profondita;
+    uint64_t prefisso = 0;
+    int k = 0;
+    for (; k < 8 && s[k] != '\0'; k++) {
+        prefisso = (prefisso << 8) | (unsigned char)s[k];
+    }
+    // Con la chiave esaurita (k == 0) lo spostamento di 64 bit non è definito
+    return k > 0 ? prefisso << (8 * (8 - k)) : 0;
+}
+
+static int confronta_coppie(const Biblioteca* bib, ChiaveOrdinamento chiave,
+                            const CoppiaOrdinamento* a, const CoppiaOrdinamento* b) {
+    if (a->prefisso != b->prefisso) {
+        return a->prefisso < b->prefisso ? -1 : 1;
+    }
+    return confronta_per_chiave(bib, chiave, a->indice, b->indice);
+}
+
+// Merge sort per i gruppi che il radix non separa (prefissi uguali)
+static void ordina_coppie_confronto(const Biblioteca* bib, ChiaveOrdinamento chiave,
+                                    CoppiaOrdinamento* coppie, CoppiaOrdinamento* appoggio, size_t num) {
+    if (num <= 16) {
+        for (size_t i = 1; i < num; i++) {
+            CoppiaOrdinamento corrente = coppie[i];
+            size_t j = i;
+            while (j > 0 && confronta_coppie(bib, chiave, &coppie[j - 1], &corrente) > 0) {
+                coppie[j] = coppie[j - 1];
+                j--;
+            }
+            coppie[j] = corrente;
+        }
+        return;
+    }
+    
+    size_t meta = num / 2;
+    ordina_coppie_confronto(bib, chiave, coppie, appoggio, meta);
+    ordina_coppie_confronto(bib, chiave, coppie + meta, appoggio, num - meta);
+    
+    size_t i = 0, j = meta, k = 0;
+    while (i < meta && j < num) {
+        if (confronta_coppie(bib, chiave, &coppie[i], &coppie[j]) <= 0) {
+            appoggio[k++] = coppie[i++];
+        } else {
+            appoggio[k++] = coppie[j++];
+        }
+    }
+    while (i < meta) appoggio[k++] = coppie[i++];
+    while (j < num) appoggio[k++] = coppie[j++];
+    memcpy(coppie, appoggio, num * sizeof(CoppiaOrdinamento));
+}
+
+// Byte 'byte' del prefisso, contando da quello più significativo
+static unsigned cifra(uint64_t prefisso, int byte) {
+    return (unsigned)(prefisso >> (8 * (7 - byte))) & 0xFF;
+}
+
+// MSD radix sort sequenziale di un intervallo, un byte del prefisso per livello.
+// Quando gli 8 byte del prefisso sono esauriti il gruppo, che ha in comune i
+// primi profondita + 8 caratteri, viene ricaricato con gli 8 successivi.
+// I gruppi piccoli passano al confronto completo.
+static void msd_ordina(const Biblioteca* bib, ChiaveOrdinamento chiave,
+                       CoppiaOrdinamento* coppie, CoppiaOrdinamento* appoggio, size_t num,
+                       int byte, size_t profondita) {
+    while (num > SOGLIA_RADIX) {
+        if (byte == 8) {
+            size_t limite = chiave == CHIAVE_TITOLO ? MAX_TITOLO : MAX_AUTORE;
+            if (chiave == CHIAVE_ANNO || profondita + 8 >= limite) {
+                break;
+            }
+            profondita += 8;
+            for (size_t i = 0; i < num; i++) {
+                coppie[i].prefisso = prefisso_chiave(&(bib->libri[coppie[i].indice]), chiave, profondita);
+            }
+            byte = 0;
+        }
+        
+        size_t conteggi[256] = {0};
+        for (size_t i = 0; i < num; i++) {
+            conteggi[cifra(coppie[i].prefisso, byte)]++;
+        }
+        
+        // Tutti nello stesso gruppo: si passa direttamente al byte successivo
+        if (conteggi[cifra(coppie[0].prefisso, byte)] == num) {
+            byte++;
+            continue;
+        }
+        
+        size_t inizi[256];
+        size_t somma = 0;
+        for (int d = 0; d < 256; d++) {
+            inizi[d] = somma;
+            somma += conteggi[d];
+        }
+        size_t posizioni[256];
+        memcpy(posizioni, inizi, sizeof(inizi));
+        for (size_t i = 0; i < num; i++) {
+            appoggio[posizioni[cifra(coppie[i].prefisso, byte)]++] = coppie[i];
+        }
+        memcpy(coppie, appoggio, num * sizeof(CoppiaOrdinamento));
+        
+        // Il byte 0 indica la fine della stringa: quel gruppo ha chiavi uguali
+        ordina_coppie_confronto(bib, chiave, coppie, appoggio, conteggi[0]);
+        for (int d = 1; d < 256; d++) {
+            msd_ordina(bib, chiave, coppie + inizi[d], appoggio + inizi[d], conteggi[d],
+                       byte + 1, profondita);
+        }
+        return;
+    }
+    ordina_coppie_confronto(bib, chiave, coppie, appoggio, num);
+}
+
+// Lavoro assegnato a un thread in una fase dell'ordinamento
+typedef struct {
+    Biblioteca* bib;
+    ChiaveOrdinamento chiave;
+    CoppiaOrdinamento* sorgente;
+    CoppiaOrdinamento* destinazione;
+    int* posizioni;
+    Libro* libri_ordinati;
+    size_t inizio;              // Porzione dell'input gestita dal thread
+    size_t fine;
+    int byte;                   // Byte del prefisso esaminato nella passata
+    size_t conteggi[256];       // Istogramma della porzione
+    size_t offset[256];         // Prima destinazione di ogni cifra per la porzione
+    const size_t* confini;      // Inizio di ogni gruppo dopo la prima passata MSD
+    atomic_int* prossimo_gruppo;
+} CompitoOrdinamento;
+
+// Esegue la stessa funzione su tutti i compiti, uno per thread
+static void esegui_in_parallelo(void* (*funzione)(void*), CompitoOrdinamento* compiti, int num_thread) {
+    pthread_t thread[MAX_THREAD_ORDINAMENTO];
+    int creato[MAX_THREAD_ORDINAMENTO] = {0};
+    
+    for (int t = 1; t < num_thread; t++) {
+        creato[t] = pthread_create(&thread[t], NULL, funzione, &compiti[t]) == 0;
+        if (!creato[t]) {
+            funzione(&compiti[t]);  // Se il thread non parte, il lavoro si fa qui
+        }
+    }
+    funzione(&compiti[0]);
+    for (int t = 1; t < num_thread; t++) {
+        if (creato[t]) {
+            pthread_join(thread[t], NULL);
+        }
+    }
+}
+
+static void* compito_prepara_coppie(void* arg) {
+    CompitoOrdinamento* c = (CompitoOrdinamento*)arg;
+    for (size_t i = c->inizio; i < c->fine; i++) {
+        c->sorgente[i].prefisso = prefisso_chiave(&(c->bib->libri[c->posizioni[i]]), c->chiave, 0);
+        c->sorgente[i].indice = c->posizioni[i];
+    }
+    return NULL;
+}
+
+static void* compito_istogramma(void* arg) {
+    CompitoOrdinamento* c = (CompitoOrdinamento*)arg;
+    memset(c->conteggi, 0, sizeof(c->conteggi));
+    for (size_t i = c->inizio; i < c->fine; i++) {
+        c->conteggi[cifra(c->sorgente[i].prefisso, c->byte)]++;
+    }
+    return NULL;
+}
+
+static void* compito_distribuisci(void* arg) {
+    CompitoOrdinamento* c = (CompitoOrdinamento*)arg;
+    for (size_t i = c->inizio; i < c->fine; i++) {
+        c->destinazione[c->offset[cifra(c->sorgente[i].prefisso, c->byte)]++] = c->sorgente[i];
+    }
+    return NULL;
+}
+
+// I gruppi della prima passata MSD vengono presi dai thread man mano che si liberano
+static void* compito_ordina_gruppi(void* arg) {
+    CompitoOrdinamento* c = (CompitoOrdinamento*)arg;
+    int d;
+    while ((d = atomic_fetch_add(c->prossimo_gruppo, 1)) < 256) {
+        size_t inizio = c->confini[d];
+        size_t num = c->confini[d + 1] - inizio;
+        if (d == 0) {
+            ordina_coppie_confronto(c->bib, c->chiave, c->destinazione + inizio, c->sorgente + inizio, num);
+        } else {
+            msd_ordina(c->bib, c->chiave, c->destinazione + inizio, c->sorgente + inizio, num,
+                       c->byte + 1, 0);
+        }
+    }
+    return NULL;
+}
+
+static void* compito_estrai_posizioni(void* arg) {
+    CompitoOrdinamento* c = (CompitoOrdinamento*)arg;
+    for (size_t i = c->inizio; i < c->fine; i++) {
+        c->posizioni[i] = c->sorgente[i].indice;
+    }
+    return NULL;
+}
+
+static void* compito_permuta(void* arg) {
+    CompitoOrdinamento* c = (CompitoOrdinamento*)arg;
+    for (size_t i = c->inizio; i < c->fine; i++) {
+        c->libri_ordinati[i] = c->bib->libri[c->posizioni[i]];
+    }
+    return NULL;
+}
+
+// Una passata di distribuzione parallela sul byte indicato, da sorgente a
+// destinazione: ogni thread conta le cifre della sua porzione, poi le somme
+// prefisse (per cifra e, a parità di cifra, per thread) danno a ciascuno una
+// zona di scrittura riservata, così la distribuzione è stabile e senza lock.
+// Restituisce 0 se tutte le chiavi hanno la stessa cifra (passata inutile).
+static int passata_parallela(CompitoOrdinamento* compiti, int num_thread, int byte, size_t* confini) {
+    for (int t = 0; t < num_thread; t++) {
+        compiti[t].byte = byte;
+    }
+    esegui_in_parallelo(compito_istogramma, compiti, num_thread);
+    
+    size_t somma = 0;
+    size_t totale = compiti[num_thread - 1].fine;
+    for (int d = 0; d < 256; d++) {
+        if (confini != NULL) {
+            confini[d] = somma;
+        }
+        size_t inizio_cifra = somma;
+        for (int t = 0; t < num_thread; t++) {
+            compiti[t].offset[d] = somma;
+            somma += compiti[t].conteggi[d];
+        }
+        if (somma - inizio_cifra == totale) {
+            return 0;
+        }
+    }
+    if (confini != NULL) {
+        confini[256] = somma;
+    }
+    
+    esegui_in_parallelo(compito_distribuisci, compiti, num_thread);
+    return 1;
+}
+
+static void scambia_buffer(CompitoOrdinamento* compiti, int num_thread) {
+    for (int t = 0; t < num_thread; t++) {
+        CoppiaOrdinamento* temp = compiti[t].sorgente;
+        compiti[t].sorgente = compiti[t].destinazione;
+        compiti[t].destinazione = temp;
+    }
+}
+
+// Ordina le posizioni indicate secondo la chiave usando num_thread thread
+// (0 = tutti i processori disponibili). Per l'anno si usa un LSD radix sort
+// sui 4 byte della chiave; per titolo e autore un MSD radix sort sui primi
+// 8 byte, con prima passata parallela e gruppi risultanti distribuiti tra i
+// thread. A parità di chiave resta l'ordine di ingresso, quindi con posizioni
+// crescenti il risultato coincide con quello di confronta_per_chiave.
+int ordina_posizioni_parallelo(Biblioteca* bib, ChiaveOrdinamento chiave,
+                               int* posizioni, int num, int num_thread) {
+    if (num_thread <= 0) {
+        num_thread = numero_processori();
+    }
+    if (num_thread > MAX_THREAD_ORDINAMENTO) {
+        num_thread = MAX_THREAD_ORDINAMENTO;
+    }
+    if (num < 2) {
+        return 1;
+    }
+    if (num_thread > num) {
+        num_thread = 1;
+    }
+    
+    CoppiaOrdinamento* a = (CoppiaOrdinamento*)malloc((size_t)num * sizeof(CoppiaOrdinamento));
+    CoppiaOrdinamento* b = (CoppiaOrdinamento*)malloc((size_t)num * sizeof(CoppiaOrdinamento));
+    if (a == NULL || b == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per l'ordinamento\n");
+        free(a);
+        free(b);
+        return 0;
+    }
+    
+    CompitoOrdinamento compiti[MAX_THREAD_ORDINAMENTO];
+    atomic_int prossimo_gruppo;
+    size_t confini[257];
+    atomic_init(&prossimo_gruppo, 0);
+    
+    for (int t = 0; t < num_thread; t++) {
+        CompitoOrdinamento* c = &compiti[t];
+        memset(c, 0, sizeof(CompitoOrdinamento));
+        c->bib = bib;
+        c->chiave = chiave;
+        c->sorgente = a;
+        c->destinazione = b;
+        c->posizioni = posizioni;
+        c->inizio = (size_t)num * t / num_thread;
+        c->fine = (size_t)num * (t + 1) / num_thread;
+        c->confini = confini;
+        c->prossimo_gruppo = &prossimo_gruppo;
+    }
+    
+    esegui_in_parallelo(compito_prepara_coppie, compiti, num_thread);
+    
+    if (chiave == CHIAVE_ANNO) {
+        // LSD: dal byte meno significativo dei 4 usati dall'anno
+        for (int byte = 7; byte >= 4; byte--) {
+            if (passata_parallela(compiti, num_thread, byte, NULL)) {
+                scambia_buffer(compiti, num_thread);
+            }
+        }
+    } else {
+        // MSD: la prima passata che separa le chiavi è fatta in parallelo,
+        // poi ogni gruppo risultante è ordinato da un solo thread
+        int byte = 0;
+        while (byte < 8 && !passata_parallela(compiti, num_thread, byte, confini)) {
+            byte++;
+        }
+        if (byte < 8) {
+            esegui_in_parallelo(compito_ordina_gruppi, compiti, num_thread);
+            scambia_buffer(compiti, num_thread);
+        } else {
+            // Tutti i prefissi sono uguali
+            ordina_coppie_confronto(bib, chiave, compiti[0].sorgente, compiti[0].destinazione, (size_t)num);
+        }
+    }
+    
+    esegui_in_parallelo(compito_estrai_posizioni, compiti, num_thread);
+    free(a);
+    free(b);
+    return 1;
+}
+
+// Riordina fisicamente l'array dei libri secondo la chiave, per esempio prima
+// di un salvataggio o di una scansione sequenziale in quell'ordine. Si ordinano
+// solo le coppie (prefisso, posizione) e i record vengono spostati una sola
+// volta, copiandoli in parallelo nel nuovo array. In modalità concorrente i
+// lettori vengono esclusi solo per lo scambio dell'array e la ricostruzione
+// degli indici.
+int ordina_fisicamente(Biblioteca* bib, ChiaveOrdinamento chiave, int num_thread) {
+    scrittura_inizia(bib);
+    int ok = riordina_libri(bib, chiave, num_thread);
+    scrittura_termina(bib);
+    return ok;
+}
+
+static int riordina_libri(Biblioteca* bib, ChiaveOrdinamento chiave, int num_thread) {
+    int num = bib->num_libri;
+    int* posizioni = (int*)malloc((num > 0 ? num : 1) * sizeof(int));
+    Libro* libri_ordinati = (Libro*)malloc((bib->capacita > 0 ? bib->capacita : 1) * sizeof(Libro));
+    if (posizioni == NULL || libri_ordinati == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per l'ordinamento\n");
+        free(posizioni);
+        free(libri_ordinati);
+        return 0;
+    }
+    
+    for (int i = 0; i < num; i++) {
+        posizioni[i] = i;
+    }
+    if (!ordina_posizioni_parallelo(bib, chiave, posizioni, num, num_thread)) {
+        free(posizioni);
+        free(libri_ordinati);
+        return 0;
+    }
+    
+    if (num_thread <= 0) {
+        num_thread = numero_processori();
+    }
+    if (num_thread > MAX_THREAD_ORDINAMENTO) {
+        num_thread = MAX_THREAD_ORDINAMENTO;
+    }
+    if (num_thread > num) {
+        num_thread = 1;
+    }
+    
+    CompitoOrdinamento compiti[MAX_THREAD_ORDINAMENTO];
+    for (int t = 0; t < num_thread; t++) {
+        memset(&compiti[t], 0, sizeof(CompitoOrdinamento));
+        compiti[t].bib = bib;
+        compiti[t].posizioni = posizioni;
+        compiti[t].libri_ordinati = libri_ordinati;
+        compiti[t].inizio = (size_t)num * t / num_thread;
+        compiti[t].fine = (size_t)num * (t + 1) / num_thread;
+    }
+    esegui_in_parallelo(compito_permuta, compiti, num_thread);
+    
+    if (!storico_permuta(&bib->storico, posizioni, num)) {
+        free(posizioni);
+        free(libri_ordinati);
+        return 0;
+    }
+    free(posizioni);
+    esclusiva_inizia(bib);
+    free(bib->libri);
+    bib->libri = libri_ordinati;
+    int ok = ricostruisci_indici(bib);
+    esclusiva_termina(bib);
+    return ok;
+}
+
+// Tabella per il CRC-32 (polinomio IEEE 802.3), calcolata al primo utilizzo
+static uint32_t tabella_crc32[256];
+static int tabella_crc32_pronta = 0;
+
+static uint32_t aggiorna_crc32(uint32_t crc, const void* dati, size_t lunghezza) {
+    const unsigned char* p = (const unsigned char*)dati;
+    
+    if (!tabella_crc32_pronta) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            tabella_crc32[i] = c;
+        }
+        tabella_crc32_pronta = 1;
+    }
+    
+    crc = ~crc;
+    while (lunghezza-- > 0) {
+        crc = tabella_crc32[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// Arrotonda un offset al prossimo multiplo di ALLINEAMENTO_SEZIONI
+static uint64_t allinea(uint64_t offset) {
+    return (offset + ALLINEAMENTO_SEZIONI - 1) & ~(uint64_t)(ALLINEAMENTO_SEZIONI - 1);
+}
+
+// Scrive dati nel file aggiornando il checksum
+static int scrivi_con_crc(FILE* file, const void* dati, size_t lunghezza, uint32_t* crc) {
+    *crc = aggiorna_crc32(*crc, dati, lunghezza);
+    return fwrite(dati, 1, lunghezza, file) == lunghezza;
+}
+
+// Scrive zeri fino a raggiungere l'offset indicato
+static int scrivi_riempimento(FILE* file, uint64_t* posizione, uint64_t destinazione, uint32_t* crc) {
+    static const char zeri[ALLINEAMENTO_SEZIONI] = {0};
+    size_t mancanti = (size_t)(destinazione - *posizione);
+    *posizione = destinazione;
+    return scrivi_con_crc(file, zeri, mancanti, crc);
+}
+
+// Salva la biblioteca nel formato versionato. Il file viene scritto con un
+// nome temporaneo e poi rinominato, così un'interruzione a metà salvataggio
+// non lascia mai un archivio troncato al posto di quello precedente.
+int salva_biblioteca(const Biblioteca* bib, const char* filename) {
+    char nome_temporaneo[FILENAME_MAX];
+    snprintf(nome_temporaneo, sizeof(nome_temporaneo), "%s.tmp", filename);
+    
+    FILE* file = fopen(nome_temporaneo, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "Errore: impossibile aprire il file %s per la scrittura\n", nome_temporaneo);
+        return 0;
+    }
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+    
+    // Con il journal aperto lo stato in memoria comprende tutte le operazioni
+    // registrate, mentre bib->sequenza è ferma all'ultimo caricamento: lo
+    // snapshot deve riportare il numero dell'ultima operazione registrata,
+    // altrimenti al riavvio verrebbero riapplicate operazioni già incluse
+    uint64_t sequenza = bib->sequenza;
+    if (bib->journal != NULL) {
+        pthread_mutex_lock(&bib->journal->mutex);
+        sequenza = bib->journal->sequenza;
+        pthread_mutex_unlock(&bib->journal->mutex);
+    }
+    
+    // Calcola la disposizione delle sezioni
+    IntestazioneArchivio intestazione;
+    memset(&intestazione, 0, sizeof(intestazione));
+    memcpy(intestazione.magic, MAGIC_ARCHIVIO, sizeof(intestazione.magic));
+    intestazione.versione = VERSIONE_ARCHIVIO;
+    intestazione.dim_intestazione = sizeof(IntestazioneArchivio);
+    intestazione.num_libri = (uint64_t)bib->num_libri;
+    intestazione.sequenza_journal = sequenza;
+    intestazione.capacita_indice = (uint64_t)bib->capacita_indice;
+    intestazione.off_record = allinea(sizeof(IntestazioneArchivio));
+    intestazione.off_indice = allinea(intestazione.off_record +
+                                      intestazione.num_libri * sizeof(RecordArchivio));
+    intestazione.off_stringhe = allinea(intestazione.off_indice +
+                                        intestazione.capacita_indice * sizeof(SlotIsbn));
+    
+    uint64_t posizione = sizeof(IntestazioneArchivio);
+    uint32_t crc = 0;
+    int ok = fwrite(&intestazione, sizeof(intestazione), 1, file) == 1;  // Segnaposto
+    
+    // Record a dimensione fissa: le stringhe di ogni libro sono memorizzate
+    // consecutivamente (titolo, autore, ISBN) nel blocco delle stringhe
+    ok = ok && scrivi_riempimento(file, &posizione, intestazione.off_record, &crc);
+    uint64_t dim_stringhe = 0;
+    for (int i = 0; ok && i < bib->num_libri; i++) {
+        const Libro* libro = &(bib->libri[i]);
+        RecordArchivio record;
+        memset(&record, 0, sizeof(record));
+        record.data_prestito = (int64_t)libro->data_prestito;
+        record.off_stringhe = dim_stringhe;
+        record.anno_pubblicazione = libro->anno_pubblicazione;
+        record.disponibile = libro->disponibile;
+        ok = scrivi_con_crc(file, &record, sizeof(record), &crc);
+        dim_stringhe += strlen(libro->titolo) + strlen(libro->autore) + strlen(libro->isbn) + 3;
+    }
+    posizione += intestazione.num_libri * sizeof(RecordArchivio);
+    
+    // L'indice ISBN viene salvato così com'è: all'apertura è subito utilizzabile
+    ok = ok && scrivi_riempimento(file, &posizione, intestazione.off_indice, &crc);
+    ok = ok && scrivi_con_crc(file, bib->indice_isbn,
+                              intestazione.capacita_indice * sizeof(SlotIsbn), &crc);
+    posizione += intestazione.capacita_indice * sizeof(SlotIsbn);
+    
+    ok = ok && scrivi_riempimento(file, &posizione, intestazione.off_stringhe, &crc);
+    for (int i = 0; ok && i < bib->num_libri; i++) {
+        const Libro* libro = &(bib->libri[i]);
+        ok = scrivi_con_crc(file, libro->titolo, strlen(libro->titolo) + 1, &crc) &&
+             scrivi_con_crc(file, libro->autore, strlen(libro->autore) + 1, &crc) &&
+             scrivi_con_crc(file, libro->isbn, strlen(libro->isbn) + 1, &crc);
+    }
+    posizione = intestazione.off_stringhe + dim_stringhe;
+    
+    // Lo storico dei prestiti segue le stringhe con un proprio checksum,
+    // quindi il riempimento non entra in checksum_dati
+    if (ok && bib->storico.num_attivi > 0) {
+        IntestazioneStorico sezione;
+        memset(&sezione, 0, sizeof(sezione));
+        size_t dim_storico = 0;
+        uint8_t* dati_storico = storico_serializza(&bib->storico, &dim_storico);
+        uint32_t crc_riempimento = 0;
+        
+        sezione.dimensione = dim_storico;
+        sezione.num_libri = (uint64_t)bib->storico.num_attivi;
+        sezione.num_prestiti = (uint64_t)bib->storico.num_prestiti;
+        intestazione.off_storico = allinea(posizione);
+        ok = dati_storico != NULL &&
+             scrivi_riempimento(file, &posizione, intestazione.off_storico, &crc_riempimento);
+        if (ok) {
+            sezione.checksum = aggiorna_crc32(0, dati_storico, dim_storico);
+            ok = fwrite(&sezione, sizeof(sezione), 1, file) == 1 &&
+                 fwrite(dati_storico, 1, dim_storico, file) == dim_storico;
+        }
+        free(dati_storico);
+    }
+    
+    // Completa l'intestazione e sovrascrivi il segnaposto
+    intestazione.dim_stringhe = dim_stringhe;
+    intestazione.checksum_dati = crc;
+    intestazione.checksum_intestazione = aggiorna_crc32(0, &intestazione, sizeof(intestazione));
+    ok = ok && fseek(file, 0, SEEK_SET) == 0;
+    ok = ok && fwrite(&intestazione, sizeof(intestazione), 1, file) == 1;
+    ok = ok && fflush(file) == 0;
+#ifndef _WIN32
+    ok = ok && fsync(fileno(file)) == 0;
+#endif
+    
+    if (fclose(file) != 0 || !ok) {
+        fprintf(stderr, "Errore: impossibile scrivere il file %s\n", nome_temporaneo);
+        remove(nome_temporaneo);
+        return 0;
+    }
+    
+#ifdef _WIN32
+    remove(filename);  // Su Windows rename non sovrascrive un file esistente
+#endif
+    if (rename(nome_temporaneo, filename) != 0) {
+        fprintf(stderr, "Errore: impossibile sostituire il file %s\n", filename);
+        remove(nome_temporaneo);
+        return 0;
+    }
+    return 1;
+}
+
+// Controlla che una sezione [offset, offset + dimensione) stia nel file
+static int sezione_valida(uint64_t offset, uint64_t num, uint64_t dim_elemento, uint64_t dim_file) {
+    if (offset > dim_file || (num != 0 && dim_elemento > (dim_file - offset) / num)) {
+        return 0;
+    }
+    return 1;
+}
+
+// Apre un archivio mappandolo in memoria. Vengono controllati solo
+// l'intestazione e i limiti delle sezioni: i dati restano su disco e il
+// sistema operativo carica le pagine solo quando vengono lette, quindi il
+// catalogo è interrogabile subito, con archivio_cerca_per_isbn e
+// archivio_leggi_libro, anche se il file è molto grande. Questo vale solo
+// per chi usa l'archivio direttamente: carica_biblioteca lo legge tutto.
+// Restituisce 1 se l'archivio è valido, 0 se il file non esiste o non è
+// nel formato versionato (per esempio un file nel formato precedente).
+int apri_archivio(Archivio* arch, const char* filename) {
+    memset(arch, 0, sizeof(Archivio));
+    
+#ifdef _WIN32
+    // Senza mmap il file viene letto interamente in memoria
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    fseek(file, 0, SEEK_END);
+    long dimensione = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (dimensione < (long)sizeof(IntestazioneArchivio)) {
+        fclose(file);
+        return 0;
+    }
+    arch->mappa = malloc((size_t)dimensione);
+    if (arch->mappa == NULL || fread(arch->mappa, 1, (size_t)dimensione, file) != (size_t)dimensione) {
+        free(arch->mappa);
+        arch->mappa = NULL;
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    arch->dimensione = (size_t)dimensione;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(IntestazioneArchivio)) {
+        close(fd);
+        return 0;
+    }
+    void* mappa = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);  // La mappatura resta valida anche dopo la chiusura
+    if (mappa == MAP_FAILED) {
+        return 0;
+    }
+    arch->mappa = mappa;
+    arch->dimensione = (size_t)info.st_size;
+#endif
+    
+    const IntestazioneArchivio* intestazione = (const IntestazioneArchivio*)arch->mappa;
+    IntestazioneArchivio copia = *intestazione;
+    copia.checksum_intestazione = 0;
+    
+    uint64_t dim_file = arch->dimensione;
+    if (memcmp(intestazione->magic, MAGIC_ARCHIVIO, sizeof(intestazione->magic)) != 0 ||
+        intestazione->versione != VERSIONE_ARCHIVIO ||
+        intestazione->dim_intestazione != sizeof(IntestazioneArchivio) ||
+        aggiorna_crc32(0, &copia, sizeof(copia)) != intestazione->checksum_intestazione ||
+        intestazione->num_libri > (uint64_t)INT32_MAX ||
+        (intestazione->capacita_indice & (intestazione->capacita_indice - 1)) != 0 ||
+        intestazione->capacita_indice < 2 * intestazione->num_libri ||
+        !sezione_valida(intestazione->off_record, intestazione->num_libri, sizeof(RecordArchivio), dim_file) ||
+        !sezione_valida(intestazione->off_indice, intestazione->capacita_indice, sizeof(SlotIsbn), dim_file) ||
+        !sezione_valida(intestazione->off_stringhe, intestazione->dim_stringhe, 1, dim_file) ||
+        (intestazione->dim_stringhe > 0 &&
+         ((const char*)arch->mappa)[intestazione->off_stringhe + intestazione->dim_stringhe - 1] != '\0')) {
+        chiudi_archivio(arch);
+        return 0;
+    }
+    
+    if (intestazione->off_storico != 0) {
+        const IntestazioneStorico* storico = (const IntestazioneStorico*)
+            ((const char*)arch->mappa + intestazione->off_storico);
+        if (intestazione->off_storico % ALLINEAMENTO_SEZIONI != 0 ||
+            !sezione_valida(intestazione->off_storico, 1, sizeof(IntestazioneStorico), dim_file) ||
+            !sezione_valida(intestazione->off_storico + sizeof(IntestazioneStorico),
+                            storico->dimensione, 1, dim_file)) {
+            chiudi_archivio(arch);
+            return 0;
+        }
+        arch->storico = storico;
+    }
+    
+    arch->intestazione = intestazione;
+    arch->record = (const RecordArchivio*)((const char*)arch->mappa + intestazione->off_record);
+    arch->indice = (const SlotIsbn*)((const char*)arch->mappa + intestazione->off_indice);
+    arch->stringhe = (const char*)arch->mappa + intestazione->off_stringhe;
+    arch->num_libri = (int)intestazione->num_libri;
+    return 1;
+}
+
+void chiudi_archivio(Archivio* arch) {
+    if (arch->mappa != NULL) {
+#ifdef _WIN32
+        free(arch->mappa);
+#else
+        munmap(arch->mappa, arch->dimensione);
+#endif
+    }
+    memset(arch, 0, sizeof(Archivio));
+}
+
+// Verifica il checksum dei dati: richiede la lettura dell'intero file,
+// quindi non viene eseguita da apri_archivio
+int verifica_archivio(const Archivio* arch) {
+    const IntestazioneArchivio* intestazione = arch->intestazione;
+    uint64_t fine = intestazione->off_stringhe + intestazione->dim_stringhe;
+    uint32_t crc = aggiorna_crc32(0, (const char*)arch->mappa + sizeof(IntestazioneArchivio),
+                                  (size_t)(fine - sizeof(IntestazioneArchivio)));
+    return crc == intestazione->checksum_dati;
+}
+
+// Carica lo storico dei prestiti salvato nell'archivio, verificandone il checksum
+static int archivio_leggi_storico(const Archivio* arch, StoricoPrestiti* storico) {
+    const uint8_t* dati = (const uint8_t*)(arch->storico + 1);
+    size_t dimensione = (size_t)arch->storico->dimensione;
+    if (aggiorna_crc32(0, dati, dimensione) != arch->storico->checksum ||
+        !storico_deserializza(storico, dati, dimensione, arch->storico->num_libri, arch->num_libri)) {
+        storico_libera(storico);
+        return 0;
+    }
+    return 1;
+}
+
+// Copia il libro in posizione i dell'archivio in una struttura Libro
+int archivio_leggi_libro(const Archivio* arch, int i, Libro* libro) {
+    if (i < 0 || i >= arch->num_libri ||
+        arch->record[i].off_stringhe >= arch->intestazione->dim_stringhe) {
+        return 0;
+    }
+    
+    // Il blocco delle stringhe termina con '\0', quindi ogni lettura è limitata
+    const RecordArchivio* record = &(arch->record[i]);
+    const char* fine = arch->stringhe + arch->intestazione->dim_stringhe;
+    const char* titolo = arch->stringhe + record->off_stringhe;
+    const char* autore = titolo + strlen(titolo) + 1;
+    const char* isbn = autore < fine ? autore + strlen(autore) + 1 : fine;
+    if (isbn >= fine) {
+        return 0;
+    }
+    
+    strncpy(libro->titolo, titolo, MAX_TITOLO - 1);
+    libro->titolo[MAX_TITOLO - 1] = '\0';
+    strncpy(libro->autore, autore, MAX_AUTORE - 1);
+    libro->autore[MAX_AUTORE - 1] = '\0';
+    strncpy(libro->isbn, isbn, MAX_ISBN - 1);
+    libro->isbn[MAX_ISBN - 1] = '\0';
+    libro->anno_pubblicazione = record->anno_pubblicazione;
+    libro->disponibile = record->disponibile;
+    libro->data_prestito = (time_t)record->data_prestito;
+    return 1;
+}
+
+// Cerca un ISBN direttamente nell'indice salvato nel file, senza caricarlo.
+// Restituisce la posizione del libro oppure -1. La scansione si ferma anche
+// dopo aver visto tutti gli slot: un indice senza slot liberi (file corrotto
+// o aperto senza verifica) non la fa girare all'infinito.
+int archivio_cerca_per_isbn(const Archivio* arch, const char* isbn) {
+    uint32_t hash = hash_isbn(isbn);
+    uint64_t capacita = arch->intestazione->capacita_indice;
+    uint64_t maschera = capacita - 1;
+    uint64_t i = hash & maschera;
+    
+    for (uint64_t passi = 0; passi < capacita && arch->indice[i].indice != -1; passi++) {
+        const SlotIsbn* slot = &(arch->indice[i]);
+        Libro libro;
+        if (slot->hash == hash && archivio_leggi_libro(arch, slot->indice, &libro) &&
+            strcmp(libro.isbn, isbn) == 0) {
+            return slot->indice;
+        }
+        i = (i + 1) & maschera;
+    }
+    return -1;
+}
+
+// Importa un file nel formato precedente (numero di libri seguito dall'array
+// di strutture Libro così com'erano in memoria)
+static int importa_biblioteca_legacy(Biblioteca* bib, const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        // Non è un errore se il file non esiste ancora
+        return 0;
+    }
+    
+    // Leggi il numero di libri
+    int num_libri;
+    if (fread(&num_libri, sizeof(int), 1, file) != 1 || num_libri < 0) {
+        fprintf(stderr, "Errore: impossibile leggere il numero di libri dal file\n");
+        fclose(file);
+        return 0;
+    }
+    
+    // La dimensione deve corrispondere esattamente: evita di interpretare come
+    // formato precedente un file versionato con l'intestazione danneggiata
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) != (long)(sizeof(int) + (size_t)num_libri * sizeof(Libro))) {
+        fprintf(stderr, "Errore: il file %s non è in un formato riconosciuto\n", filename);
+        fclose(file);
+        return 0;
+    }
+    fseek(file, sizeof(int), SEEK_SET);
+    
+    // Assicurati che ci sia abbastanza spazio
+    if (num_libri > bib->capacita) {
+        bib->capacita = num_libri;
+        Libro* temp = (Libro*)realloc(bib->libri, bib->capacita * sizeof(Libro));
+        
+        if (temp == NULL) {
+            fprintf(stderr, "Errore: impossibile allocare memoria per i libri\n");
+            fclose(file);
+            return 0;
+        }
+        
+        bib->libri = temp;
+    }
+    
+    // Leggi i libri
+    if (fread(bib->libri, sizeof(Libro), num_libri, file) != (size_t)num_libri) {
+        fprintf(stderr, "Errore: impossibile leggere i libri dal file\n");
+        fclose(file);
+        return 0;
+    }
+    
+    bib->num_libri = num_libri;
+    
+    fclose(file);
+    return ricostruisci_indici(bib);
+}
+
+// Carica la biblioteca dal file. Il formato versionato viene riconosciuto
+// dall'intestazione; in caso contrario il file viene importato con il
+// formato precedente e sarà riscritto nel nuovo al prossimo salvataggio.
+// Il catalogo caricato deve poter essere modificato, quindi ogni record
+// viene copiato in memoria e gli indici ricostruiti, dopo aver verificato
+// il checksum di tutto il file: il costo è O(dimensione del file), non
+// quello di apri_archivio.
+int carica_biblioteca(Biblioteca* bib, const char* filename) {
+    // Lo storico si riferisce alle posizioni del catalogo che viene sostituito
+    storico_libera(&bib->storico);
+    
+    Archivio arch;
+    if (!apri_archivio(&arch, filename)) {
+        return importa_biblioteca_legacy(bib, filename);
+    }
+    
+    if (!verifica_archivio(&arch)) {
+        fprintf(stderr, "Errore: checksum non valido nel file %s\n", filename);
+        chiudi_archivio(&arch);
+        return 0;
+    }
+    
+    if (arch.num_libri > bib->capacita) {
+        Libro* temp = (Libro*)realloc(bib->libri, arch.num_libri * sizeof(Libro));
+        if (temp == NULL) {
+            fprintf(stderr, "Errore: impossibile allocare memoria per i libri\n");
+            chiudi_archivio(&arch);
+            return 0;
+        }
+        bib->libri = temp;
+        bib->capacita = arch.num_libri;
+    }
+    
+    for (int i = 0; i < arch.num_libri; i++) {
+        if (!archivio_leggi_libro(&arch, i, &(bib->libri[i]))) {
+            fprintf(stderr, "Errore: record %d non valido nel file %s\n", i, filename);
+            bib->num_libri = 0;
+            chiudi_archivio(&arch);
+            ricostruisci_indici(bib);
+            return 0;
+        }
+    }
+    bib->num_libri = arch.num_libri;
+    bib->sequenza = arch.intestazione->sequenza_journal;
+    if (arch.storico != NULL && !archivio_leggi_storico(&arch, &bib->storico)) {
+        fprintf(stderr, "Attenzione: storico dei prestiti non valido nel file %s, ignorato\n", filename);
+    }
+    chiudi_archivio(&arch);
+    
+    return ricostruisci_indici(bib);
+}
+
+// Aggiunge un record al buffer del journal; la scrittura su disco e la
+// sincronizzazione avvengono a gruppi (vedi journal_scrivi_buffer).
+// Restituisce 0 se il record non entra nel buffer o se la scrittura del
+// gruppo non riesce; in questo caso i record restano nel buffer e vengono
+// riscritti al tentativo successivo.
+static int journal_registra(Journal* journal, uint32_t tipo, const void* dati, size_t lunghezza) {
+    pthread_mutex_lock(&journal->mutex);
+    
+    size_t necessari = journal->usati + sizeof(IntestazioneOperazione) + lunghezza;
+    if (necessari > journal->capacita) {
+        size_t nuova_capacita = journal->capacita ? journal->capacita : 4096;
+        while (nuova_capacita < necessari) {
+            nuova_capacita *= 2;
+        }
+        char* temp = (char*)realloc(journal->buffer, nuova_capacita);
+        if (temp == NULL) {
+            pthread_mutex_unlock(&journal->mutex);
+            fprintf(stderr, "Errore: impossibile espandere il buffer del journal\n");
+            return 0;
+        }
+        journal->buffer = temp;
+        journal->capacita = nuova_capacita;
+    }
+    
+    IntestazioneOperazione intestazione;
+    memset(&intestazione, 0, sizeof(intestazione));
+    intestazione.lunghezza = (uint32_t)lunghezza;
+    intestazione.sequenza = ++journal->sequenza;
+    intestazione.tipo = tipo;
+    intestazione.crc = aggiorna_crc32(aggiorna_crc32(0, &intestazione, sizeof(intestazione)),
+                                      dati, lunghezza);
+    
+    memcpy(journal->buffer + journal->usati, &intestazione, sizeof(intestazione));
+    memcpy(journal->buffer + journal->usati + sizeof(intestazione), dati, lunghezza);
+    journal->usati = necessari;
+    
+    if (journal->in_attesa++ == 0) {
+        journal->prima_attesa = time(NULL);
+        pthread_cond_signal(&journal->attesa);
+    }
+    
+    // Group commit: un solo fsync per un gruppo di operazioni
+    int ok = 1;
+    if (journal->in_attesa >= JOURNAL_OPERAZIONI_PER_SYNC ||
+        journal->usati >= JOURNAL_BUFFER_MAX ||
+        time(NULL) - journal->prima_attesa >= JOURNAL_ATTESA_MAX_SECONDI) {
+        ok = journal_scrivi_buffer(journal);
+    }
+    
+    pthread_mutex_unlock(&journal->mutex);
+    return ok;
+}
+
+// Scrive su disco le operazioni in attesa e le rende durevoli.
+// Va chiamata con journal->mutex acquisito.
+static int journal_scrivi_buffer(Journal* journal) {
+    if (journal->usati == 0) {
+        return 1;
+    }
+    if (journal->file == NULL) {
+        fprintf(stderr, "Errore: il journal %s non è aperto\n", journal->nome);
+        return 0;
+    }
+    
+    int ok = fwrite(journal->buffer, 1, journal->usati, journal->file) == journal->usati &&
+             fflush(journal->file) == 0;
+#ifndef _WIN32
+    ok = ok && fsync(fileno(journal->file)) == 0;
+#endif
+    
+    if (!ok) {
+        fprintf(stderr, "Errore: impossibile scrivere il journal %s\n", journal->nome);
+        return 0;
+    }
+    
+    journal->dimensione += journal->usati;
+    journal->usati = 0;
+    journal->in_attesa = 0;
+    return 1;
+}
+
+int journal_sincronizza(Journal* journal) {
+    pthread_mutex_lock(&journal->mutex);
+    int ok = journal_scrivi_buffer(journal);
+    pthread_mutex_unlock(&journal->mutex);
+    return ok;
+}
+
+// Corpo del thread di sincronizzazione: attende la prima operazione di un
+// gruppo e, se nessuna operazione successiva ha già scritto il gruppo, lo
+// scrive quando la più vecchia ha atteso JOURNAL_ATTESA_MAX_SECONDI
+static void* esegui_sincronizzazione(void* arg) {
+    Journal* journal = (Journal*)arg;
+    
+    pthread_mutex_lock(&journal->mutex);
+    while (!journal->chiusura) {
+        if (journal->in_attesa == 0) {
+            pthread_cond_wait(&journal->attesa, &journal->mutex);
+            continue;
+        }
+        time_t scadenza = journal->prima_attesa + JOURNAL_ATTESA_MAX_SECONDI;
+        if (time(NULL) < scadenza) {
+            struct timespec limite = { scadenza, 0 };
+            pthread_cond_timedwait(&journal->attesa, &journal->mutex, &limite);
+            continue;
+        }
+        if (!journal_scrivi_buffer(journal)) {
+            // Riprova dopo un altro intervallo invece di ripetere subito l'errore
+            journal->prima_attesa = time(NULL);
+        }
+    }
+    pthread_mutex_unlock(&journal->mutex);
+    return NULL;
+}
+
+static int journal_registra_aggiunta(Journal* journal, const Libro* libro) {
+    char dati[sizeof(int32_t) + MAX_TITOLO + MAX_AUTORE + MAX_ISBN];
+    int32_t anno = libro->anno_pubblicazione;
+    size_t lunghezza = sizeof(anno);
+    
+    memcpy(dati, &anno, sizeof(anno));
+    lunghezza += (size_t)sprintf(dati + lunghezza, "%s", libro->titolo) + 1;
+    lunghezza += (size_t)sprintf(dati + lunghezza, "%s", libro->autore) + 1;
+    lunghezza += (size_t)sprintf(dati + lunghezza, "%s", libro->isbn) + 1;
+    return journal_registra(journal, OP_AGGIUNTA, dati, lunghezza);
+}
+
+static int journal_registra_prestito(Journal* journal, const Libro* libro) {
+    char dati[sizeof(int64_t) + MAX_ISBN];
+    int64_t data = (int64_t)libro->data_prestito;
+    
+    memcpy(dati, &data, sizeof(data));
+    size_t lunghezza = sizeof(data) + (size_t)sprintf(dati + sizeof(data), "%s", libro->isbn) + 1;
+    return journal_registra(journal, OP_PRESTITO, dati, lunghezza);
+}
+
+static int journal_registra_restituzione(Journal* journal, const Libro* libro) {
+    return journal_registra(journal, OP_RESTITUZIONE, libro->isbn, strlen(libro->isbn) + 1);
+}
+
+// Applica un'operazione letta dal journal
+static int applica_operazione(Biblioteca* bib, uint32_t tipo, const char* dati, size_t lunghezza) {
+    // Tutti i campi di testo del payload devono essere terminati
+    if (lunghezza == 0 || dati[lunghezza - 1] != '\0') {
+        return 0;
+    }
+    
+    switch (tipo) {
+        case OP_AGGIUNTA: {
+            int32_t anno;
+            if (lunghezza < sizeof(anno) + 3) {
+                return 0;
+            }
+            memcpy(&anno, dati, sizeof(anno));
+            const char* fine = dati + lunghezza;
+            const char* titolo = dati + sizeof(anno);
+            const char* autore = titolo + strlen(titolo) + 1;
+            if (autore >= fine) {
+                return 0;
+            }
+            const char* isbn = autore + strlen(autore) + 1;
+            if (isbn >= fine) {
+                return 0;
+            }
+            return aggiungi_libro(bib, titolo, autore, isbn, anno);
+        }
+        
+        case OP_PRESTITO: {
+            int64_t data;
+            if (lunghezza <= sizeof(data)) {
+                return 0;
+            }
+            memcpy(&data, dati, sizeof(data));
+            return esegui_prestito(bib, dati + sizeof(data), (time_t)data);
+        }
+        
+        case OP_RESTITUZIONE:
+            return restituisci_libro(bib, dati);
+    }
+    return 0;
+}
+
+// Riapplica le operazioni del journal successive all'ultimo snapshot caricato
+// (quelle con numero di sequenza maggiore di bib->sequenza). Un record
+// incompleto o con checksum errato in coda al file è il segno di una scrittura
+// interrotta: il file viene troncato lì e la riapplicazione si ferma.
+// Restituisce il numero di operazioni riapplicate, -1 in caso di errore.
+int riapplica_journal(Biblioteca* bib, const char* nome) {
+    FILE* file = fopen(nome, "rb");
+    if (file == NULL) {
+        return 0;  // Nessun journal: niente da riapplicare
+    }
+    
+    Journal* journal = bib->journal;
+    bib->journal = NULL;  // Le operazioni riapplicate non vanno registrate di nuovo
+    
+    int applicate = 0;
+    long fine_valida = 0;
+    char* dati = NULL;
+    size_t capacita = 0;
+    IntestazioneOperazione intestazione;
+    
+    while (fread(&intestazione, sizeof(intestazione), 1, file) == 1) {
+        if (intestazione.lunghezza > JOURNAL_BUFFER_MAX) {
+            break;
+        }
+        if (intestazione.lunghezza > capacita) {
+            char* temp = (char*)realloc(dati, intestazione.lunghezza);
+            if (temp == NULL) {
+                fprintf(stderr, "Errore: impossibile allocare memoria per il journal\n");
+                applicate = -1;
+                break;
+            }
+            dati = temp;
+            capacita = intestazione.lunghezza;
+        }
+        if (fread(dati, 1, intestazione.lunghezza, file) != intestazione.lunghezza) {
+            break;
+        }
+        
+        uint32_t crc = intestazione.crc;
+        intestazione.crc = 0;
+        if (aggiorna_crc32(aggiorna_crc32(0, &intestazione, sizeof(intestazione)),
+                           dati, intestazione.lunghezza) != crc) {
+            break;
+        }
+        fine_valida = ftell(file);
+        
+        if (intestazione.sequenza <= bib->sequenza) {
+            continue;  // Già incluso nello snapshot
+        }
+        if (!applica_operazione(bib, intestazione.tipo, dati, intestazione.lunghezza)) {
+            fprintf(stderr, "Attenzione: operazione %llu del journal non applicabile\n",
+                    (unsigned long long)intestazione.sequenza);
+        }
+        bib->sequenza = intestazione.sequenza;
+        applicate++;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    long dimensione = ftell(file);
+    fclose(file);
+    free(dati);
+    bib->journal = journal;
+    
+    if (applicate >= 0 && fine_valida < dimensione) {
+        fprintf(stderr, "Attenzione: journal %s troncato a %ld byte\n", nome, fine_valida);
+#ifndef _WIN32
+        if (truncate(nome, fine_valida) != 0) {
+            fprintf(stderr, "Errore: impossibile troncare il journal %s\n", nome);
+            return -1;
+        }
+#endif
+    }
+    return applicate;
+}
+
+// Attiva il journal: da questo momento aggiunte, prestiti e restituzioni
+// vengono registrati in coda al file. Va chiamata dopo carica_biblioteca
+// e riapplica_journal.
+int apri_journal(Biblioteca* bib, const char* nome) {
+    Journal* journal = (Journal*)calloc(1, sizeof(Journal));
+    if (journal == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il journal\n");
+        return 0;
+    }
+    
+    journal->file = fopen(nome, "ab");
+    if (journal->file == NULL) {
+        fprintf(stderr, "Errore: impossibile aprire il journal %s\n", nome);
+        free(journal);
+        return 0;
+    }
+    fseek(journal->file, 0, SEEK_END);
+    
+    snprintf(journal->nome, sizeof(journal->nome), "%s", nome);
+    journal->dimensione = (uint64_t)ftell(journal->file);
+    journal->sequenza = bib->sequenza;
+    pthread_mutex_init(&journal->mutex, NULL);
+    pthread_cond_init(&journal->attesa, NULL);
+    if (pthread_create(&journal->sincronizzatore, NULL, esegui_sincronizzazione, journal) != 0) {
+        fprintf(stderr, "Errore: impossibile avviare il thread di sincronizzazione del journal\n");
+        pthread_cond_destroy(&journal->attesa);
+        pthread_mutex_destroy(&journal->mutex);
+        fclose(journal->file);
+        free(journal);
+        return 0;
+    }
+    bib->journal = journal;
+    return 1;
+}
+
+// Corpo del thread di compattazione: salva lo snapshot e poi elimina dal
+// journal le operazioni che vi sono incluse
+static void* esegui_compattazione(void* arg) {
+    Journal* journal = (Journal*)arg;
+    Biblioteca* copia = journal->copia;
+    int ok = ricostruisci_indice_isbn(copia) && salva_biblioteca(copia, journal->file_snapshot);
+    
+    // Lo snapshot è durevole: le operazioni fino a copia->sequenza, che si
+    // trovano prima di offset_snapshot nel journal, non servono più. Le
+    // operazioni arrivate nel frattempo vengono copiate in un nuovo journal
+    // che sostituisce il vecchio.
+    pthread_mutex_lock(&journal->mutex);
+    if (ok) {
+        ok = journal_scrivi_buffer(journal);
+    }
+    if (ok) {
+        char nome_temporaneo[FILENAME_MAX + 8];
+        snprintf(nome_temporaneo, sizeof(nome_temporaneo), "%s.tmp", journal->nome);
+        
+        FILE* origine = fopen(journal->nome, "rb");
+        FILE* destinazione = fopen(nome_temporaneo, "wb");
+        ok = origine != NULL && destinazione != NULL &&
+             fseek(origine, (long)journal->offset_snapshot, SEEK_SET) == 0;
+        
+        char blocco[8192];
+        size_t letti;
+        while (ok && (letti = fread(blocco, 1, sizeof(blocco), origine)) > 0) {
+            ok = fwrite(blocco, 1, letti, destinazione) == letti;
+        }
+        ok = ok && fflush(destinazione) == 0;
+#ifndef _WIN32
+        ok = ok && fsync(fileno(destinazione)) == 0;
+#endif
+        if (origine != NULL) {
+            fclose(origine);
+        }
+        if (destinazione != NULL && fclose(destinazione) != 0) {
+            ok = 0;
+        }
+        
+        if (ok) {
+            fclose(journal->file);
+#ifdef _WIN32
+            remove(journal->nome);
+#endif
+            ok = rename(nome_temporaneo, journal->nome) == 0;
+            journal->file = fopen(journal->nome, "ab");
+            if (journal->file == NULL) {
+                fprintf(stderr, "Errore: impossibile riaprire il journal %s\n", journal->nome);
+                ok = 0;
+            } else {
+                fseek(journal->file, 0, SEEK_END);
+                journal->dimensione = (uint64_t)ftell(journal->file);
+            }
+        } else {
+            remove(nome_temporaneo);
+        }
+    }
+    journal->esito_compattazione = ok;
+    pthread_mutex_unlock(&journal->mutex);
+    
+    if (!ok) {
+        fprintf(stderr, "Errore: compattazione del journal %s non riuscita\n", journal->nome);
+    }
+    
+    libera_biblioteca(copia);
+    journal->copia = NULL;
+    atomic_store(&journal->compattazione_terminata, 1);
+    return NULL;
 }
 
-void libera_biblioteca(Biblioteca* bib) {
-    if (bib != NULL) {
-        if (bib->libri != NULL) {
-            free(bib->libri);
-        }
-        free(bib);
+// Attende la fine della compattazione in corso, se presente
+int attendi_compattazione(Biblioteca* bib) {
+    Journal* journal = bib->journal;
+    if (journal == NULL || !journal->compattazione_attiva) {
+        return 1;
     }
+    pthread_join(journal->compattatore, NULL);
+    journal->compattazione_attiva = 0;
+    return journal->esito_compattazione;
 }
 
-int aggiungi_libro(Biblioteca* bib, const char* titolo, const char* autore, 
-                  const char* isbn, int anno) {
-    // Verifica se il libro esiste già
-    if (cerca_libro_per_isbn(bib, isbn) != NULL) {
-        fprintf(stderr, "Errore: libro con ISBN %s già presente\n", isbn);
-        return 0;
+// Avvia in background la scrittura di un nuovo snapshot che incorpora il
+// journal. Nel thread chiamante viene fatta solo una copia dei record (le
+// stringhe sono contenute nei Libro, quindi basta una memcpy) e dei blocchi
+// dello storico dei prestiti; serializzazione,
+// fsync e riscrittura del journal avvengono nel thread di compattazione,
+// mentre la biblioteca continua a ricevere operazioni.
+int avvia_compattazione(Biblioteca* bib, const char* file_snapshot) {
+    Journal* journal = bib->journal;
+    if (journal == NULL) {
+        return salva_biblioteca(bib, file_snapshot);
     }
+    attendi_compattazione(bib);
     
-    // Verifica se è necessario espandere l'array
-    if (bib->num_libri >= bib->capacita) {
-        bib->capacita *= 2;  // Raddoppia la capacità
-        Libro* temp = (Libro*)realloc(bib->libri, bib->capacita * sizeof(Libro));
-        
-        if (temp == NULL) {
-            fprintf(stderr, "Errore: impossibile espandere la memoria per i libri\n");
-            return 0;
-        }
-        
-        bib->libri = temp;
+    // Nessuna modifica tra la copia dei record e la scelta del punto del
+    // journal da cui ripartire
+    scrittura_inizia(bib);
+    Biblioteca* copia = (Biblioteca*)calloc(1, sizeof(Biblioteca));
+    if (copia != NULL) {
+        copia->capacita = bib->num_libri > 0 ? bib->num_libri : 1;
+        copia->libri = (Libro*)malloc(copia->capacita * sizeof(Libro));
+    }
+    if (copia == NULL || copia->libri == NULL || !storico_copia(&copia->storico, &bib->storico)) {
+        scrittura_termina(bib);
+        fprintf(stderr, "Errore: impossibile allocare memoria per lo snapshot\n");
+        libera_biblioteca(copia);
+        return 0;
     }
+    memcpy(copia->libri, bib->libri, bib->num_libri * sizeof(Libro));
+    copia->num_libri = bib->num_libri;
     
-    // Aggiungi il nuovo libro
-    Libro* nuovo_libro = &(bib->libri[bib->num_libri]);
-    strncpy(nuovo_libro->titolo, titolo, MAX_TITOLO - 1);
-    nuovo_libro->titolo[MAX_TITOLO - 1] = '\0';  // Assicura terminazione
+    // Fissa il punto del journal corrispondente alla copia
+    pthread_mutex_lock(&journal->mutex);
+    int ok = journal_scrivi_buffer(journal);
+    copia->sequenza = journal->sequenza;
+    journal->offset_snapshot = journal->dimensione;
+    pthread_mutex_unlock(&journal->mutex);
+    scrittura_termina(bib);
     
-    strncpy(nuovo_libro->autore, autore, MAX_AUTORE - 1);
-    nuovo_libro->autore[MAX_AUTORE - 1] = '\0';
+    if (!ok) {
+        libera_biblioteca(copia);
+        return 0;
+    }
     
-    strncpy(nuovo_libro->isbn, isbn, MAX_ISBN - 1);
-    nuovo_libro->isbn[MAX_ISBN - 1] = '\0';
+    snprintf(journal->file_snapshot, sizeof(journal->file_snapshot), "%s", file_snapshot);
+    journal->copia = copia;
+    atomic_store(&journal->compattazione_terminata, 0);
+    if (pthread_create(&journal->compattatore, NULL, esegui_compattazione, journal) != 0) {
+        fprintf(stderr, "Errore: impossibile avviare il thread di compattazione\n");
+        journal->copia = NULL;
+        libera_biblioteca(copia);
+        return 0;
+    }
+    journal->compattazione_attiva = 1;
+    return 1;
+}
+
+// Indica se il journal è cresciuto abbastanza da meritare una compattazione
+int journal_da_compattare(Biblioteca* bib) {
+    Journal* journal = bib->journal;
+    if (journal == NULL ||
+        (journal->compattazione_attiva && !atomic_load(&journal->compattazione_terminata))) {
+        return 0;
+    }
     
-    nuovo_libro->anno_pubblicazione = anno;
-    nuovo_libro->disponibile = 1;  // Inizialmente disponibile
-    nuovo_libro->data_prestito = 0;
+    pthread_mutex_lock(&journal->mutex);
+    int da_compattare = journal->dimensione + journal->usati >= JOURNAL_SOGLIA_COMPATTAZIONE;
+    pthread_mutex_unlock(&journal->mutex);
+    return da_compattare;
+}
+
+// Rende durevoli le operazioni in attesa, attende un'eventuale compattazione
+// e disattiva il journal
+void chiudi_journal(Biblioteca* bib) {
+    Journal* journal = bib->journal;
+    if (journal == NULL) {
+        return;
+    }
     
-    bib->num_libri++;
-    return 1;
+    attendi_compattazione(bib);
+    pthread_mutex_lock(&journal->mutex);
+    journal->chiusura = 1;
+    pthread_cond_signal(&journal->attesa);
+    pthread_mutex_unlock(&journal->mutex);
+    pthread_join(journal->sincronizzatore, NULL);
+    
+    journal_sincronizza(journal);
+    if (journal->file != NULL) {
+        fclose(journal->file);
+    }
+    pthread_cond_destroy(&journal->attesa);
+    pthread_mutex_destroy(&journal->mutex);
+    free(journal->buffer);
+    free(journal);
+    bib->journal = NULL;
 }
 
-Libro* cerca_libro_per_isbn(Biblioteca* bib, const char* isbn) {
-    for (int i = 0; i < bib->num_libri; i++) {
-        if (strcmp(bib->libri[i].isbn, isbn) == 0) {
-            return &(bib->libri[i]);
-        }
+// ---------------------------------------------------------------------------
+// Catalogo a colonne (structure of arrays)
+// ---------------------------------------------------------------------------
+
+// Hash FNV-1a a 64 bit, usato come chiave degli ISBN e degli autori
+static uint64_t hash64(const char* s) {
+    uint64_t hash = 14695981039346656037ull;
+    while (*s != '\0') {
+        hash ^= (unsigned char)*s++;
+        hash *= 1099511628211ull;
     }
-    return NULL;
+    return hash;
 }
 
-Libro* cerca_libri_per_autore(Biblioteca* bib, const char* autore, int* num_trovati) {
-    // Prima conta quanti libri corrispondono
-    *num_trovati = 0;
-    for (int i = 0; i < bib->num_libri; i++) {
-        if (strstr(bib->libri[i].autore, autore) != NULL) {
-            (*num_trovati)++;
+// Copia una stringa in coda all'arena e ne restituisce l'offset, (uint64_t)-1 in caso di errore
+static uint64_t arena_aggiungi(ArenaStringhe* arena, const char* s, size_t max) {
+    size_t lunghezza = strlen(s);
+    if (lunghezza > max - 1) {
+        lunghezza = max - 1;  // Stessi limiti dei campi di Libro
+    }
+    
+    if (arena->usati + lunghezza + 1 > arena->capacita) {
+        size_t nuova_capacita = arena->capacita ? arena->capacita : 4096;
+        while (nuova_capacita < arena->usati + lunghezza + 1) {
+            nuova_capacita *= 2;
+        }
+        char* temp = (char*)realloc(arena->dati, nuova_capacita);
+        if (temp == NULL) {
+            fprintf(stderr, "Errore: impossibile espandere l'arena delle stringhe\n");
+            return (uint64_t)-1;
         }
+        arena->dati = temp;
+        arena->capacita = nuova_capacita;
     }
     
-    if (*num_trovati == 0) {
+    uint64_t offset = arena->usati;
+    memcpy(arena->dati + offset, s, lunghezza);
+    arena->dati[offset + lunghezza] = '\0';
+    arena->usati += lunghezza + 1;
+    return offset;
+}
+
+// Tabella hash di identificativi (indirizzamento aperto, -1 = slot vuoto)
+static int32_t* tabella_id_crea(int capacita) {
+    int32_t* slot = (int32_t*)malloc(capacita * sizeof(int32_t));
+    if (slot != NULL) {
+        memset(slot, 0xFF, capacita * sizeof(int32_t));
+    }
+    return slot;
+}
+
+BibliotecaColonnare* crea_biblioteca_colonnare() {
+    BibliotecaColonnare* col = (BibliotecaColonnare*)calloc(1, sizeof(BibliotecaColonnare));
+    if (col == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il catalogo a colonne\n");
         return NULL;
     }
     
-    // Alloca memoria per i risultati
-    Libro* risultati = (Libro*)malloc((*num_trovati) * sizeof(Libro));
-    if (risultati == NULL) {
-        fprintf(stderr, "Errore: impossibile allocare memoria per i risultati\n");
-        *num_trovati = 0;
+    col->capacita_tabella_isbn = CAPACITA_INDICE_INIZIALE;
+    col->capacita_tabella_autori = CAPACITA_INDICE_INIZIALE;
+    col->tabella_isbn = tabella_id_crea(col->capacita_tabella_isbn);
+    col->tabella_autori = tabella_id_crea(col->capacita_tabella_autori);
+    if (col->tabella_isbn == NULL || col->tabella_autori == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per il catalogo a colonne\n");
+        libera_biblioteca_colonnare(col);
         return NULL;
     }
+    return col;
+}
+
+void libera_biblioteca_colonnare(BibliotecaColonnare* col) {
+    if (col == NULL) {
+        return;
+    }
+    free(col->anni);
+    free(col->disponibili);
+    free(col->date_prestito);
+    free(col->chiavi_isbn);
+    free(col->off_isbn);
+    free(col->off_titoli);
+    free(col->id_autori);
+    free(col->off_autori);
+    free(col->chiavi_autori);
+    free(col->tabella_isbn);
+    free(col->tabella_autori);
+    free(col->arena.dati);
+    free(col);
+}
+
+// Rialloca una colonna; in caso di errore la colonna originale resta valida
+static int colonna_ridimensiona(void** colonna, size_t num, size_t dim_elemento) {
+    void* temp = realloc(*colonna, num * dim_elemento);
+    if (temp == NULL) {
+        return 0;
+    }
+    *colonna = temp;
+    return 1;
+}
+
+// Porta la capacità delle colonne ad almeno 'capacita' libri
+int colonnare_riserva(BibliotecaColonnare* col, int capacita) {
+    if (capacita <= col->capacita) {
+        return 1;
+    }
     
-    // Copia i libri corrispondenti
-    int indice = 0;
-    for (int i = 0; i < bib->num_libri; i++) {
-        if (strstr(bib->libri[i].autore, autore) != NULL) {
-            risultati[indice++] = bib->libri[i];
-        }
+    size_t parole = ((size_t)capacita + 63) / 64;
+    size_t parole_prima = ((size_t)col->capacita + 63) / 64;
+    if (!colonna_ridimensiona((void**)&col->anni, capacita, sizeof(int32_t)) ||
+        !colonna_ridimensiona((void**)&col->date_prestito, capacita, sizeof(int64_t)) ||
+        !colonna_ridimensiona((void**)&col->chiavi_isbn, capacita, sizeof(uint64_t)) ||
+        !colonna_ridimensiona((void**)&col->off_isbn, capacita, sizeof(uint64_t)) ||
+        !colonna_ridimensiona((void**)&col->off_titoli, capacita, sizeof(uint64_t)) ||
+        !colonna_ridimensiona((void**)&col->id_autori, capacita, sizeof(uint32_t)) ||
+        !colonna_ridimensiona((void**)&col->disponibili, parole, sizeof(uint64_t))) {
+        fprintf(stderr, "Errore: impossibile espandere il catalogo a colonne\n");
+        return 0;
     }
+    memset(col->disponibili + parole_prima, 0, (parole - parole_prima) * sizeof(uint64_t));
     
-    return risultati;
+    // L'indice degli ISBN viene dimensionato subito per la nuova capacità,
+    // prima di registrarla: se non c'è memoria per l'indice la capacità resta
+    // quella vecchia, così le aggiunte non lo riempiono oltre metà
+    if (2 * capacita > col->capacita_tabella_isbn) {
+        int nuova_capacita = col->capacita_tabella_isbn;
+        while (nuova_capacita < 2 * capacita) {
+            nuova_capacita *= 2;
+        }
+        int32_t* slot = tabella_id_crea(nuova_capacita);
+        if (slot == NULL) {
+            fprintf(stderr, "Errore: impossibile espandere l'indice ISBN a colonne\n");
+            return 0;
+        }
+        for (int i = 0; i < col->num_libri; i++) {
+            int j = (int)(col->chiavi_isbn[i] & (uint64_t)(nuova_capacita - 1));
+            while (slot[j] != -1) {
+                j = (j + 1) & (nuova_capacita - 1);
+            }
+            slot[j] = i;
+        }
+        free(col->tabella_isbn);
+        col->tabella_isbn = slot;
+        col->capacita_tabella_isbn = nuova_capacita;
+    }
+    col->capacita = capacita;
+    return 1;
 }
 
-Libro* cerca_libri_per_titolo(Biblioteca* bib, const char* titolo, int* num_trovati) {
-    // Implementazione simile a cerca_libri_per_autore
-    *num_trovati = 0;
-    for (int i = 0; i < bib->num_libri; i++) {
-        if (strstr(bib->libri[i].titolo, titolo) != NULL) {
-            (*num_trovati)++;
+// Restituisce l'identificativo dell'autore, creandolo se non esiste:
+// ogni nome compare una sola volta nell'arena
+static int32_t colonnare_interna_autore(BibliotecaColonnare* col, const char* autore, int crea) {
+    char nome[MAX_AUTORE];
+    strncpy(nome, autore, MAX_AUTORE - 1);
+    nome[MAX_AUTORE - 1] = '\0';
+    
+    uint64_t chiave = hash64(nome);
+    int maschera = col->capacita_tabella_autori - 1;
+    int j = (int)(chiave & (uint64_t)maschera);
+    
+    while (col->tabella_autori[j] != -1) {
+        int32_t id = col->tabella_autori[j];
+        if (col->chiavi_autori[id] == chiave &&
+            strcmp(col->arena.dati + col->off_autori[id], nome) == 0) {
+            return id;
         }
+        j = (j + 1) & maschera;
     }
     
-    if (*num_trovati == 0) {
-        return NULL;
+    if (!crea) {
+        return -1;
     }
     
-    Libro* risultati = (Libro*)malloc((*num_trovati) * sizeof(Libro));
-    if (risultati == NULL) {
-        fprintf(stderr, "Errore: impossibile allocare memoria per i risultati\n");
-        *num_trovati = 0;
-        return NULL;
+    // Mantieni il fattore di carico sotto il 50%. La tabella si ingrandisce
+    // prima dell'inserimento: se l'espansione non riesce l'autore non viene
+    // aggiunto, così restano sempre slot liberi e la scansione termina.
+    if (2 * (col->num_autori + 1) > col->capacita_tabella_autori) {
+        int nuova_capacita = col->capacita_tabella_autori * 2;
+        int32_t* slot = tabella_id_crea(nuova_capacita);
+        if (slot == NULL) {
+            fprintf(stderr, "Errore: impossibile espandere l'indice degli autori\n");
+            return -1;
+        }
+        for (int32_t a = 0; a < col->num_autori; a++) {
+            int k = (int)(col->chiavi_autori[a] & (uint64_t)(nuova_capacita - 1));
+            while (slot[k] != -1) {
+                k = (k + 1) & (nuova_capacita - 1);
+            }
+            slot[k] = a;
+        }
+        free(col->tabella_autori);
+        col->tabella_autori = slot;
+        col->capacita_tabella_autori = nuova_capacita;
+        
+        maschera = nuova_capacita - 1;
+        j = (int)(chiave & (uint64_t)maschera);
+        while (col->tabella_autori[j] != -1) {
+            j = (j + 1) & maschera;
+        }
     }
     
-    int indice = 0;
-    for (int i = 0; i < bib->num_libri; i++) {
-        if (strstr(bib->libri[i].titolo, titolo) != NULL) {
-            risultati[indice++] = bib->libri[i];
+    if (col->num_autori >= col->capacita_autori) {
+        int nuova_capacita = col->capacita_autori ? col->capacita_autori * 2 : 16;
+        if (!colonna_ridimensiona((void**)&col->off_autori, nuova_capacita, sizeof(uint64_t)) ||
+            !colonna_ridimensiona((void**)&col->chiavi_autori, nuova_capacita, sizeof(uint64_t))) {
+            fprintf(stderr, "Errore: impossibile espandere la tabella degli autori\n");
+            return -1;
         }
+        col->capacita_autori = nuova_capacita;
     }
     
-    return risultati;
+    uint64_t offset = arena_aggiungi(&col->arena, nome, MAX_AUTORE);
+    if (offset == (uint64_t)-1) {
+        return -1;
+    }
+    
+    int32_t id = col->num_autori++;
+    col->off_autori[id] = offset;
+    col->chiavi_autori[id] = chiave;
+    col->tabella_autori[j] = id;
+    return id;
 }
 
-int presta_libro(Biblioteca* bib, const char* isbn) {
-    Libro* libro = cerca_libro_per_isbn(bib, isbn);
+// Restituisce la posizione del libro con l'ISBN indicato, -1 se non presente
+int colonnare_cerca_isbn(const BibliotecaColonnare* col, const char* isbn) {
+    uint64_t chiave = hash64(isbn);
+    int maschera = col->capacita_tabella_isbn - 1;
     
-    if (libro == NULL) {
-        fprintf(stderr, "Errore: libro con ISBN %s non trovato\n", isbn);
-        return 0;
+    for (int j = (int)(chiave & (uint64_t)maschera); col->tabella_isbn[j] != -1; j = (j + 1) & maschera) {
+        int32_t i = col->tabella_isbn[j];
+        if (col->chiavi_isbn[i] == chiave && strcmp(col->arena.dati + col->off_isbn[i], isbn) == 0) {
+            return i;
+        }
     }
+    return -1;
+}
+
+int colonnare_aggiungi(BibliotecaColonnare* col, const char* titolo, const char* autore,
+                       const char* isbn, int anno) {
+    char chiave_isbn[MAX_ISBN];
+    strncpy(chiave_isbn, isbn, MAX_ISBN - 1);
+    chiave_isbn[MAX_ISBN - 1] = '\0';
     
-    if (!libro->disponibile) {
-        fprintf(stderr, "Errore: libro con ISBN %s già in prestito\n", isbn);
+    if (colonnare_cerca_isbn(col, chiave_isbn) != -1) {
+        fprintf(stderr, "Errore: libro con ISBN %s già presente\n", chiave_isbn);
         return 0;
     }
     
-    libro->disponibile = 0;
-    libro->data_prestito = time(NULL);
-    return 1;
-}
-
-int restituisci_libro(Biblioteca* bib, const char* isbn) {
-    Libro* libro = cerca_libro_per_isbn(bib, isbn);
-    
-    if (libro == NULL) {
-        fprintf(stderr, "Errore: libro con ISBN %s non trovato\n", isbn);
+    if (col->num_libri >= col->capacita &&
+        !colonnare_riserva(col, col->capacita ? col->capacita * 2 : 16)) {
         return 0;
     }
     
-    if (libro->disponibile) {
-        fprintf(stderr, "Errore: libro con ISBN %s non risulta in prestito\n", isbn);
+    int32_t id_autore = colonnare_interna_autore(col, autore, 1);
+    uint64_t off_titolo = arena_aggiungi(&col->arena, titolo, MAX_TITOLO);
+    uint64_t off_isbn = arena_aggiungi(&col->arena, chiave_isbn, MAX_ISBN);
+    if (id_autore < 0 || off_titolo == (uint64_t)-1 || off_isbn == (uint64_t)-1) {
         return 0;
     }
     
-    libro->disponibile = 1;
+    int i = col->num_libri;
+    col->anni[i] = anno;
+    col->date_prestito[i] = 0;
+    col->chiavi_isbn[i] = hash64(chiave_isbn);
+    col->off_isbn[i] = off_isbn;
+    col->off_titoli[i] = off_titolo;
+    col->id_autori[i] = (uint32_t)id_autore;
+    col->disponibili[i / 64] |= 1ull << (i % 64);
+    
+    int maschera = col->capacita_tabella_isbn - 1;
+    int j = (int)(col->chiavi_isbn[i] & (uint64_t)maschera);
+    while (col->tabella_isbn[j] != -1) {
+        j = (j + 1) & maschera;
+    }
+    col->tabella_isbn[j] = i;
+    
+    col->num_libri++;
     return 1;
 }
 
-// Funzioni di confronto per qsort
-int confronta_titoli(const void* a, const void* b) {
-    return strcmp(((Libro*)a)->titolo, ((Libro*)b)->titolo);
+// Costruisce la versione a colonne di una biblioteca esistente
+BibliotecaColonnare* converti_in_colonnare(const Biblioteca* bib) {
+    BibliotecaColonnare* col = crea_biblioteca_colonnare();
+    if (col == NULL || !colonnare_riserva(col, bib->num_libri > 0 ? bib->num_libri : 1)) {
+        libera_biblioteca_colonnare(col);
+        return NULL;
+    }
+    
+    for (int i = 0; i < bib->num_libri; i++) {
+        const Libro* libro = &(bib->libri[i]);
+        if (!colonnare_aggiungi(col, libro->titolo, libro->autore, libro->isbn,
+                                libro->anno_pubblicazione)) {
+            continue;  // ISBN duplicato: si tiene la prima occorrenza, come cerca_libro_per_isbn
+        }
+        int j = col->num_libri - 1;
+        col->date_prestito[j] = (int64_t)libro->data_prestito;
+        if (!libro->disponibile) {
+            col->disponibili[j / 64] &= ~(1ull << (j % 64));
+        }
+    }
+    return col;
 }
 
-int confronta_autori(const void* a, const void* b) {
-    return strcmp(((Libro*)a)->autore, ((Libro*)b)->autore);
+const char* colonnare_titolo(const BibliotecaColonnare* col, int i) {
+    return col->arena.dati + col->off_titoli[i];
 }
 
-int confronta_anni(const void* a, const void* b) {
-    return ((Libro*)a)->anno_pubblicazione - ((Libro*)b)->anno_pubblicazione;
+const char* colonnare_autore(const BibliotecaColonnare* col, int i) {
+    return col->arena.dati + col->off_autori[col->id_autori[i]];
 }
 
-void ordina_per_titolo(Biblioteca* bib) {
-    qsort(bib->libri, bib->num_libri, sizeof(Libro), confronta_titoli);
+const char* colonnare_isbn(const BibliotecaColonnare* col, int i) {
+    return col->arena.dati + col->off_isbn[i];
 }
 
-void ordina_per_autore(Biblioteca* bib) {
-    qsort(bib->libri, bib->num_libri, sizeof(Libro), confronta_autori);
+int colonnare_disponibile(const BibliotecaColonnare* col, int i) {
+    return (int)((col->disponibili[i / 64] >> (i % 64)) & 1);
 }
 
-void ordina_per_anno(Biblioteca* bib) {
-    qsort(bib->libri, bib->num_libri, sizeof(Libro), confronta_anni);
+int colonnare_presta(BibliotecaColonnare* col, const char* isbn, time_t data) {
+    int i = colonnare_cerca_isbn(col, isbn);
+    if (i < 0 || !colonnare_disponibile(col, i)) {
+        return 0;
+    }
+    col->disponibili[i / 64] &= ~(1ull << (i % 64));
+    col->date_prestito[i] = (int64_t)data;
+    return 1;
 }
 
-int salva_biblioteca(const Biblioteca* bib, const char* filename) {
-    FILE* file = fopen(filename, "wb");
-    if (file == NULL) {
-        fprintf(stderr, "Errore: impossibile aprire il file %s per la scrittura\n", filename);
+int colonnare_restituisci(BibliotecaColonnare* col, const char* isbn) {
+    int i = colonnare_cerca_isbn(col, isbn);
+    if (i < 0 || colonnare_disponibile(col, i)) {
         return 0;
     }
-    
-    // Scrivi il numero di libri
-    fwrite(&(bib->num_libri), sizeof(int), 1, file);
-    
-    // Scrivi i libri
-    fwrite(bib->libri, sizeof(Libro), bib->num_libri, file);
-    
-    fclose(file);
+    col->disponibili[i / 64] |= 1ull << (i % 64);
     return 1;
 }
 
-int carica_biblioteca(Biblioteca* bib, const char* filename) {
-    FILE* file = fopen(filename, "rb");
-    if (file == NULL) {
-        // Non è un errore se il file non esiste ancora
-        return 0;
+// Conta i libri disponibili leggendo solo la colonna dei bit, 64 libri per parola
+int colonnare_conta_disponibili(const BibliotecaColonnare* col) {
+    int conteggio = 0;
+    size_t parole_piene = (size_t)col->num_libri / 64;
+    
+    for (size_t k = 0; k < parole_piene; k++) {
+        conteggio += __builtin_popcountll(col->disponibili[k]);
+    }
+    if (col->num_libri % 64 != 0) {
+        uint64_t maschera = (1ull << (col->num_libri % 64)) - 1;
+        conteggio += __builtin_popcountll(col->disponibili[parole_piene] & maschera);
+    }
+    return conteggio;
+}
+
+// Posizioni dei libri pubblicati tra anno_da e anno_a (inclusi); scorre solo la colonna degli anni
+int* colonnare_filtra_per_anno(const BibliotecaColonnare* col, int anno_da, int anno_a, int* num_trovati) {
+    *num_trovati = 0;
+    for (int i = 0; i < col->num_libri; i++) {
+        *num_trovati += (col->anni[i] >= anno_da && col->anni[i] <= anno_a);
+    }
+    if (*num_trovati == 0) {
+        return NULL;
     }
     
-    // Leggi il numero di libri
-    int num_libri;
-    if (fread(&num_libri, sizeof(int), 1, file) != 1) {
-        fprintf(stderr, "Errore: impossibile leggere il numero di libri dal file\n");
-        fclose(file);
-        return 0;
+    int* risultati = (int*)malloc(*num_trovati * sizeof(int));
+    if (risultati == NULL) {
+        fprintf(stderr, "Errore: impossibile allocare memoria per i risultati\n");
+        *num_trovati = 0;
+        return NULL;
     }
     
-    // Assicurati che ci sia abbastanza spazio
-    if (num_libri > bib->capacita) {
-        bib->capacita = num_libri;
-        Libro* temp = (Libro*)realloc(bib->libri, bib->capacita * sizeof(Libro));
-        
-        if (temp == NULL) {
-            fprintf(stderr, "Errore: impossibile allocare memoria per i libri\n");
-            fclose(file);
-            return 0;
+    int k = 0;
+    for (int i = 0; i < col->num_libri; i++) {
+        if (col->anni[i] >= anno_da && col->anni[i] <= anno_a) {
+            risultati[k++] = i;
         }
-        
-        bib->libri = temp;
     }
+    return risultati;
+}
+
+// Anno minimo, massimo e medio di pubblicazione
+void colonnare_statistiche_anni(const BibliotecaColonnare* col, int* anno_min, int* anno_max,
+                                double* anno_medio) {
+    int64_t somma = 0;
+    *anno_min = col->num_libri > 0 ? col->anni[0] : 0;
+    *anno_max = *anno_min;
     
-    // Leggi i libri
-    if (fread(bib->libri, sizeof(Libro), num_libri, file) != num_libri) {
-        fprintf(stderr, "Errore: impossibile leggere i libri dal file\n");
-        fclose(file);
+    for (int i = 0; i < col->num_libri; i++) {
+        int anno = col->anni[i];
+        somma += anno;
+        if (anno < *anno_min) *anno_min = anno;
+        if (anno > *anno_max) *anno_max = anno;
+    }
+    *anno_medio = col->num_libri > 0 ? (double)somma / col->num_libri : 0.0;
+}
+
+// Numero di libri di un autore (nome esatto): un confronto tra interi per libro
+int colonnare_conta_per_autore(const BibliotecaColonnare* col, const char* autore) {
+    int32_t id = colonnare_interna_autore((BibliotecaColonnare*)col, autore, 0);
+    if (id < 0) {
         return 0;
     }
     
-    bib->num_libri = num_libri;
-    
-    fclose(file);
-    return 1;
+    int conteggio = 0;
+    for (int i = 0; i < col->num_libri; i++) {
+        conteggio += (col->id_autori[i] == (uint32_t)id);
+    }
+    return conteggio;
 }
 
 void stampa_libro(const Libro* libro) {
@@ -344,25 +4558,47 @@ void stampa_libro(const Libro* libro) {
     printf("\n");
 }
 
-void stampa_biblioteca(const Biblioteca* bib) {
+void stampa_biblioteca(Biblioteca* bib) {
     printf("=== Biblioteca (%d libri) ===\n\n", bib->num_libri);
     
-    for (int i = 0; i < bib->num_libri; i++) {
+    // Con un ordinamento attivo i libri vengono elencati tramite il suo indice
+    int num = bib->num_libri;
+    const int* ordine = NULL;
+    if (bib->vista != NESSUNA_VISTA) {
+        ordine = vista_ordinata(bib, (ChiaveOrdinamento)bib->vista, &num);
+    }
+    
+    for (int i = 0; i < num; i++) {
         printf("Libro %d:\n", i + 1);
-        stampa_libro(&(bib->libri[i]));
+        stampa_libro(&(bib->libri[ordine != NULL ? ordine[i] : i]));
     }
 }
 
-// Funzione principale per testare il sistema
+// Funzione principale per testare il sistema. Chi include questo file per
+// riusarne le funzioni (come bench_biblioteca.c e test_biblioteca.c) definisce
+// BIBLIOTECA_SENZA_MAIN.
+#ifndef BIBLIOTECA_SENZA_MAIN
 int main() {
     Biblioteca* bib = inizializza_biblioteca();
     if (bib == NULL) {
         return EXIT_FAILURE;
     }
     
-    // Prova a caricare la biblioteca dal file
-    if (carica_biblioteca(bib, FILENAME)) {
-        printf("Biblioteca caricata con successo dal file %s\n\n", FILENAME);
+    // Prova a caricare la biblioteca dal file e riapplica le operazioni
+    // registrate nel journal dopo l'ultimo salvataggio
+    int caricata = carica_biblioteca(bib, FILENAME);
+    int riapplicate = riapplica_journal(bib, FILENAME_JOURNAL);
+    if (riapplicate < 0 || !apri_journal(bib, FILENAME_JOURNAL)) {
+        libera_biblioteca(bib);
+        return EXIT_FAILURE;
+    }
+    
+    if (caricata || riapplicate > 0) {
+        printf("Biblioteca caricata con successo dal file %s", FILENAME);
+        if (riapplicate > 0) {
+            printf(" (%d operazioni riapplicate dal journal)", riapplicate);
+        }
+        printf("\n\n");
     } else {
         printf("Nessun file esistente. Creazione di una nuova biblioteca.\n\n");
         
@@ -372,6 +4608,7 @@ int main() {
         aggiungi_libro(bib, "Il signore degli anelli", "J.R.R. Tolkien", "9788830101531", 1954);
         aggiungi_libro(bib, "Fondazione", "Isaac Asimov", "9788804667049", 1951);
         aggiungi_libro(bib, "Il piccolo principe", "Antoine de Saint-Exupéry", "9788845278679", 1943);
+        journal_sincronizza(bib->journal);
     }
     
     // Menu principale
@@ -390,6 +4627,9 @@ int main() {
         printf("8. Ordina libri per titolo\n");
         printf("9. Ordina libri per autore\n");
         printf("10. Ordina libri per anno\n");
+        printf("11. Cerca libri per intervallo di anni\n");
+        printf("12. Importa libri da file CSV/TSV\n");
+        printf("13. Statistiche dei prestiti\n");
         printf("0. Esci\n");
         printf("Scelta: ");
         
@@ -428,7 +4668,7 @@ int main() {
                 
                 if (aggiungi_libro(bib, titolo, autore, isbn, anno)) {
                     printf("Libro aggiunto con successo!\n");
-                    salva_biblioteca(bib, FILENAME);
+                    journal_sincronizza(bib->journal);
                 }
                 break;
             }
@@ -458,13 +4698,13 @@ int main() {
                 autore[strcspn(autore, "\n")] = '\0';
                 
                 int num_trovati;
-                Libro* risultati = cerca_libri_per_autore(bib, autore, &num_trovati);
+                int* risultati = cerca_libri_per_autore(bib, autore, &num_trovati);
                 
                 if (risultati != NULL) {
                     printf("\nTrovati %d libri dell'autore '%s':\n\n", num_trovati, autore);
                     for (int i = 0; i < num_trovati; i++) {
                         printf("Libro %d:\n", i + 1);
-                        stampa_libro(&risultati[i]);
+                        stampa_libro(&(bib->libri[risultati[i]]));
                     }
                     free(risultati);
                 } else {
@@ -481,13 +4721,13 @@ int main() {
                 titolo[strcspn(titolo, "\n")] = '\0';
                 
                 int num_trovati;
-                Libro* risultati = cerca_libri_per_titolo(bib, titolo, &num_trovati);
+                int* risultati = cerca_libri_per_titolo(bib, titolo, &num_trovati);
                 
                 if (risultati != NULL) {
                     printf("\nTrovati %d libri con titolo contenente '%s':\n\n", num_trovati, titolo);
                     for (int i = 0; i < num_trovati; i++) {
                         printf("Libro %d:\n", i + 1);
-                        stampa_libro(&risultati[i]);
+                        stampa_libro(&(bib->libri[risultati[i]]));
                     }
                     free(risultati);
                 } else {
@@ -505,7 +4745,7 @@ int main() {
                 
                 if (presta_libro(bib, isbn)) {
                     printf("Libro prestato con successo!\n");
-                    salva_biblioteca(bib, FILENAME);
+                    journal_sincronizza(bib->journal);
                 }
                 break;
             }
@@ -519,7 +4759,7 @@ int main() {
                 
                 if (restituisci_libro(bib, isbn)) {
                     printf("Libro restituito con successo!\n");
-                    salva_biblioteca(bib, FILENAME);
+                    journal_sincronizza(bib->journal);
                 }
                 break;
             }
@@ -527,24 +4767,108 @@ int main() {
             case 8: // Ordina libri per titolo
                 ordina_per_titolo(bib);
                 printf("Libri ordinati per titolo\n");
-                salva_biblioteca(bib, FILENAME);
                 break;
                 
             case 9: // Ordina libri per autore
                 ordina_per_autore(bib);
                 printf("Libri ordinati per autore\n");
-                salva_biblioteca(bib, FILENAME);
                 break;
                 
             case 10: // Ordina libri per anno
                 ordina_per_anno(bib);
                 printf("Libri ordinati per anno di pubblicazione\n");
-                salva_biblioteca(bib, FILENAME);
                 break;
                 
+            case 11: { // Cerca libri per intervallo di anni
+                printf("Dall'anno: ");
+                fgets(buffer, sizeof(buffer), stdin);
+                int anno_da = atoi(buffer);
+                
+                printf("All'anno: ");
+                fgets(buffer, sizeof(buffer), stdin);
+                int anno_a = atoi(buffer);
+                
+                int num_trovati;
+                int* risultati = cerca_libri_per_anno(bib, anno_da, anno_a, &num_trovati);
+                
+                if (risultati != NULL) {
+                    printf("\nTrovati %d libri pubblicati tra il %d e il %d:\n\n", num_trovati, anno_da, anno_a);
+                    for (int i = 0; i < num_trovati; i++) {
+                        printf("Libro %d:\n", i + 1);
+                        stampa_libro(&(bib->libri[risultati[i]]));
+                    }
+                    free(risultati);
+                } else {
+                    printf("Nessun libro pubblicato tra il %d e il %d\n", anno_da, anno_a);
+                }
+                break;
+            }
+                
+            case 12: { // Importa libri da file CSV/TSV
+                char nome_file[FILENAME_MAX];
+                
+                printf("File da importare (titolo,autore,isbn,anno): ");
+                fgets(nome_file, sizeof(nome_file), stdin);
+                nome_file[strcspn(nome_file, "\n")] = '\0';
+                
+                FILE* file = fopen(nome_file, "rb");
+                if (file == NULL) {
+                    fprintf(stderr, "Errore: impossibile aprire il file %s\n", nome_file);
+                    break;
+                }
+                
+                // I file .tsv sono separati da tabulazioni, gli altri da virgole
+                size_t lunghezza = strlen(nome_file);
+                char separatore = lunghezza >= 4 && strcmp(nome_file + lunghezza - 4, ".tsv") == 0 ? '\t' : ',';
+                
+                int num_importati = 0;
+                if (importa_libri_da_file(bib, file, separatore, &num_importati)) {
+                    printf("Importati %d libri\n", num_importati);
+                }
+                fclose(file);
+                journal_sincronizza(bib->journal);
+                break;
+            }
+                
+            case 13: { // Statistiche dei prestiti
+                printf("Ultimi giorni da considerare (0 = tutto lo storico): ");
+                fgets(buffer, sizeof(buffer), stdin);
+                int giorni = atoi(buffer);
+                
+                time_t a = time(NULL);
+                time_t da = giorni > 0 ? a - (time_t)giorni * 24 * 60 * 60 : 0;
+                
+                ConteggioPrestiti classifica[10];
+                int num = libri_piu_prestati(bib, da, a, 10, classifica);
+                if (num == 0) {
+                    printf("Nessun prestito nel periodo indicato\n");
+                    break;
+                }
+                
+                printf("\nLibri più prestati:\n");
+                for (int i = 0; i < num; i++) {
+                    const Libro* libro = &(bib->libri[classifica[i].posizione]);
+                    printf("%2d. %s - %s (%d prestiti)\n", i + 1, libro->titolo, libro->autore,
+                           classifica[i].prestiti);
+                }
+                
+                int num_anni;
+                UtilizzoAnno* utilizzo = utilizzo_per_anno(bib, da, a, &num_anni);
+                if (utilizzo != NULL) {
+                    printf("\nUtilizzo per anno di pubblicazione:\n");
+                    for (int i = 0; i < num_anni; i++) {
+                        printf("%d: %d libri prestati su %d, %d prestiti\n", utilizzo[i].anno,
+                               utilizzo[i].libri_prestati, utilizzo[i].libri, utilizzo[i].prestiti);
+                    }
+                    free(utilizzo);
+                }
+                break;
+            }
+                
             case 0: // Esci
                 printf("Salvataggio della biblioteca...\n");
-                salva_biblioteca(bib, FILENAME);
+                avvia_compattazione(bib, FILENAME);
+                attendi_compattazione(bib);
                 printf("Arrivederci!\n");
                 break;
                 
@@ -552,25 +4876,76 @@ int main() {
                 printf("Scelta non valida. Riprova.\n");
         }
         
+        // Incorpora il journal in un nuovo snapshot quando diventa troppo grande
+        if (journal_da_compattare(bib)) {
+            avvia_compattazione(bib, FILENAME);
+        }
+        
     } while (scelta != 0);
     
     libera_biblioteca(bib);
     return EXIT_SUCCESS;
 }
+#endif
 
 /**
  * Compilazione ed esecuzione:
  * 
  * Su sistemi Linux/Unix:
- *   gcc -o biblioteca biblioteca.c
+ *   gcc -o biblioteca biblioteca.c -lpthread
  *   ./biblioteca
  * 
  * Su Windows con MinGW:
- *   gcc -o biblioteca biblioteca.c
+ *   gcc -o biblioteca biblioteca.c -lpthread
  *   biblioteca.exe
  * 
  * Note:
- * - Il programma salva i dati in un file binario chiamato "biblioteca.dat"
+ * - Il programma salva i dati in un file binario chiamato "biblioteca.dat", con
+ *   intestazione versionata, record allineati, blocco delle stringhe e checksum;
+ *   i file nel formato precedente vengono importati automaticamente
+ * - apri_archivio mappa il file in memoria e lo rende interrogabile subito
+ *   (archivio_cerca_per_isbn, archivio_leggi_libro) qualunque sia la sua
+ *   dimensione. Il menu invece usa carica_biblioteca, che verifica il
+ *   checksum e copia tutti i record per poterli modificare: l'avvio del
+ *   programma resta proporzionale alla dimensione del catalogo
+ * - Aggiunte, prestiti e restituzioni vengono registrati nel journal
+ *   "biblioteca.log" invece di riscrivere tutto il file; all'avvio il journal
+ *   viene riapplicato sopra l'ultimo snapshot e, quando supera una certa
+ *   dimensione, viene incorporato in un nuovo snapshot da un thread separato
+ * - Le operazioni del journal sono rese durevoli a gruppi: al più ogni
+ *   JOURNAL_OPERAZIONI_PER_SYNC operazioni o dopo JOURNAL_ATTESA_MAX_SECONDI,
+ *   anche se non ne arrivano altre (un thread scrive il gruppo in attesa).
+ *   Se la registrazione non riesce aggiunta, prestito e restituzione
+ *   restituiscono 0: la modifica resta in memoria e il prossimo salvataggio
+ *   la rende durevole
+ * - Gli ordinamenti non spostano i libri: ogni chiave (titolo, autore, anno) ha
+ *   un indice ordinato aggiornato a ogni aggiunta, usato anche per la ricerca
+ *   per intervallo di anni
+ * - ordina_fisicamente riordina l'array dei libri con un radix sort parallelo
+ *   (lo stesso usato per costruire in blocco gli indici ordinati)
  * - È possibile modificare il nome del file cambiando la costante FILENAME
  * - Il programma gestisce automaticamente l'espansione della memoria quando necessario
+ * - La ricerca per ISBN (usata anche da aggiunta, prestito e restituzione) passa
+ *   per una tabella hash, quindi costa O(1) anche su cataloghi molto grandi
+ * - Le ricerche per titolo e autore usano un indice di trigrammi e restituiscono
+ *   le posizioni dei libri trovati; le query più corte di 3 caratteri scorrono
+ *   l'intero catalogo
+ * - Dopo abilita_concorrenza più thread possono cercare (leggi_libro_per_isbn,
+ *   ricerche per titolo, autore e anno) senza lock mentre altri aggiungono,
+ *   prestano e restituiscono libri; le modifiche sono serializzate tra loro
+ * - importa_libri e importa_libri_da_file (opzione 12 del menu) caricano molti
+ *   libri insieme: lo spazio viene riservato una volta, i duplicati sono
+ *   scartati durante l'inserimento nell'indice ISBN e trigrammi e indici
+ *   ordinati vengono costruiti solo alla fine
+ * - I risultati delle ultime ricerche per titolo e autore restano in una cache
+ *   (configura_cache_ricerche, limiti per numero di voci e per memoria)
+ *   finché il catalogo non cambia; statistiche_cache_ricerche riporta
+ *   successi e mancati. La cache è divisa in segmenti con lock
+ *   lettori/scrittori e sceglie le voci da eliminare con l'algoritmo
+ *   dell'orologio, così le ricerche concorrenti che la trovano non si
+ *   attendono; con max_voci a 0 non prendono alcun lock
+ * - Ogni prestito viene registrato in uno storico compatto salvato insieme
+ *   al catalogo; conta_prestiti, libri_piu_prestati e utilizzo_per_anno
+ *   (opzione 13 del menu) rispondono su un intervallo di tempo visitando
+ *   solo i libri prestati e i blocchi che lo intersecano
  */
\ No newline at end of file
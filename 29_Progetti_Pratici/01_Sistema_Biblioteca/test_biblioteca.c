@@ -0,0 +1,371 @@
+/**
+ * Verifiche del Sistema di Gestione Biblioteca
+ *
+ * Esegue scenari completi sulle funzioni di biblioteca.c e controlla i
+ * risultati, stampando una riga per ogni verifica. Il programma termina con
+ * EXIT_FAILURE se almeno una verifica non è superata, quindi può essere
+ * usato prima di ogni modifica per confermare che il comportamento non è
+ * cambiato.
+ *
+ * Concetti applicati:
+ * - Riutilizzo di un programma come libreria tramite #include e macro
+ * - Verifiche automatiche con file temporanei
+ * - Thread che usano la stessa biblioteca in modalità concorrente
+ */
+
+#define BIBLIOTECA_SENZA_MAIN
+#include "biblioteca.c"
+
+#define FILE_TEST "test_biblioteca.dat"
+#define JOURNAL_TEST "test_biblioteca.journal"
+
+static int verifiche_fallite = 0;
+
+// Registra l'esito di una verifica
+static void verifica(int condizione, const char* descrizione) {
+    printf("%s: %s\n", condizione ? "OK" : "FALLITA", descrizione);
+    if (!condizione) {
+        verifiche_fallite++;
+    }
+}
+
+static void rimuovi_file_test() {
+    remove(FILE_TEST);
+    remove(JOURNAL_TEST);
+}
+
+// Un salvataggio diretto con il journal aperto deve riportare nello snapshot
+// l'ultima operazione registrata: al caricamento successivo nessuna
+// operazione del journal va riapplicata una seconda volta
+static void test_salvataggio_con_journal() {
+    rimuovi_file_test();
+    
+    Biblioteca* bib = inizializza_biblioteca();
+    if (bib == NULL || !apri_journal(bib, JOURNAL_TEST)) {
+        verifica(0, "apertura del journal");
+        libera_biblioteca(bib);
+        return;
+    }
+    aggiungi_libro(bib, "Il nome della rosa", "Umberto Eco", "9788845292613", 1980);
+    for (int i = 0; i < 2; i++) {
+        presta_libro(bib, "9788845292613");
+        restituisci_libro(bib, "9788845292613");
+    }
+    verifica(salva_biblioteca(bib, FILE_TEST), "salvataggio con il journal aperto");
+    chiudi_journal(bib);
+    libera_biblioteca(bib);
+    
+    bib = inizializza_biblioteca();
+    if (bib == NULL || !carica_biblioteca(bib, FILE_TEST)) {
+        verifica(0, "caricamento dello snapshot");
+        libera_biblioteca(bib);
+        rimuovi_file_test();
+        return;
+    }
+    int riapplicate = riapplica_journal(bib, JOURNAL_TEST);
+    verifica(riapplicate == 0, "nessuna operazione del journal riapplicata dopo il salvataggio");
+    verifica(bib->num_libri == 1, "un solo libro dopo il caricamento");
+    verifica(conta_prestiti(bib, "9788845292613", 0, (time_t)INT32_MAX) == 2,
+             "due prestiti nello storico dopo il caricamento");
+    libera_biblioteca(bib);
+    rimuovi_file_test();
+}
+
+// Dimensione del journal su disco, -1 se il file non esiste
+static long dimensione_journal() {
+    FILE* file = fopen(JOURNAL_TEST, "rb");
+    if (file == NULL) {
+        return -1;
+    }
+    fseek(file, 0, SEEK_END);
+    long dimensione = ftell(file);
+    fclose(file);
+    return dimensione;
+}
+
+static void attendi_millisecondi(int millisecondi) {
+#ifdef _WIN32
+    Sleep(millisecondi);
+#else
+    usleep((useconds_t)millisecondi * 1000);
+#endif
+}
+
+// Un gruppo di operazioni più piccolo di JOURNAL_OPERAZIONI_PER_SYNC deve
+// arrivare su disco entro JOURNAL_ATTESA_MAX_SECONDI anche se dopo non
+// arrivano altre operazioni
+static void test_sincronizzazione_periodica() {
+    rimuovi_file_test();
+    
+    Biblioteca* bib = inizializza_biblioteca();
+    if (bib == NULL || !apri_journal(bib, JOURNAL_TEST)) {
+        verifica(0, "apertura del journal");
+        libera_biblioteca(bib);
+        return;
+    }
+    aggiungi_libro(bib, "Il nome della rosa", "Umberto Eco", "9788845292613", 1980);
+    verifica(dimensione_journal() == 0, "operazione in attesa nel buffer");
+    
+    int attese = 0;
+    while (dimensione_journal() == 0 && attese++ < 10 * (JOURNAL_ATTESA_MAX_SECONDI + 2)) {
+        attendi_millisecondi(100);
+    }
+    verifica(dimensione_journal() > 0, "operazione scritta senza altre operazioni");
+    chiudi_journal(bib);
+    libera_biblioteca(bib);
+    rimuovi_file_test();
+}
+
+// Se il journal non si può scrivere le operazioni devono segnalarlo
+static void test_errore_journal() {
+    rimuovi_file_test();
+    
+    Biblioteca* bib = inizializza_biblioteca();
+    if (bib == NULL || !apri_journal(bib, JOURNAL_TEST)) {
+        verifica(0, "apertura del journal");
+        libera_biblioteca(bib);
+        return;
+    }
+    aggiungi_libro(bib, "Il nome della rosa", "Umberto Eco", "9788845292613", 1980);
+    journal_sincronizza(bib->journal);
+    
+    // Il file aperto in sola lettura fa fallire la scrittura del gruppo
+    pthread_mutex_lock(&bib->journal->mutex);
+    fclose(bib->journal->file);
+    bib->journal->file = fopen(JOURNAL_TEST, "rb");
+    pthread_mutex_unlock(&bib->journal->mutex);
+    
+    int errore = 0;
+    for (int i = 0; i < JOURNAL_OPERAZIONI_PER_SYNC && !errore; i++) {
+        errore = !presta_libro(bib, "9788845292613") || !restituisci_libro(bib, "9788845292613");
+    }
+    verifica(errore, "errore di scrittura del journal segnalato");
+    
+    pthread_mutex_lock(&bib->journal->mutex);
+    fclose(bib->journal->file);
+    bib->journal->file = fopen(JOURNAL_TEST, "ab");
+    pthread_mutex_unlock(&bib->journal->mutex);
+    verifica(journal_sincronizza(bib->journal), "operazioni in attesa scritte al tentativo successivo");
+    chiudi_journal(bib);
+    libera_biblioteca(bib);
+    rimuovi_file_test();
+}
+
+// Un indice ISBN senza slot liberi (file corrotto, aperto senza
+// verifica_archivio) non deve bloccare la ricerca di un ISBN assente
+static void test_archivio_indice_pieno() {
+    rimuovi_file_test();
+    
+    Biblioteca* bib = inizializza_biblioteca();
+    if (bib == NULL) {
+        verifica(0, "creazione della biblioteca");
+        return;
+    }
+    aggiungi_libro(bib, "Il nome della rosa", "Umberto Eco", "9788845292613", 1980);
+    int ok = salva_biblioteca(bib, FILE_TEST);
+    libera_biblioteca(bib);
+    
+    // Occupa tutti gli slot dell'indice con il primo libro
+    Archivio arch;
+    ok = ok && apri_archivio(&arch, FILE_TEST);
+    if (!ok) {
+        verifica(0, "salvataggio e apertura dell'archivio");
+        rimuovi_file_test();
+        return;
+    }
+    uint64_t off_indice = arch.intestazione->off_indice;
+    uint64_t capacita = arch.intestazione->capacita_indice;
+    chiudi_archivio(&arch);
+    
+    FILE* file = fopen(FILE_TEST, "r+b");
+    SlotIsbn slot = { 0, 0 };
+    ok = file != NULL && fseek(file, (long)off_indice, SEEK_SET) == 0;
+    for (uint64_t i = 0; ok && i < capacita; i++) {
+        ok = fwrite(&slot, sizeof(slot), 1, file) == 1;
+    }
+    if (file != NULL) {
+        fclose(file);
+    }
+    
+    ok = ok && apri_archivio(&arch, FILE_TEST);
+    verifica(ok, "apertura dell'archivio con l'indice senza slot liberi");
+    if (ok) {
+        verifica(archivio_cerca_per_isbn(&arch, "9780000000000") == -1,
+                 "ricerca di un ISBN assente nell'indice senza slot liberi");
+        chiudi_archivio(&arch);
+    }
+    rimuovi_file_test();
+}
+
+// Gli autori vengono internati una sola volta e la loro tabella resta
+// sempre meno che piena a metà, anche mentre cresce
+static void test_colonnare_autori() {
+    BibliotecaColonnare* col = crea_biblioteca_colonnare();
+    if (col == NULL) {
+        verifica(0, "creazione del catalogo a colonne");
+        return;
+    }
+    
+    int ok = 1;
+    int carico_valido = 1;
+    for (int i = 0; i < 2000; i++) {
+        char autore[MAX_AUTORE];
+        char isbn[MAX_ISBN];
+        snprintf(autore, sizeof(autore), "Autore %d", i % 500);
+        snprintf(isbn, sizeof(isbn), "978%010d", i);
+        ok = ok && colonnare_aggiungi(col, "Titolo", autore, isbn, 2000);
+        carico_valido = carico_valido && 2 * col->num_autori <= col->capacita_tabella_autori;
+    }
+    verifica(ok, "aggiunta di 2000 libri di 500 autori");
+    verifica(col->num_autori == 500, "500 autori internati");
+    verifica(carico_valido, "tabella degli autori mai oltre metà");
+    
+    int conteggi_validi = 1;
+    for (int a = 0; a < 500; a++) {
+        char autore[MAX_AUTORE];
+        snprintf(autore, sizeof(autore), "Autore %d", a);
+        conteggi_validi = conteggi_validi && colonnare_conta_per_autore(col, autore) == 4;
+    }
+    verifica(conteggi_validi, "quattro libri per ogni autore");
+    verifica(colonnare_conta_per_autore(col, "Autore assente") == 0, "autore assente non trovato");
+    libera_biblioteca_colonnare(col);
+}
+
+// Numero di libri che contengono la query nel titolo, 0 in caso di errore
+static int conta_per_titolo(Biblioteca* bib, const char* titolo) {
+    int num = 0;
+    int* risultati = cerca_libri_per_titolo(bib, titolo, &num);
+    free(risultati);
+    return risultati != NULL ? num : 0;
+}
+
+typedef struct {
+    Biblioteca* bib;
+    int risultati_validi;
+} ArgomentiRicerche;
+
+// Ripete le stesse ricerche: quasi tutte vengono trovate nella cache
+static void* esegui_ricerche(void* argomento) {
+    ArgomentiRicerche* args = (ArgomentiRicerche*)argomento;
+    args->risultati_validi = 1;
+    for (int i = 0; i < 20000; i++) {
+        char query[32];
+        snprintf(query, sizeof(query), "Titolo %d-", i % 64);
+        args->risultati_validi = args->risultati_validi && conta_per_titolo(args->bib, query) == 2;
+    }
+    return NULL;
+}
+
+// La cache restituisce i risultati delle ricerche ripetute, li scarta quando
+// il catalogo cambia e, da disattivata, lascia passare ogni ricerca all'indice
+static void test_cache_ricerche() {
+    Biblioteca* bib = inizializza_biblioteca();
+    if (bib == NULL) {
+        verifica(0, "creazione della biblioteca");
+        return;
+    }
+    for (int i = 0; i < 128; i++) {
+        char titolo[MAX_TITOLO];
+        char isbn[MAX_ISBN];
+        snprintf(titolo, sizeof(titolo), "Titolo %d-%d", i % 64, i);
+        snprintf(isbn, sizeof(isbn), "978%010d", i);
+        aggiungi_libro(bib, titolo, "Autore", isbn, 2000);
+    }
+    
+    StatisticheCache statistiche;
+    conta_per_titolo(bib, "Titolo 7-");
+    int num = conta_per_titolo(bib, "Titolo 7-");
+    statistiche_cache_ricerche(bib, &statistiche);
+    verifica(num == 2 && statistiche.successi == 1 && statistiche.mancati == 1,
+             "ricerca ripetuta trovata nella cache");
+    
+    aggiungi_libro(bib, "Titolo 7-nuovo", "Autore", "9789999999999", 2000);
+    verifica(conta_per_titolo(bib, "Titolo 7-") == 3, "cache invalidata da una modifica");
+    
+    configura_cache_ricerche(bib, 4, CACHE_MAX_BYTE);
+    int limite_rispettato = 1;
+    for (int i = 0; i < 64; i++) {
+        char query[32];
+        snprintf(query, sizeof(query), "Titolo %d-", i);
+        conta_per_titolo(bib, query);
+        statistiche_cache_ricerche(bib, &statistiche);
+        limite_rispettato = limite_rispettato && statistiche.voci <= 4;
+    }
+    verifica(limite_rispettato, "numero di voci entro il limite");
+    
+    configura_cache_ricerche(bib, 0, 0);
+    statistiche_cache_ricerche(bib, &statistiche);
+    uint64_t mancati = statistiche.mancati;
+    conta_per_titolo(bib, "Titolo 7-");
+    conta_per_titolo(bib, "Titolo 7-");
+    statistiche_cache_ricerche(bib, &statistiche);
+    verifica(statistiche.voci == 0 && statistiche.mancati == mancati, "cache disattivata");
+    libera_biblioteca(bib);
+    
+    // Ricerche concorrenti sugli stessi segmenti
+    bib = inizializza_biblioteca();
+    if (bib == NULL || !abilita_concorrenza(bib)) {
+        verifica(0, "biblioteca in modalità concorrente");
+        if (bib != NULL) {
+            libera_biblioteca(bib);
+        }
+        return;
+    }
+    for (int i = 0; i < 128; i++) {
+        char titolo[MAX_TITOLO];
+        char isbn[MAX_ISBN];
+        snprintf(titolo, sizeof(titolo), "Titolo %d-%d", i % 64, i);
+        snprintf(isbn, sizeof(isbn), "978%010d", i);
+        aggiungi_libro(bib, titolo, "Autore", isbn, 2000);
+    }
+    pthread_t thread[4];
+    ArgomentiRicerche args[4];
+    for (int t = 0; t < 4; t++) {
+        args[t].bib = bib;
+        pthread_create(&thread[t], NULL, esegui_ricerche, &args[t]);
+    }
+    int tutti_validi = 1;
+    for (int t = 0; t < 4; t++) {
+        pthread_join(thread[t], NULL);
+        tutti_validi = tutti_validi && args[t].risultati_validi;
+    }
+    statistiche_cache_ricerche(bib, &statistiche);
+    verifica(tutti_validi, "risultati corretti con ricerche concorrenti");
+    verifica(statistiche.successi + statistiche.mancati == 4 * 20000 &&
+             statistiche.successi > statistiche.mancati,
+             "ricerche concorrenti servite dalla cache");
+    libera_biblioteca(bib);
+}
+
+int main() {
+    test_salvataggio_con_journal();
+    test_sincronizzazione_periodica();
+    test_errore_journal();
+    test_archivio_indice_pieno();
+    test_colonnare_autori();
+    test_cache_ricerche();
+    
+    if (verifiche_fallite > 0) {
+        printf("%d verifiche fallite\n", verifiche_fallite);
+        return EXIT_FAILURE;
+    }
+    printf("Tutte le verifiche superate\n");
+    return EXIT_SUCCESS;
+}
+
+/**
+ * Compilazione ed esecuzione:
+ *
+ * Su sistemi Linux/Unix:
+ *   gcc -o test_biblioteca test_biblioteca.c -lpthread
+ *   ./test_biblioteca
+ *
+ * Su Windows con MinGW:
+ *   gcc -o test_biblioteca test_biblioteca.c -lpthread
+ *   test_biblioteca.exe
+ *
+ * Note:
+ * - Come bench_biblioteca.c include biblioteca.c definendo
+ *   BIBLIOTECA_SENZA_MAIN, quindi verifica il codice del programma principale
+ * - I file temporanei vengono creati nella cartella corrente e rimossi alla fine
+ */
\ No newline at end of file
@@ -8,6 +8,7 @@
  * - Programmazione di rete con socket
  * - Multithreading per gestire invio e ricezione simultanei
  * - Gestione degli errori
+ * - Protocollo opzionale a frame con lunghezza, tipo e mittente (protocollo.h)
  */
 
 #include <stdio.h>
@@ -34,6 +35,8 @@
     #define close_socket close
 #endif
 
+#include "protocollo.h"
+
 #define BUFFER_SIZE 1024
 #define DEFAULT_PORT 8888
 #define DEFAULT_SERVER "127.0.0.1"
@@ -44,20 +47,56 @@ socket_t client_socket;
 // Flag per indicare se il client è in esecuzione
 int running = 1;
 
+// 1 se si usa il protocollo a frame (--framed) invece delle righe di testo
+int framed_protocol = 0;
+
 // Funzione per gestire gli errori
 void error(const char *msg) {
     perror(msg);
     exit(EXIT_FAILURE);
 }
 
+// Stampa i frame completi ricevuti; 0 se il server ha inviato un frame non valido
+int print_frames(frame_buffer_t *input) {
+    frame_t frame;
+    int found;
+    
+    while ((found = frame_next(input, &frame)) > 0) {
+        if (frame.type == FRAME_PROMPT) {
+            printf("%.*s", (int)frame.length, frame.payload);
+        } else {
+            printf("%.*s\n", (int)frame.length, frame.payload);
+        }
+    }
+    fflush(stdout);
+    return found == 0;
+}
+
 // Thread per ricevere messaggi dal server
 void *receive_messages(void *arg) {
-    char buffer[BUFFER_SIZE];
-    int read_size;
+    char buffer[FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD];
+    frame_buffer_t input = { buffer, sizeof(buffer), 0, 0 };
+    int read_size = 0;
     
-    while (running && (read_size = recv(client_socket, buffer, BUFFER_SIZE, 0)) > 0) {
-        buffer[read_size] = '\0';
-        printf("%s", buffer);
+    (void)arg;
+    if (framed_protocol) {
+        // I frame vengono stampati direttamente dal buffer di ricezione
+        size_t space;
+        char *dest = frame_buffer_space(&input, &space);
+        while (running && (read_size = recv(client_socket, dest, (int)space, 0)) > 0) {
+            input.end += (size_t)read_size;
+            if (!print_frames(&input)) {
+                printf("\nProtocollo non valido: il server usa le righe di testo?\n");
+                read_size = 0;
+                break;
+            }
+            dest = frame_buffer_space(&input, &space);
+        }
+    } else {
+        while (running && (read_size = recv(client_socket, buffer, BUFFER_SIZE - 1, 0)) > 0) {
+            buffer[read_size] = '\0';
+            printf("%s", buffer);
+        }
     }
     
     if (read_size == 0) {
@@ -70,20 +109,49 @@ void *receive_messages(void *arg) {
     pthread_exit(NULL);
 }
 
+// Invia una riga digitata dall'utente come frame: la prima è il nome,
+// "exit" chiede la disconnessione, "/join <stanza>" cambia stanza, le
+// altre sono messaggi di chat
+int send_frame(const char *line, int *named) {
+    char frame[FRAME_HEADER_SIZE + BUFFER_SIZE];
+    size_t len = strlen(line);
+    int type = FRAME_CHAT;
+    
+    if (!*named) {
+        type = FRAME_NAME;
+    } else if (strcmp(line, "exit") == 0) {
+        type = FRAME_EXIT;
+        len = 0;
+    } else if (strncmp(line, "/join ", 6) == 0) {
+        type = FRAME_ROOM;
+        line += 6;
+        len -= 6;
+    }
+    *named = 1;
+    size_t size = frame_encode(frame, type, 0, line, len);
+    return send(client_socket, frame, (int)size, 0) == (int)size;
+}
+
 int main(int argc, char *argv[]) {
     struct sockaddr_in server_addr;
     pthread_t receive_thread;
     char buffer[BUFFER_SIZE];
     char *server_ip = DEFAULT_SERVER;
     int port = DEFAULT_PORT;
+    int named = 0;
+    int positional = 0;
     
     // Controlla gli argomenti della riga di comando
-    if (argc >= 2) {
-        server_ip = argv[1];
-    }
-    
-    if (argc >= 3) {
-        port = atoi(argv[2]);
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--framed") == 0) {
+            framed_protocol = 1;
+        } else if (positional == 0) {
+            server_ip = argv[i];
+            positional++;
+        } else if (positional == 1) {
+            port = atoi(argv[i]);
+            positional++;
+        }
     }
     
 #ifdef _WIN32
@@ -129,7 +197,13 @@ int main(int argc, char *argv[]) {
         }
         
         // Invia il messaggio al server
-        if (send(client_socket, buffer, strlen(buffer), 0) < 0) {
+        if (framed_protocol) {
+            buffer[strcspn(buffer, "\r\n")] = '\0';
+            if (!send_frame(buffer, &named)) {
+                printf("Errore nell'invio del messaggio\n");
+                break;
+            }
+        } else if (send(client_socket, buffer, strlen(buffer), 0) < 0) {
             printf("Errore nell'invio del messaggio\n");
             break;
         }
@@ -164,14 +238,19 @@ int main(int argc, char *argv[]) {
  * 
  * Su sistemi Linux/Unix:
  *   gcc -o client client.c -lpthread
- *   ./client [server_ip] [port]
+ *   ./client [server_ip] [port] [--framed]
  * 
  * Su Windows con MinGW:
  *   gcc -o client client.c -lws2_32 -lpthread
- *   client.exe [server_ip] [port]
+ *   client.exe [server_ip] [port] [--framed]
  * 
  * Note:
  * - Se non specificati, l'indirizzo IP predefinito è 127.0.0.1 (localhost) e la porta è 8888
  * - Per disconnettersi, digitare "exit" e premere Invio
+ * - Per cambiare stanza, digitare "/join <stanza>": si ricevono solo i
+ *   messaggi dei client nella stessa stanza (all'inizio "generale")
  * - Il client gestisce sia l'invio che la ricezione di messaggi in modo asincrono
+ * - Con --framed il client usa il protocollo a frame: va avviato anche il
+ *   server con --framed. Ogni riga digitata diventa un frame (la prima è il
+ *   nome) e i messaggi ricevuti vengono stampati uno per riga
  */
\ No newline at end of file
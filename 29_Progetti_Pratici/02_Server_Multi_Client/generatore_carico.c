@@ -0,0 +1,604 @@
+/**
+ * Generatore di carico per il Server Multi-client
+ *
+ * Questo programma simula da un solo processo migliaia di client della chat:
+ * apre le connessioni, invia i nomi, distribuisce i client tra le stanze e
+ * poi invia messaggi al ritmo richiesto. Ogni messaggio contiene l'istante
+ * in cui è stato inviato, quindi chi lo riceve può misurare la latenza di
+ * consegna end-to-end (dall'invio del mittente alla ricezione di ciascun
+ * destinatario, attraverso il server).
+ *
+ * Alla fine stampa messaggi inviati, consegne ricevute e attese, throughput
+ * e i percentili della latenza.
+ *
+ * Concetti applicati:
+ * - I/O non bloccante e multiplexing con epoll, anche per connect()
+ * - Macchina a stati per ogni connessione simulata
+ * - Controllo del ritmo di invio (messaggi al secondo)
+ * - Misura della latenza con un orologio monotono e istogramma log-lineare
+ *   (istogramma.h, lo stesso delle statistiche del server)
+ * - Protocollo a righe di testo o a frame (protocollo.h)
+ */
+
+#ifndef __linux__
+#error "Il generatore di carico usa epoll ed è disponibile solo su Linux"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "protocollo.h"
+#include "istogramma.h"
+
+#define BUFFER_SIZE 1024                    // Come nel server: lunghezza massima di una riga
+#define DEFAULT_PORT 8888
+#define DEFAULT_SERVER "127.0.0.1"
+#define INPUT_SIZE (FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD)
+#define OUTPUT_SIZE (4 * (FRAME_HEADER_SIZE + BUFFER_SIZE))
+#define MAX_EVENTS 256
+#define NS_PER_SEC 1000000000ULL
+#define CONNECT_TIMEOUT_NS (10 * NS_PER_SEC) // Tempo massimo per connessioni e nomi
+#define SETTLE_NS (NS_PER_SEC / 2)          // Attesa dopo i cambi di stanza
+#define DRAIN_NS NS_PER_SEC                 // Attesa dei messaggi in viaggio a fine prova
+#define MARKER "lg:"                        // Precede l'istante di invio nel testo
+
+// Stati di un client simulato
+enum {
+    SIM_CONNECTING,     // connect() in corso
+    SIM_CONNECTED,      // In attesa della richiesta del nome
+    SIM_NAMED,          // Nome inviato: può ricevere e inviare messaggi
+    SIM_CLOSED
+};
+
+// Fasi della prova
+enum {
+    PHASE_CONNECT,      // Connessioni e invio dei nomi
+    PHASE_SETTLE,       // Cambi di stanza e notifiche di ingresso
+    PHASE_RUN,          // Invio dei messaggi al ritmo richiesto
+    PHASE_DRAIN,        // Attesa degli ultimi messaggi
+    PHASE_DONE
+};
+
+// Un client simulato
+typedef struct {
+    int socket;
+    int id;
+    int state;
+    int room;
+    int want_write;             // EPOLLOUT registrato perché l'output è in attesa
+    char in_buf[INPUT_SIZE];
+    frame_buffer_t input;       // Byte ricevuti ma non ancora elaborati
+    char out_buf[OUTPUT_SIZE];
+    size_t out_len;
+} sim_client_t;
+
+// Parametri della prova, impostabili da riga di comando
+typedef struct {
+    const char *server_ip;
+    int port;
+    int num_clients;
+    double rate;                // Messaggi al secondo, sommati su tutti i client
+    double duration;            // Secondi di invio
+    int num_rooms;              // 1 = tutti nella stanza predefinita
+    int message_size;           // Byte di testo per messaggio
+    int framed;
+} load_params_t;
+
+// Stato della prova
+typedef struct {
+    load_params_t params;
+    int epoll_fd;
+    sim_client_t *clients;
+    int *room_members;          // Client con nome in ogni stanza, per le consegne attese
+    int phase;
+    int next_sender;
+    int num_named;
+    int num_failed;
+    int num_lost;               // Client disconnessi dopo aver inviato il nome
+    uint64_t sent;
+    uint64_t skipped;           // Messaggi non inviati perché l'output del client era pieno
+    uint64_t expected;
+    uint64_t received;
+    uint64_t bytes_received;
+    uint64_t run_start;
+    histogram_t latency;
+} load_t;
+
+// Funzione per gestire gli errori
+void error(const char *msg) {
+    perror(msg);
+    exit(EXIT_FAILURE);
+}
+
+uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_SEC + (uint64_t)ts.tv_nsec;
+}
+
+// Le connessioni simulate sono molte più del limite predefinito di descrittori
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+static void sim_close(load_t *load, sim_client_t *client) {
+    if (client->state == SIM_CLOSED) {
+        return;
+    }
+    if (client->state == SIM_NAMED) {
+        load->num_lost++;
+        if (load->phase >= PHASE_RUN) {
+            load->room_members[client->room]--;
+        }
+    } else {
+        load->num_failed++;
+    }
+    client->state = SIM_CLOSED;
+    close(client->socket);    // Lo toglie anche dall'insieme di epoll
+}
+
+static void sim_watch_output(load_t *load, sim_client_t *client, int want_write) {
+    struct epoll_event event;
+
+    if (client->want_write == want_write) {
+        return;
+    }
+    event.events = EPOLLIN | EPOLLRDHUP | (want_write ? EPOLLOUT : 0);
+    event.data.ptr = client;
+    epoll_ctl(load->epoll_fd, EPOLL_CTL_MOD, client->socket, &event);
+    client->want_write = want_write;
+}
+
+// Invia l'output in attesa; quello che il socket non accetta resta nel
+// buffer e viene inviato quando epoll segnala EPOLLOUT
+static void sim_flush(load_t *load, sim_client_t *client) {
+    size_t offset = 0;
+
+    while (offset < client->out_len) {
+        ssize_t n = send(client->socket, client->out_buf + offset, client->out_len - offset,
+                         MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                sim_close(load, client);
+                return;
+            }
+            break;
+        }
+        offset += (size_t)n;
+    }
+    memmove(client->out_buf, client->out_buf + offset, client->out_len - offset);
+    client->out_len -= offset;
+    sim_watch_output(load, client, client->out_len > 0);
+}
+
+// Accoda un messaggio come riga di testo o come frame; 0 se non c'è spazio
+static int sim_send(load_t *load, sim_client_t *client, int type, const char *text, size_t len) {
+    size_t size = load->params.framed ? FRAME_HEADER_SIZE + len : len + 1;
+
+    if (client->out_len + size > OUTPUT_SIZE) {
+        return 0;
+    }
+    char *out = client->out_buf + client->out_len;
+    if (load->params.framed) {
+        frame_encode(out, type, 0, text, len);
+    } else {
+        memcpy(out, text, len);
+        out[len] = '\n';
+    }
+    client->out_len += size;
+    if (!client->want_write) {
+        sim_flush(load, client);
+    }
+    return 1;
+}
+
+// Cerca MARKER nel testo e restituisce l'istante che lo segue, 0 se manca
+static uint64_t find_timestamp(const char *text, size_t len) {
+    size_t marker_len = strlen(MARKER);
+
+    for (size_t i = 0; i + marker_len < len; i++) {
+        if (memcmp(text + i, MARKER, marker_len) == 0) {
+            uint64_t value = 0;
+            for (i += marker_len; i < len && text[i] >= '0' && text[i] <= '9'; i++) {
+                value = value * 10 + (uint64_t)(text[i] - '0');
+            }
+            return value;
+        }
+    }
+    return 0;
+}
+
+// Elabora un messaggio ricevuto: la richiesta del nome o un messaggio di chat
+static void sim_handle_message(load_t *load, sim_client_t *client, int type,
+                               const char *text, size_t len) {
+    if (client->state == SIM_CONNECTED) {
+        char name[32];
+        int name_len = snprintf(name, sizeof(name), "c%d", client->id);
+
+        (void)type;
+        client->state = SIM_NAMED;
+        load->num_named++;
+        sim_send(load, client, FRAME_NAME, name, (size_t)name_len);
+        return;
+    }
+
+    uint64_t sent_at = find_timestamp(text, len);
+    if (sent_at != 0 && sent_at >= load->run_start) {
+        load->received++;
+        histogram_add(&load->latency, now_ns() - sent_at);
+    }
+}
+
+// Riceve tutto quello che è disponibile e lo divide in righe o frame
+static void sim_handle_read(load_t *load, sim_client_t *client) {
+    frame_buffer_t *input = &client->input;
+
+    for (;;) {
+        size_t space;
+        char *dest = frame_buffer_space(input, &space);
+        if (space == 0) {
+            // Riga più lunga del buffer: non è un messaggio del generatore
+            input->start = input->end = 0;
+            dest = frame_buffer_space(input, &space);
+        }
+
+        ssize_t n = recv(client->socket, dest, space, 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                sim_close(load, client);
+            }
+            return;
+        }
+        input->end += (size_t)n;
+        load->bytes_received += (uint64_t)n;
+
+        if (load->params.framed) {
+            frame_t frame;
+            int found;
+            while ((found = frame_next(input, &frame)) > 0) {
+                sim_handle_message(load, client, frame.type, frame.payload, frame.length);
+            }
+            if (found < 0) {
+                sim_close(load, client);
+                return;
+            }
+        } else if (client->state == SIM_CONNECTED) {
+            // La richiesta del nome non termina con '\n'
+            input->start = input->end;
+            sim_handle_message(load, client, FRAME_PROMPT, NULL, 0);
+        } else {
+            char *line = input->data + input->start;
+            char *newline;
+            while ((newline = memchr(line, '\n', (size_t)(input->data + input->end - line))) != NULL) {
+                sim_handle_message(load, client, FRAME_CHAT, line, (size_t)(newline - line));
+                line = newline + 1;
+            }
+            input->start = (size_t)(line - input->data);
+        }
+        if (client->state == SIM_CLOSED) {
+            return;
+        }
+    }
+}
+
+static void sim_handle_event(load_t *load, sim_client_t *client, uint32_t events) {
+    if (client->state == SIM_CONNECTING) {
+        int err = 0;
+        socklen_t err_len = sizeof(err);
+        if (!(events & EPOLLOUT) ||
+            getsockopt(client->socket, SOL_SOCKET, SO_ERROR, &err, &err_len) < 0 || err != 0) {
+            sim_close(load, client);
+            return;
+        }
+        client->state = SIM_CONNECTED;
+        client->want_write = 1;
+        sim_watch_output(load, client, 0);
+    }
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        sim_handle_read(load, client);
+    }
+    if (client->state != SIM_CLOSED && (events & EPOLLOUT)) {
+        sim_flush(load, client);
+    }
+}
+
+// Avvia la connect() non bloccante di un client
+static void sim_connect(load_t *load, sim_client_t *client, const struct sockaddr_in *addr) {
+    struct epoll_event event;
+
+    client->state = SIM_CONNECTING;
+    client->input.data = client->in_buf;
+    client->input.size = sizeof(client->in_buf);
+    client->socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (client->socket < 0) {
+        perror("Errore nella creazione del socket");
+        client->state = SIM_CLOSED;
+        load->num_failed++;
+        return;
+    }
+    if (connect(client->socket, (const struct sockaddr *)addr, sizeof(*addr)) < 0 &&
+        errno != EINPROGRESS) {
+        sim_close(load, client);
+        return;
+    }
+
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    event.data.ptr = client;
+    if (epoll_ctl(load->epoll_fd, EPOLL_CTL_ADD, client->socket, &event) < 0) {
+        perror("Errore nella registrazione del socket");
+        sim_close(load, client);
+    }
+}
+
+// Con più stanze ogni client entra nella sua, scelta a turno
+static void join_rooms(load_t *load) {
+    for (int i = 0; i < load->params.num_clients; i++) {
+        sim_client_t *client = &load->clients[i];
+        client->room = i % load->params.num_rooms;
+        if (client->state == SIM_NAMED && load->params.num_rooms > 1) {
+            char room[32];
+            int len = snprintf(room, sizeof(room), "carico%d", client->room);
+            if (load->params.framed) {
+                sim_send(load, client, FRAME_ROOM, room, (size_t)len);
+            } else {
+                char line[40];
+                len = snprintf(line, sizeof(line), "/join %s", room);
+                sim_send(load, client, FRAME_ROOM, line, (size_t)len);
+            }
+        }
+    }
+}
+
+// Prima dell'invio conta i client di ogni stanza: ogni messaggio deve
+// arrivare a tutti quelli della stanza del mittente tranne lui
+static void count_room_members(load_t *load) {
+    for (int i = 0; i < load->params.num_clients; i++) {
+        if (load->clients[i].state == SIM_NAMED) {
+            load->room_members[load->clients[i].room]++;
+        }
+    }
+}
+
+// Invia i messaggi dovuti fino a now, scegliendo i mittenti a turno
+static void send_due(load_t *load, uint64_t now) {
+    char text[BUFFER_SIZE];
+    uint64_t due = (uint64_t)(load->params.rate * (double)(now - load->run_start) / NS_PER_SEC);
+
+    while (load->sent + load->skipped < due) {
+        sim_client_t *client = NULL;
+        for (int tries = 0; tries < load->params.num_clients; tries++) {
+            sim_client_t *candidate = &load->clients[load->next_sender];
+            load->next_sender = (load->next_sender + 1) % load->params.num_clients;
+            if (candidate->state == SIM_NAMED) {
+                client = candidate;
+                break;
+            }
+        }
+        if (client == NULL) {
+            return;    // Nessun client ancora connesso
+        }
+
+        int len = snprintf(text, sizeof(text), MARKER "%llu ", (unsigned long long)now_ns());
+        if (len < load->params.message_size) {
+            memset(text + len, 'x', (size_t)(load->params.message_size - len));
+            len = load->params.message_size;
+        }
+        if (sim_send(load, client, FRAME_CHAT, text, (size_t)len)) {
+            load->sent++;
+            load->expected += (uint64_t)(load->room_members[client->room] - 1);
+        } else {
+            load->skipped++;
+        }
+    }
+}
+
+static void print_report(const load_t *load, double seconds) {
+    const histogram_t *lat = &load->latency;
+
+    printf("Client connessi: %d di %d (%d falliti, %d persi durante la prova)\n",
+           load->num_named, load->params.num_clients, load->num_failed, load->num_lost);
+    printf("Durata dell'invio: %.2f s\n", seconds);
+    printf("Messaggi inviati: %llu (%.1f al secondo), non inviati per output pieno: %llu\n",
+           (unsigned long long)load->sent, (double)load->sent / seconds,
+           (unsigned long long)load->skipped);
+    printf("Consegne ricevute: %llu di %llu attese (%.1f al secondo, %.2f MB/s ricevuti)\n",
+           (unsigned long long)load->received, (unsigned long long)load->expected,
+           (double)load->received / seconds, (double)load->bytes_received / seconds / 1e6);
+    if (counter_get(&lat->total) == 0) {
+        printf("Latenza: nessun messaggio ricevuto\n");
+        return;
+    }
+    printf("Latenza (us): media %.1f, p50 %.1f, p90 %.1f, p99 %.1f, p99.9 %.1f, max %.1f\n",
+           histogram_mean(lat) / 1e3,
+           histogram_percentile(lat, 0.50) / 1e3, histogram_percentile(lat, 0.90) / 1e3,
+           histogram_percentile(lat, 0.99) / 1e3, histogram_percentile(lat, 0.999) / 1e3,
+           counter_get(&lat->max) / 1e3);
+}
+
+int main(int argc, char *argv[]) {
+    struct sockaddr_in server_addr;
+    struct epoll_event events[MAX_EVENTS];
+    load_t load;
+    int positional = 0;
+    uint64_t start, phase_start, run_end = 0;
+
+    memset(&load, 0, sizeof(load));
+    load.params.server_ip = DEFAULT_SERVER;
+    load.params.port = DEFAULT_PORT;
+    load.params.num_clients = 1000;
+    load.params.rate = 1000;
+    load.params.duration = 10;
+    load.params.num_rooms = 1;
+    load.params.message_size = 64;
+
+    // Controlla gli argomenti della riga di comando
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--framed") == 0) {
+            load.params.framed = 1;
+        } else if (strcmp(argv[i], "--clients") == 0 && i + 1 < argc) {
+            load.params.num_clients = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rate") == 0 && i + 1 < argc) {
+            load.params.rate = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--duration") == 0 && i + 1 < argc) {
+            load.params.duration = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--rooms") == 0 && i + 1 < argc) {
+            load.params.num_rooms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            load.params.message_size = atoi(argv[++i]);
+        } else if (argv[i][0] != '-' && positional == 0) {
+            load.params.server_ip = argv[i];
+            positional++;
+        } else if (argv[i][0] != '-' && positional == 1) {
+            load.params.port = atoi(argv[i]);
+            positional++;
+        } else {
+            printf("Uso: %s [server_ip] [port] [--clients N] [--rate MSG/S] [--duration S]\n"
+                   "          [--rooms N] [--size BYTE] [--framed]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    // Il server formatta "nome: testo" in righe di al più BUFFER_SIZE byte
+    if (load.params.num_clients < 2 || load.params.rate <= 0 || load.params.duration <= 0 ||
+        load.params.num_rooms < 1 || load.params.message_size < 32 ||
+        load.params.message_size > BUFFER_SIZE - 64) {
+        printf("Parametri non validi: almeno 2 client, dimensione tra 32 e %d byte\n",
+               BUFFER_SIZE - 64);
+        return EXIT_FAILURE;
+    }
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_port = htons(load.params.port);
+    if (inet_pton(AF_INET, load.params.server_ip, &server_addr.sin_addr) <= 0) {
+        error("Indirizzo IP non valido");
+    }
+
+    raise_fd_limit();
+    load.clients = (sim_client_t *)calloc((size_t)load.params.num_clients, sizeof(sim_client_t));
+    load.room_members = (int *)calloc((size_t)load.params.num_rooms, sizeof(int));
+    if (load.clients == NULL || load.room_members == NULL) {
+        error("Errore nell'allocazione dei client");
+    }
+    load.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (load.epoll_fd < 0) {
+        error("Errore nella creazione di epoll");
+    }
+
+    printf("Connessione di %d client a %s:%d...\n", load.params.num_clients,
+           load.params.server_ip, load.params.port);
+    load.phase = PHASE_CONNECT;
+    for (int i = 0; i < load.params.num_clients; i++) {
+        load.clients[i].id = i;
+        sim_connect(&load, &load.clients[i], &server_addr);
+    }
+    start = phase_start = now_ns();
+
+    // Loop degli eventi; durante l'invio si risveglia ogni millisecondo
+    while (load.phase != PHASE_DONE) {
+        int n = epoll_wait(load.epoll_fd, events, MAX_EVENTS, load.phase == PHASE_RUN ? 1 : 10);
+        if (n < 0 && errno != EINTR) {
+            error("Errore in epoll_wait");
+        }
+        for (int i = 0; i < n; i++) {
+            sim_client_t *client = (sim_client_t *)events[i].data.ptr;
+            if (client->state != SIM_CLOSED) {
+                sim_handle_event(&load, client, events[i].events);
+            }
+        }
+
+        uint64_t now = now_ns();
+        switch (load.phase) {
+            case PHASE_CONNECT:
+                if (load.num_named + load.num_failed == load.params.num_clients ||
+                    now - start > CONNECT_TIMEOUT_NS) {
+                    printf("Connessi %d client in %.2f s\n", load.num_named, (now - start) / 1e9);
+                    join_rooms(&load);
+                    load.phase = PHASE_SETTLE;
+                    phase_start = now;
+                }
+                break;
+            case PHASE_SETTLE:
+                if (now - phase_start >= SETTLE_NS) {
+                    printf("Invio di %.0f messaggi al secondo per %.0f s...\n",
+                           load.params.rate, load.params.duration);
+                    count_room_members(&load);
+                    load.phase = PHASE_RUN;
+                    load.run_start = now;
+                }
+                break;
+            case PHASE_RUN:
+                send_due(&load, now);
+                if (now - load.run_start >= (uint64_t)(load.params.duration * NS_PER_SEC)) {
+                    load.phase = PHASE_DRAIN;
+                    run_end = now;
+                }
+                break;
+            case PHASE_DRAIN:
+                if (load.received >= load.expected || now - run_end >= DRAIN_NS) {
+                    load.phase = PHASE_DONE;
+                }
+                break;
+        }
+    }
+
+    print_report(&load, (run_end - load.run_start) / 1e9);
+
+    for (int i = 0; i < load.params.num_clients; i++) {
+        if (load.clients[i].state != SIM_CLOSED) {
+            close(load.clients[i].socket);
+        }
+    }
+    close(load.epoll_fd);
+    free(load.clients);
+    free(load.room_members);
+
+    return 0;
+}
+
+/**
+ * Compilazione ed esecuzione:
+ *
+ * Solo su Linux (usa epoll):
+ *   gcc -O2 -o generatore_carico generatore_carico.c
+ *   ./server_multi_client --reactors 4
+ *   ./generatore_carico --clients 2000 --rate 500 --duration 10 --rooms 20
+ *
+ * Note:
+ * - Se non specificati, l'indirizzo IP predefinito è 127.0.0.1 (localhost) e la porta è 8888
+ * - Ogni messaggio viene consegnato a tutti gli altri client della stanza del
+ *   mittente: con N client e R stanze le consegne sono circa rate * (N/R - 1)
+ *   al secondo. --rooms permette di variare il fan-out a parità di client
+ * - La latenza include anche il tempo che il generatore impiega a leggere le
+ *   risposte: se le consegne attese superano quelle che un solo thread riesce
+ *   a ricevere, i percentili crescono per colpa del generatore. Conviene
+ *   eseguirlo su una macchina diversa da quella del server, o dividere il
+ *   carico tra più processi
+ * - --size imposta la lunghezza del testo di ogni messaggio (almeno 32 byte,
+ *   per l'istante di invio)
+ * - Con --framed va avviato anche il server con --framed
+ * - La modalità a thread del server accetta al più MAX_CLIENTS client: i
+ *   client in più risultano falliti. Per le prove di carico usare --epoll
+ *   o --reactors
+ * - Per migliaia di client può servire aumentare il limite dei descrittori
+ *   (ulimit -n) sia per il server sia per il generatore
+ */
\ No newline at end of file
@@ -0,0 +1,131 @@
+/**
+ * Istogramma log-lineare
+ *
+ * Definizioni condivise da server_multi_client.c e generatore_carico.c per
+ * misurare latenze e lunghezze delle code. Come negli istogrammi HDR i
+ * valori sono divisi per potenze di due e ogni potenza in HIST_SUB
+ * intervalli uguali: l'errore relativo sui percentili è al più 1/HIST_SUB
+ * (circa 6%) su tutti i valori a 64 bit, con una tabella fissa di
+ * HIST_BUCKETS contatori e senza allocazioni.
+ *
+ * Ogni istogramma e ogni contatore ha un solo scrittore, il thread che lo
+ * possiede, che lo aggiorna con operazioni atomiche rilassate: costano come
+ * normali scritture in memoria (nessun lock né istruzione read-modify-write)
+ * e altri thread possono leggerli mentre vengono aggiornati.
+ */
+
+#ifndef ISTOGRAMMA_H
+#define ISTOGRAMMA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+typedef struct {
+    atomic_ullong counts[HIST_BUCKETS];
+    atomic_ullong total;
+    atomic_ullong sum;
+    atomic_ullong max;
+} histogram_t;
+
+// Aggiunge value a un contatore che ha un solo scrittore
+static inline void counter_add(atomic_ullong *counter, uint64_t value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+static inline uint64_t counter_get(const atomic_ullong *counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// I valori sotto HIST_SUB hanno un intervallo ciascuno; gli altri finiscono
+// nell'intervallo dato dalla potenza di due e dai HIST_SUB_BITS bit seguenti
+static inline int histogram_index(uint64_t value) {
+    if (value < HIST_SUB) {
+        return (int)value;
+    }
+    int exponent = 63 - __builtin_clzll(value);
+    int sub = (int)(value >> (exponent - HIST_SUB_BITS)) & (HIST_SUB - 1);
+    return (exponent - HIST_SUB_BITS + 1) * HIST_SUB + sub;
+}
+
+// Valore più piccolo che cade nell'intervallo index
+static inline uint64_t histogram_value(int index) {
+    if (index < HIST_SUB) {
+        return (uint64_t)index;
+    }
+    int exponent = index / HIST_SUB + HIST_SUB_BITS - 1;
+    uint64_t sub = (uint64_t)(index % HIST_SUB);
+    return (HIST_SUB + sub) << (exponent - HIST_SUB_BITS);
+}
+
+static inline void histogram_clear(histogram_t *hist) {
+    memset(hist, 0, sizeof(*hist));
+}
+
+static inline void histogram_add(histogram_t *hist, uint64_t value) {
+    counter_add(&hist->counts[histogram_index(value)], 1);
+    counter_add(&hist->total, 1);
+    counter_add(&hist->sum, value);
+    if (value > counter_get(&hist->max)) {
+        atomic_store_explicit(&hist->max, value, memory_order_relaxed);
+    }
+}
+
+// Somma in dst i campioni di src; dst deve appartenere al chiamante
+static inline void histogram_merge(histogram_t *dst, const histogram_t *src) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        uint64_t count = counter_get(&src->counts[i]);
+        if (count > 0) {
+            counter_add(&dst->counts[i], count);
+        }
+    }
+    counter_add(&dst->total, counter_get(&src->total));
+    counter_add(&dst->sum, counter_get(&src->sum));
+    if (counter_get(&src->max) > counter_get(&dst->max)) {
+        atomic_store_explicit(&dst->max, counter_get(&src->max), memory_order_relaxed);
+    }
+}
+
+// Mette in dst i campioni di now che non erano in before, cioè quelli di un
+// intervallo di tempo; il massimo resta quello di now
+static inline void histogram_difference(histogram_t *dst, const histogram_t *now,
+                                        const histogram_t *before) {
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        atomic_store_explicit(&dst->counts[i],
+                              counter_get(&now->counts[i]) - counter_get(&before->counts[i]),
+                              memory_order_relaxed);
+    }
+    atomic_store_explicit(&dst->total, counter_get(&now->total) - counter_get(&before->total),
+                          memory_order_relaxed);
+    atomic_store_explicit(&dst->sum, counter_get(&now->sum) - counter_get(&before->sum),
+                          memory_order_relaxed);
+    atomic_store_explicit(&dst->max, counter_get(&now->max), memory_order_relaxed);
+}
+
+static inline double histogram_mean(const histogram_t *hist) {
+    uint64_t total = counter_get(&hist->total);
+    return total > 0 ? (double)counter_get(&hist->sum) / (double)total : 0.0;
+}
+
+// Valore sotto il quale cade la frazione p dei campioni
+static inline uint64_t histogram_percentile(const histogram_t *hist, double p) {
+    uint64_t max = counter_get(&hist->max);
+    uint64_t rank = (uint64_t)(p * (double)counter_get(&hist->total));
+    uint64_t seen = 0;
+
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += counter_get(&hist->counts[i]);
+        if (seen > rank) {
+            uint64_t value = histogram_value(i + 1) - 1;  // Massimo dell'intervallo
+            return value < max ? value : max;
+        }
+    }
+    return max;
+}
+
+#endif // ISTOGRAMMA_H
\ No newline at end of file
@@ -0,0 +1,131 @@
+/**
+ * Protocollo a frame per la chat
+ *
+ * Definizioni condivise da server_multi_client.c e client.c per il
+ * protocollo opzionale a frame (opzione --framed). Ogni messaggio è
+ * preceduto da un'intestazione di lunghezza fissa, quindi i confini dei
+ * messaggi non dipendono da come TCP divide o unisce i segmenti: un frame
+ * può arrivare in più recv() e una recv() può contenere molti frame.
+ *
+ * Intestazione (FRAME_HEADER_SIZE byte, interi in ordine di rete):
+ * - 4 byte: lunghezza del contenuto, al più FRAME_MAX_PAYLOAD
+ * - 1 byte: tipo del messaggio (FRAME_NAME, FRAME_CHAT, ...)
+ * - 3 byte: riservati, sempre a zero
+ * - 4 byte: id del mittente (FRAME_SENDER_SERVER per i messaggi del server)
+ *
+ * Il contenuto è testo UTF-8 senza terminatore.
+ */
+
+#ifndef PROTOCOLLO_H
+#define PROTOCOLLO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FRAME_HEADER_SIZE 12
+#define FRAME_MAX_PAYLOAD 4096
+#define FRAME_SENDER_SERVER 0xFFFFFFFFu
+
+// Tipi di messaggio
+enum {
+    FRAME_NAME = 1,     // Client -> server: nome scelto dall'utente
+    FRAME_CHAT,         // Messaggio di chat, in entrambe le direzioni
+    FRAME_EXIT,         // Client -> server: disconnessione
+    FRAME_PROMPT,       // Server -> client: richiesta del nome
+    FRAME_JOIN,         // Server -> client: un utente è entrato
+    FRAME_LEAVE,        // Server -> client: un utente è uscito
+    FRAME_ROOM          // Client -> server: cambio di stanza, il contenuto è il nome
+};
+
+// Frame decodificato; il contenuto non viene copiato ma punta nel buffer
+// di ricezione ed è valido fino alla successiva frame_buffer_space()
+typedef struct {
+    uint32_t length;
+    int type;
+    uint32_t sender;
+    const char *payload;
+} frame_t;
+
+// Buffer di ricezione: i byte tra start ed end sono arrivati ma non sono
+// ancora stati consumati da frame_next()
+typedef struct {
+    char *data;
+    size_t size;
+    size_t start;
+    size_t end;
+} frame_buffer_t;
+
+static inline void frame_put_u32(unsigned char *p, uint32_t value) {
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+static inline uint32_t frame_get_u32(const unsigned char *p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Scrive l'intestazione di un frame nei primi FRAME_HEADER_SIZE byte di out
+static inline void frame_write_header(char *out, int type, uint32_t sender, uint32_t length) {
+    unsigned char *p = (unsigned char *)out;
+    frame_put_u32(p, length);
+    p[4] = (unsigned char)type;
+    p[5] = p[6] = p[7] = 0;
+    frame_put_u32(p + 8, sender);
+}
+
+// Codifica un frame completo in out, che deve avere spazio per
+// FRAME_HEADER_SIZE + length byte; restituisce la dimensione del frame
+static inline size_t frame_encode(char *out, int type, uint32_t sender,
+                                  const char *payload, size_t length) {
+    frame_write_header(out, type, sender, (uint32_t)length);
+    memcpy(out + FRAME_HEADER_SIZE, payload, length);
+    return FRAME_HEADER_SIZE + length;
+}
+
+// Estrae il prossimo frame completo dal buffer. Restituisce 1 se l'ha
+// trovato, 0 se servono altri byte, -1 se l'intestazione non è valida o il
+// frame non può stare nel buffer (la connessione va chiusa).
+static inline int frame_next(frame_buffer_t *buf, frame_t *frame) {
+    size_t available = buf->end - buf->start;
+    if (available < FRAME_HEADER_SIZE) {
+        return 0;
+    }
+
+    const unsigned char *p = (const unsigned char *)buf->data + buf->start;
+    uint32_t length = frame_get_u32(p);
+    if (length > FRAME_MAX_PAYLOAD || FRAME_HEADER_SIZE + (size_t)length > buf->size ||
+        p[4] == 0 || p[5] != 0 || p[6] != 0 || p[7] != 0) {
+        return -1;
+    }
+    if (available < FRAME_HEADER_SIZE + (size_t)length) {
+        return 0;
+    }
+
+    frame->length = length;
+    frame->type = p[4];
+    frame->sender = frame_get_u32(p + 8);
+    frame->payload = buf->data + buf->start + FRAME_HEADER_SIZE;
+    buf->start += FRAME_HEADER_SIZE + length;
+    return 1;
+}
+
+// Restituisce dove ricevere i prossimi byte e quanti ne possono arrivare.
+// I frame completi vengono consumati direttamente nel buffer; si sposta
+// all'inizio solo la parte di un frame incompleto, e solo quando il buffer
+// è pieno fino in fondo.
+static inline char *frame_buffer_space(frame_buffer_t *buf, size_t *space) {
+    if (buf->start == buf->end) {
+        buf->start = buf->end = 0;
+    } else if (buf->end == buf->size) {
+        memmove(buf->data, buf->data + buf->start, buf->end - buf->start);
+        buf->end -= buf->start;
+        buf->start = 0;
+    }
+    *space = buf->size - buf->end;
+    return buf->data + buf->end;
+}
+
+#endif // PROTOCOLLO_H
\ No newline at end of file
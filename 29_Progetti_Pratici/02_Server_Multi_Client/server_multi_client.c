@@ -9,13 +9,39 @@
  * - Programmazione di rete con socket
  * - Multithreading per gestire connessioni parallele
  * - Sincronizzazione tra thread con mutex
+ * - Messaggi condivisi con conteggio dei riferimenti e code di uscita per client
+ * - Pool di buffer per thread e invio di più messaggi con una sola sendmsg
+ * - Protocollo opzionale a frame con lunghezza, tipo e mittente (protocollo.h)
+ * - Stanze con insiemi di iscritti copy-on-write: un messaggio raggiunge solo
+ *   i client della stanza del mittente
  * - Gestione degli errori
+ * - Posti dei client e worker preparati all'avvio, accettazione a raffica con accept4
+ * - I/O non bloccante con epoll in modalità edge-triggered (solo Linux)
+ * - Più reactor con SO_REUSEPORT e code di messaggi lock-free tra thread
+ * - Backend opzionale io_uring (uring.h): accept e recv multishot con buffer
+ *   forniti dal kernel, invii con SENDMSG, ritorno a epoll se non disponibile
+ * - Code di uscita limitate con soglie alta e bassa e politiche per i client
+ *   lenti: disconnessione, scarto dei messaggi più vecchi, pausa dei mittenti
+ * - Logger asincrono e statistiche con contatori e istogrammi per thread,
+ *   aggiornati senza lock (istogramma.h)
+ * - Cronologia di ogni stanza in un buffer circolare allocato al primo
+ *   messaggio, letto senza lock (seqlock) e inviata in un solo blocco a chi
+ *   entra; le cronologie sono in una tabella divisa in parti con un mutex
+ *   ciascuna
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE                     // accept4
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
 #ifdef _WIN32
     // Librerie Windows per socket
@@ -25,20 +51,157 @@
     typedef SOCKET socket_t;
     #define SOCKET_ERROR_VALUE INVALID_SOCKET
     #define close_socket closesocket
+    #define SHUTDOWN_BOTH SD_BOTH
 #else
     // Librerie Unix/Linux per socket
     #include <unistd.h>
     #include <sys/socket.h>
     #include <netinet/in.h>
     #include <arpa/inet.h>
+    #include <sys/uio.h>
     typedef int socket_t;
     #define SOCKET_ERROR_VALUE -1
     #define close_socket close
+    #define SHUTDOWN_BOTH SHUT_RDWR
+#endif
+
+#include "protocollo.h"
+#include "istogramma.h"
+
+#ifndef MSG_NOSIGNAL
+    #define MSG_NOSIGNAL 0              // Dove non esiste, SIGPIPE resta attivo
+#endif
+
+#ifdef __linux__
+    // Modalità a eventi
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <stdint.h>
+    #include <sys/epoll.h>
+    #include <sys/eventfd.h>
+    #include <sys/resource.h>
+    #include "uring.h"
 #endif
 
 #define MAX_CLIENTS 10
 #define BUFFER_SIZE 1024
 #define PORT 8888
+#define DEFAULT_BACKLOG 5              // Coda di ascolto della modalità a thread se non indicata
+#define CLIENT_QUEUE_SIZE 4096         // Capacità in messaggi della coda di un client (modalità a thread)
+#define DEFAULT_QUEUE_HIGH (1 << 20)   // Soglia alta predefinita dei byte in attesa per client
+#define MIN_QUEUE_HIGH (16 * 1024)
+#define PAUSE_TIMEOUT_MS 5000          // Pausa massima dei mittenti per un destinatario bloccato
+#define PAUSE_CHECK_MS 100             // Intervallo dei controlli sui destinatari congestionati
+#define MESSAGE_POOL_DATA (BUFFER_SIZE + 64)  // Capacità dei buffer riciclati dal pool
+#define INPUT_BUFFER_SIZE (FRAME_HEADER_SIZE + FRAME_MAX_PAYLOAD)  // Ricezione: un frame intero
+#define MESSAGE_POOL_MAX 1024          // Buffer liberi conservati per ogni thread che alloca
+#define WRITE_BATCH 64                 // Messaggi inviati al più con una sola sendmsg
+#define ROOM_NAME_SIZE 32
+#define DEFAULT_ROOM "generale"        // Stanza in cui entra ogni nuovo client
+#define ROOM_TABLE_MIN 64              // Bucket iniziali della tabella delle stanze
+#define DEFAULT_HISTORY 20             // Messaggi ricordati da ogni stanza se non indicato
+#define MAX_HISTORY 1000
+#define HISTORY_SLOT_WORDS ((MESSAGE_POOL_DATA + 7) / 8)  // Parole di 8 byte per messaggio
+#define HISTORY_SHARDS 64              // Parti della tabella delle cronologie, ognuna con il suo mutex
+#define HISTORY_BUCKETS_MIN 8          // Bucket iniziali di ogni parte
+#define LOG_RING_SIZE (1 << 16)        // Byte di log in attesa per ogni thread (potenza di due)
+#define LOG_IDLE_MS 10                 // Pausa del logger quando non c'è nulla da stampare
+
+#ifdef __linux__
+#define MAX_EVENTS 256                 // Eventi letti a ogni chiamata di epoll_wait
+#define MAX_REACTORS 64
+#define CONNECTION_CHUNK 256           // Connessioni preallocate a ogni espansione del pool
+#define URING_ENTRIES 4096             // Richieste nella coda di invio di ogni anello io_uring
+#define URING_BUFFERS 1024             // Buffer di ricezione forniti al kernel (potenza di due)
+#endif
+
+// Messaggio condiviso tra tutti i destinatari di un broadcast: il testo
+// viene formattato una volta sola e l'ultimo che lo rilascia lo libera
+// (o lo restituisce al pool del thread che l'ha creato, se ha la capacità
+// standard)
+typedef struct shared_message {
+    atomic_int refs;
+    size_t len;
+    struct message_pool *owner;     // Pool di origine del buffer, NULL se non riciclabile
+    struct shared_message *next_free;
+    char data[];                    // Sempre terminato da '\0'
+} shared_message_t;
+
+// Buffer liberi di un thread. Solo il proprietario usa free_list; gli altri
+// thread gli restituiscono i buffer su una pila lock-free, che il
+// proprietario svuota in blocco quando la sua lista è vuota.
+typedef struct message_pool {
+    shared_message_t *free_list;
+    int free_count;
+    _Atomic(shared_message_t *) returned;
+    atomic_int returned_count;
+} message_pool_t;
+
+// Insieme degli iscritti a una stanza: un array compatto che non viene mai
+// modificato. Ingressi e uscite ne costruiscono una copia aggiornata e la
+// sostituiscono (copy-on-write), quindi chi pubblica scorre la sua copia
+// senza lock anche mentre altri client entrano o escono.
+typedef struct {
+    atomic_int refs;
+    int count;
+    void *items[];                  // client_t o connection_t, secondo la modalità
+} subscriber_set_t;
+
+// Posto della cronologia di una stanza: i byte di un messaggio di chat così
+// come vengono inviati. seq vale 2 * (n + 1) quando il posto contiene il
+// messaggio numero n ed è dispari mentre viene scritto (seqlock): chi legge
+// copia i byte e poi controlla che seq non sia cambiato. I byte sono letti e
+// scritti con operazioni atomiche rilassate, così una lettura sovrapposta a
+// una scrittura non è una data race ma solo una copia da scartare.
+typedef struct {
+    atomic_ullong seq;
+    atomic_size_t len;
+    atomic_ullong words[HISTORY_SLOT_WORDS];
+} history_slot_t;
+
+// Cronologia di una stanza: history_size posti allocati in un solo blocco al
+// primo messaggio, così le stanze in cui nessuno scrive occupano solo questa
+// struttura. È condivisa da tutte le stanze con lo stesso nome (con
+// --reactors ogni reactor ha la sua) e viene liberata quando l'ultima di
+// esse si svuota.
+typedef struct room_history {
+    char name[ROOM_NAME_SIZE];
+    int refs;                       // Stanze che la usano, protetto dal mutex della parte
+    struct room_history *next;      // Catena nel bucket della parte
+    atomic_ullong next_index;       // Messaggi registrati finora
+    _Atomic(history_slot_t *) slots;  // NULL fino al primo messaggio
+} room_history_t;
+
+// Parte della tabella delle cronologie: le cronologie sono divise per hash
+// del nome in HISTORY_SHARDS parti con tabelle e mutex indipendenti, quindi
+// reactor che creano o eliminano stanze diverse di rado si attendono
+typedef struct {
+    room_history_t **buckets;       // NULL finché la parte non ha cronologie
+    int num_buckets;                // Potenza di 2
+    int count;
+    pthread_mutex_t mutex;
+} history_shard_t;
+
+// Stanza della chat
+typedef struct room {
+    char name[ROOM_NAME_SIZE];
+    pthread_mutex_t mutex;          // Protegge solo lo scambio di subscribers
+    subscriber_set_t *subscribers;  // NULL quando la stanza è vuota
+    struct room *next;              // Catena nel bucket della tabella
+    struct room_history *history;   // NULL se la cronologia è disattivata
+} room_t;
+
+// Tabella delle stanze per nome. Una stanza esiste finché ha iscritti.
+// retain e release, se presenti, mantengono vivi gli elementi finché una
+// copia dell'insieme di iscritti che li contiene è in uso.
+typedef struct {
+    room_t **buckets;
+    int num_buckets;                // Potenza di 2
+    int num_rooms;
+    pthread_mutex_t mutex;          // Protegge buckets e gli ingressi/uscite
+    void (*retain)(void *item);
+    void (*release)(void *item);
+} room_table_t;
 
 // Struttura per rappresentare un client connesso
 typedef struct {
@@ -46,222 +209,3116 @@ typedef struct {
     struct sockaddr_in address;
     int id;
     char name[50];
+    // Coda circolare dei messaggi in uscita, svuotata dal thread writer
+    shared_message_t *queue[CLIENT_QUEUE_SIZE];
+    int queue_head;
+    int queue_count;
+    size_t queue_bytes;             // Byte dei messaggi in coda
+    int congested;                  // Oltre la soglia alta, non ancora sceso a quella bassa
+    int closing;                    // Il writer deve terminare
+    int slow;                       // Coda piena: il client viene disconnesso
+    int writer_done;                // Il writer ha finito con questo client
+    pthread_mutex_t queue_mutex;
+    pthread_cond_t queue_cond;
+    atomic_int refs;                // Worker del client più gli insiemi di iscritti che lo contengono
+    room_t *room;                   // Stanza corrente, NULL se non è in nessuna
 } client_t;
 
+// Coda dei client in attesa di un worker. I worker vengono creati all'avvio,
+// uno per posto, e servono un client alla volta fino alla sua chiusura:
+// accettare una connessione non richiede pthread_create.
+typedef struct {
+    client_t *queue[MAX_CLIENTS];
+    int head;
+    int count;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    void (*serve)(client_t *client);
+} worker_pool_t;
+
+#ifdef __linux__
+// Connessione gestita dal ciclo a eventi
+typedef struct connection {
+    socket_t socket;
+    struct sockaddr_in address;
+    int id;
+    char name[50];
+    int named;                      // 0 finché il client non ha inviato il nome
+    int closing;                    // Chiusura richiesta, eseguita a fine iterazione
+    int index;                      // Posizione nell'array delle connessioni
+    room_t *room;                   // Stanza corrente, nella tabella del reactor
+    char in_buf[INPUT_BUFFER_SIZE]; // Righe o frame ricevuti non ancora completi
+    size_t in_len;
+    size_t in_start;                // Con i frame: primo byte non ancora consumato
+    shared_message_t **out_queue;   // Messaggi che il socket non ha ancora accettato
+    int out_head;                   // Primo messaggio in attesa
+    int out_count;
+    int out_cap;
+    size_t out_offset;              // Byte già inviati del primo messaggio
+    size_t out_bytes;               // Byte in attesa in totale
+    int congested;                  // Oltre la soglia alta, non ancora sceso a quella bassa
+    uint64_t congested_since;
+    int paused;                     // Lettura sospesa finché i destinatari sono congestionati
+    int in_pending;                 // Presente nella lista pending del reactor
+    int in_flight;                  // Messaggi in testa alla coda già affidati a io_uring
+    int ops;                        // Operazioni io_uring in corso sulla connessione
+    int sending;                    // SENDMSG io_uring in corso
+    struct iovec send_iov[WRITE_BATCH];  // Parti dei messaggi della SENDMSG, fino alla sua fine
+    struct msghdr send_header;
+    int recv_armed;                 // Ricezione multishot io_uring attiva
+    int closed;                     // Tolta dal reactor, libera quando ops arriva a zero
+    char *stash;                    // Byte ricevuti da io_uring durante una pausa
+    size_t stash_start;
+    size_t stash_len;
+    struct connection *next_pending;
+    struct connection *next_closing;
+    struct connection *next_free;   // Catena delle strutture libere del reactor
+} connection_t;
+
+// Messaggio inoltrato da un reactor agli altri
+typedef struct inbox_message {
+    struct inbox_message *next;
+    shared_message_t *message;
+    char room[ROOM_NAME_SIZE];      // Stanza di destinazione
+} inbox_message_t;
+
+// Stato di un ciclo a eventi (reactor). Ogni reactor ha il proprio socket
+// di ascolto, il proprio epoll e le proprie connessioni; gli altri reactor
+// gli consegnano i messaggi tramite la inbox e lo svegliano con event_fd.
+typedef struct {
+    int epoll_fd;
+    socket_t server_socket;
+    connection_t **connections;     // Connessioni aperte, senza buchi
+    int num_connections;
+    int cap_connections;
+    connection_t *closing;          // Connessioni da chiudere a fine iterazione
+    connection_t *pending;          // Connessioni con messaggi da inviare a fine iterazione
+    room_table_t rooms;             // Stanze con almeno un client di questo reactor
+    connection_t *free_connections; // Strutture pronte per nuove connessioni
+    connection_t *reading;          // Connessione di cui si stanno gestendo i messaggi
+    int num_congested;              // Connessioni con congested impostato
+    int num_paused;                 // Connessioni con paused impostato
+    uint64_t last_pause_check;
+    int event_fd;                   // Notifica l'arrivo di messaggi nella inbox
+    _Atomic(inbox_message_t *) inbox;  // Pila lock-free, dal più recente
+    int uring;                      // 1 se usa io_uring invece di epoll
+#if URING_SUPPORTED
+    uring_t ring;
+#endif
+    connection_t *input_conn;       // Con io_uring: connessione a cui appartiene input
+    const char *input;              // Con io_uring: byte ricevuti non ancora consumati
+    size_t input_len;
+    pthread_t thread;
+} event_loop_t;
+
+int run_event_loop(socket_t server_socket, int count, int backlog, int uring);
+#endif
+
 // Array di client connessi
 client_t *clients[MAX_CLIENTS];
 
 // Mutex per proteggere l'accesso all'array dei client
 pthread_mutex_t clients_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+// Stato di un thread per logger e statistiche, creato al primo uso. I
+// contatori e gli istogrammi hanno un solo scrittore, il thread stesso; il
+// thread delle statistiche li somma leggendoli senza lock. Il buffer
+// circolare del log ha un solo produttore (il thread) e un solo consumatore
+// (il logger). I thread del server vivono quanto il processo, quindi questi
+// record non vengono mai liberati.
+typedef struct thread_monitor {
+    atomic_ullong messages_in;      // Messaggi di chat ricevuti
+    atomic_ullong deliveries;       // Messaggi accodati ai destinatari
+    atomic_ullong bytes_in;
+    atomic_ullong bytes_out;
+    atomic_ullong connections_opened;
+    atomic_ullong connections_closed;
+    atomic_ullong messages_dropped; // Scartati dalla politica SLOW_DROP
+    atomic_ullong slow_disconnects;
+    atomic_ullong pauses;           // Mittenti sospesi dalla politica SLOW_PAUSE
+    histogram_t fanout_ns;          // Tempo per consegnare un messaggio alla stanza
+    histogram_t queue_depth;        // Messaggi già in coda al destinatario
+    atomic_ullong log_dropped;      // Righe perse perché il buffer del log era pieno
+    atomic_size_t log_head;         // Byte scritti nel buffer, avanzato dal thread
+    atomic_size_t log_tail;         // Byte stampati, avanzato dal logger
+    char log_ring[LOG_RING_SIZE];
+    struct thread_monitor *next;
+} thread_monitor_t;
+
+// Politiche per i destinatari che non leggono abbastanza in fretta
+// (--slow-policy). Quando i byte in coda per un client superano la soglia
+// alta (--queue-high):
+enum {
+    SLOW_DISCONNECT,    // il client viene disconnesso
+    SLOW_DROP,          // si scartano i suoi messaggi più vecchi fino alla soglia bassa
+    SLOW_PAUSE          // si smette di leggere dai mittenti finché la sua coda non
+                        // scende alla soglia bassa (--queue-low)
+};
+
+// Modalità di stampa dei messaggi della chat (--log)
+enum {
+    LOG_SYNC,       // printf nel thread che gestisce il messaggio
+    LOG_ASYNC,      // Copia nel buffer del thread, stampa dal thread del logger
+    LOG_OFF
+};
+
+// 1 se i client usano il protocollo a frame (--framed) invece delle righe di testo
+int framed_protocol = 0;
+
+int log_mode = LOG_SYNC;
+
+int slow_policy = SLOW_DISCONNECT;
+size_t queue_high = DEFAULT_QUEUE_HIGH;
+size_t queue_low = DEFAULT_QUEUE_HIGH / 4;
+
+// Messaggi di chat ricordati da ogni stanza (--history), 0 se disattivata
+int history_size = DEFAULT_HISTORY;
+history_shard_t history_shards[HISTORY_SHARDS];  // Per hash del nome
+
+// Secondi tra due stampe delle statistiche (--stats), 0 se disattivate
+int stats_interval = 0;
+
+// Record di tutti i thread, dal più recente; protetto da monitors_mutex
+thread_monitor_t *monitors = NULL;
+pthread_mutex_t monitors_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Aggiornano le statistiche del thread corrente, solo se sono attive
+#define STATS_ADD(field, value) \
+    do { if (stats_interval > 0) counter_add(&monitor_local()->field, (uint64_t)(value)); } while (0)
+#define STATS_RECORD(field, value) \
+    do { if (stats_interval > 0) histogram_add(&monitor_local()->field, (uint64_t)(value)); } while (0)
+
+// Byte in coda oltre i quali un client viene comunque disconnesso. Con
+// SLOW_PAUSE la coda può superare la soglia alta finché i mittenti non si
+// fermano (e quelli degli altri reactor non si fermano mai), ma non il doppio.
+size_t queue_limit(void) {
+    return slow_policy == SLOW_PAUSE ? 2 * queue_high : queue_high;
+}
+
+// Stanze della modalità a thread
+room_table_t rooms;
+
+// Posti per i client, preparati all'avvio: quelli liberi sono in free_slots,
+// protetto da clients_mutex
+client_t client_slots[MAX_CLIENTS];
+client_t *free_slots[MAX_CLIENTS];
+int num_free_slots;
+
+// Worker che leggono dai client e worker che scrivono sui loro socket
+worker_pool_t reader_pool;
+worker_pool_t writer_pool;
+
 // Funzione per gestire gli errori
 void error(const char *msg) {
     perror(msg);
     exit(EXIT_FAILURE);
 }
 
-// Funzione per inviare un messaggio a tutti i client tranne il mittente
-void send_message_to_all(char *message, int sender_id) {
-    pthread_mutex_lock(&clients_mutex);
+// Pool del thread corrente. Un messaggio torna nel pool del thread che
+// l'ha creato, anche se l'ultimo riferimento viene rilasciato altrove: nella
+// modalità a thread i lettori creano i messaggi e i writer li rilasciano, e
+// senza restituzione i buffer si accumulerebbero nei writer mentre i lettori
+// chiamerebbero malloc per ogni messaggio. Il pool non viene mai liberato:
+// i thread che allocano messaggi vivono quanto il server.
+static _Thread_local message_pool_t *message_pool;
+
+static message_pool_t *message_pool_get(void) {
+    if (message_pool == NULL) {
+        message_pool = (message_pool_t *)calloc(1, sizeof(message_pool_t));
+    }
+    return message_pool;
+}
+
+// Alloca un messaggio per len byte di testo con refs riferimenti già assegnati
+shared_message_t *message_alloc(size_t len, int refs) {
+    shared_message_t *msg = NULL;
+    message_pool_t *pool = len < MESSAGE_POOL_DATA ? message_pool_get() : NULL;
     
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i] != NULL && clients[i]->id != sender_id) {
-            if (send(clients[i]->socket, message, strlen(message), 0) < 0) {
-                printf("Errore nell'invio del messaggio al client %d\n", clients[i]->id);
-                break;
+    if (pool != NULL) {
+        if (pool->free_list == NULL &&
+            atomic_load_explicit(&pool->returned, memory_order_relaxed) != NULL) {
+            // Riprende in blocco i buffer restituiti dagli altri thread
+            shared_message_t *list = atomic_exchange_explicit(&pool->returned, NULL,
+                                                              memory_order_acquire);
+            int count = 0;
+            for (shared_message_t *m = list; m != NULL; m = m->next_free) {
+                count++;
             }
+            atomic_fetch_sub_explicit(&pool->returned_count, count, memory_order_relaxed);
+            pool->free_list = list;
+            pool->free_count = count;
+        }
+        if (pool->free_list != NULL) {
+            msg = pool->free_list;
+            pool->free_list = msg->next_free;
+            pool->free_count--;
         }
     }
-    
-    pthread_mutex_unlock(&clients_mutex);
+    if (msg == NULL) {
+        // Anche senza pool un testo corto riceve la capacità standard:
+        // chat_message vi formatta direttamente fino a MESSAGE_POOL_DATA byte
+        msg = (shared_message_t *)malloc(sizeof(shared_message_t) +
+                                         (len < MESSAGE_POOL_DATA ? MESSAGE_POOL_DATA : len + 1));
+        if (msg == NULL) {
+            printf("Errore nell'allocazione della memoria per il messaggio\n");
+            return NULL;
+        }
+        msg->owner = pool;
+    }
+    atomic_init(&msg->refs, refs);
+    msg->len = len;
+    msg->data[len] = '\0';
+    return msg;
 }
 
-// Funzione per aggiungere un client all'array
-void add_client(client_t *client) {
-    pthread_mutex_lock(&clients_mutex);
-    
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i] == NULL) {
-            clients[i] = client;
-            break;
+// Rilascia un riferimento; l'ultimo restituisce il buffer al pool di origine
+// o lo libera se quel pool ne contiene già MESSAGE_POOL_MAX
+void message_release(shared_message_t *msg) {
+    if (atomic_fetch_sub_explicit(&msg->refs, 1, memory_order_acq_rel) != 1) {
+        return;
+    }
+    message_pool_t *pool = msg->owner;
+    if (pool == NULL) {
+        free(msg);
+    } else if (pool == message_pool) {
+        if (pool->free_count < MESSAGE_POOL_MAX) {
+            msg->next_free = pool->free_list;
+            pool->free_list = msg;
+            pool->free_count++;
+        } else {
+            free(msg);
         }
+    } else if (atomic_fetch_add_explicit(&pool->returned_count, 1, memory_order_relaxed) <
+               MESSAGE_POOL_MAX) {
+        // Solo inserimenti in testa, e il proprietario preleva l'intera
+        // pila: nessun problema ABA
+        shared_message_t *head = atomic_load_explicit(&pool->returned, memory_order_relaxed);
+        do {
+            msg->next_free = head;
+        } while (!atomic_compare_exchange_weak_explicit(&pool->returned, &head, msg,
+                                                        memory_order_release, memory_order_relaxed));
+    } else {
+        atomic_fetch_sub_explicit(&pool->returned_count, 1, memory_order_relaxed);
+        free(msg);
     }
-    
-    pthread_mutex_unlock(&clients_mutex);
 }
 
-// Funzione per rimuovere un client dall'array
-void remove_client(int id) {
-    pthread_mutex_lock(&clients_mutex);
+// Crea il messaggio da inviare ai client nel protocollo in uso, formattando
+// il testo direttamente nel buffer condiviso. Con i frame il testo segue
+// l'intestazione e perde il '\n' finale, che nel protocollo testuale serve
+// solo a separare i messaggi.
+shared_message_t *chat_message(int type, uint32_t sender, const char *format, ...) {
+    size_t offset = framed_protocol ? FRAME_HEADER_SIZE : 0;
+    va_list args;
     
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        if (clients[i] != NULL && clients[i]->id == id) {
-            close_socket(clients[i]->socket);
-            free(clients[i]);
-            clients[i] = NULL;
-            break;
-        }
+    shared_message_t *msg = message_alloc(0, 1);
+    if (msg == NULL) {
+        return NULL;
+    }
+    va_start(args, format);
+    int len = vsnprintf(msg->data + offset, MESSAGE_POOL_DATA - offset, format, args);
+    va_end(args);
+    if (len < 0) {
+        len = 0;
     }
     
-    pthread_mutex_unlock(&clients_mutex);
+    if (offset + (size_t)len >= MESSAGE_POOL_DATA) {
+        // Testo più lungo della capacità del pool: serve un buffer su misura
+        message_release(msg);
+        msg = message_alloc(offset + (size_t)len, 1);
+        if (msg == NULL) {
+            return NULL;
+        }
+        va_start(args, format);
+        vsnprintf(msg->data + offset, (size_t)len + 1, format, args);
+        va_end(args);
+    }
+    msg->len = offset + (size_t)len;
+    if (framed_protocol) {
+        if (len > 0 && msg->data[msg->len - 1] == '\n') {
+            msg->len--;
+        }
+        // Con il nome del mittente il testo di un frame massimo non ci sta
+        // più: si tronca, perché i client rifiutano i frame troppo lunghi
+        if (msg->len - offset > FRAME_MAX_PAYLOAD) {
+            msg->len = offset + FRAME_MAX_PAYLOAD;
+        }
+        frame_write_header(msg->data, type, sender, (uint32_t)(msg->len - offset));
+    }
+    msg->data[msg->len] = '\0';
+    return msg;
 }
 
-// Funzione eseguita da ciascun thread per gestire un client
-void *handle_client(void *arg) {
-    char buffer[BUFFER_SIZE];
-    char message[BUFFER_SIZE + 50];
-    int read_size;
-    client_t *client = (client_t *)arg;
+uint64_t now_ns(void) {
+    struct timespec ts;
+#ifdef _WIN32
+    timespec_get(&ts, TIME_UTC);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void sleep_ms(int ms) {
+#ifdef _WIN32
+    Sleep(ms);
+#else
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+#endif
+}
+
+// Record del thread corrente, creato e registrato al primo uso
+thread_monitor_t *monitor_local(void) {
+    static _Thread_local thread_monitor_t *local;
     
-    // Richiedi il nome del client
-    if (send(client->socket, "Inserisci il tuo nome: ", 23, 0) < 0) {
-        printf("Errore nell'invio della richiesta del nome\n");
-        goto cleanup;
+    if (local == NULL) {
+        local = (thread_monitor_t *)calloc(1, sizeof(thread_monitor_t));
+        if (local == NULL) {
+            error("Errore nell'allocazione delle statistiche del thread");
+        }
+        pthread_mutex_lock(&monitors_mutex);
+        local->next = monitors;
+        monitors = local;
+        pthread_mutex_unlock(&monitors_mutex);
     }
+    return local;
+}
+
+// Primo record della lista; i record si aggiungono solo in testa, quindi
+// la lista si può scorrere senza lock a partire da qui
+thread_monitor_t *monitors_first(void) {
+    pthread_mutex_lock(&monitors_mutex);
+    thread_monitor_t *first = monitors;
+    pthread_mutex_unlock(&monitors_mutex);
+    return first;
+}
+
+// Copia una riga nel buffer del log del thread, senza lock né chiamate di
+// sistema. Se il logger è rimasto indietro e la riga non ci sta, viene
+// scartata e contata: il thread non si ferma mai ad aspettare il terminale.
+void log_write(const char *text, size_t len, int add_newline) {
+    thread_monitor_t *self = monitor_local();
+    size_t head = atomic_load_explicit(&self->log_head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&self->log_tail, memory_order_acquire);
+    size_t total = len + (add_newline ? 1 : 0);
     
-    // Ricevi il nome del client
-    read_size = recv(client->socket, buffer, BUFFER_SIZE, 0);
-    if (read_size <= 0) {
-        printf("Client disconnesso senza fornire un nome\n");
-        goto cleanup;
+    if (total > LOG_RING_SIZE - (head - tail)) {
+        counter_add(&self->log_dropped, 1);
+        return;
+    }
+    size_t pos = head & (LOG_RING_SIZE - 1);
+    size_t first = LOG_RING_SIZE - pos < len ? LOG_RING_SIZE - pos : len;
+    memcpy(self->log_ring + pos, text, first);
+    memcpy(self->log_ring, text + first, len - first);
+    if (add_newline) {
+        self->log_ring[(head + len) & (LOG_RING_SIZE - 1)] = '\n';
+    }
+    atomic_store_explicit(&self->log_head, head + total, memory_order_release);
+}
+
+// Stampa sul terminale del server il testo di un messaggio
+void log_message(shared_message_t *msg) {
+    if (log_mode == LOG_OFF) {
+        return;
+    }
+    if (framed_protocol) {
+        if (log_mode == LOG_ASYNC) {
+            log_write(msg->data + FRAME_HEADER_SIZE, msg->len - FRAME_HEADER_SIZE, 1);
+        } else {
+            printf("%s\n", msg->data + FRAME_HEADER_SIZE);
+        }
+    } else {
+        if (log_mode == LOG_ASYNC) {
+            log_write(msg->data, msg->len, 0);
+        } else {
+            printf("%s", msg->data);
+        }
     }
+}
+
+// Stampa un avviso del server (connessioni, disconnessioni) come i messaggi
+void log_printf(const char *format, ...) {
+    char line[BUFFER_SIZE];
+    va_list args;
     
-    buffer[read_size] = '\0';
-    buffer[strcspn(buffer, "\n")] = '\0'; // Rimuovi il newline se presente
-    strncpy(client->name, buffer, sizeof(client->name) - 1);
-    client->name[sizeof(client->name) - 1] = '\0'; // Assicura terminazione
+    if (log_mode == LOG_OFF) {
+        return;
+    }
+    va_start(args, format);
+    if (log_mode == LOG_ASYNC) {
+        int len = vsnprintf(line, sizeof(line), format, args);
+        if (len > 0) {
+            log_write(line, (size_t)len < sizeof(line) ? (size_t)len : sizeof(line) - 1, 0);
+        }
+    } else {
+        vprintf(format, args);
+    }
+    va_end(args);
+}
+
+// Thread del logger: svuota i buffer di tutti i thread con una fwrite per
+// buffer e un solo fflush per giro. L'ordine delle righe è garantito solo
+// tra quelle dello stesso thread.
+void *logger_main(void *arg) {
+    uint64_t reported = 0;
     
-    // Notifica a tutti che un nuovo client si è connesso
-    sprintf(message, "%s si è unito alla chat!\n", client->name);
-    printf("%s", message);
-    send_message_to_all(message, client->id);
+    (void)arg;
+    while (1) {
+        int printed = 0;
+        uint64_t dropped = 0;
+        
+        for (thread_monitor_t *m = monitors_first(); m != NULL; m = m->next) {
+            size_t tail = atomic_load_explicit(&m->log_tail, memory_order_relaxed);
+            size_t head = atomic_load_explicit(&m->log_head, memory_order_acquire);
+            if (head != tail) {
+                size_t pos = tail & (LOG_RING_SIZE - 1);
+                size_t first = LOG_RING_SIZE - pos < head - tail ? LOG_RING_SIZE - pos : head - tail;
+                fwrite(m->log_ring + pos, 1, first, stdout);
+                fwrite(m->log_ring, 1, head - tail - first, stdout);
+                atomic_store_explicit(&m->log_tail, head, memory_order_release);
+                printed = 1;
+            }
+            dropped += counter_get(&m->log_dropped);
+        }
+        if (dropped > reported) {
+            printf("[log] %llu righe non stampate: il terminale non tiene il ritmo\n",
+                   (unsigned long long)(dropped - reported));
+            reported = dropped;
+            printed = 1;
+        }
+        if (printed) {
+            fflush(stdout);
+        } else {
+            sleep_ms(LOG_IDLE_MS);
+        }
+    }
+    return NULL;
+}
+
+// Thread delle statistiche: ogni stats_interval secondi somma i record di
+// tutti i thread e stampa su stderr i valori dell'ultimo intervallo. I
+// thread che gestiscono i client non vengono mai fermati.
+void *stats_main(void *arg) {
+    static histogram_t fanout, queue, fanout_before, queue_before, interval;
+    uint64_t before[9] = { 0 };
+    uint64_t last = now_ns();
     
-    // Loop principale per ricevere e inviare messaggi
-    while ((read_size = recv(client->socket, buffer, BUFFER_SIZE, 0)) > 0) {
-        buffer[read_size] = '\0';
+    (void)arg;
+    while (1) {
+        sleep_ms(stats_interval * 1000);
         
-        // Controlla se il client vuole disconnettersi
-        if (strcmp(buffer, "exit") == 0) {
-            break;
+        uint64_t totals[9] = { 0 };
+        histogram_clear(&fanout);
+        histogram_clear(&queue);
+        for (thread_monitor_t *m = monitors_first(); m != NULL; m = m->next) {
+            totals[0] += counter_get(&m->messages_in);
+            totals[1] += counter_get(&m->deliveries);
+            totals[2] += counter_get(&m->bytes_in);
+            totals[3] += counter_get(&m->bytes_out);
+            totals[4] += counter_get(&m->connections_opened);
+            totals[5] += counter_get(&m->connections_closed);
+            totals[6] += counter_get(&m->messages_dropped);
+            totals[7] += counter_get(&m->slow_disconnects);
+            totals[8] += counter_get(&m->pauses);
+            histogram_merge(&fanout, &m->fanout_ns);
+            histogram_merge(&queue, &m->queue_depth);
         }
+        uint64_t now = now_ns();
+        double seconds = (now - last) / 1e9;
+        last = now;
         
-        // Formatta il messaggio con il nome del mittente
-        sprintf(message, "%s: %s\n", client->name, buffer);
-        printf("%s", message);
+        fprintf(stderr, "[statistiche] connessioni: %llu attive (+%llu -%llu) | messaggi: %.0f/s | "
+                "consegne: %.0f/s | ingresso: %.2f MB/s | uscita: %.2f MB/s\n",
+                (unsigned long long)(totals[4] - totals[5]),
+                (unsigned long long)(totals[4] - before[4]), (unsigned long long)(totals[5] - before[5]),
+                (totals[0] - before[0]) / seconds, (totals[1] - before[1]) / seconds,
+                (totals[2] - before[2]) / seconds / 1e6, (totals[3] - before[3]) / seconds / 1e6);
+        if (totals[6] + totals[7] + totals[8] > before[6] + before[7] + before[8]) {
+            fprintf(stderr, "[statistiche] client lenti: %llu messaggi scartati, %llu disconnessi, "
+                    "%llu mittenti sospesi\n",
+                    (unsigned long long)(totals[6] - before[6]), (unsigned long long)(totals[7] - before[7]),
+                    (unsigned long long)(totals[8] - before[8]));
+        }
+        histogram_difference(&interval, &fanout, &fanout_before);
+        if (counter_get(&interval.total) > 0) {
+            fprintf(stderr, "[statistiche] fan-out (us): media %.1f p50 %.1f p99 %.1f p99.9 %.1f max %.1f\n",
+                    histogram_mean(&interval) / 1e3, histogram_percentile(&interval, 0.50) / 1e3,
+                    histogram_percentile(&interval, 0.99) / 1e3,
+                    histogram_percentile(&interval, 0.999) / 1e3, counter_get(&interval.max) / 1e3);
+        }
+        histogram_difference(&interval, &queue, &queue_before);
+        if (counter_get(&interval.total) > 0) {
+            fprintf(stderr, "[statistiche] coda dei destinatari: media %.1f p50 %llu p99 %llu max %llu\n",
+                    histogram_mean(&interval),
+                    (unsigned long long)histogram_percentile(&interval, 0.50),
+                    (unsigned long long)histogram_percentile(&interval, 0.99),
+                    (unsigned long long)counter_get(&interval.max));
+        }
         
-        // Invia il messaggio a tutti gli altri client
-        send_message_to_all(message, client->id);
+        memcpy(before, totals, sizeof(before));
+        histogram_clear(&fanout_before);
+        histogram_merge(&fanout_before, &fanout);
+        histogram_clear(&queue_before);
+        histogram_merge(&queue_before, &queue);
     }
-    
-    // Notifica a tutti che il client si è disconnesso
-    sprintf(message, "%s ha lasciato la chat.\n", client->name);
-    printf("%s", message);
-    send_message_to_all(message, client->id);
-    
-cleanup:
-    // Rimuovi il client e libera le risorse
-    remove_client(client->id);
-    
-    pthread_exit(NULL);
+    return NULL;
 }
 
-int main() {
-    socket_t server_socket, client_socket;
-    struct sockaddr_in server_addr, client_addr;
-    pthread_t thread_id;
-    int opt = 1;
-    int client_count = 0;
-    socklen_t client_addr_len = sizeof(client_addr);
-    
+// Invia con una sola chiamata di sistema fino a WRITE_BATCH messaggi, a
+// partire da offset byte nel primo. Restituisce i byte accettati dal socket
+// (che possono fermarsi a metà di un messaggio) o -1 in caso di errore.
+long send_messages(socket_t sock, shared_message_t **msgs, int count, size_t offset) {
 #ifdef _WIN32
-    // Inizializza Winsock
-    WSADATA wsa_data;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
-        error("Errore nell'inizializzazione di Winsock");
+    // Winsock non ha sendmsg: si invia un messaggio alla volta
+    (void)count;
+    return send(sock, msgs[0]->data + offset, (int)(msgs[0]->len - offset), 0);
+#else
+    struct iovec iov[WRITE_BATCH];
+    struct msghdr header;
+    
+    if (count > WRITE_BATCH) {
+        count = WRITE_BATCH;
+    }
+    for (int i = 0; i < count; i++) {
+        size_t skip = i == 0 ? offset : 0;
+        iov[i].iov_base = msgs[i]->data + skip;
+        iov[i].iov_len = msgs[i]->len - skip;
     }
+    memset(&header, 0, sizeof(header));
+    header.msg_iov = iov;
+    header.msg_iovlen = count;
+    return sendmsg(sock, &header, MSG_NOSIGNAL);
 #endif
+}
+
+// Dopo un invio di sent byte rilascia i messaggi completati e aggiorna
+// offset con la parte già inviata del primo rimasto; restituisce quanti
+// messaggi sono stati completati
+int messages_consume(shared_message_t **msgs, int count, size_t *offset, size_t sent) {
+    int done = 0;
     
-    // Crea il socket del server
-    server_socket = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket == SOCKET_ERROR_VALUE) {
-        error("Errore nella creazione del socket");
+    sent += *offset;
+    while (done < count && sent >= msgs[done]->len) {
+        sent -= msgs[done]->len;
+        message_release(msgs[done]);
+        done++;
     }
-    
-    // Imposta le opzioni del socket
-    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt)) < 0) {
-        error("Errore nell'impostazione delle opzioni del socket");
+    *offset = sent;
+    return done;
+}
+
+// Prepara una tabella delle stanze vuota; 0 in caso di errore
+int room_table_init(room_table_t *table, void (*retain)(void *), void (*release)(void *)) {
+    table->buckets = (room_t **)calloc(ROOM_TABLE_MIN, sizeof(room_t *));
+    if (table->buckets == NULL) {
+        return 0;
+    }
+    table->num_buckets = ROOM_TABLE_MIN;
+    table->num_rooms = 0;
+    table->retain = retain;
+    table->release = release;
+    pthread_mutex_init(&table->mutex, NULL);
+    return 1;
+}
+
+// Hash FNV-1a del nome di una stanza
+static unsigned room_hash(const char *name) {
+    unsigned hash = 2166136261u;
+    while (*name != '\0') {
+        hash = (hash ^ (unsigned char)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+// Cerca una stanza per nome; va chiamata con il mutex della tabella
+static room_t *room_lookup(room_table_t *table, const char *name) {
+    room_t *room = table->buckets[room_hash(name) & (table->num_buckets - 1)];
+    while (room != NULL && strcmp(room->name, name) != 0) {
+        room = room->next;
+    }
+    return room;
+}
+
+// Raddoppia i bucket quando le stanze sono più dei bucket
+static void room_table_grow(room_table_t *table) {
+    int new_size = table->num_buckets * 2;
+    room_t **buckets = (room_t **)calloc(new_size, sizeof(room_t *));
+    if (buckets == NULL) {
+        return;  // Catene più lunghe, ma la tabella resta valida
+    }
+    for (int i = 0; i < table->num_buckets; i++) {
+        room_t *room = table->buckets[i];
+        while (room != NULL) {
+            room_t *next = room->next;
+            unsigned b = room_hash(room->name) & (new_size - 1);
+            room->next = buckets[b];
+            buckets[b] = room;
+            room = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->num_buckets = new_size;
+}
+
+// Rilascia una copia dell'insieme di iscritti; l'ultima la libera
+void subscriber_set_release(room_table_t *table, subscriber_set_t *set) {
+    if (set != NULL && atomic_fetch_sub_explicit(&set->refs, 1, memory_order_acq_rel) == 1) {
+        if (table->release != NULL) {
+            for (int i = 0; i < set->count; i++) {
+                table->release(set->items[i]);
+            }
+        }
+        free(set);
+    }
+}
+
+// Restituisce l'insieme di iscritti corrente, che resta valido fino a
+// subscriber_set_release anche se nel frattempo viene sostituito
+subscriber_set_t *room_subscribers(room_t *room) {
+    pthread_mutex_lock(&room->mutex);
+    subscriber_set_t *set = room->subscribers;
+    if (set != NULL) {
+        atomic_fetch_add_explicit(&set->refs, 1, memory_order_relaxed);
     }
+    pthread_mutex_unlock(&room->mutex);
+    return set;
+}
+
+// Costruisce la copia dell'insieme con item aggiunto (add) o tolto;
+// restituisce NULL se l'insieme risultante è vuoto o manca la memoria
+static subscriber_set_t *subscriber_set_copy(room_table_t *table, subscriber_set_t *old,
+                                             void *item, int add, int *failed) {
+    int old_count = old != NULL ? old->count : 0;
+    int count = add ? old_count + 1 : old_count - 1;
     
-    // Configura l'indirizzo del server
-    memset(&server_addr, 0, sizeof(server_addr));
-    server_addr.sin_family = AF_INET;
-    server_addr.sin_addr.s_addr = INADDR_ANY;
-    server_addr.sin_port = htons(PORT);
+    *failed = 0;
+    if (count <= 0) {
+        return NULL;
+    }
+    subscriber_set_t *set = (subscriber_set_t *)malloc(sizeof(subscriber_set_t) + count * sizeof(void *));
+    if (set == NULL) {
+        *failed = 1;
+        return NULL;
+    }
+    atomic_init(&set->refs, 1);
+    set->count = 0;
+    for (int i = 0; i < old_count; i++) {
+        if (old->items[i] != item) {
+            set->items[set->count++] = old->items[i];
+        }
+    }
+    if (add) {
+        set->items[set->count++] = item;
+    }
+    if (table->retain != NULL) {
+        for (int i = 0; i < set->count; i++) {
+            table->retain(set->items[i]);
+        }
+    }
+    return set;
+}
+
+// Prepara le parti vuote della tabella delle cronologie
+void history_init(void) {
+    for (int i = 0; i < HISTORY_SHARDS; i++) {
+        pthread_mutex_init(&history_shards[i].mutex, NULL);
+    }
+}
+
+// Bucket di una cronologia nella sua parte: i bit bassi dell'hash scelgono la parte
+static unsigned history_bucket(const history_shard_t *shard, unsigned hash) {
+    return (hash / HISTORY_SHARDS) & (unsigned)(shard->num_buckets - 1);
+}
+
+// Raddoppia i bucket di una parte (come room_table_grow); va chiamata con il
+// mutex della parte
+static void history_shard_grow(history_shard_t *shard) {
+    int new_size = shard->num_buckets > 0 ? shard->num_buckets * 2 : HISTORY_BUCKETS_MIN;
+    room_history_t **buckets = (room_history_t **)calloc(new_size, sizeof(room_history_t *));
+    if (buckets == NULL) {
+        return;  // Catene più lunghe, ma la parte resta valida
+    }
+    int old_size = shard->num_buckets;
+    shard->num_buckets = new_size;
+    for (int i = 0; i < old_size; i++) {
+        room_history_t *history = shard->buckets[i];
+        while (history != NULL) {
+            room_history_t *next = history->next;
+            unsigned b = history_bucket(shard, room_hash(history->name));
+            history->next = buckets[b];
+            buckets[b] = history;
+            history = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+}
+
+// Restituisce la cronologia della stanza con quel nome, creandola se nessuna
+// stanza con lo stesso nome esiste già. NULL se disattivata o senza memoria:
+// la stanza funziona comunque, senza cronologia.
+room_history_t *history_acquire(const char *name) {
+    if (history_size == 0) {
+        return NULL;
+    }
+    unsigned hash = room_hash(name);
+    history_shard_t *shard = &history_shards[hash % HISTORY_SHARDS];
+    room_history_t *history = NULL;
     
-    // Associa il socket all'indirizzo e alla porta
-    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
-        error("Errore nel binding del socket");
+    pthread_mutex_lock(&shard->mutex);
+    if (shard->num_buckets > 0) {
+        history = shard->buckets[history_bucket(shard, hash)];
+        while (history != NULL && strcmp(history->name, name) != 0) {
+            history = history->next;
+        }
+    }
+    if (history == NULL) {
+        if (shard->count >= shard->num_buckets) {
+            history_shard_grow(shard);
+        }
+        if (shard->num_buckets > 0) {
+            history = (room_history_t *)calloc(1, sizeof(room_history_t));
+        }
+        if (history != NULL) {
+            strncpy(history->name, name, sizeof(history->name) - 1);
+            room_history_t **bucket = &shard->buckets[history_bucket(shard, hash)];
+            history->next = *bucket;
+            *bucket = history;
+            shard->count++;
+        }
+    }
+    if (history != NULL) {
+        history->refs++;
+    }
+    pthread_mutex_unlock(&shard->mutex);
+    return history;
+}
+
+// Chiamata quando una stanza viene eliminata: solo le stanze pubblicano e
+// rileggono, quindi dopo l'ultima nessuno usa più la cronologia
+void history_release(room_history_t *history) {
+    if (history == NULL) {
+        return;
     }
+    unsigned hash = room_hash(history->name);
+    history_shard_t *shard = &history_shards[hash % HISTORY_SHARDS];
     
-    // Metti il socket in ascolto
-    if (listen(server_socket, 5) < 0) {
-        error("Errore nell'ascolto del socket");
+    pthread_mutex_lock(&shard->mutex);
+    if (--history->refs == 0) {
+        room_history_t **link = &shard->buckets[history_bucket(shard, hash)];
+        while (*link != history) {
+            link = &(*link)->next;
+        }
+        *link = history->next;
+        shard->count--;
+        free(atomic_load_explicit(&history->slots, memory_order_relaxed));
+        free(history);
+    }
+    pthread_mutex_unlock(&shard->mutex);
+}
+
+// Posti della cronologia, allocati dal primo che registra un messaggio. Se
+// due thread li allocano insieme resta il blocco di chi arriva primo.
+// NULL senza memoria: il messaggio non viene registrato.
+static history_slot_t *history_slots(room_history_t *history) {
+    history_slot_t *slots = atomic_load_explicit(&history->slots, memory_order_acquire);
+    if (slots != NULL) {
+        return slots;
+    }
+    history_slot_t *fresh = (history_slot_t *)calloc((size_t)history_size, sizeof(history_slot_t));
+    if (fresh == NULL) {
+        return NULL;
+    }
+    if (!atomic_compare_exchange_strong_explicit(&history->slots, &slots, fresh,
+                                                 memory_order_acq_rel, memory_order_acquire)) {
+        free(fresh);
+        return slots;
+    }
+    return fresh;
+}
+
+// Registra un messaggio nella cronologia della stanza. Più thread, anche di
+// reactor diversi, possono
+// registrare insieme: ognuno prenota un numero con fetch_add e occupa il posto
+// corrispondente. Un messaggio che non entra in un posto, o il cui posto è
+// ancora occupato da una scrittura di un giro precedente, non viene registrato.
+void room_history_add(room_t *room, const shared_message_t *msg) {
+    if (room == NULL || room->history == NULL || msg->len > HISTORY_SLOT_WORDS * 8) {
+        return;
+    }
+    room_history_t *history = room->history;
+    history_slot_t *slots = history_slots(history);
+    if (slots == NULL) {
+        return;
+    }
+    uint64_t n = atomic_fetch_add_explicit(&history->next_index, 1, memory_order_relaxed);
+    history_slot_t *slot = &slots[n % (uint64_t)history_size];
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    if ((seq & 1) || seq > 2 * n ||
+        !atomic_compare_exchange_strong_explicit(&slot->seq, &seq, 2 * n + 1,
+                                                 memory_order_relaxed, memory_order_relaxed)) {
+        return;
     }
+    atomic_thread_fence(memory_order_release);  // seq dispari prima dei nuovi byte
     
-    printf("Server avviato sulla porta %d\n", PORT);
-    printf("In attesa di connessioni...\n");
+    for (size_t w = 0; w * 8 < msg->len; w++) {
+        uint64_t word = 0;
+        size_t left = msg->len - w * 8;
+        memcpy(&word, msg->data + w * 8, left < 8 ? left : 8);
+        atomic_store_explicit(&slot->words[w], word, memory_order_relaxed);
+    }
+    atomic_store_explicit(&slot->len, msg->len, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, 2 * (n + 1), memory_order_release);
+}
+
+// Copia gli ultimi history_size messaggi della stanza, dal più vecchio, in un
+// unico messaggio da inviare con una sola scrittura a chi entra. Il blocco
+// non supera queue_low byte, così non fa scattare la politica per i client
+// lenti: se i messaggi non ci stanno tutti si scartano i più vecchi. Non
+// prende lock e non ferma chi registra: i posti riscritti durante la copia
+// vengono saltati. Restituisce NULL se non c'è nulla da inviare.
+shared_message_t *room_history_replay(room_t *room) {
+    if (room == NULL || room->history == NULL) {
+        return NULL;
+    }
+    room_history_t *history = room->history;
+    history_slot_t *slots = atomic_load_explicit(&history->slots, memory_order_acquire);
+    if (slots == NULL) {
+        return NULL;  // Nessun messaggio ancora
+    }
+    uint64_t next = atomic_load_explicit(&history->next_index, memory_order_relaxed);
+    uint64_t oldest = next > (uint64_t)history_size ? next - (uint64_t)history_size : 0;
     
-    // Inizializza l'array dei client a NULL
-    for (int i = 0; i < MAX_CLIENTS; i++) {
-        clients[i] = NULL;
+    // Dal più recente al più vecchio, finché i messaggi stanno in queue_low:
+    // il blocco è grande quanto i messaggi effettivamente presenti
+    uint64_t first = next;
+    size_t total = 0;
+    while (first > oldest) {
+        history_slot_t *slot = &slots[(first - 1) % (uint64_t)history_size];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) == 2 * first) {
+            size_t len = atomic_load_explicit(&slot->len, memory_order_relaxed);
+            if (len > HISTORY_SLOT_WORDS * 8 || total + len > queue_low) {
+                break;
+            }
+            total += len;
+        }
+        first--;
+    }
+    if (total == 0) {
+        return NULL;
     }
     
-    // Loop principale per accettare connessioni
-    while (1) {
-        // Accetta una nuova connessione
-        client_socket = accept(server_socket, (struct sockaddr *)&client_addr, &client_addr_len);
-        if (client_socket == SOCKET_ERROR_VALUE) {
-            error("Errore nell'accettazione della connessione");
+    // La copia procede a parole di 8 byte: 8 byte in più per l'ultima
+    shared_message_t *batch = message_alloc(total + 8, 1);
+    if (batch == NULL) {
+        return NULL;
+    }
+    size_t used = 0;
+    for (uint64_t n = first; n < next; n++) {
+        history_slot_t *slot = &slots[n % (uint64_t)history_size];
+        uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        if (seq != 2 * (n + 1)) {
+            continue;  // Ancora in scrittura o già sostituito
+        }
+        // Un posto riscritto dopo la misura può contenere più byte: si salta
+        size_t len = atomic_load_explicit(&slot->len, memory_order_relaxed);
+        if (len > HISTORY_SLOT_WORDS * 8 || used + len > total) {
             continue;
         }
-        
-        // Verifica se abbiamo raggiunto il limite di client
-        if (client_count >= MAX_CLIENTS) {
-            printf("Limite di client raggiunto. Connessione rifiutata.\n");
-            close_socket(client_socket);
-            continue;
+        for (size_t w = 0; w * 8 < len; w++) {
+            uint64_t word = atomic_load_explicit(&slot->words[w], memory_order_relaxed);
+            memcpy(batch->data + used + w * 8, &word, 8);
+        }
+        atomic_thread_fence(memory_order_acquire);  // Byte letti prima di ricontrollare seq
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) {
+            used += len;
+        }
+    }
+    if (used == 0) {
+        message_release(batch);
+        return NULL;
+    }
+    batch->len = used;
+    batch->data[used] = '\0';
+    return batch;
+}
+
+// Iscrive item alla stanza con quel nome, creandola se non esiste;
+// restituisce la stanza o NULL in caso di errore
+room_t *room_join(room_table_t *table, const char *name, void *item) {
+    int failed;
+    
+    pthread_mutex_lock(&table->mutex);
+    room_t *room = room_lookup(table, name);
+    if (room == NULL) {
+        room = (room_t *)calloc(1, sizeof(room_t));
+        if (room == NULL) {
+            pthread_mutex_unlock(&table->mutex);
+            return NULL;
+        }
+        strncpy(room->name, name, sizeof(room->name) - 1);
+        pthread_mutex_init(&room->mutex, NULL);
+        room->history = history_acquire(room->name);
+        if (table->num_rooms >= table->num_buckets) {
+            room_table_grow(table);
+        }
+        unsigned b = room_hash(room->name) & (table->num_buckets - 1);
+        room->next = table->buckets[b];
+        table->buckets[b] = room;
+        table->num_rooms++;
+    }
+    
+    subscriber_set_t *old = room->subscribers;
+    subscriber_set_t *set = subscriber_set_copy(table, old, item, 1, &failed);
+    if (!failed) {
+        pthread_mutex_lock(&room->mutex);
+        room->subscribers = set;
+        pthread_mutex_unlock(&room->mutex);
+    }
+    pthread_mutex_unlock(&table->mutex);
+    
+    if (failed) {
+        return NULL;  // Se la stanza era nuova resta vuota fino alla prossima uscita
+    }
+    subscriber_set_release(table, old);
+    return room;
+}
+
+// Toglie item dalla stanza; una stanza rimasta vuota viene eliminata
+void room_leave(room_table_t *table, room_t *room, void *item) {
+    int failed;
+    
+    pthread_mutex_lock(&table->mutex);
+    subscriber_set_t *old = room->subscribers;
+    subscriber_set_t *set = subscriber_set_copy(table, old, item, 0, &failed);
+    if (failed) {
+        // Senza memoria per la copia l'elemento resta nell'insieme, ma
+        // l'insieme resta valido: chi pubblica lo troverà chiuso
+        pthread_mutex_unlock(&table->mutex);
+        return;
+    }
+    pthread_mutex_lock(&room->mutex);
+    room->subscribers = set;
+    pthread_mutex_unlock(&room->mutex);
+    
+    if (set == NULL) {
+        // Solo gli iscritti pubblicano in una stanza: se è vuota nessuno la usa più
+        room_t **link = &table->buckets[room_hash(room->name) & (table->num_buckets - 1)];
+        while (*link != room) {
+            link = &(*link)->next;
+        }
+        *link = room->next;
+        table->num_rooms--;
+        pthread_mutex_destroy(&room->mutex);
+        history_release(room->history);
+        free(room);
+    }
+    pthread_mutex_unlock(&table->mutex);
+    
+    subscriber_set_release(table, old);
+}
+
+// Estrae il nome di una stanza da un comando: il primo token di text,
+// troncato a ROOM_NAME_SIZE - 1 byte. Restituisce la lunghezza, 0 se manca.
+size_t room_name_parse(char *out, const char *text, size_t len) {
+    size_t start = 0, n = 0;
+    while (start < len && (text[start] == ' ' || text[start] == '\t')) {
+        start++;
+    }
+    while (start + n < len && n < ROOM_NAME_SIZE - 1 &&
+           strchr(" \t\r\n", text[start + n]) == NULL && text[start + n] != '\0') {
+        n++;
+    }
+    memcpy(out, text + start, n);
+    out[n] = '\0';
+    return n;
+}
+
+// Con SLOW_DROP: fa posto a un messaggio di incoming byte scartando i più
+// vecchi in coda finché non si scende alla soglia bassa. Il writer ha già
+// tolto dalla coda quelli che sta inviando, quindi si scartano solo
+// messaggi interi e i confini di righe e frame restano intatti.
+static void client_drop_oldest(client_t *client, size_t incoming) {
+    int dropped = 0;
+    
+    if (client->queue_count < CLIENT_QUEUE_SIZE && client->queue_bytes + incoming <= queue_high) {
+        return;
+    }
+    while (client->queue_count > 0 &&
+           (client->queue_count == CLIENT_QUEUE_SIZE || client->queue_bytes + incoming > queue_low)) {
+        shared_message_t *old = client->queue[client->queue_head];
+        client->queue_head = (client->queue_head + 1) % CLIENT_QUEUE_SIZE;
+        client->queue_count--;
+        client->queue_bytes -= old->len;
+        message_release(old);
+        dropped++;
+    }
+    STATS_ADD(messages_dropped, dropped);
+}
+
+// Accoda un messaggio per il writer del client senza mai bloccarsi sul
+// socket. Se la coda supera il limite il client non legge abbastanza in
+// fretta: invece di rallentare gli altri lo si disconnette, e shutdown()
+// sveglia sia il suo thread di lettura sia il writer fermo in send().
+int client_enqueue(client_t *client, shared_message_t *msg) {
+    int queued = 0;
+    
+    pthread_mutex_lock(&client->queue_mutex);
+    if (!client->slow && !client->closing) {
+        if (slow_policy == SLOW_DROP) {
+            client_drop_oldest(client, msg->len);
+        }
+        if (client->queue_count < CLIENT_QUEUE_SIZE &&
+            client->queue_bytes + msg->len <= queue_limit()) {
+            STATS_RECORD(queue_depth, client->queue_count);
+            atomic_fetch_add_explicit(&msg->refs, 1, memory_order_relaxed);
+            client->queue[(client->queue_head + client->queue_count) % CLIENT_QUEUE_SIZE] = msg;
+            client->queue_count++;
+            client->queue_bytes += msg->len;
+            if (client->queue_bytes > queue_high) {
+                client->congested = 1;
+            }
+            queued = 1;
+            pthread_cond_broadcast(&client->queue_cond);  // Writer e mittenti in pausa
+        } else {
+            client->slow = 1;
+            STATS_ADD(slow_disconnects, 1);
+            log_printf("Client %d troppo lento: disconnessione\n", client->id);
+            shutdown(client->socket, SHUTDOWN_BOTH);
+        }
+    }
+    pthread_mutex_unlock(&client->queue_mutex);
+    
+    return queued;
+}
+
+// Con SLOW_PAUSE il thread che legge dal mittente si ferma finché la coda
+// del destinatario non scende alla soglia bassa: il mittente non viene letto
+// e TCP rallenta lui invece di far crescere la coda. Un destinatario che non
+// si sblocca entro PAUSE_TIMEOUT_MS viene disconnesso.
+void client_wait_drained(client_t *client) {
+    pthread_mutex_lock(&client->queue_mutex);
+    if (client->congested && !client->slow && !client->closing) {
+        struct timespec deadline;
+        timespec_get(&deadline, TIME_UTC);
+        deadline.tv_sec += PAUSE_TIMEOUT_MS / 1000;
+        deadline.tv_nsec += (PAUSE_TIMEOUT_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
         }
         
-        // Crea una nuova struttura client
-        client_t *client = (client_t *)malloc(sizeof(client_t));
-        if (client == NULL) {
-            error("Errore nell'allocazione della memoria per il client");
-            close_socket(client_socket);
-            continue;
+        STATS_ADD(pauses, 1);
+        while (client->congested && !client->slow && !client->closing) {
+            if (pthread_cond_timedwait(&client->queue_cond, &client->queue_mutex, &deadline) == ETIMEDOUT) {
+                client->slow = 1;
+                STATS_ADD(slow_disconnects, 1);
+                log_printf("Client %d bloccato: disconnessione\n", client->id);
+                shutdown(client->socket, SHUTDOWN_BOTH);
+            }
+        }
+    }
+    pthread_mutex_unlock(&client->queue_mutex);
+}
+
+// Invia un testo del server a un solo client passando dalla sua coda
+void send_message_to_client(client_t *client, int type, const char *message) {
+    shared_message_t *msg = chat_message(type, FRAME_SENDER_SERVER, "%s", message);
+    if (msg != NULL) {
+        client_enqueue(client, msg);
+        message_release(msg);
+    }
+}
+
+// Invia a un client appena entrato nella stanza i suoi ultimi messaggi
+void client_replay_history(client_t *client) {
+    shared_message_t *history = room_history_replay(client->room);
+    if (history != NULL) {
+        client_enqueue(client, history);
+        message_release(history);
+    }
+}
+
+// Writer: unico a scrivere sul socket del client, così la send() bloccante
+// di un client lento non ferma nessun altro. Prende dalla coda tutti i
+// messaggi in attesa (fino a WRITE_BATCH) e li invia insieme.
+void client_writer(client_t *client) {
+    shared_message_t *batch[WRITE_BATCH];
+    int failed = 0;
+    
+    pthread_mutex_lock(&client->queue_mutex);
+    while (1) {
+        while (client->queue_count == 0 && !client->closing) {
+            pthread_cond_wait(&client->queue_cond, &client->queue_mutex);
+        }
+        if (client->queue_count == 0) {
+            break;
+        }
+        int count = 0;
+        while (count < WRITE_BATCH && client->queue_count > 0) {
+            batch[count] = client->queue[client->queue_head];
+            client->queue_bytes -= batch[count++]->len;
+            client->queue_head = (client->queue_head + 1) % CLIENT_QUEUE_SIZE;
+            client->queue_count--;
+        }
+        if (client->congested && client->queue_bytes <= queue_low) {
+            client->congested = 0;
+            pthread_cond_broadcast(&client->queue_cond);  // Riprendono i mittenti in pausa
+        }
+        pthread_mutex_unlock(&client->queue_mutex);
+        
+        int first = 0;
+        size_t offset = 0;
+        while (!failed && first < count) {
+            long sent = send_messages(client->socket, batch + first, count - first, offset);
+            if (sent <= 0) {
+                printf("Errore nell'invio del messaggio al client %d\n", client->id);
+                shutdown(client->socket, SHUTDOWN_BOTH);
+                failed = 1;
+            } else {
+                STATS_ADD(bytes_out, sent);
+                first += messages_consume(batch + first, count - first, &offset, (size_t)sent);
+            }
+        }
+        // Dopo un errore la coda viene solo svuotata
+        while (first < count) {
+            message_release(batch[first++]);
         }
         
-        // Inizializza la struttura client
-        client->socket = client_socket;
-        client->address = client_addr;
-        client->id = client_count++;
-        strcpy(client->name, "Anonimo"); // Nome predefinito
+        pthread_mutex_lock(&client->queue_mutex);
+    }
+    client->writer_done = 1;
+    pthread_cond_broadcast(&client->queue_cond);
+    pthread_mutex_unlock(&client->queue_mutex);
+}
+
+// Prepara tutti i posti dei client; 0 in caso di errore
+int client_slots_init(void) {
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (pthread_mutex_init(&client_slots[i].queue_mutex, NULL) != 0 ||
+            pthread_cond_init(&client_slots[i].queue_cond, NULL) != 0) {
+            return 0;
+        }
+        free_slots[i] = &client_slots[MAX_CLIENTS - 1 - i];
+    }
+    num_free_slots = MAX_CLIENTS;
+    return 1;
+}
+
+// Prende un posto libero; NULL se i client sono già MAX_CLIENTS
+client_t *client_slot_alloc(void) {
+    client_t *client = NULL;
+    
+    pthread_mutex_lock(&clients_mutex);
+    if (num_free_slots > 0) {
+        client = free_slots[--num_free_slots];
+    }
+    pthread_mutex_unlock(&clients_mutex);
+    
+    return client;
+}
+
+// Consegna un client alla coda di un pool di worker
+void worker_pool_push(worker_pool_t *pool, client_t *client) {
+    pthread_mutex_lock(&pool->mutex);
+    pool->queue[(pool->head + pool->count) % MAX_CLIENTS] = client;
+    pool->count++;
+    pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+}
+
+// Ciclo di un worker: attende un client, lo serve, ricomincia
+void *worker_main(void *arg) {
+    worker_pool_t *pool = (worker_pool_t *)arg;
+    
+    while (1) {
+        pthread_mutex_lock(&pool->mutex);
+        while (pool->count == 0) {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+        client_t *client = pool->queue[pool->head];
+        pool->head = (pool->head + 1) % MAX_CLIENTS;
+        pool->count--;
+        pthread_mutex_unlock(&pool->mutex);
         
-        // Aggiungi il client all'array
-        add_client(client);
+        pool->serve(client);
+    }
+    return NULL;
+}
+
+// Avvia un pool con un worker per posto. Ogni client resta a lungo al suo
+// worker, quindi ne servono tanti quanti i client contemporanei.
+int worker_pool_start(worker_pool_t *pool, void (*serve)(client_t *client)) {
+    pthread_t thread;
+    
+    pool->head = 0;
+    pool->count = 0;
+    pool->serve = serve;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (pthread_create(&thread, NULL, worker_main, pool) != 0) {
+            return 0;
+        }
+        pthread_detach(thread);
+    }
+    return 1;
+}
+
+// Prepara la coda del client e la affida a un writer
+void client_start_writer(client_t *client) {
+    client->queue_head = 0;
+    client->queue_count = 0;
+    client->queue_bytes = 0;
+    client->congested = 0;
+    client->closing = 0;
+    client->slow = 0;
+    client->writer_done = 0;
+    worker_pool_push(&writer_pool, client);
+}
+
+// Ferma il writer dopo che ha inviato i messaggi già in coda. Da qui in
+// poi client_enqueue rifiuta i messaggi di chi ha ancora il client in una
+// vecchia copia degli iscritti.
+void client_stop_writer(client_t *client) {
+    pthread_mutex_lock(&client->queue_mutex);
+    client->closing = 1;
+    pthread_cond_broadcast(&client->queue_cond);
+    while (!client->writer_done) {
+        pthread_cond_wait(&client->queue_cond, &client->queue_mutex);
+    }
+    pthread_mutex_unlock(&client->queue_mutex);
+}
+
+void client_retain(void *item) {
+    atomic_fetch_add_explicit(&((client_t *)item)->refs, 1, memory_order_relaxed);
+}
+
+// Rilascia un riferimento al client; con l'ultimo il posto torna libero
+void client_release(void *item) {
+    client_t *client = (client_t *)item;
+    if (atomic_fetch_sub_explicit(&client->refs, 1, memory_order_acq_rel) == 1) {
+        pthread_mutex_lock(&clients_mutex);
+        free_slots[num_free_slots++] = client;
+        pthread_mutex_unlock(&clients_mutex);
+    }
+}
+
+// Funzione per inviare un messaggio ai client di una stanza tranne il
+// mittente. Il messaggio è condiviso e viene accodato a ogni destinatario
+// della copia corrente degli iscritti: il lavoro è proporzionale ai client
+// della stanza, non a quelli connessi, e senza nessuna send() né lock
+// globale un client lento non blocca gli altri.
+void send_message_to_room(room_t *room, shared_message_t *msg, int sender_id) {
+    if (room == NULL) {
+        return;
+    }
+    uint64_t start = stats_interval > 0 ? now_ns() : 0;
+    int delivered = 0;
+    subscriber_set_t *set = room_subscribers(room);
+    if (set == NULL) {
+        return;
+    }
+    for (int i = 0; i < set->count; i++) {
+        client_t *client = (client_t *)set->items[i];
+        if (client->id != sender_id) {
+            delivered += client_enqueue(client, msg);
+        }
+    }
+    STATS_ADD(deliveries, delivered);
+    STATS_RECORD(fanout_ns, now_ns() - start);
+    
+    // Il messaggio è già in tutte le code: solo ora il mittente aspetta
+    // i destinatari congestionati
+    if (slow_policy == SLOW_PAUSE && sender_id >= 0) {
+        for (int i = 0; i < set->count; i++) {
+            client_t *client = (client_t *)set->items[i];
+            if (client->id != sender_id) {
+                client_wait_drained(client);
+            }
+        }
+    }
+    subscriber_set_release(&rooms, set);
+}
+
+// Sposta il client nella stanza indicata, avvisando entrambe le stanze
+void client_change_room(client_t *client, const char *text, size_t len) {
+    char name[ROOM_NAME_SIZE];
+    char notice[ROOM_NAME_SIZE + 32];
+    shared_message_t *message;
+    
+    if (room_name_parse(name, text, len) == 0) {
+        send_message_to_client(client, FRAME_CHAT, "Uso: /join <stanza>\n");
+        return;
+    }
+    if (client->room != NULL) {
+        if (strcmp(client->room->name, name) == 0) {
+            return;
+        }
+        message = chat_message(FRAME_LEAVE, client->id, "%s ha lasciato la stanza %s\n",
+                               client->name, client->room->name);
+        if (message != NULL) {
+            send_message_to_room(client->room, message, client->id);
+            message_release(message);
+        }
+        room_leave(&rooms, client->room, client);
+    }
+    
+    client->room = room_join(&rooms, name, client);
+    if (client->room == NULL) {
+        send_message_to_client(client, FRAME_CHAT, "Impossibile entrare nella stanza\n");
+        return;
+    }
+    message = chat_message(FRAME_JOIN, client->id, "%s è entrato nella stanza %s\n", client->name, name);
+    if (message != NULL) {
+        send_message_to_room(client->room, message, client->id);
+        message_release(message);
+    }
+    snprintf(notice, sizeof(notice), "Sei nella stanza %s\n", name);
+    send_message_to_client(client, FRAME_CHAT, notice);
+    client_replay_history(client);
+}
+
+// Funzione per aggiungere un client all'array
+void add_client(client_t *client) {
+    pthread_mutex_lock(&clients_mutex);
+    
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i] == NULL) {
+            clients[i] = client;
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&clients_mutex);
+}
+
+// Funzione per rimuovere un client dall'array. Il writer viene fermato
+// fuori dal mutex: deve ancora inviare i messaggi rimasti in coda.
+void remove_client(int id) {
+    client_t *client = NULL;
+    
+    pthread_mutex_lock(&clients_mutex);
+    
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (clients[i] != NULL && clients[i]->id == id) {
+            client = clients[i];
+            clients[i] = NULL;
+            break;
+        }
+    }
+    
+    pthread_mutex_unlock(&clients_mutex);
+    
+    if (client != NULL) {
+        if (client->room != NULL) {
+            room_leave(&rooms, client->room, client);
+            client->room = NULL;
+        }
+        client_stop_writer(client);
+        close_socket(client->socket);
+        client_release(client);
+        STATS_ADD(connections_closed, 1);
+    }
+}
+
+// Riceve il prossimo messaggio di un client. Nel protocollo testuale ogni
+// recv() è un messaggio di tipo FRAME_CHAT, terminato da '\0'; con i frame
+// il testo punta nel buffer di ricezione, senza copie e senza terminatore.
+// Restituisce il tipo del messaggio, 0 se il client si è disconnesso o ha
+// inviato un frame non valido.
+int client_receive(client_t *client, frame_buffer_t *input, const char **text, size_t *len) {
+    int read_size;
+    
+    if (!framed_protocol) {
+        read_size = recv(client->socket, input->data, BUFFER_SIZE - 1, 0);
+        if (read_size <= 0) {
+            return 0;
+        }
+        STATS_ADD(bytes_in, read_size);
+        input->data[read_size] = '\0';
+        *text = input->data;
+        *len = (size_t)read_size;
+        return FRAME_CHAT;
+    }
+    
+    while (1) {
+        frame_t frame;
+        int found = frame_next(input, &frame);
+        if (found > 0) {
+            *text = frame.payload;
+            *len = frame.length;
+            return frame.type;
+        }
+        if (found < 0) {
+            log_printf("Frame non valido dal client %d\n", client->id);
+            return 0;
+        }
+        size_t space;
+        char *dest = frame_buffer_space(input, &space);
+        read_size = recv(client->socket, dest, (int)space, 0);
+        if (read_size <= 0) {
+            return 0;
+        }
+        STATS_ADD(bytes_in, read_size);
+        input->end += (size_t)read_size;
+    }
+}
+
+// Funzione eseguita dai worker di lettura per gestire un client
+void handle_client(client_t *client) {
+    char buffer[INPUT_BUFFER_SIZE];
+    frame_buffer_t input = { buffer, sizeof(buffer), 0, 0 };
+    shared_message_t *message;
+    const char *text;
+    size_t len;
+    int type;
+    
+    // Richiedi il nome del client
+    send_message_to_client(client, FRAME_PROMPT, "Inserisci il tuo nome: ");
+    
+    // Ricevi il nome del client
+    type = client_receive(client, &input, &text, &len);
+    if (type == 0 || type == FRAME_EXIT) {
+        log_printf("Client disconnesso senza fornire un nome\n");
+        goto cleanup;
+    }
+    
+    if (type == FRAME_NAME || !framed_protocol) {
+        size_t name_len = 0;
+        while (name_len < len && text[name_len] != '\n') { // Rimuovi il newline se presente
+            name_len++;
+        }
+        if (name_len > sizeof(client->name) - 1) {
+            name_len = sizeof(client->name) - 1;
+        }
+        memcpy(client->name, text, name_len);
+        client->name[name_len] = '\0'; // Assicura terminazione
+    }
+    
+    // Entra nella stanza predefinita e notifica agli altri client che un nuovo
+    // client si è connesso
+    client->room = room_join(&rooms, DEFAULT_ROOM, client);
+    message = chat_message(FRAME_JOIN, client->id, "%s si è unito alla chat!\n", client->name);
+    if (message != NULL) {
+        log_message(message);
+        send_message_to_room(client->room, message, client->id);
+        message_release(message);
+    }
+    client_replay_history(client);
+    
+    // Loop principale per ricevere e inviare messaggi
+    while ((type = client_receive(client, &input, &text, &len)) != 0) {
+        // Controlla se il client vuole disconnettersi
+        if (type == FRAME_EXIT || (!framed_protocol && strcmp(text, "exit") == 0)) {
+            break;
+        }
         
-        printf("Nuova connessione accettata: %s:%d (ID: %d)\n", 
-               inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), client->id);
+        // Cambio di stanza: frame dedicato o comando testuale "/join <stanza>"
+        if (!framed_protocol && strncmp(text, "/join ", 6) == 0) {
+            type = FRAME_ROOM;
+            text += 6;
+            len -= 6;
+        }
+        if (type == FRAME_ROOM) {
+            client_change_room(client, text, len);
+            continue;
+        }
+        if (type != FRAME_CHAT) {
+            continue;
+        }
         
-        // Crea un nuovo thread per gestire il client
-        if (pthread_create(&thread_id, NULL, handle_client, (void *)client) != 0) {
-            printf("Errore nella creazione del thread\n");
-            remove_client(client->id);
-            client_count--;
+        // Formatta il messaggio con il nome del mittente, una sola volta
+        // per tutti i destinatari
+        message = chat_message(FRAME_CHAT, client->id, "%s: %.*s\n", client->name, (int)len, text);
+        STATS_ADD(messages_in, 1);
+        if (message == NULL) {
             continue;
         }
+        log_message(message);
+        room_history_add(client->room, message);
         
-        // Imposta il thread come detached
-        pthread_detach(thread_id);
+        // Invia il messaggio agli altri client della stanza
+        send_message_to_room(client->room, message, client->id);
+        message_release(message);
+    }
+    
+    // Notifica alla stanza che il client si è disconnesso
+    message = chat_message(FRAME_LEAVE, client->id, "%s ha lasciato la chat.\n", client->name);
+    if (message != NULL) {
+        log_message(message);
+        send_message_to_room(client->room, message, client->id);
+        message_release(message);
+    }
+    
+cleanup:
+    // Rimuovi il client e libera le risorse
+    remove_client(client->id);
+}
+
+// Accetta una connessione. Su Linux accept4 imposta i flag del nuovo socket
+// (SOCK_NONBLOCK) nella stessa chiamata, senza fcntl successive.
+socket_t accept_client(socket_t server_socket, struct sockaddr_in *addr, int flags) {
+    socklen_t addr_len = sizeof(*addr);
+#ifdef __linux__
+    return accept4(server_socket, (struct sockaddr *)addr, &addr_len, flags | SOCK_CLOEXEC);
+#else
+    (void)flags;
+    return accept(server_socket, (struct sockaddr *)addr, &addr_len);
+#endif
+}
+
+#ifdef __linux__
+// ---------------------------------------------------------------------------
+// Modalità a eventi (epoll)
+// ---------------------------------------------------------------------------
+//
+// Un solo thread gestisce tutte le connessioni: i socket sono non bloccanti
+// e registrati su epoll in modalità edge-triggered, quindi a ogni notifica
+// si legge (o si scrive) finché il kernel non risponde EAGAIN. Ogni
+// connessione ha un buffer di ingresso, dove si accumulano le righe non
+// ancora complete, e una coda di uscita con i messaggi condivisi che il
+// socket non ha ancora accettato. I messaggi accodati durante un'iterazione
+// vengono inviati alla fine, tutti insieme con una sendmsg per connessione.
+// Il protocollo è lo stesso della modalità a thread: la
+// prima riga è il nome, le successive sono messaggi inoltrati agli altri
+// client, "exit" chiude la connessione.
+//
+// Con più reactor ogni thread esegue un ciclo completo su un proprio socket
+// di ascolto (SO_REUSEPORT: il kernel distribuisce le nuove connessioni tra
+// i socket) e non ci sono strutture condivise protette da mutex. Un
+// messaggio viene consegnato subito ai client del reactor che l'ha ricevuto
+// e accodato nella inbox degli altri, una pila lock-free con più produttori
+// e un solo consumatore.
+//
+// Ogni reactor ha la propria tabella delle stanze con i soli client locali.
+// Un messaggio va agli iscritti locali della stanza del mittente e, nella
+// inbox, porta il nome della stanza: gli altri reactor lo consegnano ai
+// propri iscritti o lo scartano se non ne hanno.
+//
+// Con --uring i reactor usano io_uring al posto di epoll e delle chiamate
+// recv e sendmsg, ma connessioni, stanze, inbox e politiche per i client
+// lenti restano le stesse: cambiano solo il modo di ricevere (conn_recv),
+// di inviare (conn_flush) e di attendere gli eventi (uring_run).
+
+static event_loop_t *reactors;      // Tutti i reactor, per gli inoltri
+static int num_reactors;
+static atomic_int next_client_id;   // Identificativi unici tra i reactor
+
+static int uring_flush(event_loop_t *loop, connection_t *conn);
+static void uring_recv(event_loop_t *loop, connection_t *conn);
+static void uring_resume_recv(event_loop_t *loop, connection_t *conn);
+static void uring_cancel_all(event_loop_t *loop, connection_t *conn);
+static void *uring_run(event_loop_t *loop);
+
+// Aggiorna la coda di uscita dopo l'invio di sent byte
+static void conn_sent(event_loop_t *loop, connection_t *conn, size_t sent) {
+    STATS_ADD(bytes_out, sent);
+    int done = messages_consume(conn->out_queue + conn->out_head, conn->out_count,
+                                &conn->out_offset, sent);
+    conn->out_head += done;
+    conn->out_count -= done;
+    conn->out_bytes -= sent;
+    conn->in_flight = done < conn->in_flight ? conn->in_flight - done : 0;
+    if (conn->out_count == 0) {
+        conn->out_head = 0;
+    }
+    if (conn->congested && conn->out_bytes <= queue_low) {
+        conn->congested = 0;
+        loop->num_congested--;
+    }
+}
+
+// Invia i messaggi in attesa finché il socket li accetta; 0 in caso di errore
+static int conn_flush(event_loop_t *loop, connection_t *conn) {
+    int ok = 1;
+    
+    if (loop->uring) {
+        return uring_flush(loop, conn);
+    }
+    while (conn->out_count > 0) {
+        long sent = send_messages(conn->socket, conn->out_queue + conn->out_head,
+                                  conn->out_count, conn->out_offset);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ok = errno == EAGAIN || errno == EWOULDBLOCK;  // Riprova su EPOLLOUT
+            break;
+        }
+        conn_sent(loop, conn, (size_t)sent);
+    }
+    return ok;
+}
+
+// Con SLOW_DROP: come client_drop_oldest, ma il primo messaggio può essere
+// già stato inviato in parte e in quel caso va tenuto, come quelli già
+// affidati a io_uring
+static void conn_drop_oldest(connection_t *conn, size_t incoming) {
+    int keep = conn->in_flight > 0 ? conn->in_flight : (conn->out_offset > 0 ? 1 : 0);
+    shared_message_t **first = conn->out_queue + conn->out_head + keep;
+    int available = conn->out_count - keep;
+    int dropped = 0;
+    
+    while (dropped < available && conn->out_bytes + incoming > queue_low) {
+        conn->out_bytes -= first[dropped]->len;
+        message_release(first[dropped]);
+        dropped++;
+    }
+    memmove(first, first + dropped, (size_t)(available - dropped) * sizeof(shared_message_t *));
+    conn->out_count -= dropped;
+    STATS_ADD(messages_dropped, dropped);
+}
+
+// Accoda un messaggio; 0 se il client ha troppi dati in attesa
+static int conn_queue(connection_t *conn, shared_message_t *msg) {
+    if (slow_policy == SLOW_DROP && conn->out_bytes + msg->len > queue_high) {
+        conn_drop_oldest(conn, msg->len);
+    }
+    if (conn->out_bytes + msg->len > queue_limit()) {
+        return 0;
+    }
+    
+    // Recupera lo spazio dei messaggi già inviati prima di ingrandire la coda
+    if (conn->out_head + conn->out_count == conn->out_cap) {
+        if (conn->out_head > 0) {
+            memmove(conn->out_queue, conn->out_queue + conn->out_head,
+                    conn->out_count * sizeof(shared_message_t *));
+            conn->out_head = 0;
+        } else {
+            int new_cap = conn->out_cap > 0 ? conn->out_cap * 2 : 16;
+            shared_message_t **temp = (shared_message_t **)realloc(conn->out_queue,
+                                                                   new_cap * sizeof(shared_message_t *));
+            if (temp == NULL) {
+                return 0;
+            }
+            conn->out_queue = temp;
+            conn->out_cap = new_cap;
+        }
+    }
+    STATS_RECORD(queue_depth, conn->out_count);
+    atomic_fetch_add_explicit(&msg->refs, 1, memory_order_relaxed);
+    conn->out_queue[conn->out_head + conn->out_count++] = msg;
+    conn->out_bytes += msg->len;
+    return 1;
+}
+
+// Prende una struttura dal pool del reactor, allocandone un blocco di
+// CONNECTION_CHUNK quando è vuoto: durante un'ondata di riconnessioni
+// serve una malloc ogni CONNECTION_CHUNK client. Le strutture non tornano
+// mai al sistema, ma vengono riusate dalle connessioni successive.
+static connection_t *conn_alloc(event_loop_t *loop) {
+    if (loop->free_connections == NULL) {
+        connection_t *chunk = (connection_t *)malloc(CONNECTION_CHUNK * sizeof(connection_t));
+        if (chunk == NULL) {
+            return NULL;
+        }
+        for (int i = CONNECTION_CHUNK - 1; i >= 0; i--) {
+            chunk[i].next_free = loop->free_connections;
+            loop->free_connections = &chunk[i];
+        }
+    }
+    connection_t *conn = loop->free_connections;
+    loop->free_connections = conn->next_free;
+    memset(conn, 0, sizeof(connection_t));
+    return conn;
+}
+
+static void conn_free(event_loop_t *loop, connection_t *conn) {
+    conn->next_free = loop->free_connections;
+    loop->free_connections = conn;
+}
+
+// Rilascia i messaggi che non verranno più inviati
+static void conn_release_output(connection_t *conn) {
+    for (int i = 0; i < conn->out_count; i++) {
+        message_release(conn->out_queue[conn->out_head + i]);
+    }
+    free(conn->out_queue);
+}
+
+// Libera una connessione già tolta dal reactor. Con io_uring il socket e i
+// messaggi in uscita servono finché il kernel non ha completato le
+// operazioni in corso, quindi è l'ultimo completamento a liberarla.
+static void conn_destroy(event_loop_t *loop, connection_t *conn) {
+    if (loop->uring) {
+        close_socket(conn->socket);
+    }
+    free(conn->stash);
+    conn_release_output(conn);
+    conn_free(loop, conn);
+}
+
+// La chiusura è rimandata alla fine dell'iterazione: la connessione può
+// comparire ancora tra gli eventi già letti o nel broadcast in corso
+static void conn_schedule_close(event_loop_t *loop, connection_t *conn) {
+    if (!conn->closing) {
+        conn->closing = 1;
+        conn->next_closing = loop->closing;
+        loop->closing = conn;
+    }
+}
+
+// Accoda un messaggio a una connessione. Se la coda era vuota la connessione
+// entra nella lista pending e l'invio avviene a fine iterazione, insieme ai
+// messaggi arrivati nel frattempo; altrimenti ci penserà EPOLLOUT.
+static void conn_send(event_loop_t *loop, connection_t *conn, shared_message_t *msg) {
+    if (conn->closing) {
+        return;
+    }
+    int idle = conn->out_count == 0;
+    if (!conn_queue(conn, msg)) {
+        STATS_ADD(slow_disconnects, 1);
+        log_printf("Client %d troppo lento, connessione chiusa\n", conn->id);
+        conn_schedule_close(loop, conn);
+        return;
+    }
+    if (slow_policy == SLOW_PAUSE && conn->out_bytes > queue_high) {
+        if (!conn->congested) {
+            conn->congested = 1;
+            conn->congested_since = now_ns();
+            loop->num_congested++;
+        }
+        // Si smette di leggere dal client che ha prodotto il messaggio; i
+        // messaggi degli altri reactor e gli avvisi del server non hanno un
+        // mittente da fermare e restano soggetti solo a queue_limit()
+        connection_t *sender = loop->reading;
+        if (sender != NULL && sender != conn && !sender->paused) {
+            sender->paused = 1;
+            loop->num_paused++;
+            STATS_ADD(pauses, 1);
+        }
+    }
+    if (idle && !conn->in_pending) {
+        conn->in_pending = 1;
+        conn->next_pending = loop->pending;
+        loop->pending = conn;
+    }
+}
+
+// Consegna un messaggio agli iscritti locali della stanza, tranne il mittente
+static void loop_deliver(event_loop_t *loop, room_t *room, shared_message_t *msg, int sender_id) {
+    int delivered = 0;
+    subscriber_set_t *set = room_subscribers(room);
+    if (set == NULL) {
+        return;
+    }
+    for (int i = 0; i < set->count; i++) {
+        connection_t *conn = (connection_t *)set->items[i];
+        if (conn->id != sender_id && !conn->closing) {
+            conn_send(loop, conn, msg);
+            delivered++;
+        }
+    }
+    subscriber_set_release(&loop->rooms, set);
+    STATS_ADD(deliveries, delivered);
+}
+
+// Accoda un messaggio nella inbox di un altro reactor. Solo chi trova la
+// inbox vuota lo sveglia: finché non l'ha svuotata, un risveglio basta.
+static void inbox_push(event_loop_t *target, const char *room, shared_message_t *msg) {
+    inbox_message_t *node = (inbox_message_t *)malloc(sizeof(inbox_message_t));
+    if (node == NULL) {
+        printf("Errore nell'allocazione della memoria per il messaggio\n");
+        return;
+    }
+    atomic_fetch_add_explicit(&msg->refs, 1, memory_order_relaxed);
+    node->message = msg;
+    memcpy(node->room, room, ROOM_NAME_SIZE);
+    
+    inbox_message_t *head = atomic_load_explicit(&target->inbox, memory_order_relaxed);
+    do {
+        node->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&target->inbox, &head, node,
+                                                    memory_order_release, memory_order_relaxed));
+    if (head == NULL) {
+        uint64_t one = 1;
+        if (write(target->event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+            perror("Errore nella notifica del reactor");
+        }
+    }
+}
+
+// Prende tutti i messaggi della inbox e li consegna nell'ordine di arrivo.
+// Il contatore di event_fd va azzerato prima di svuotare la pila, così un
+// messaggio arrivato dopo lo svuotamento produce sempre un nuovo risveglio.
+static void loop_drain_inbox(event_loop_t *loop) {
+    uint64_t count;
+    while (read(loop->event_fd, &count, sizeof(count)) > 0) {
+    }
+    
+    inbox_message_t *node = atomic_exchange_explicit(&loop->inbox, NULL, memory_order_acquire);
+    inbox_message_t *ordered = NULL;
+    while (node != NULL) {  // La pila è dal più recente: va invertita
+        inbox_message_t *next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+    }
+    while (ordered != NULL) {
+        inbox_message_t *next = ordered->next;
+        pthread_mutex_lock(&loop->rooms.mutex);
+        room_t *room = room_lookup(&loop->rooms, ordered->room);
+        pthread_mutex_unlock(&loop->rooms.mutex);
+        if (room != NULL) {
+            loop_deliver(loop, room, ordered->message, -1);  // Il mittente è altrove
+        }
+        message_release(ordered->message);
+        free(ordered);
+        ordered = next;
+    }
+}
+
+// Equivalente di send_message_to_room per la modalità a eventi. Gli altri
+// reactor ricevono lo stesso messaggio condiviso, senza copie del testo.
+// Con history il messaggio entra anche nella cronologia della stanza, che è
+// condivisa con gli altri reactor e non va registrato anche da loro.
+static void loop_broadcast(event_loop_t *loop, room_t *room, shared_message_t *msg, int sender_id,
+                           int history) {
+    if (room == NULL) {
+        return;
+    }
+    uint64_t start = stats_interval > 0 ? now_ns() : 0;
+    if (history) {
+        room_history_add(room, msg);
+    }
+    loop_deliver(loop, room, msg, sender_id);
+    for (int r = 0; r < num_reactors; r++) {
+        if (&reactors[r] != loop) {
+            inbox_push(&reactors[r], room->name, msg);
+        }
+    }
+    STATS_RECORD(fanout_ns, now_ns() - start);
+}
+
+// Invia i messaggi accodati durante l'iterazione alle connessioni pending
+static void loop_flush_pending(event_loop_t *loop) {
+    while (loop->pending != NULL) {
+        connection_t *conn = loop->pending;
+        loop->pending = conn->next_pending;
+        conn->in_pending = 0;
+        if (!conn->closing && !conn_flush(loop, conn)) {
+            conn_schedule_close(loop, conn);
+        }
+    }
+}
+
+// Fine iterazione: invia i messaggi in attesa e chiude le connessioni
+// segnalate. L'avviso di uscita produce altri invii e può farne chiudere
+// altre (client troppo lenti), quindi si ripete finché le liste sono vuote.
+// La lista pending viene svuotata prima di ogni chiusura, così non contiene
+// mai una connessione già liberata.
+static void loop_process_closing(event_loop_t *loop) {
+    while (1) {
+        loop_flush_pending(loop);
+        if (loop->closing == NULL) {
+            break;
+        }
+        connection_t *conn = loop->closing;
+        loop->closing = conn->next_closing;
+        
+        // Toglie la connessione dall'array spostando l'ultima al suo posto
+        int last = --loop->num_connections;
+        loop->connections[conn->index] = loop->connections[last];
+        loop->connections[conn->index]->index = conn->index;
+        if (loop->uring) {
+            uring_cancel_all(loop, conn);
+        } else {
+            close_socket(conn->socket);  // La rimuove anche da epoll
+        }
+        
+        if (conn->named) {
+            shared_message_t *message = chat_message(FRAME_LEAVE, conn->id,
+                                                     "%s ha lasciato la chat.\n", conn->name);
+            if (message != NULL) {
+                log_message(message);
+                loop_broadcast(loop, conn->room, message, conn->id, 0);
+                message_release(message);
+            }
+        } else {
+            log_printf("Client disconnesso senza fornire un nome\n");
+        }
+        if (conn->room != NULL) {
+            room_leave(&loop->rooms, conn->room, conn);
+        }
+        loop->num_congested -= conn->congested;
+        loop->num_paused -= conn->paused;
+        conn->closed = 1;
+        if (conn->ops == 0) {
+            conn_destroy(loop, conn);
+        }
+        STATS_ADD(connections_closed, 1);
+    }
+}
+
+// Invia a una connessione appena entrata nella stanza i suoi ultimi messaggi
+static void conn_replay_history(event_loop_t *loop, connection_t *conn) {
+    shared_message_t *history = room_history_replay(conn->room);
+    if (history != NULL) {
+        conn_send(loop, conn, history);
+        message_release(history);
+    }
+}
+
+// Sposta la connessione nella stanza indicata, avvisando entrambe le stanze
+static void conn_change_room(event_loop_t *loop, connection_t *conn, const char *text, size_t len) {
+    char name[ROOM_NAME_SIZE];
+    shared_message_t *message;
+    int joined = 0;
+    
+    if (room_name_parse(name, text, len) == 0) {
+        message = chat_message(FRAME_CHAT, FRAME_SENDER_SERVER, "Uso: /join <stanza>\n");
+    } else if (conn->room != NULL && strcmp(conn->room->name, name) == 0) {
+        return;
+    } else {
+        if (conn->room != NULL) {
+            message = chat_message(FRAME_LEAVE, conn->id, "%s ha lasciato la stanza %s\n",
+                                   conn->name, conn->room->name);
+            if (message != NULL) {
+                loop_broadcast(loop, conn->room, message, conn->id, 0);
+                message_release(message);
+            }
+            room_leave(&loop->rooms, conn->room, conn);
+        }
+        conn->room = room_join(&loop->rooms, name, conn);
+        if (conn->room == NULL) {
+            message = chat_message(FRAME_CHAT, FRAME_SENDER_SERVER, "Impossibile entrare nella stanza\n");
+        } else {
+            message = chat_message(FRAME_JOIN, conn->id, "%s è entrato nella stanza %s\n", conn->name, name);
+            if (message != NULL) {
+                loop_broadcast(loop, conn->room, message, conn->id, 0);
+                message_release(message);
+            }
+            message = chat_message(FRAME_CHAT, FRAME_SENDER_SERVER, "Sei nella stanza %s\n", name);
+            joined = 1;
+        }
+    }
+    if (message != NULL) {
+        conn_send(loop, conn, message);
+        message_release(message);
+    }
+    if (joined) {
+        conn_replay_history(loop, conn);
+    }
+}
+
+// Gestisce un messaggio ricevuto da un client. Il primo messaggio dà il
+// nome; con i frame, se non è un FRAME_NAME il client resta "Anonimo".
+static void conn_handle_message(event_loop_t *loop, connection_t *conn, int type,
+                                const char *text, size_t len) {
+    shared_message_t *message;
+    
+    if (type == FRAME_EXIT) {
+        conn_schedule_close(loop, conn);
+        return;
+    }
+    if (!conn->named) {
+        if (type == FRAME_NAME && len > 0) {
+            if (len > sizeof(conn->name) - 1) {
+                len = sizeof(conn->name) - 1;
+            }
+            memcpy(conn->name, text, len);
+            conn->name[len] = '\0';
+        }
+        conn->named = 1;
+        conn->room = room_join(&loop->rooms, DEFAULT_ROOM, conn);
+        message = chat_message(FRAME_JOIN, conn->id, "%s si è unito alla chat!\n", conn->name);
+        if (message != NULL) {
+            log_message(message);
+            loop_broadcast(loop, conn->room, message, conn->id, 0);
+            message_release(message);
+        }
+        conn_replay_history(loop, conn);
+        if (type == FRAME_NAME) {
+            return;
+        }
+    }
+    if (type == FRAME_ROOM) {
+        conn_change_room(loop, conn, text, len);
+        return;
+    }
+    if (type != FRAME_CHAT) {
+        return;
+    }
+    STATS_ADD(messages_in, 1);
+    message = chat_message(FRAME_CHAT, conn->id, "%s: %.*s\n", conn->name, (int)len, text);
+    if (message != NULL) {
+        log_message(message);
+        loop_broadcast(loop, conn->room, message, conn->id, 1);
+        message_release(message);
+    }
+}
+
+// Gestisce una riga completa (senza terminatore) del protocollo testuale:
+// la prima è il nome, "exit" chiude la connessione, "/join <stanza>"
+// cambia stanza
+static void conn_handle_line(event_loop_t *loop, connection_t *conn, char *line) {
+    line[strcspn(line, "\r")] = '\0';
+    
+    if (!conn->named) {
+        conn_handle_message(loop, conn, FRAME_NAME, line, strlen(line));
+    } else if (strcmp(line, "exit") == 0) {
+        conn_handle_message(loop, conn, FRAME_EXIT, line, 0);
+    } else if (strncmp(line, "/join ", 6) == 0) {
+        conn_handle_message(loop, conn, FRAME_ROOM, line + 6, strlen(line + 6));
+    } else {
+        conn_handle_message(loop, conn, FRAME_CHAT, line, strlen(line));
+    }
+}
+
+// Riceve fino a space byte del client, come recv su un socket non bloccante.
+// Con io_uring i byte sono già arrivati: prima quelli messi da parte durante
+// una pausa, poi quelli del buffer fornito di cui si sta gestendo il
+// completamento; quando finiscono restituisce -1 con errno EAGAIN.
+static ssize_t conn_recv(event_loop_t *loop, connection_t *conn, char *dest, size_t space) {
+    if (!loop->uring) {
+        return recv(conn->socket, dest, space, 0);
+    }
+    
+    size_t count;
+    if (conn->stash_start < conn->stash_len) {
+        count = conn->stash_len - conn->stash_start;
+        count = count < space ? count : space;
+        memcpy(dest, conn->stash + conn->stash_start, count);
+        conn->stash_start += count;
+        if (conn->stash_start == conn->stash_len) {
+            conn->stash_start = conn->stash_len = 0;
+        }
+    } else if (loop->input_conn == conn && loop->input_len > 0) {
+        count = loop->input_len < space ? loop->input_len : space;
+        memcpy(dest, loop->input, count);
+        loop->input += count;
+        loop->input_len -= count;
+    } else {
+        errno = EAGAIN;
+        return -1;
+    }
+    return (ssize_t)count;
+}
+
+// Con il protocollo a frame: legge tutto ciò che è disponibile e gestisce
+// i frame completi direttamente nel buffer di ingresso. Un segmento può
+// contenere molti frame e un frame può arrivare in più segmenti.
+static void conn_handle_frames(event_loop_t *loop, connection_t *conn) {
+    frame_buffer_t input = { conn->in_buf, sizeof(conn->in_buf), conn->in_start, conn->in_len };
+    
+    while (!conn->closing) {
+        // Prima i frame già nel buffer: dopo una pausa possono essercene
+        frame_t frame;
+        int found = 0;
+        while (!conn->closing && !conn->paused && (found = frame_next(&input, &frame)) > 0) {
+            conn_handle_message(loop, conn, frame.type, frame.payload, frame.length);
+        }
+        if (!conn->closing && found < 0) {
+            log_printf("Frame non valido dal client %d\n", conn->id);
+            conn_schedule_close(loop, conn);
+        }
+        if (conn->closing || conn->paused) {
+            break;
+        }
+        
+        size_t space;
+        char *dest = frame_buffer_space(&input, &space);
+        ssize_t received = conn_recv(loop, conn, dest, space);
+        if (received == 0) {
+            conn_schedule_close(loop, conn);
+            break;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn_schedule_close(loop, conn);
+            }
+            break;
+        }
+        STATS_ADD(bytes_in, received);
+        input.end += (size_t)received;
+    }
+    conn->in_start = input.start;
+    conn->in_len = input.end;
+}
+
+// Gestisce le righe complete nel buffer di ingresso. Se la lettura del
+// client viene sospesa le righe rimanenti restano nel buffer per la ripresa.
+static void conn_handle_lines(event_loop_t *loop, connection_t *conn) {
+    char *start = conn->in_buf;
+    char *newline;
+    
+    conn->in_buf[conn->in_len] = '\0';
+    while (!conn->closing && !conn->paused && (newline = strchr(start, '\n')) != NULL) {
+        *newline = '\0';
+        conn_handle_line(loop, conn, start);
+        start = newline + 1;
+    }
+    conn->in_len -= (size_t)(start - conn->in_buf);
+    memmove(conn->in_buf, start, conn->in_len);
+    
+    if (!conn->paused && conn->in_len == sizeof(conn->in_buf) - 1) {
+        conn->in_buf[conn->in_len] = '\0';
+        conn_handle_line(loop, conn, conn->in_buf);
+        conn->in_len = 0;
+    }
+}
+
+// Legge tutto ciò che è disponibile e gestisce le righe complete. Una riga
+// più lunga del buffer viene gestita a pezzi, come fa la modalità a thread.
+static void conn_handle_read(event_loop_t *loop, connection_t *conn) {
+    if (conn->paused) {
+        return;  // I dati restano nel socket: TCP rallenta il mittente
+    }
+    loop->reading = conn;
+    if (framed_protocol) {
+        conn_handle_frames(loop, conn);
+        loop->reading = NULL;
+        return;
+    }
+    conn_handle_lines(loop, conn);
+    while (!conn->closing && !conn->paused) {
+        ssize_t received = conn_recv(loop, conn, conn->in_buf + conn->in_len,
+                                     sizeof(conn->in_buf) - 1 - conn->in_len);
+        if (received == 0) {
+            conn_schedule_close(loop, conn);
+            break;
+        }
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                conn_schedule_close(loop, conn);
+            }
+            break;
+        }
+        STATS_ADD(bytes_in, received);
+        conn->in_len += (size_t)received;
+        conn_handle_lines(loop, conn);
+    }
+    loop->reading = NULL;
+}
+
+static int set_nonblocking(socket_t sock) {
+    int flags = fcntl(sock, F_GETFL, 0);
+    return flags >= 0 && fcntl(sock, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+// Aggiunge al reactor la connessione di un socket appena accettato e le
+// chiede il nome; in caso di errore chiude il socket
+static void loop_add_connection(event_loop_t *loop, socket_t client_socket,
+                                const struct sockaddr_in *client_addr) {
+    connection_t *conn = conn_alloc(loop);
+    if (conn != NULL && loop->num_connections == loop->cap_connections) {
+        int new_cap = loop->cap_connections > 0 ? loop->cap_connections * 2 : 64;
+        connection_t **temp = (connection_t **)realloc(loop->connections,
+                                                       new_cap * sizeof(connection_t *));
+        if (temp == NULL) {
+            conn_free(loop, conn);
+            conn = NULL;
+        } else {
+            loop->connections = temp;
+            loop->cap_connections = new_cap;
+        }
+    }
+    if (conn == NULL) {
+        printf("Errore nell'allocazione della memoria per il client\n");
+        close_socket(client_socket);
+        return;
+    }
+    
+    conn->socket = client_socket;
+    conn->address = *client_addr;
+    conn->id = atomic_fetch_add(&next_client_id, 1);
+    strcpy(conn->name, "Anonimo"); // Nome predefinito
+    
+    if (loop->uring) {
+        uring_recv(loop, conn);
+    } else {
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        event.data.ptr = conn;
+        if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, client_socket, &event) < 0) {
+            perror("Errore nella registrazione del client");
+            close_socket(client_socket);
+            conn_free(loop, conn);
+            return;
+        }
+    }
+    conn->index = loop->num_connections;
+    loop->connections[loop->num_connections++] = conn;
+    
+    STATS_ADD(connections_opened, 1);
+    log_printf("Nuova connessione accettata: %s:%d (ID: %d)\n",
+               inet_ntoa(client_addr->sin_addr), ntohs(client_addr->sin_port), conn->id);
+    shared_message_t *prompt = chat_message(FRAME_PROMPT, FRAME_SENDER_SERVER,
+                                            "Inserisci il tuo nome: ");
+    if (prompt != NULL) {
+        conn_send(loop, conn, prompt);
+        message_release(prompt);
+    }
+}
+
+// Accetta tutte le connessioni in coda (il socket di ascolto è edge-triggered)
+static void loop_accept(event_loop_t *loop) {
+    for (;;) {
+        struct sockaddr_in client_addr;
+        socket_t client_socket = accept_client(loop->server_socket, &client_addr, SOCK_NONBLOCK);
+        if (client_socket == SOCKET_ERROR_VALUE) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                perror("Errore nell'accettazione della connessione");
+            }
+            return;
+        }
+        loop_add_connection(loop, client_socket, &client_addr);
+    }
+}
+
+// Con SLOW_PAUSE: quando nessun destinatario è più congestionato riprende a
+// leggere dai mittenti sospesi, partendo da quello che hanno già nel buffer
+// (con epoll edge-triggered non arriverebbe un nuovo evento). Altrimenti,
+// ogni PAUSE_CHECK_MS, disconnette i destinatari congestionati da più di
+// PAUSE_TIMEOUT_MS, così un client bloccato non ferma per sempre la stanza.
+// Restituisce 1 se ha prodotto invii o chiusure da completare.
+static int loop_update_pause(event_loop_t *loop) {
+    int changed = 0;
+    
+    if (loop->num_congested == 0) {
+        for (int i = 0; i < loop->num_connections && loop->num_paused > 0; i++) {
+            connection_t *conn = loop->connections[i];
+            if (conn->paused) {
+                conn->paused = 0;
+                loop->num_paused--;
+                conn_handle_read(loop, conn);
+                if (loop->uring) {
+                    uring_resume_recv(loop, conn);
+                }
+                changed = 1;
+            }
+        }
+        return changed;
+    }
+    
+    uint64_t now = now_ns();
+    if (now - loop->last_pause_check < PAUSE_CHECK_MS * 1000000ULL) {
+        return 0;
+    }
+    loop->last_pause_check = now;
+    for (int i = 0; i < loop->num_connections; i++) {
+        connection_t *conn = loop->connections[i];
+        if (conn->congested && !conn->closing &&
+            now - conn->congested_since > PAUSE_TIMEOUT_MS * 1000000ULL) {
+            STATS_ADD(slow_disconnects, 1);
+            log_printf("Client %d bloccato, connessione chiusa\n", conn->id);
+            conn_schedule_close(loop, conn);
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+// Porta il limite dei descrittori aperti al massimo consentito: con decine
+// di migliaia di connessioni il limite predefinito (spesso 1024) non basta
+static void raise_fd_limit(void) {
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Backend io_uring (--uring)
+// ---------------------------------------------------------------------------
+//
+// Ogni reactor ha un proprio anello, creato e usato solo dal suo thread
+// (IORING_SETUP_SINGLE_ISSUER). Le operazioni restano attive tra
+// un'iterazione e l'altra: un accept multishot produce un completamento per
+// ogni nuova connessione, una recv multishot per connessione ne produce uno
+// per ogni blocco di dati ricevuto, in un buffer scelto dal kernel tra
+// quelli forniti (URING_BUFFERS da BUFFER_SIZE byte per reactor, invece di
+// un buffer per connessione). I messaggi in uscita partono con SENDMSG di
+// più messaggi. A ogni iterazione una sola io_uring_enter invia tutte le
+// richieste preparate e attende i completamenti.
+//
+// user_data identifica l'operazione: i valori senza connessione sono quelli
+// dell'enum, gli altri sono l'indirizzo della connessione con il tipo di
+// operazione nei due bit bassi.
+
+#if URING_SUPPORTED
+#define URING_SETUP_FLAGS (IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN)
+#define URING_BUFFER_GROUP 0
+#define URING_RECV 1
+#define URING_SEND 2
+#define URING_TAG_MASK 3
+
+enum {
+    URING_IGNORE,                   // Annullamenti: il risultato non serve
+    URING_ACCEPT,
+    URING_INBOX
+};
+
+static uint64_t uring_data(connection_t *conn, int tag) {
+    return (uint64_t)(uintptr_t)conn | (uint64_t)tag;
+}
+
+// Verifica che il kernel permetta le operazioni usate dal backend: può
+// mancare (kernel precedente al 6.1) o essere vietato (seccomp dei container,
+// sysctl kernel.io_uring_disabled). La versione è controllata prima di
+// provare l'anello: alcuni kernel più vecchi accettano i flag ma non tutte
+// le operazioni usate dopo
+static int uring_available(void) {
+    char release[65];
+    if (!uring_kernel_supported(release, sizeof(release))) {
+        printf("io_uring richiede Linux %d.%d o successivo (kernel %s): uso epoll\n",
+               URING_MIN_KERNEL_MAJOR, URING_MIN_KERNEL_MINOR, release);
+        return 0;
+    }
+    
+    uring_t ring;
+    int result = uring_init(&ring, 8, URING_SETUP_FLAGS);
+    if (result == 0) {
+        result = uring_init_buffers(&ring, 8, 64, URING_BUFFER_GROUP);
+        uring_close(&ring);
+    }
+    if (result < 0) {
+        printf("io_uring non disponibile (%s): uso epoll\n", strerror(-result));
+        return 0;
+    }
+    return 1;
+}
+
+// Accept multishot sul socket di ascolto: resta attivo finché non fallisce
+static void uring_accept(event_loop_t *loop) {
+    struct io_uring_sqe *sqe = uring_sqe(&loop->ring);
+    if (sqe == NULL) {
+        printf("Coda io_uring piena: accept non attivato\n");
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = loop->server_socket;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = URING_ACCEPT;
+}
+
+// Poll multishot su event_fd, al posto della registrazione su epoll
+static void uring_watch_inbox(event_loop_t *loop) {
+    struct io_uring_sqe *sqe = uring_sqe(&loop->ring);
+    if (sqe == NULL) {
+        printf("Coda io_uring piena: inbox non controllata\n");
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = loop->event_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = URING_INBOX;
+}
+
+// Recv multishot con buffer forniti: il kernel sceglie il buffer solo
+// quando arrivano dati, quindi le connessioni inattive non ne occupano
+static void uring_recv(event_loop_t *loop, connection_t *conn) {
+    struct io_uring_sqe *sqe = uring_sqe(&loop->ring);
+    if (sqe == NULL) {
+        conn_schedule_close(loop, conn);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->socket;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = uring_data(conn, URING_RECV);
+    conn->recv_armed = 1;
+    conn->ops++;
+}
+
+// Riattiva la ricezione quando si è fermata: buffer forniti esauriti o
+// pausa terminata
+static void uring_resume_recv(event_loop_t *loop, connection_t *conn) {
+    if (!conn->recv_armed && !conn->paused && !conn->closing) {
+        uring_recv(loop, conn);
+    }
+}
+
+// Ferma la recv multishot di un mittente in pausa: finché è attiva il
+// kernel continuerebbe a consegnare dati da mettere da parte
+static void uring_cancel_recv(event_loop_t *loop, connection_t *conn) {
+    struct io_uring_sqe *sqe = uring_sqe(&loop->ring);
+    if (sqe != NULL) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->addr = uring_data(conn, URING_RECV);
+        sqe->user_data = URING_IGNORE;
+    }
+}
+
+// Annulla tutte le operazioni sul socket di una connessione chiusa; ognuna
+// termina con un completamento e l'ultimo libera la connessione
+static void uring_cancel_all(event_loop_t *loop, connection_t *conn) {
+    struct io_uring_sqe *sqe = uring_sqe(&loop->ring);
+    if (sqe == NULL) {
+        shutdown(conn->socket, SHUT_RDWR);  // Le operazioni terminano comunque
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = conn->socket;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = URING_IGNORE;
+}
+
+// Affida al kernel i primi WRITE_BATCH messaggi in attesa con una SENDMSG,
+// come sendmsg nella modalità epoll. Una connessione ha al più una SENDMSG
+// in corso, così i byte partono in ordine; i messaggi restano in coda, con
+// il loro riferimento, finché non è completata. Senza MSG_WAITALL una
+// SENDMSG termina appena il socket accetta dei byte, anche solo una parte:
+// con MSG_WAITALL un client lento la terrebbe ferma e con lei tutti i
+// messaggi accodati dopo.
+static int uring_flush(event_loop_t *loop, connection_t *conn) {
+    int count = conn->out_count < WRITE_BATCH ? conn->out_count : WRITE_BATCH;
+    if (conn->sending || conn->closed || count == 0) {
+        return 1;
+    }
+    struct io_uring_sqe *sqe = uring_sqe(&loop->ring);
+    if (sqe == NULL) {
+        return 0;
+    }
+    
+    for (int i = 0; i < count; i++) {
+        shared_message_t *msg = conn->out_queue[conn->out_head + i];
+        size_t skip = i == 0 ? conn->out_offset : 0;
+        conn->send_iov[i].iov_base = msg->data + skip;
+        conn->send_iov[i].iov_len = msg->len - skip;
+    }
+    memset(&conn->send_header, 0, sizeof(conn->send_header));
+    conn->send_header.msg_iov = conn->send_iov;
+    conn->send_header.msg_iovlen = count;
+    
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->socket;
+    sqe->addr = (uint64_t)(uintptr_t)&conn->send_header;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = uring_data(conn, URING_SEND);
+    conn->in_flight = count;
+    conn->sending = 1;
+    conn->ops++;
+    return 1;
+}
+
+// Completamento della SENDMSG: i byte inviati escono dalla coda e, se ne
+// restano, parte la SENDMSG successiva
+static void uring_sent(event_loop_t *loop, connection_t *conn, int result) {
+    conn->ops--;
+    conn->sending = 0;
+    conn->in_flight = 0;
+    if (conn->closed) {
+        return;  // I messaggi vengono rilasciati insieme alla connessione
+    }
+    if (result > 0) {
+        conn_sent(loop, conn, (size_t)result);
+    } else if (result != -ECANCELED) {
+        conn_schedule_close(loop, conn);  // Il client ha chiuso o la rete ha fallito
+    }
+    if (!conn->closing && !uring_flush(loop, conn)) {
+        conn_schedule_close(loop, conn);
+    }
+}
+
+// Completamento della recv multishot: i dati sono nel buffer fornito id e
+// vengono gestiti come se arrivassero da recv (conn_recv). Quelli rimasti
+// perché il client è stato messo in pausa vengono copiati da parte, così il
+// buffer torna subito al kernel.
+static void uring_received(event_loop_t *loop, connection_t *conn, int result, unsigned flags) {
+    if (!(flags & IORING_CQE_F_MORE)) {
+        conn->recv_armed = 0;
+        conn->ops--;
+    }
+    if (result > 0 && (flags & IORING_CQE_F_BUFFER)) {
+        unsigned id = flags >> IORING_CQE_BUFFER_SHIFT;
+        if (!conn->closing) {
+            loop->input_conn = conn;
+            loop->input = uring_buffer(&loop->ring, id);
+            loop->input_len = (size_t)result;
+            conn_handle_read(loop, conn);
+            if (loop->input_len > 0 && !conn->closing) {
+                size_t needed = conn->stash_len + loop->input_len;
+                char *temp = (char *)realloc(conn->stash, needed);
+                if (temp == NULL) {
+                    printf("Errore nell'allocazione della memoria per il client\n");
+                    conn_schedule_close(loop, conn);
+                } else {
+                    memcpy(temp + conn->stash_len, loop->input, loop->input_len);
+                    conn->stash = temp;
+                    conn->stash_len = needed;
+                }
+            }
+            loop->input_conn = NULL;
+            loop->input_len = 0;
+        }
+        uring_buffer_return(&loop->ring, id);
+        if (conn->paused && conn->recv_armed) {
+            uring_cancel_recv(loop, conn);
+        }
+    } else if (result == 0) {
+        conn_schedule_close(loop, conn);
+    } else if (result != -ENOBUFS && result != -ECANCELED) {
+        conn_schedule_close(loop, conn);
+    }
+    uring_resume_recv(loop, conn);
+}
+
+// Completamento dell'accept multishot: un nuovo client
+static void uring_accepted(event_loop_t *loop, int result, unsigned flags) {
+    if (result >= 0) {
+        struct sockaddr_in client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        memset(&client_addr, 0, sizeof(client_addr));
+        getpeername(result, (struct sockaddr *)&client_addr, &addr_len);
+        loop_add_connection(loop, result, &client_addr);
+    } else if (result != -ECONNABORTED && result != -EINTR) {
+        printf("Errore nell'accettazione della connessione: %s\n", strerror(-result));
+    }
+    if (!(flags & IORING_CQE_F_MORE)) {
+        uring_accept(loop);
+    }
+}
+
+// Ciclo di un reactor con io_uring; termina solo in caso di errore
+static void *uring_run(event_loop_t *loop) {
+    int result = uring_init(&loop->ring, URING_ENTRIES, URING_SETUP_FLAGS);
+    if (result == 0) {
+        result = uring_init_buffers(&loop->ring, URING_BUFFERS, BUFFER_SIZE, URING_BUFFER_GROUP);
+    }
+    if (result < 0) {
+        printf("Errore nella creazione dell'anello io_uring: %s\n", strerror(-result));
+        return NULL;
+    }
+    uring_accept(loop);
+    uring_watch_inbox(loop);
+    
+    while (1) {
+        // Con mittenti in pausa il reactor si sveglia anche senza eventi,
+        // come con epoll
+        int timeout = loop->num_paused > 0 ? PAUSE_CHECK_MS : -1;
+        result = uring_submit(&loop->ring, 1, timeout);
+        if (result < 0) {
+            printf("Errore in io_uring_enter: %s\n", strerror(-result));
+            break;
+        }
+        
+        // Al più MAX_EVENTS completamenti per iterazione, come epoll_wait:
+        // i messaggi ricevuti partono prima di leggerne altri
+        struct io_uring_cqe *cqe;
+        int handled = 0;
+        while (handled++ < MAX_EVENTS && (cqe = uring_peek(&loop->ring)) != NULL) {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            uring_cqe_seen(&loop->ring);
+            
+            if (data == URING_ACCEPT) {
+                uring_accepted(loop, res, flags);
+            } else if (data == URING_INBOX) {
+                loop_drain_inbox(loop);
+                if (!(flags & IORING_CQE_F_MORE)) {
+                    uring_watch_inbox(loop);
+                }
+            } else if (data != URING_IGNORE) {
+                connection_t *conn = (connection_t *)(uintptr_t)(data & ~(uint64_t)URING_TAG_MASK);
+                if ((data & URING_TAG_MASK) == URING_RECV) {
+                    uring_received(loop, conn, res, flags);
+                } else {
+                    uring_sent(loop, conn, res);
+                }
+                if (conn->closed && conn->ops == 0) {
+                    conn_destroy(loop, conn);
+                }
+            }
+        }
+        loop_process_closing(loop);
+        if (loop->num_paused > 0 && loop_update_pause(loop)) {
+            loop_process_closing(loop);
+        }
+    }
+    uring_close(&loop->ring);
+    return NULL;
+}
+#else
+// Intestazioni del kernel senza io_uring multishot: il backend non è
+// compilato e --uring usa sempre epoll
+static int uring_available(void) {
+    printf("io_uring non supportato da questa compilazione: uso epoll\n");
+    return 0;
+}
+
+static int uring_flush(event_loop_t *loop, connection_t *conn) {
+    (void)loop;
+    (void)conn;
+    return 0;
+}
+
+static void uring_recv(event_loop_t *loop, connection_t *conn) {
+    (void)loop;
+    (void)conn;
+}
+
+static void uring_resume_recv(event_loop_t *loop, connection_t *conn) {
+    (void)loop;
+    (void)conn;
+}
+
+static void uring_cancel_all(event_loop_t *loop, connection_t *conn) {
+    (void)loop;
+    (void)conn;
+}
+
+static void *uring_run(event_loop_t *loop) {
+    (void)loop;
+    return NULL;
+}
+#endif
+
+// Prepara un reactor sul socket di ascolto indicato
+static int loop_init(event_loop_t *loop, socket_t server_socket, int uring) {
+    memset(loop, 0, sizeof(event_loop_t));
+    loop->server_socket = server_socket;
+    loop->uring = uring;
+    atomic_init(&loop->inbox, NULL);
+    if (!room_table_init(&loop->rooms, NULL, NULL)) {
+        printf("Errore nell'allocazione della tabella delle stanze\n");
+        return 0;
+    }
+    
+    loop->event_fd = eventfd(0, EFD_NONBLOCK);
+    if (loop->event_fd < 0) {
+        perror("Errore nella creazione della inbox");
+        return 0;
+    }
+    if (uring) {
+        return 1;  // L'anello io_uring viene creato dal thread che lo usa
+    }
+    loop->epoll_fd = epoll_create1(0);
+    if (loop->epoll_fd < 0) {
+        perror("Errore nella creazione dell'istanza epoll");
+        return 0;
+    }
+    
+    // data.ptr distingue le sorgenti: NULL il socket di ascolto, il reactor
+    // stesso la inbox, altrimenti la connessione
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = NULL;
+    if (!set_nonblocking(server_socket) ||
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, server_socket, &event) < 0) {
+        perror("Errore nella registrazione del socket del server");
+        return 0;
+    }
+    event.events = EPOLLIN | EPOLLET;
+    event.data.ptr = loop;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->event_fd, &event) < 0) {
+        perror("Errore nella registrazione della inbox");
+        return 0;
+    }
+    return 1;
+}
+
+// Ciclo di un reactor; termina solo in caso di errore
+static void *loop_run(void *arg) {
+    event_loop_t *loop = (event_loop_t *)arg;
+    struct epoll_event events[MAX_EVENTS];
+    
+    if (loop->uring) {
+        return uring_run(loop);
+    }
+    while (1) {
+        // Con mittenti in pausa il reactor si sveglia anche senza eventi
+        // per controllare da quanto tempo i destinatari sono congestionati
+        int timeout = loop->num_paused > 0 ? PAUSE_CHECK_MS : -1;
+        int num_events = epoll_wait(loop->epoll_fd, events, MAX_EVENTS, timeout);
+        if (num_events < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("Errore in epoll_wait");
+            break;
+        }
+        
+        for (int i = 0; i < num_events; i++) {
+            void *source = events[i].data.ptr;
+            if (source == NULL) {
+                loop_accept(loop);
+                continue;
+            }
+            if (source == loop) {
+                loop_drain_inbox(loop);
+                continue;
+            }
+            connection_t *conn = (connection_t *)source;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                conn_schedule_close(loop, conn);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLRDHUP)) {
+                conn_handle_read(loop, conn);
+            }
+            if ((events[i].events & EPOLLOUT) && !conn->closing && !conn_flush(loop, conn)) {
+                conn_schedule_close(loop, conn);
+            }
+        }
+        loop_process_closing(loop);
+        if (loop->num_paused > 0 && loop_update_pause(loop)) {
+            loop_process_closing(loop);
+        }
+    }
+    return NULL;
+}
+
+// Apre un altro socket di ascolto sulla stessa porta di 'first'; il kernel
+// distribuisce le connessioni tra tutti i socket con SO_REUSEPORT
+static socket_t open_reuseport_socket(socket_t first, int backlog) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    int opt = 1;
+    
+    socket_t sock = socket(AF_INET, SOCK_STREAM, 0);
+    if (sock == SOCKET_ERROR_VALUE) {
+        return SOCKET_ERROR_VALUE;
+    }
+    if (getsockname(first, (struct sockaddr *)&addr, &addr_len) < 0 ||
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0 ||
+        bind(sock, (struct sockaddr *)&addr, addr_len) < 0 ||
+        listen(sock, backlog) < 0) {
+        close_socket(sock);
+        return SOCKET_ERROR_VALUE;
+    }
+    return sock;
+}
+
+// Avvia la modalità a eventi con 'count' reactor: il primo usa
+// server_socket e gira nel thread chiamante, gli altri aprono un proprio
+// socket sulla stessa porta. Con uring i reactor usano io_uring se il
+// kernel lo permette. Non ritorna se non in caso di errore.
+int run_event_loop(socket_t server_socket, int count, int backlog, int uring) {
+    raise_fd_limit();
+    if (uring && !uring_available()) {
+        uring = 0;
+    }
+    
+    reactors = (event_loop_t *)calloc(count, sizeof(event_loop_t));
+    if (reactors == NULL) {
+        printf("Errore nell'allocazione della memoria per i reactor\n");
+        return -1;
+    }
+    num_reactors = count;
+    
+    // Tutti i reactor devono essere pronti prima che uno di essi inoltri messaggi
+    for (int r = 0; r < count; r++) {
+        socket_t sock = r == 0 ? server_socket : open_reuseport_socket(server_socket, backlog);
+        if (sock == SOCKET_ERROR_VALUE) {
+            perror("Errore nell'apertura del socket del reactor");
+            return -1;
+        }
+        if (!loop_init(&reactors[r], sock, uring)) {
+            return -1;
+        }
+    }
+    for (int r = 1; r < count; r++) {
+        if (pthread_create(&reactors[r].thread, NULL, loop_run, &reactors[r]) != 0) {
+            printf("Errore nella creazione del thread del reactor\n");
+            return -1;
+        }
+    }
+    if (count > 1) {
+        printf("Avviati %d reactor%s\n", count, uring ? " con io_uring" : "");
+    } else if (uring) {
+        printf("Ciclo a eventi con io_uring\n");
+    }
+    
+    loop_run(&reactors[0]);
+    return -1;
+}
+#endif
+
+int main(int argc, char *argv[]) {
+    socket_t server_socket, client_socket;
+    struct sockaddr_in server_addr, client_addr;
+    int opt = 1;
+    int client_count = 0;
+    int event_mode = 0;
+    int reactor_count = 1;
+    int uring = 0;
+    int backlog = -1;
+    int low_given = 0;
+    pthread_t thread;
+    
+    // Controlla gli argomenti della riga di comando
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--framed") == 0) {
+            framed_protocol = 1;
+        } else if (strcmp(argv[i], "--backlog") == 0 && i + 1 < argc) {
+            // Il kernel limita comunque la coda a net.core.somaxconn
+            backlog = atoi(argv[++i]);
+            if (backlog <= 0) {
+                backlog = SOMAXCONN;
+            }
+        } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "sync") == 0) {
+                log_mode = LOG_SYNC;
+            } else if (strcmp(argv[i], "async") == 0) {
+                log_mode = LOG_ASYNC;
+            } else if (strcmp(argv[i], "off") == 0) {
+                log_mode = LOG_OFF;
+            } else {
+                printf("Modalità di log non valida: usare sync, async o off\n");
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--slow-policy") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "disconnect") == 0) {
+                slow_policy = SLOW_DISCONNECT;
+            } else if (strcmp(argv[i], "drop") == 0) {
+                slow_policy = SLOW_DROP;
+            } else if (strcmp(argv[i], "pause") == 0) {
+                slow_policy = SLOW_PAUSE;
+            } else {
+                printf("Politica non valida: usare disconnect, drop o pause\n");
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--queue-high") == 0 && i + 1 < argc) {
+            queue_high = (size_t)atol(argv[++i]);
+        } else if (strcmp(argv[i], "--queue-low") == 0 && i + 1 < argc) {
+            queue_low = (size_t)atol(argv[++i]);
+            low_given = 1;
+        } else if (strcmp(argv[i], "--history") == 0 && i + 1 < argc) {
+            history_size = atoi(argv[++i]);
+            if (history_size < 0) {
+                history_size = 0;
+            }
+            if (history_size > MAX_HISTORY) {
+                history_size = MAX_HISTORY;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0 && i + 1 < argc) {
+            stats_interval = atoi(argv[++i]);
+            if (stats_interval < 0) {
+                stats_interval = 0;
+            }
+        } else if (strcmp(argv[i], "--epoll") == 0) {
+#ifdef __linux__
+            event_mode = 1;
+#else
+            printf("La modalità --epoll è disponibile solo su Linux\n");
+            return EXIT_FAILURE;
+#endif
+        } else if (strcmp(argv[i], "--uring") == 0) {
+#ifdef __linux__
+            event_mode = 1;
+            uring = 1;
+#else
+            printf("La modalità --uring è disponibile solo su Linux\n");
+            return EXIT_FAILURE;
+#endif
+        } else if (strcmp(argv[i], "--reactors") == 0 && i + 1 < argc) {
+#ifdef __linux__
+            // Un reactor per core se il numero non è indicato (0)
+            event_mode = 1;
+            reactor_count = atoi(argv[++i]);
+            if (reactor_count <= 0) {
+                reactor_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+            }
+            if (reactor_count < 1) {
+                reactor_count = 1;
+            }
+            if (reactor_count > MAX_REACTORS) {
+                reactor_count = MAX_REACTORS;
+            }
+#else
+            printf("La modalità --reactors è disponibile solo su Linux\n");
+            return EXIT_FAILURE;
+#endif
+        } else {
+            printf("Uso: %s [--epoll | --reactors N] [--uring] [--framed] [--backlog N]\n"
+                   "          [--log sync|async|off] [--stats SECONDI] [--history N]\n"
+                   "          [--slow-policy disconnect|drop|pause] [--queue-high BYTE] [--queue-low BYTE]\n",
+                   argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    
+    // La soglia alta deve lasciare posto ad alcuni messaggi interi
+    if (!low_given) {
+        queue_low = queue_high / 4;
+    }
+    if (queue_high < MIN_QUEUE_HIGH || queue_low >= queue_high) {
+        printf("Soglie non valide: la alta deve essere almeno %d byte e la bassa minore della alta\n",
+               MIN_QUEUE_HIGH);
+        return EXIT_FAILURE;
+    }
+    history_init();
+    
+#ifdef _WIN32
+    // Inizializza Winsock
+    WSADATA wsa_data;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0) {
+        error("Errore nell'inizializzazione di Winsock");
+    }
+#endif
+    
+    // Crea il socket del server
+    server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_socket == SOCKET_ERROR_VALUE) {
+        error("Errore nella creazione del socket");
+    }
+    
+    // Imposta le opzioni del socket
+    if (setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, (char *)&opt, sizeof(opt)) < 0) {
+        error("Errore nell'impostazione delle opzioni del socket");
+    }
+    
+#ifdef __linux__
+    // Con più reactor ognuno ascolta sulla stessa porta con un proprio socket
+    if (reactor_count > 1 &&
+        setsockopt(server_socket, SOL_SOCKET, SO_REUSEPORT, (char *)&opt, sizeof(opt)) < 0) {
+        error("Errore nell'impostazione di SO_REUSEPORT");
+    }
+#endif
+    
+    // Configura l'indirizzo del server
+    memset(&server_addr, 0, sizeof(server_addr));
+    server_addr.sin_family = AF_INET;
+    server_addr.sin_addr.s_addr = INADDR_ANY;
+    server_addr.sin_port = htons(PORT);
+    
+    // Associa il socket all'indirizzo e alla porta
+    if (bind(server_socket, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0) {
+        error("Errore nel binding del socket");
+    }
+    
+    // Metti il socket in ascolto; nella modalità a eventi le connessioni
+    // arrivano a raffiche e la coda predefinita è più lunga
+    if (backlog < 0) {
+        backlog = event_mode ? SOMAXCONN : DEFAULT_BACKLOG;
+    }
+    if (listen(server_socket, backlog) < 0) {
+        error("Errore nell'ascolto del socket");
+    }
+    
+    printf("Server avviato sulla porta %d\n", PORT);
+    printf("In attesa di connessioni...\n");
+    
+    // Logger e statistiche girano in thread propri, che non hanno mai lock
+    // in comune con quelli che gestiscono i client
+    if (log_mode == LOG_ASYNC) {
+        if (pthread_create(&thread, NULL, logger_main, NULL) != 0) {
+            error("Errore nella creazione del thread del logger");
+        }
+        pthread_detach(thread);
+    }
+    if (stats_interval > 0) {
+        if (pthread_create(&thread, NULL, stats_main, NULL) != 0) {
+            error("Errore nella creazione del thread delle statistiche");
+        }
+        pthread_detach(thread);
+    }
+    
+#ifdef __linux__
+    if (event_mode) {
+        run_event_loop(server_socket, reactor_count, backlog, uring);
+        close_socket(server_socket);
+        return EXIT_FAILURE;
+    }
+#endif
+    
+    // Inizializza l'array dei client a NULL
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        clients[i] = NULL;
+    }
+    
+    // Le copie degli insiemi di iscritti tengono vivi i client che contengono
+    if (!room_table_init(&rooms, client_retain, client_release)) {
+        error("Errore nell'allocazione della tabella delle stanze");
+    }
+    
+    // Posti e worker sono preparati una volta sola: accettare una
+    // connessione non richiede né malloc né pthread_create
+    if (!client_slots_init() ||
+        !worker_pool_start(&reader_pool, handle_client) ||
+        !worker_pool_start(&writer_pool, client_writer)) {
+        error("Errore nella creazione dei worker");
+    }
+    
+#ifdef __linux__
+    // Con il socket di ascolto non bloccante a ogni risveglio si accettano
+    // tutte le connessioni in coda; i socket dei client restano bloccanti
+    if (!set_nonblocking(server_socket)) {
+        error("Errore nell'impostazione del socket del server");
+    }
+#endif
+    
+    // Loop principale per accettare connessioni
+    while (1) {
+#ifdef __linux__
+        struct pollfd listen_poll = { server_socket, POLLIN, 0 };
+        if (poll(&listen_poll, 1, -1) < 0 && errno != EINTR) {
+            error("Errore nell'attesa delle connessioni");
+        }
+#endif
+        
+        while (1) {
+            // Accetta una nuova connessione
+            client_socket = accept_client(server_socket, &client_addr, 0);
+            if (client_socket == SOCKET_ERROR_VALUE) {
+#ifdef __linux__
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    break;  // Coda vuota
+                }
+                if (errno == EMFILE || errno == ENFILE) {
+                    poll(NULL, 0, 100);  // Senza descrittori liberi poll tornerebbe subito
+                }
+#endif
+                perror("Errore nell'accettazione della connessione");
+                break;
+            }
+            
+            // Prende un posto libero; se non ce ne sono il client viene rifiutato
+            client_t *client = client_slot_alloc();
+            if (client == NULL) {
+                log_printf("Limite di client raggiunto. Connessione rifiutata.\n");
+                close_socket(client_socket);
+                continue;
+            }
+            
+            // Inizializza la struttura client
+            client->socket = client_socket;
+            client->address = client_addr;
+            client->id = client_count++;
+            strcpy(client->name, "Anonimo"); // Nome predefinito
+            client->room = NULL;
+            atomic_store(&client->refs, 1);
+            
+            // Aggiungi il client all'array
+            add_client(client);
+            
+            STATS_ADD(connections_opened, 1);
+            log_printf("Nuova connessione accettata: %s:%d (ID: %d)\n", 
+                       inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port), client->id);
+            
+            // Affida il client ai worker: uno scrive sul socket, l'altro legge
+            client_start_writer(client);
+            worker_pool_push(&reader_pool, client);
+#ifndef __linux__
+            break;  // Socket di ascolto bloccante: una connessione per iterazione
+#endif
+        }
     }
     
     // Chiudi il socket del server
@@ -280,7 +3337,13 @@ int main() {
  * 
  * Su sistemi Linux/Unix:
  *   gcc -o server_multi_client server_multi_client.c -lpthread
- *   ./server_multi_client
+ *   ./server_multi_client            (un thread per client)
+ *   ./server_multi_client --epoll    (ciclo a eventi, solo Linux)
+ *   ./server_multi_client --reactors N   (N cicli a eventi, 0 = uno per core)
+ *   ./server_multi_client --framed   (protocollo a frame, combinabile con gli altri)
+ *   ./server_multi_client --backlog N   (coda delle connessioni in attesa)
+ *   ./server_multi_client --log async --stats 5   (logger asincrono, statistiche ogni 5 s)
+ *   ./server_multi_client --slow-policy pause --queue-high 262144   (client lenti)
  * 
  * Su Windows con MinGW:
  *   gcc -o server_multi_client server_multi_client.c -lws2_32 -lpthread
@@ -288,7 +3351,81 @@ int main() {
  * 
  * Note:
  * - Il server ascolta sulla porta 8888 (modificabile cambiando la costante PORT)
- * - Supporta fino a 10 client simultanei (modificabile cambiando MAX_CLIENTS)
+ * - Supporta fino a 10 client simultanei (modificabile cambiando MAX_CLIENTS).
+ *   I posti dei client e i worker che li servono sono creati all'avvio: una
+ *   nuova connessione non richiede malloc né pthread_create
+ * - --backlog N imposta la coda delle connessioni in attesa di accept
+ *   (predefinita: 5 con i thread, SOMAXCONN con --epoll e --reactors). Il
+ *   server accetta tutte le connessioni in coda a ogni risveglio, con accept4
+ *   su Linux; nella modalità a eventi SOCK_NONBLOCK evita due fcntl per client
+ *   e le strutture delle connessioni vengono riusate
  * - Per testare il server, è possibile utilizzare telnet o un client TCP personalizzato
  * - Per disconnettersi, un client può inviare il messaggio "exit"
+ * - Ogni client entra nella stanza "generale" e riceve solo i messaggi della
+ *   propria stanza; "/join <stanza>" (o un frame FRAME_ROOM) la cambia. Gli
+ *   iscritti di una stanza sono un array ricostruito a ogni ingresso o uscita:
+ *   un messaggio costa quanto i destinatari, non quanto i client connessi
+ * - Nella modalità a thread ogni client ha anche un thread writer: i broadcast
+ *   creano un solo messaggio con conteggio dei riferimenti e lo accodano ai
+ *   destinatari senza chiamare send() sotto clients_mutex
+ * - I messaggi sono formattati una sola volta in buffer riciclati da un pool
+ *   per thread: un buffer torna sempre al pool del thread che l'ha creato,
+ *   anche quando l'ultimo a rilasciarlo è un altro thread (tramite una pila
+ *   lock-free). I writer e i cicli a eventi inviano con una sola sendmsg
+ *   tutti i messaggi in attesa per un client (fino a WRITE_BATCH)
+ * - Con --epoll un solo thread gestisce tutte le connessioni tramite socket non
+ *   bloccanti ed epoll edge-triggered: il limite MAX_CLIENTS non si applica e
+ *   il server alza il limite dei descrittori aperti al massimo consentito.
+ *   I messaggi sono divisi in righe
+ * - Con --reactors N ci sono N thread, ognuno con un proprio socket di ascolto
+ *   (SO_REUSEPORT), un proprio epoll e le proprie connessioni. Non c'è uno
+ *   stato globale protetto da un solo mutex: i messaggi destinati ai client
+ *   degli altri reactor passano per code lock-free e un eventfd sveglia chi le
+ *   riceve. Solo la creazione e l'eliminazione di una stanza toccano la
+ *   tabella condivisa delle cronologie, divisa in HISTORY_SHARDS parti con un
+ *   mutex ciascuna
+ * - Con --uring i reactor (uno solo, o N con --reactors N) usano io_uring
+ *   invece di epoll: un accept multishot per le nuove connessioni, una recv
+ *   multishot per client con buffer scelti dal kernel tra quelli condivisi
+ *   dal reactor, e SENDMSG di più messaggi, una alla volta per client. Una
+ *   sola io_uring_enter per iterazione invia tutte le richieste e raccoglie
+ *   al più MAX_EVENTS completamenti, come epoll_wait. Serve Linux 6.1 o
+ *   successivo, controllato all'avvio con uname: con un kernel più vecchio,
+ *   o se io_uring è vietato (ad esempio dal seccomp di un container), il
+ *   server lo segnala e usa epoll. Stanze, inbox e politiche per i client lenti non cambiano
+ * - Con --framed ogni messaggio è un frame con lunghezza, tipo e id del
+ *   mittente (formato descritto in protocollo.h): i messaggi non dipendono da
+ *   come TCP divide i dati e un client può inviarne molti in un segmento.
+ *   Tutti i client devono usare lo stesso protocollo (./client --framed)
+ * - Ogni client ha una coda di uscita limitata: quando i byte in attesa
+ *   superano --queue-high (predefinita 1 MB) interviene --slow-policy:
+ *   disconnect (predefinita) disconnette il client, drop scarta i suoi
+ *   messaggi più vecchi fino a --queue-low (predefinita un quarto della
+ *   alta), pause smette di leggere dai client che gli inviano messaggi
+ *   finché la sua coda non scende a --queue-low. Con pause la coda può
+ *   arrivare al doppio della soglia alta e un client bloccato per più di
+ *   PAUSE_TIMEOUT_MS viene disconnesso. La memoria per connessione resta
+ *   limitata e i client veloci non vengono mai rallentati da disconnect e drop
+ * - --log sceglie come stampare messaggi e avvisi: sync (predefinito) con
+ *   printf nel thread che li gestisce, async copiandoli nel buffer circolare
+ *   del thread (senza lock né chiamate di sistema) da cui li stampa il
+ *   thread del logger, off per non stamparli. Se il logger resta indietro le
+ *   righe in eccesso vengono scartate e contate
+ * - --stats N stampa su stderr ogni N secondi connessioni, messaggi e
+ *   consegne al secondo, byte in ingresso e in uscita, e i percentili del
+ *   tempo di fan-out e della coda dei destinatari. Ogni thread aggiorna solo
+ *   i propri contatori e istogrammi; con --stats 0 (predefinito) non viene
+ *   misurato nulla
+ * - Ogni stanza ricorda gli ultimi --history N messaggi di chat (predefiniti
+ *   20, 0 per disattivare) in un buffer circolare allocato al primo messaggio
+ *   (una stanza in cui nessuno scrive occupa poche decine di byte). Chi
+ *   entra li riceve in un solo messaggio, quindi con una sola scrittura, di
+ *   al più --queue-low byte: se non ci stanno tutti riceve i più recenti.
+ *   Chi pubblica scrive nel proprio posto senza lock e chi li rilegge scarta i
+ *   posti riscritti nel frattempo (seqlock), così nessuno dei due aspetta
+ *   l'altro. Un messaggio inviato mentre un client entra può arrivargli due
+ *   volte. Con --reactors la cronologia di una stanza è la stessa in tutti i
+ *   reactor e si perde quando la stanza resta vuota ovunque
+ * - generatore_carico.c simula migliaia di client e misura latenza e
+ *   throughput dal lato dei client
  */
\ No newline at end of file
@@ -0,0 +1,283 @@
+/**
+ * Interfaccia minima a io_uring
+ *
+ * Funzioni usate da server_multi_client.c per la modalità --uring, scritte
+ * direttamente sulle chiamate di sistema io_uring_setup, io_uring_enter e
+ * io_uring_register, senza liburing. Il kernel e il programma condividono
+ * due code in memoria: in quella di invio (SQ) il programma scrive le
+ * richieste (SQE), in quella di completamento (CQ) il kernel scrive i
+ * risultati (CQE). Una sola io_uring_enter invia tutte le richieste
+ * preparate e attende i risultati.
+ *
+ * Ogni anello va usato da un solo thread. I buffer forniti (provided buffer
+ * ring) sono buffer di ricezione che il kernel sceglie da sé: una recv non
+ * occupa un buffer finché non arrivano dati, e il programma lo restituisce
+ * dopo averli gestiti.
+ *
+ * Servono le intestazioni e un kernel 6.1 o successivo (accept e recv
+ * multishot, anelli di buffer forniti, IORING_SETUP_DEFER_TASKRUN);
+ * URING_SUPPORTED vale 0 se le intestazioni sono più vecchie e
+ * uring_kernel_supported controlla la versione del kernel in uso.
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+#if defined(IORING_RECV_MULTISHOT) && defined(IORING_SETUP_DEFER_TASKRUN)
+#define URING_SUPPORTED 1
+#define URING_MIN_KERNEL_MAJOR 6
+#define URING_MIN_KERNEL_MINOR 1
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+
+typedef struct {
+    int fd;
+    void *ring_ptr;                 // Code SQ e CQ, mappate insieme (IORING_FEAT_SINGLE_MMAP)
+    size_t ring_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_local_tail;         // Richieste preparate, non ancora pubblicate
+    unsigned sq_submitted;          // Richieste già pubblicate al kernel
+    struct io_uring_sqe *sqes;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_buf_ring *buf_ring;  // Buffer forniti, NULL se non registrati
+    char *buffers;
+    unsigned buf_count;
+    unsigned buf_size;
+    uint16_t buf_tail;
+} uring_t;
+
+// 1 se il kernel in uso è almeno URING_MIN_KERNEL_MAJOR.URING_MIN_KERNEL_MINOR;
+// in release la versione letta, se serve per un messaggio
+static inline int uring_kernel_supported(char *release, size_t size) {
+    struct utsname name;
+    int major = 0, minor = 0;
+
+    if (uname(&name) != 0) {
+        snprintf(release, size, "sconosciuto");
+        return 0;
+    }
+    snprintf(release, size, "%s", name.release);
+    if (sscanf(name.release, "%d.%d", &major, &minor) != 2) {
+        return 0;
+    }
+    return major > URING_MIN_KERNEL_MAJOR ||
+           (major == URING_MIN_KERNEL_MAJOR && minor >= URING_MIN_KERNEL_MINOR);
+}
+
+// Crea un anello di entries richieste; restituisce 0 o -errno. I flag
+// IORING_SETUP_* richiesti ai kernel recenti fanno fallire i vecchi, che
+// vengono così riconosciuti subito.
+static inline int uring_init(uring_t *ring, unsigned entries, unsigned flags) {
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    params.flags = flags;
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        ring->fd = -1;
+        return -errno;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        close(ring->fd);
+        ring->fd = -1;
+        return -ENOSYS;
+    }
+
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    ring->ring_ptr = mmap(NULL, ring->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ring->fd, IORING_OFF_SQ_RING);
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe),
+                                             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                             ring->fd, IORING_OFF_SQES);
+    if (ring->ring_ptr == MAP_FAILED || ring->sqes == MAP_FAILED) {
+        int error = errno;
+        close(ring->fd);
+        ring->fd = -1;
+        return -error;
+    }
+
+    char *base = (char *)ring->ring_ptr;
+    ring->sq_head = (unsigned *)(base + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(base + params.sq_off.tail);
+    ring->sq_mask = *(unsigned *)(base + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_local_tail = ring->sq_submitted = *ring->sq_tail;
+    ring->cq_head = (unsigned *)(base + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(base + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *)(base + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(base + params.cq_off.cqes);
+
+    // La posizione i della coda SQ usa sempre la SQE i
+    unsigned *array = (unsigned *)(base + params.sq_off.array);
+    for (unsigned i = 0; i < params.sq_entries; i++) {
+        array[i] = i;
+    }
+    return 0;
+}
+
+// Registra count buffer di size byte (count potenza di due) come gruppo
+// group; restituisce 0 o -errno
+static inline int uring_init_buffers(uring_t *ring, unsigned count, unsigned size, uint16_t group) {
+    struct io_uring_buf_reg reg;
+
+    ring->buf_ring = (struct io_uring_buf_ring *)mmap(NULL, count * sizeof(struct io_uring_buf),
+                                                      PROT_READ | PROT_WRITE,
+                                                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ring->buffers = (char *)malloc((size_t)count * size);
+    if (ring->buf_ring == MAP_FAILED || ring->buffers == NULL) {
+        if (ring->buf_ring != MAP_FAILED) {
+            munmap(ring->buf_ring, count * sizeof(struct io_uring_buf));
+        }
+        free(ring->buffers);
+        ring->buf_ring = NULL;
+        ring->buffers = NULL;
+        return -ENOMEM;
+    }
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring->buf_ring;
+    reg.ring_entries = count;
+    reg.bgid = group;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        int error = errno;
+        munmap(ring->buf_ring, count * sizeof(struct io_uring_buf));
+        free(ring->buffers);
+        ring->buf_ring = NULL;
+        ring->buffers = NULL;
+        return -error;
+    }
+
+    ring->buf_count = count;
+    ring->buf_size = size;
+    ring->buf_tail = 0;
+    for (unsigned i = 0; i < count; i++) {
+        struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail++ & (count - 1)];
+        buf->addr = (uint64_t)(uintptr_t)(ring->buffers + (size_t)i * size);
+        buf->len = size;
+        buf->bid = (uint16_t)i;
+    }
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Dati del buffer id, scelto dal kernel per una ricezione
+static inline char *uring_buffer(uring_t *ring, unsigned id) {
+    return ring->buffers + (size_t)id * ring->buf_size;
+}
+
+// Restituisce al kernel il buffer id dopo averne gestito i dati
+static inline void uring_buffer_return(uring_t *ring, unsigned id) {
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail++ & (ring->buf_count - 1)];
+    buf->addr = (uint64_t)(uintptr_t)uring_buffer(ring, id);
+    buf->len = ring->buf_size;
+    buf->bid = (uint16_t)id;
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+// Pubblica le richieste preparate e, se wait, attende almeno un risultato
+// per al più timeout_ms millisecondi (-1 senza limite). Restituisce il
+// numero di richieste accettate dal kernel o -errno; un'attesa scaduta o
+// interrotta da un segnale non è un errore.
+static inline int uring_submit(uring_t *ring, int wait, int timeout_ms) {
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned flags = 0;
+
+    __atomic_store_n(ring->sq_tail, ring->sq_local_tail, __ATOMIC_RELEASE);
+    unsigned pending = ring->sq_local_tail - ring->sq_submitted;
+
+    memset(&arg, 0, sizeof(arg));
+    if (wait) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (long long)(timeout_ms % 1000) * 1000000;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+    }
+    arg.sigmask_sz = _NSIG / 8;
+
+    int result = (int)syscall(__NR_io_uring_enter, ring->fd, pending, wait ? 1 : 0,
+                              flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (result < 0) {
+        if (errno == ETIME || errno == EINTR) {
+            return 0;
+        }
+        return -errno;
+    }
+    ring->sq_submitted += (unsigned)result;
+    return result;
+}
+
+// Prossima SQE libera, azzerata; se la coda è piena pubblica prima le
+// richieste preparate. NULL solo se il kernel non ne accetta nessuna.
+static inline struct io_uring_sqe *uring_sqe(uring_t *ring) {
+    unsigned head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    if (ring->sq_local_tail - head == ring->sq_entries) {
+        if (uring_submit(ring, 0, 0) <= 0) {
+            return NULL;
+        }
+        head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+        if (ring->sq_local_tail - head == ring->sq_entries) {
+            return NULL;
+        }
+    }
+    struct io_uring_sqe *sqe = &ring->sqes[ring->sq_local_tail++ & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+// Prossimo risultato disponibile, NULL se non ce ne sono; va confermato
+// con uring_cqe_seen prima di chiedere il successivo
+static inline struct io_uring_cqe *uring_peek(uring_t *ring) {
+    unsigned head = *ring->cq_head;
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+static inline void uring_cqe_seen(uring_t *ring) {
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+static inline void uring_close(uring_t *ring) {
+    if (ring->buf_ring != NULL) {
+        munmap(ring->buf_ring, ring->buf_count * sizeof(struct io_uring_buf));
+        free(ring->buffers);
+    }
+    if (ring->fd >= 0) {
+        munmap(ring->sqes, ring->sq_entries * sizeof(struct io_uring_sqe));
+        munmap(ring->ring_ptr, ring->ring_size);
+        close(ring->fd);
+    }
+    ring->fd = -1;
+}
+
+#else
+#define URING_SUPPORTED 0
+#endif
+
+#endif // URING_H
\ No newline at end of file
@@ -9,12 +9,16 @@
  * - Gestione di file di testo
  * - Interfaccia utente a riga di comando
  * - Gestione della memoria per documenti di grandi dimensioni
+ * - Piece table: il file originale mappato in memoria e un buffer delle
+ *   aggiunte, descritti da pezzi tenuti in un albero bilanciato (treap)
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <errno.h>
 
 #ifdef _WIN32
     #include <conio.h>  // Per getch() su Windows
@@ -22,6 +26,9 @@
 #else
     #include <unistd.h>
     #include <termios.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
     #define CLEAR_SCREEN "clear"
     
     // Implementazione di getch() per sistemi Unix/Linux
@@ -38,15 +45,50 @@
     }
 #endif
 
-#define MAX_LINES 1000
 #define MAX_LINE_LENGTH 200
 #define MAX_FILENAME 100
+#define PIECE_CHUNK 4096     // Byte del file originale contati alla volta
 
-// Struttura per rappresentare il documento
+// Buffer da cui un pezzo prende il testo
+#define PIECE_ORIGINAL 0
+#define PIECE_ADDED 1
+
+// Un pezzo è un intervallo di uno dei due buffer. Il testo del documento è
+// la concatenazione dei pezzi nell'ordine dell'albero (visita in ordine).
+// Ogni nodo conosce anche lunghezza e numero di a capo del proprio
+// sottoalbero, così una posizione o una linea si trovano scendendo
+// dall'alto senza scorrere tutti i pezzi.
+typedef struct Piece {
+    int source;          // PIECE_ORIGINAL o PIECE_ADDED
+    size_t start;        // Posizione del testo nel buffer
+    size_t length;
+    int newlines;        // Caratteri '\n' nel pezzo
+    size_t total_length; // Somme sul sottoalbero, pezzo compreso
+    int total_newlines;
+    int priority;        // Priorità casuale del treap
+    struct Piece* left;
+    struct Piece* right;
+} Piece;
+
+// Struttura per rappresentare il documento (piece table). Il testo è
+// diviso tra il file originale, mai modificato, e il buffer delle aggiunte,
+// in cui ogni nuovo testo viene solo accodato. Ogni linea termina con
+// '\n', quindi le linee sono tante quanti gli a capo.
+//
+// Il file originale da counted in poi è un unico pezzo non ancora contato
+// che segue il testo dell'albero: entra nell'albero un blocco alla volta
+// solo quando serve una sua linea (vedi count_lines_until).
 typedef struct {
-    char** lines;        // Array di stringhe (linee)
-    int num_lines;       // Numero di linee nel documento
-    int capacity;        // Capacità massima dell'array
+    Piece* root;         // Albero dei pezzi
+    char* original;      // Contenuto del file aperto (mappato o letto)
+    size_t original_size;
+    size_t counted;      // Byte del file originale già nell'albero
+    char* added;         // Buffer delle aggiunte
+    size_t added_size;
+    size_t added_capacity;
+    int num_lines;       // Linee contate nell'albero (al più INT_MAX); sono
+                         // tutte quelle del documento solo se counted
+                         // arriva a original_size
     char filename[MAX_FILENAME];  // Nome del file aperto
     int modified;        // Flag per indicare se il documento è stato modificato
 } Document;
@@ -54,6 +96,8 @@ typedef struct {
 // Funzioni di gestione del documento
 Document* create_document();
 void free_document(Document* doc);
+void clear_document(Document* doc);
+char* get_line(Document* doc, int position);
 int insert_line(Document* doc, int position, const char* text);
 int delete_line(Document* doc, int position);
 int replace_line(Document* doc, int position, const char* text);
@@ -69,7 +113,6 @@ void run_editor(Document* doc);
 
 // Funzioni di utilità
 void clear_screen();
-char* duplicate_string(const char* str);
 
 int main(int argc, char* argv[]) {
     Document* doc = create_document();
@@ -96,25 +139,435 @@ int main(int argc, char* argv[]) {
     return EXIT_SUCCESS;
 }
 
+// ---------------------------------------------------------------------------
+// Albero dei pezzi
+// ---------------------------------------------------------------------------
+//
+// Il treap è un albero binario ordinato per posizione nel testo in cui ogni
+// nodo ha anche una priorità casuale, maggiore di quella dei figli: la forma
+// dell'albero è quella che si otterrebbe inserendo i pezzi in ordine
+// casuale, quindi la profondità attesa è O(log N) qualunque sia l'ordine
+// delle modifiche. Tutte le modifiche si fanno con due operazioni:
+// split divide l'albero in una posizione e merge unisce due alberi.
+
+static const char* piece_text(Document* doc, Piece* piece) {
+    return (piece->source == PIECE_ORIGINAL ? doc->original : doc->added) + piece->start;
+}
+
+static size_t subtree_length(Piece* piece) {
+    return piece != NULL ? piece->total_length : 0;
+}
+
+static int subtree_newlines(Piece* piece) {
+    return piece != NULL ? piece->total_newlines : 0;
+}
+
+// Ricalcola le somme di un nodo dopo che sono cambiati i suoi figli
+static void update_piece(Piece* piece) {
+    piece->total_length = subtree_length(piece->left) + piece->length + subtree_length(piece->right);
+    piece->total_newlines = subtree_newlines(piece->left) + piece->newlines + subtree_newlines(piece->right);
+}
+
+static int count_newlines(const char* text, size_t length) {
+    int count = 0;
+    const char* end = text + length;
+    
+    while ((text = memchr(text, '\n', end - text)) != NULL) {
+        count++;
+        text++;
+    }
+    return count;
+}
+
+static Piece* create_piece(Document* doc, int source, size_t start, size_t length) {
+    Piece* piece = (Piece*)malloc(sizeof(Piece));
+    if (piece == NULL) {
+        return NULL;
+    }
+    
+    piece->source = source;
+    piece->start = start;
+    piece->length = length;
+    piece->newlines = count_newlines(piece_text(doc, piece), length);
+    piece->priority = rand();
+    piece->left = NULL;
+    piece->right = NULL;
+    update_piece(piece);
+    return piece;
+}
+
+static void free_pieces(Piece* piece) {
+    if (piece == NULL) {
+        return;
+    }
+    free_pieces(piece->left);
+    free_pieces(piece->right);
+    free(piece);
+}
+
+// Unisce due alberi: tutto il testo di left precede quello di right
+static Piece* merge_pieces(Piece* left, Piece* right) {
+    if (left == NULL) {
+        return right;
+    }
+    if (right == NULL) {
+        return left;
+    }
+    
+    if (left->priority > right->priority) {
+        left->right = merge_pieces(left->right, right);
+        update_piece(left);
+        return left;
+    }
+    right->left = merge_pieces(left, right->left);
+    update_piece(right);
+    return right;
+}
+
+// Divide l'albero: i primi offset byte in *left, il resto in *right. Se
+// offset cade dentro un pezzo, la sua seconda parte diventa il pezzo
+// *spare, allocato dal chiamante perché la divisione non possa fallire a
+// metà; in quel caso *spare viene messo a NULL.
+static void split_pieces(Document* doc, Piece* piece, size_t offset,
+                         Piece** left, Piece** right, Piece** spare) {
+    if (piece == NULL) {
+        *left = NULL;
+        *right = NULL;
+        return;
+    }
+    
+    size_t left_length = subtree_length(piece->left);
+    if (offset <= left_length) {
+        split_pieces(doc, piece->left, offset, left, &piece->left, spare);
+        update_piece(piece);
+        *right = piece;
+    } else if (offset >= left_length + piece->length) {
+        split_pieces(doc, piece->right, offset - left_length - piece->length,
+                     &piece->right, right, spare);
+        update_piece(piece);
+        *left = piece;
+    } else {
+        // La posizione cade dentro il pezzo: la coda diventa un nuovo pezzo
+        size_t cut = offset - left_length;
+        Piece* tail = *spare;
+        *spare = NULL;
+        
+        tail->source = piece->source;
+        tail->start = piece->start + cut;
+        tail->length = piece->length - cut;
+        tail->newlines = count_newlines(piece_text(doc, tail), tail->length);
+        tail->priority = rand();
+        tail->left = NULL;
+        tail->right = NULL;
+        update_piece(tail);
+        
+        piece->length = cut;
+        piece->newlines -= tail->newlines;
+        Piece* rest = piece->right;
+        piece->right = NULL;
+        update_piece(piece);
+        
+        *left = piece;
+        *right = merge_pieces(tail, rest);
+    }
+}
+
+// Divide l'albero del documento in offset; 0 se manca la memoria
+static int split_document(Document* doc, Piece* root, size_t offset, Piece** left, Piece** right) {
+    Piece* spare = (Piece*)malloc(sizeof(Piece));
+    if (spare == NULL) {
+        return 0;
+    }
+    
+    split_pieces(doc, root, offset, left, right, &spare);
+    free(spare);  // Non usato se offset era già un confine tra pezzi
+    return 1;
+}
+
+// Posizione in byte dell'inizio della linea line, per line <= num_lines
+static size_t line_offset(Document* doc, int line) {
+    if (line <= 0) {
+        return 0;
+    }
+    if (line > doc->num_lines) {
+        return subtree_length(doc->root);
+    }
+    
+    // L'inizio della linea segue il line-esimo a capo: si scende verso il
+    // pezzo che lo contiene contando gli a capo dei sottoalberi a sinistra
+    Piece* piece = doc->root;
+    size_t base = 0;
+    int remaining = line;
+    while (piece != NULL) {
+        int left_newlines = subtree_newlines(piece->left);
+        if (remaining <= left_newlines) {
+            piece = piece->left;
+            continue;
+        }
+        base += subtree_length(piece->left);
+        remaining -= left_newlines;
+        
+        if (remaining <= piece->newlines) {
+            const char* text = piece_text(doc, piece);
+            const char* found = text;
+            while (1) {
+                found = memchr(found, '\n', text + piece->length - found);
+                if (--remaining == 0) {
+                    return base + (size_t)(found - text) + 1;
+                }
+                found++;
+            }
+        }
+        remaining -= piece->newlines;
+        base += piece->length;
+        piece = piece->right;
+    }
+    return base;
+}
+
+// Copia in dest length byte del testo a partire da offset
+static void copy_text(Document* doc, Piece* piece, size_t offset, size_t length, char* dest) {
+    while (piece != NULL && length > 0) {
+        size_t left_length = subtree_length(piece->left);
+        if (offset < left_length) {
+            size_t count = left_length - offset < length ? left_length - offset : length;
+            copy_text(doc, piece->left, offset, count, dest);
+            dest += count;
+            length -= count;
+            offset = left_length;
+        }
+        offset -= left_length;
+        
+        if (length > 0 && offset < piece->length) {
+            size_t count = piece->length - offset < length ? piece->length - offset : length;
+            memcpy(dest, piece_text(doc, piece) + offset, count);
+            dest += count;
+            length -= count;
+            offset = piece->length;
+        }
+        offset -= piece->length;
+        piece = piece->right;
+    }
+}
+
+// Accoda text (e un a capo se newline) al buffer delle aggiunte e
+// restituisce il pezzo che lo descrive, ancora fuori dall'albero
+static Piece* append_added(Document* doc, const char* text, int newline) {
+    size_t length = strlen(text) + (newline ? 1 : 0);
+    
+    // Verifica se è necessario espandere il buffer delle aggiunte: i pezzi
+    // lo indicano con posizioni, quindi può essere spostato da realloc
+    if (doc->added_size + length > doc->added_capacity) {
+        size_t new_capacity = doc->added_capacity > 0 ? doc->added_capacity * 2 : 4096;
+        while (new_capacity < doc->added_size + length) {
+            new_capacity *= 2;
+        }
+        char* temp = (char*)realloc(doc->added, new_capacity);
+        if (temp == NULL) {
+            return NULL;
+        }
+        doc->added = temp;
+        doc->added_capacity = new_capacity;
+    }
+    memcpy(doc->added + doc->added_size, text, length - (newline ? 1 : 0));
+    if (newline) {
+        doc->added[doc->added_size + length - 1] = '\n';
+    }
+    
+    Piece* piece = create_piece(doc, PIECE_ADDED, doc->added_size, length);
+    if (piece != NULL) {
+        doc->added_size += length;
+    }
+    return piece;
+}
+
+// Inserisce text (e un a capo se newline) nel testo in offset
+static int insert_text(Document* doc, size_t offset, const char* text, int newline) {
+    Piece* piece = append_added(doc, text, newline);
+    if (piece == NULL) {
+        return 0;
+    }
+    
+    Piece* left;
+    Piece* right;
+    if (!split_document(doc, doc->root, offset, &left, &right)) {
+        free(piece);
+        return 0;
+    }
+    doc->root = merge_pieces(merge_pieces(left, piece), right);
+    doc->num_lines = subtree_newlines(doc->root);
+    return 1;
+}
+
+// Toglie dal testo length byte a partire da offset; i buffer non cambiano
+static int remove_text(Document* doc, size_t offset, size_t length) {
+    Piece* left;
+    Piece* middle;
+    Piece* right;
+    
+    if (!split_document(doc, doc->root, offset, &left, &right)) {
+        return 0;
+    }
+    if (!split_document(doc, right, length, &middle, &right)) {
+        doc->root = merge_pieces(left, right);
+        return 0;
+    }
+    free_pieces(middle);
+    doc->root = merge_pieces(left, right);
+    doc->num_lines = subtree_newlines(doc->root);
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// File originale
+// ---------------------------------------------------------------------------
+//
+// Il file aperto non viene copiato: su Linux/Unix è mappato in memoria con
+// mmap, quindi non occupa memoria del processo oltre alla cache del sistema,
+// e le sue pagine vengono lette dal disco solo quando si contano o si
+// mostrano le linee che contengono. Su Windows viene letto in un unico
+// blocco.
+
+static int map_original(Document* doc, const char* filename) {
+#ifdef _WIN32
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+    
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = size > 0 ? (char*)malloc((size_t)size) : NULL;
+    if (size < 0 || (size > 0 && (data == NULL || fread(data, 1, (size_t)size, file) != (size_t)size))) {
+        free(data);
+        fclose(file);
+        return 0;
+    }
+    fclose(file);
+    
+    doc->original = data;
+    doc->original_size = (size_t)size;
+    return 1;
+#else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) < 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return 0;
+    }
+    
+    char* data = NULL;
+    if (info.st_size > 0) {
+        data = (char*)mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return 0;
+        }
+    }
+    close(fd);  // La mappatura resta valida anche senza il descrittore
+    
+    doc->original = data;
+    doc->original_size = (size_t)info.st_size;
+    return 1;
+#endif
+}
+
+static void unmap_original(Document* doc) {
+    if (doc->original != NULL) {
+#ifdef _WIN32
+        free(doc->original);
+#else
+        munmap(doc->original, doc->original_size);
+#endif
+    }
+    doc->original = NULL;
+    doc->original_size = 0;
+}
+
+// Libera pezzi e buffer lasciando il documento senza linee
+static void release_content(Document* doc) {
+    free_pieces(doc->root);
+    doc->root = NULL;
+    free(doc->added);
+    doc->added = NULL;
+    doc->added_size = 0;
+    doc->added_capacity = 0;
+    unmap_original(doc);
+    doc->counted = 0;
+    doc->num_lines = 0;
+}
+
+// Porta nell'albero il file originale non ancora contato, un pezzo di
+// PIECE_CHUNK byte alla volta, finché la linea line non è tra quelle
+// contate o il file finisce. Così dividere un pezzo o cercarvi una linea
+// richiede al più di scorrerne uno, e si conta solo la parte di file
+// fino alla linea più lontana usata finora. 0 se manca la memoria o il
+// file ha troppe linee.
+static int count_lines_until(Document* doc, int line) {
+    while (doc->num_lines <= line && doc->counted < doc->original_size) {
+        size_t length = doc->original_size - doc->counted < PIECE_CHUNK ?
+                        doc->original_size - doc->counted : PIECE_CHUNK;
+        Piece* piece = create_piece(doc, PIECE_ORIGINAL, doc->counted, length);
+        if (piece == NULL) {
+            return 0;
+        }
+        
+        // I contatori del treap sono int: serve posto anche per l'ultimo a capo
+        if (piece->newlines >= INT_MAX - doc->num_lines) {
+            fprintf(stderr, "Errore: il file ha troppe linee (al più %d)\n", INT_MAX - 1);
+            free(piece);
+            return 0;
+        }
+        
+        // Ogni linea deve terminare con un a capo, anche l'ultima del file
+        Piece* newline = NULL;
+        if (doc->counted + length == doc->original_size &&
+            doc->original[doc->original_size - 1] != '\n') {
+            newline = append_added(doc, "", 1);
+            if (newline == NULL) {
+                free(piece);
+                return 0;
+            }
+        }
+        
+        doc->root = merge_pieces(merge_pieces(doc->root, piece), newline);
+        doc->counted += length;
+        doc->num_lines = subtree_newlines(doc->root);
+    }
+    return 1;
+}
+
+// ---------------------------------------------------------------------------
+// Documento
+// ---------------------------------------------------------------------------
+
 Document* create_document() {
     Document* doc = (Document*)malloc(sizeof(Document));
     if (doc == NULL) {
         return NULL;
     }
     
-    doc->capacity = 10;  // Capacità iniziale
+    doc->root = NULL;
+    doc->original = NULL;
+    doc->original_size = 0;
+    doc->counted = 0;
+    doc->added = NULL;
+    doc->added_size = 0;
+    doc->added_capacity = 0;
     doc->num_lines = 0;
     doc->modified = 0;
     doc->filename[0] = '\0';
     
-    doc->lines = (char**)malloc(doc->capacity * sizeof(char*));
-    if (doc->lines == NULL) {
+    // Inizializza con una linea vuota
+    if (!insert_line(doc, 0, "")) {
         free(doc);
         return NULL;
     }
-    
-    // Inizializza con una linea vuota
-    insert_line(doc, 0, "");
     doc->modified = 0;  // Reset del flag dopo l'inserimento iniziale
     
     return doc;
@@ -125,46 +578,47 @@ void free_document(Document* doc) {
         return;
     }
     
-    // Libera ogni linea
-    for (int i = 0; i < doc->num_lines; i++) {
-        free(doc->lines[i]);
-    }
-    
-    // Libera l'array di linee e la struttura documento
-    free(doc->lines);
+    release_content(doc);
     free(doc);
 }
 
-int insert_line(Document* doc, int position, const char* text) {
+// Riporta il documento a un nuovo file con una sola linea vuota
+void clear_document(Document* doc) {
+    release_content(doc);
+    insert_line(doc, 0, "");
+    doc->filename[0] = '\0';
+    doc->modified = 0;
+}
+
+// Restituisce una copia della linea, senza a capo, da liberare con free
+char* get_line(Document* doc, int position) {
     // Verifica che la posizione sia valida
-    if (position < 0 || position > doc->num_lines) {
-        return 0;
+    if (position < 0 || !count_lines_until(doc, position) || position >= doc->num_lines) {
+        return NULL;
     }
     
-    // Verifica se è necessario espandere l'array
-    if (doc->num_lines >= doc->capacity) {
-        doc->capacity *= 2;
-        char** temp = (char**)realloc(doc->lines, doc->capacity * sizeof(char*));
-        if (temp == NULL) {
-            return 0;
-        }
-        doc->lines = temp;
+    size_t start = line_offset(doc, position);
+    size_t length = line_offset(doc, position + 1) - 1 - start;
+    char* line = (char*)malloc(length + 1);
+    if (line == NULL) {
+        return NULL;
     }
-    
-    // Duplica la stringa di testo
-    char* new_line = duplicate_string(text);
-    if (new_line == NULL) {
+    copy_text(doc, doc->root, start, length, line);
+    line[length] = '\0';
+    return line;
+}
+
+int insert_line(Document* doc, int position, const char* text) {
+    // Verifica che la posizione sia valida
+    if (position < 0 || !count_lines_until(doc, position) || position > doc->num_lines) {
         return 0;
     }
     
-    // Sposta le linee esistenti per fare spazio
-    for (int i = doc->num_lines; i > position; i--) {
-        doc->lines[i] = doc->lines[i - 1];
+    // La nuova linea, con il suo a capo, diventa un pezzo all'inizio della
+    // linea che occupava la posizione
+    if (!insert_text(doc, line_offset(doc, position), text, 1)) {
+        return 0;
     }
-    
-    // Inserisci la nuova linea
-    doc->lines[position] = new_line;
-    doc->num_lines++;
     doc->modified = 1;
     
     return 1;
@@ -172,23 +626,19 @@ int insert_line(Document* doc, int position, const char* text) {
 
 int delete_line(Document* doc, int position) {
     // Verifica che la posizione sia valida
-    if (position < 0 || position >= doc->num_lines) {
+    if (position < 0 || !count_lines_until(doc, position) || position >= doc->num_lines) {
         return 0;
     }
     
-    // Libera la memoria della linea da eliminare
-    free(doc->lines[position]);
-    
-    // Sposta le linee successive
-    for (int i = position; i < doc->num_lines - 1; i++) {
-        doc->lines[i] = doc->lines[i + 1];
+    // Toglie dal testo la linea e il suo a capo
+    size_t start = line_offset(doc, position);
+    if (!remove_text(doc, start, line_offset(doc, position + 1) - start)) {
+        return 0;
     }
-    
-    doc->num_lines--;
     doc->modified = 1;
     
     // Se il documento è vuoto, aggiungi una linea vuota
-    if (doc->num_lines == 0) {
+    if (count_lines_until(doc, 0) && doc->num_lines == 0) {
         insert_line(doc, 0, "");
     }
     
@@ -197,87 +647,214 @@ int delete_line(Document* doc, int position) {
 
 int replace_line(Document* doc, int position, const char* text) {
     // Verifica che la posizione sia valida
-    if (position < 0 || position >= doc->num_lines) {
+    if (position < 0 || !count_lines_until(doc, position) || position >= doc->num_lines) {
         return 0;
     }
     
-    // Duplica la nuova stringa
-    char* new_line = duplicate_string(text);
-    if (new_line == NULL) {
+    // Toglie il testo della linea, a capo escluso, e inserisce quello nuovo
+    size_t start = line_offset(doc, position);
+    if (!remove_text(doc, start, line_offset(doc, position + 1) - 1 - start)) {
+        return 0;
+    }
+    if (!insert_text(doc, start, text, 0)) {
         return 0;
     }
-    
-    // Libera la vecchia linea e sostituiscila
-    free(doc->lines[position]);
-    doc->lines[position] = new_line;
     doc->modified = 1;
     
     return 1;
 }
 
 int load_file(Document* doc, const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (file == NULL) {
+    Document loaded;
+    
+    // Il documento corrente resta com'è se il file non si apre
+    memset(&loaded, 0, sizeof(loaded));
+    if (!map_original(&loaded, filename)) {
         return 0;
     }
     
-    // Resetta il documento
-    for (int i = 0; i < doc->num_lines; i++) {
-        free(doc->lines[i]);
+    // Tutto il file resta un unico pezzo non ancora contato: le sue linee
+    // vengono contate solo quando servono (vedi count_lines_until), quindi
+    // l'apertura non legge il file e costa lo stesso per qualunque
+    // dimensione. Un file vuoto ha una linea vuota
+    if (loaded.original_size == 0 && !insert_text(&loaded, 0, "", 1)) {
+        release_content(&loaded);
+        return 0;
     }
-    doc->num_lines = 0;
     
-    // Leggi il file linea per linea
-    char buffer[MAX_LINE_LENGTH];
-    while (fgets(buffer, MAX_LINE_LENGTH, file) != NULL) {
-        // Rimuovi il carattere newline se presente
-        size_t len = strlen(buffer);
-        if (len > 0 && buffer[len - 1] == '\n') {
-            buffer[len - 1] = '\0';
-        }
-        
-        // Inserisci la linea nel documento
-        if (!insert_line(doc, doc->num_lines, buffer)) {
-            fclose(file);
-            return 0;
+    // Sostituisce il contenuto del documento con quello del file
+    release_content(doc);
+    doc->root = loaded.root;
+    doc->original = loaded.original;
+    doc->original_size = loaded.original_size;
+    doc->counted = loaded.counted;
+    doc->added = loaded.added;
+    doc->added_size = loaded.added_size;
+    doc->added_capacity = loaded.added_capacity;
+    doc->num_lines = loaded.num_lines;
+    
+    // Salva il nome del file e resetta il flag di modifica
+    strncpy(doc->filename, filename, MAX_FILENAME - 1);
+    doc->filename[MAX_FILENAME - 1] = '\0';
+    doc->modified = 0;
+    
+    return 1;
+}
+
+// Scrive il testo dei pezzi nell'ordine del documento
+static void write_pieces(Document* doc, Piece* piece, FILE* file) {
+    if (piece == NULL) {
+        return;
+    }
+    write_pieces(doc, piece->left, file);
+    fwrite(piece_text(doc, piece), 1, piece->length, file);
+    write_pieces(doc, piece->right, file);
+}
+
+// Scrive nel file tutto il testo del documento: i pezzi, poi la parte non
+// ancora contata dell'originale con l'a capo finale che le manca
+static int write_document(Document* doc, FILE* file) {
+    write_pieces(doc, doc->root, file);
+    if (doc->counted < doc->original_size) {
+        fwrite(doc->original + doc->counted, 1, doc->original_size - doc->counted, file);
+        if (doc->original[doc->original_size - 1] != '\n') {
+            fputc('\n', file);
         }
     }
+    return !ferror(file);
+}
+
+#ifdef _WIN32
+int save_file(Document* doc, const char* filename) {
+    // Il testo viene scritto in un file temporaneo che poi prende il posto
+    // di quello vecchio: il documento può leggere ancora il file da salvare
+    char temp_name[MAX_FILENAME + 8];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
     
-    fclose(file);
+    FILE* file = fopen(temp_name, "wb");
+    if (file == NULL) {
+        return 0;
+    }
     
-    // Se il file era vuoto, aggiungi una linea vuota
-    if (doc->num_lines == 0) {
-        insert_line(doc, 0, "");
+    if (!write_document(doc, file) || fclose(file) != 0) {
+        remove(temp_name);
+        return 0;
+    }
+    remove(filename);  // Su Windows rename non sostituisce un file esistente
+    if (rename(temp_name, filename) != 0) {
+        remove(temp_name);
+        return 0;
     }
     
-    // Salva il nome del file e resetta il flag di modifica
+    // Aggiorna il nome del file e resetta il flag di modifica
     strncpy(doc->filename, filename, MAX_FILENAME - 1);
     doc->filename[MAX_FILENAME - 1] = '\0';
     doc->modified = 0;
     
     return 1;
 }
+#else
+// Riscrive sul posto il file path con length byte di data
+static int overwrite_file(const char* path, const char* data, size_t length) {
+    int fd = open(path, O_WRONLY | O_TRUNC);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    while (length > 0) {
+        ssize_t written = write(fd, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(fd);
+            return 0;
+        }
+        data += written;
+        length -= (size_t)written;
+    }
+    if (fsync(fd) != 0) {
+        close(fd);
+        return 0;
+    }
+    return close(fd) == 0;
+}
 
 int save_file(Document* doc, const char* filename) {
-    FILE* file = fopen(filename, "w");
+    // Se il nome è un collegamento simbolico si salva il file a cui punta,
+    // così il collegamento resta; un file che non esiste si crea con il
+    // nome dato
+    char target[PATH_MAX];
+    struct stat info;
+    int exists = 0;
+    if (realpath(filename, target) != NULL) {
+        exists = stat(target, &info) == 0;
+    } else if (errno == ENOENT && strlen(filename) < sizeof(target)) {
+        strcpy(target, filename);
+    } else {
+        return 0;
+    }
+    
+    // Il testo viene scritto in un file temporaneo nella stessa cartella,
+    // che poi prende il posto di quello vecchio con rename: chi legge il
+    // file vede il testo vecchio o quello nuovo, mai uno a metà, e il
+    // documento può leggere ancora il file da salvare mentre lo scrive
+    char temp_name[PATH_MAX + 8];
+    snprintf(temp_name, sizeof(temp_name), "%s.XXXXXX", target);
+    int fd = mkstemp(temp_name);
+    if (fd < 0) {
+        return 0;
+    }
+    
+    // mkstemp crea il file con permessi 0600: prende quelli del file
+    // sostituito, o quelli predefiniti (umask) se il file è nuovo
+    mode_t mode;
+    if (exists) {
+        mode = info.st_mode & 07777;
+    } else {
+        mode_t mask = umask(0);
+        umask(mask);
+        mode = 0666 & ~mask;
+    }
+    FILE* file = fchmod(fd, mode) == 0 ? fdopen(fd, "wb") : NULL;
     if (file == NULL) {
+        close(fd);
+        unlink(temp_name);
         return 0;
     }
     
-    // Scrivi ogni linea nel file
-    for (int i = 0; i < doc->num_lines; i++) {
-        fprintf(file, "%s\n", doc->lines[i]);
+    // Il testo deve essere sul disco prima che rename lo renda visibile
+    int saved = write_document(doc, file) && fflush(file) == 0 && fsync(fd) == 0;
+    if (fclose(file) != 0 || !saved) {
+        unlink(temp_name);
+        return 0;
     }
     
-    fclose(file);
+    if (exists && info.st_nlink > 1) {
+        // Il file ha altri collegamenti fisici, che con rename resterebbero
+        // al testo vecchio: va riscritto sul posto. Il documento passa prima
+        // a leggere il file temporaneo, che ha lo stesso testo, perché il
+        // file mappato può essere proprio quello da riscrivere; la
+        // mappatura resta valida anche dopo unlink
+        if (!load_file(doc, temp_name)) {
+            unlink(temp_name);
+            return 0;
+        }
+        unlink(temp_name);
+        saved = overwrite_file(target, doc->original, doc->original_size);
+    } else if (rename(temp_name, target) != 0) {
+        unlink(temp_name);
+        return 0;
+    }
     
     // Aggiorna il nome del file e resetta il flag di modifica
     strncpy(doc->filename, filename, MAX_FILENAME - 1);
     doc->filename[MAX_FILENAME - 1] = '\0';
-    doc->modified = 0;
+    doc->modified = !saved;
     
-    return 1;
+    return saved;
 }
+#endif
 
 void display_document(Document* doc, int current_line, int start_line) {
     clear_screen();
@@ -290,17 +867,20 @@ void display_document(Document* doc, int current_line, int start_line) {
     
     // Calcola l'intervallo di linee da visualizzare
     int end_line = start_line + 20;  // Mostra 20 linee alla volta
+    count_lines_until(doc, end_line - 1);
     if (end_line > doc->num_lines) {
         end_line = doc->num_lines;
     }
     
     // Mostra le linee del documento
     for (int i = start_line; i < end_line; i++) {
+        char* line = get_line(doc, i);
         if (i == current_line) {
-            printf("-> %3d: %s\n", i + 1, doc->lines[i]);
+            printf("-> %3d: %s\n", i + 1, line != NULL ? line : "");
         } else {
-            printf("   %3d: %s\n", i + 1, doc->lines[i]);
+            printf("   %3d: %s\n", i + 1, line != NULL ? line : "");
         }
+        free(line);
     }
     
     // Mostra il piè di pagina con i comandi
@@ -362,6 +942,7 @@ void run_editor(Document* doc) {
                         }
                         break;
                     case 'B':  // Freccia Giù
+                        count_lines_until(doc, current_line + 1);
                         if (current_line < doc->num_lines - 1) {
                             current_line++;
                             if (current_line >= start_line + 20) {
@@ -379,11 +960,12 @@ void run_editor(Document* doc) {
                     case '6':  // PgDown (alcuni terminali)
                         getch();  // Consuma il carattere '~'
                         start_line += 10;
+                        current_line += 10;
+                        count_lines_until(doc, start_line + 19 > current_line ? start_line + 19 : current_line);
                         if (start_line > doc->num_lines - 20) {
                             start_line = doc->num_lines - 20;
                             if (start_line < 0) start_line = 0;
                         }
-                        current_line += 10;
                         if (current_line >= doc->num_lines) {
                             current_line = doc->num_lines - 1;
                         }
@@ -436,13 +1018,7 @@ void run_editor(Document* doc) {
                 }
                 
                 // Resetta il documento
-                for (int i = 0; i < doc->num_lines; i++) {
-                    free(doc->lines[i]);
-                }
-                doc->num_lines = 0;
-                doc->filename[0] = '\0';
-                insert_line(doc, 0, "");
-                doc->modified = 0;
+                clear_document(doc);
                 current_line = 0;
                 start_line = 0;
                 break;
@@ -535,22 +1111,27 @@ void run_editor(Document* doc) {
                 break;
                 
             case 'd':  // Elimina linea corrente
+                count_lines_until(doc, 1);
                 if (doc->num_lines > 1) {  // Mantieni almeno una linea
                     delete_line(doc, current_line);
+                    count_lines_until(doc, current_line);
                     if (current_line >= doc->num_lines) {
                         current_line = doc->num_lines - 1;
                     }
                 }
                 break;
                 
-            case 'e':  // Modifica linea corrente
-                printf("\nModifica: %s\n", doc->lines[current_line]);
+            case 'e': {  // Modifica linea corrente
+                char* line = get_line(doc, current_line);
+                printf("\nModifica: %s\n", line != NULL ? line : "");
+                free(line);
                 printf("Nuova linea: ");
                 if (fgets(buffer, MAX_LINE_LENGTH, stdin) != NULL) {
                     buffer[strcspn(buffer, "\n")] = '\0';
                     replace_line(doc, current_line, buffer);
                 }
                 break;
+            }
         }
     }
 }
@@ -559,16 +1140,6 @@ void clear_screen() {
     system(CLEAR_SCREEN);
 }
 
-char* duplicate_string(const char* str) {
-    size_t len = strlen(str);
-    char* new_str = (char*)malloc(len + 1);
-    if (new_str == NULL) {
-        return NULL;
-    }
-    strcpy(new_str, str);
-    return new_str;
-}
-
 /**
  * Compilazione ed esecuzione:
  * 
@@ -585,4 +1156,25 @@ char* duplicate_string(const char* str) {
  * - La navigazione può essere effettuata con i tasti freccia
  * - Il documento viene salvato in formato testo semplice
  * - L'editor chiede conferma prima di uscire se ci sono modifiche non salvate
+ * - Il documento è una piece table: il file aperto viene mappato in memoria
+ *   (mmap) senza copiarlo né dividerlo in stringhe, il testo nuovo viene
+ *   accodato a un buffer delle aggiunte e il documento è la sequenza di pezzi
+ *   dei due buffer, tenuta in un treap con lunghezze e numero di a capo di
+ *   ogni sottoalbero. Aprire un file non lo legge: all'inizio è un unico
+ *   pezzo non contato, e gli a capo vengono contati a blocchi di
+ *   PIECE_CHUNK byte solo fino alla linea più lontana mostrata o modificata.
+ *   Solo andare in fondo a un file grande lo scorre tutto, una volta.
+ *   Inserire, eliminare o trovare una linea già contata costa O(log N), e
+ *   le linee non hanno più un limite di lunghezza (MAX_LINE_LENGTH vale solo
+ *   per quelle digitate)
+ * - Linee e a capo sono contati con int, quindi un documento può avere al
+ *   più INT_MAX (circa 2 miliardi) di linee
+ * - Il salvataggio scrive un file temporaneo e lo rinomina, perché il
+ *   documento continua a leggere il file originale mentre viene salvato.
+ *   Su Linux/Unix il file temporaneo è creato con mkstemp accanto al file
+ *   vero (risolvendo i collegamenti simbolici con realpath), prende i suoi
+ *   permessi con fchmod e va sul disco con fsync prima di rename; se
+ *   qualcosa fallisce viene cancellato. Un file con più collegamenti
+ *   fisici viene invece riscritto sul posto, così tutti i nomi vedono il
+ *   testo nuovo
  */
\ No newline at end of file